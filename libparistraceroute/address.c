@@ -15,28 +15,28 @@
 #endif
 
 #include "address.h"
+#include "address_cache.h"        // address_cache_t
+#include "containers/hashtable.h" // hash_bytes, hash_uint64
 
 #ifdef USE_CACHE
-#    include "containers/map.h"
-
-static map_t * cache_ip_hostname = NULL;
+static address_cache_t * cache_ip_hostname = NULL;
 
 static void __cache_ip_hostname_create() __attribute__((constructor));
 static void __cache_ip_hostname_free()   __attribute__((destructor));
 
-static void str_dump(const char * s) {
-    printf("%s (%p)", s, s);
+static void str_fprintf(FILE * out, const char * s) {
+    fprintf(out, "%s", s);
 }
 
 static void __cache_ip_hostname_create() {
-    cache_ip_hostname = map_create(
-        address_dup, address_free, address_dump, address_compare,
-        strdup,      free,         str_dump
+    cache_ip_hostname = address_cache_create(
+        "hostname", ADDRESS_CACHE_DEFAULT_CAPACITY, ADDRESS_CACHE_DEFAULT_TTL,
+        strdup, free, str_fprintf, strdup
     );
 }
 
 static void __cache_ip_hostname_free() {
-    if (cache_ip_hostname) map_free(cache_ip_hostname);
+    address_cache_free(cache_ip_hostname);
 }
 
 #endif
@@ -221,6 +221,44 @@ int address_compare(const address_t * x, const address_t * y) {
     return *--px - *--py;
 }
 
+size_t address_hash(const address_t * address) {
+    const void * ip = NULL;
+
+    switch (address->family) {
+#ifdef USE_IPV4
+        case AF_INET:
+            ip = &address->ip.ipv4;
+            break;
+#endif
+#ifdef USE_IPV6
+        case AF_INET6:
+            ip = &address->ip.ipv6;
+            break;
+#endif
+        default:
+            return hash_uint64(address->family);
+    }
+
+    return hash_bytes(ip, address_get_size(address)) ^ hash_uint64(address->family);
+}
+
+void address_get_prefix(const address_t * address, size_t prefix_len, address_t * prefix) {
+    uint8_t * bytes = (uint8_t *) &prefix->ip;
+    size_t    i, size = address_get_size(address);
+
+    memset(prefix, 0, sizeof(address_t));
+    prefix->family = address->family;
+    memcpy(&prefix->ip, &address->ip, size);
+
+    for (i = 0; i < size; i++) {
+        if (prefix_len <= 8 * i) {
+            bytes[i] = 0;
+        } else if (prefix_len < 8 * (i + 1)) {
+            bytes[i] &= 0xff << (8 * (i + 1) - prefix_len);
+        }
+    }
+}
+
 int address_to_string(const address_t * address, char ** pbuffer)
 {
     struct sockaddr     * sa;
@@ -294,22 +332,48 @@ size_t address_get_size(const address_t * address) {
     return 0;
 }
 
+address_cache_t * address_get_hostname_cache()
+{
+#ifdef USE_CACHE
+    return cache_ip_hostname;
+#else
+    return NULL;
+#endif
+}
+
+bool address_get_cached_hostname(const address_t * address, char ** phostname)
+{
+#ifdef USE_CACHE
+    const char * hostname;
+
+    if (cache_ip_hostname && (hostname = address_cache_find(cache_ip_hostname, address))) {
+        return (*phostname = strdup(hostname)) != NULL;
+    }
+#endif
+    return false;
+}
+
+bool address_set_cached_hostname(const address_t * address, const char * hostname)
+{
+#ifdef USE_CACHE
+    return cache_ip_hostname && address_cache_update(cache_ip_hostname, address, hostname);
+#else
+    return false;
+#endif
+}
+
 bool address_resolv(const address_t * address, char ** phostname, int mask_cache)
 {
     struct hostent * hp;
     bool             found = false;
-    const void     * data;
 
     if (!address) goto ERR_INVALID_PARAMETER;
 
 #ifdef USE_CACHE
-    if (cache_ip_hostname && (mask_cache & CACHE_READ)) {
-        found = map_find(cache_ip_hostname, address, &data); //phostname);
-        if (found) {
-            // We've to strdup the cached value, otherwise the function
-            // calling address_resolv will erase this cached value.
-            *phostname = strdup(data);
-        }
+    if (mask_cache & CACHE_READ) {
+        // address_get_cached_hostname duplicates the cached value, otherwise
+        // the function calling address_resolv would erase it.
+        found = address_get_cached_hostname(address, phostname);
     }
 #endif
 
@@ -326,7 +390,7 @@ bool address_resolv(const address_t * address, char ** phostname, int mask_cache
         }
 #ifdef USE_CACHE
         if (mask_cache & CACHE_WRITE) {
-            map_update(cache_ip_hostname, address, *phostname);
+            address_set_cached_hostname(address, *phostname);
         }
     }
 #endif
@@ -96,6 +96,15 @@ address_t * address_create();
 
 int address_compare(const address_t * x, const address_t * y);
 
+/**
+ * \brief Hash an address_t instance.
+ * \param address An address_t instance.
+ * \return The corresponding hash. Two addresses equal according to
+ *    address_compare() have the same hash.
+ */
+
+size_t address_hash(const address_t * address);
+
 /**
  * \brief Release an address_t instance from the memory.
  * \param address An address instance.
@@ -114,6 +123,16 @@ void address_free(address_t * address);
 
 int address_from_string(int family, const char * hostname, address_t * address);
 
+/**
+ * \brief Compute the prefix of an address.
+ * \param address An address_t instance.
+ * \param prefix_len The length of the prefix (in bits).
+ * \param prefix A preallocated address_t in which the prefix is written
+ *    (the bits beyond prefix_len are set to 0).
+ */
+
+void address_get_prefix(const address_t * address, size_t prefix_len, address_t * prefix);
+
 /**
  * \brief Duplicate an address.
  * \param address The address to copy.
@@ -203,4 +222,34 @@ int address_to_string(const address_t * addr, char ** pbuffer);
 
 bool address_resolv(const address_t * address, char ** phostname, int mask_cache);
 
+/**
+ * \brief Retrieve the hostname of an address from the cache used by
+ *    address_resolv, without performing any DNS lookup.
+ * \param address An address_t instance.
+ * \param phostname Points to a char * which is updated to point to a copy
+ *    of the cached hostname, to be freed by the caller.
+ * \return true iif the hostname has been found.
+ */
+
+bool address_get_cached_hostname(const address_t * address, char ** phostname);
+
+/**
+ * \brief Store the hostname of an address in the cache used by address_resolv.
+ * \param address An address_t instance.
+ * \param hostname The corresponding hostname (it is duplicated).
+ * \return true iif successful.
+ */
+
+bool address_set_cached_hostname(const address_t * address, const char * hostname);
+
+struct address_cache_s;
+
+/**
+ * \brief Retrieve the cache used by address_resolv (see address_cache.h),
+ *    e.g. to bound it or to save it.
+ * \return The corresponding address_cache_t instance, NULL if caches are disabled.
+ */
+
+struct address_cache_s * address_get_hostname_cache();
+
 #endif // LIBPT_ADDRESS_H
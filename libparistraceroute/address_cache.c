@@ -0,0 +1,358 @@
+#include "use.h"
+#include "config.h"
+
+#include <stdlib.h>         // calloc, free
+#include <stdio.h>          // fprintf, fgets, sscanf
+#include <string.h>         // memcpy, memset, strcmp
+#include <arpa/inet.h>      // inet_pton
+#include <sys/socket.h>     // AF_INET, AF_INET6
+
+#include "address_cache.h"
+
+//---------------------------------------------------------------------------
+// Slots (internal usage)
+//---------------------------------------------------------------------------
+
+static inline address_cache_slot_t * address_cache_get_slot(const address_cache_t * cache, size_t link) {
+    return &cache->slots[link - 1];
+}
+
+static inline bool address_cache_slot_has_expired(const address_cache_slot_t * slot, double now) {
+    return slot->expiration && slot->expiration <= now;
+}
+
+/**
+ * \brief Find the link leading to the slot of an address.
+ * \param cache An address_cache_t instance (whose slots are allocated).
+ * \param address The searched address.
+ * \return The address of the link (0 if the address is not stored).
+ */
+
+static size_t * address_cache_find_link(const address_cache_t * cache, const address_t * address) {
+    size_t * plink = &cache->buckets[address_hash(address) & (cache->num_buckets - 1)];
+
+    while (*plink && address_compare(&address_cache_get_slot(cache, *plink)->address, address) != 0) {
+        plink = &address_cache_get_slot(cache, *plink)->next;
+    }
+    return plink;
+}
+
+/**
+ * \brief Remove an entry from an address_cache_t.
+ * \param cache An address_cache_t instance.
+ * \param plink The link leading to the slot of the entry.
+ */
+
+static void address_cache_remove(address_cache_t * cache, size_t * plink) {
+    size_t                 link = *plink;
+    address_cache_slot_t * slot = address_cache_get_slot(cache, link);
+
+    *plink = slot->next;
+    cache->value_free(slot->value);
+    slot->value = NULL;
+    slot->next = cache->free_slots;
+    cache->free_slots = link;
+    cache->num_entries--;
+}
+
+/**
+ * \brief Remove an entry from a full address_cache_t (CLOCK algorithm).
+ *    An expired entry, or an entry which has not been found since the
+ *    last round of the hand, is removed.
+ * \param cache An address_cache_t instance.
+ * \param now The current timestamp.
+ */
+
+static void address_cache_evict(address_cache_t * cache, double now) {
+    address_cache_slot_t * slot;
+
+    for (;;) {
+        slot = &cache->slots[cache->hand];
+        cache->hand = (cache->hand + 1) % cache->num_slots;
+
+        if (address_cache_slot_has_expired(slot, now)) {
+            cache->num_expirations++;
+            break;
+        } else if (slot->is_referenced) {
+            slot->is_referenced = false;
+        } else {
+            cache->num_evictions++;
+            break;
+        }
+    }
+    address_cache_remove(cache, address_cache_find_link(cache, &slot->address));
+}
+
+/**
+ * \brief Allocate the slots and the buckets of an address_cache_t.
+ * \param cache An address_cache_t instance.
+ * \return true iif successful.
+ */
+
+static bool address_cache_allocate(address_cache_t * cache) {
+    for (cache->num_buckets = 1; cache->num_buckets < cache->capacity; cache->num_buckets <<= 1);
+
+    // Zeroed memory is an empty cache
+    if (!(cache->slots = calloc(cache->capacity, sizeof(address_cache_slot_t)))) goto ERR_SLOTS;
+    if (!(cache->buckets = calloc(cache->num_buckets, sizeof(size_t))))          goto ERR_BUCKETS;
+    cache->num_slots   = 0;
+    cache->num_entries = 0;
+    cache->free_slots  = 0;
+    cache->hand        = 0;
+    return true;
+
+ERR_BUCKETS:
+    free(cache->slots);
+    cache->slots = NULL;
+ERR_SLOTS:
+    return false;
+}
+
+/**
+ * \brief Insert an entry in an address_cache_t.
+ * \param cache An address_cache_t instance.
+ * \param address The address.
+ * \param value The value, released by the cache once the entry is removed.
+ * \param expiration The expiration timestamp (0: never).
+ * \return true iif successful (the value is released otherwise).
+ */
+
+static bool address_cache_insert(address_cache_t * cache, const address_t * address, void * value, double expiration) {
+    address_cache_slot_t * slot;
+    size_t               * plink,
+                           link;
+
+    if (!cache->slots && !address_cache_allocate(cache)) {
+        cache->value_free(value);
+        return false;
+    }
+
+    // Replace the value of a stored address
+    plink = address_cache_find_link(cache, address);
+    if (*plink) {
+        slot = address_cache_get_slot(cache, *plink);
+        cache->value_free(slot->value);
+        slot->value = value;
+        slot->expiration = expiration;
+        return true;
+    }
+
+    // Take a free slot, possibly by evicting an entry
+    if (!cache->free_slots && cache->num_slots == cache->capacity) {
+        address_cache_evict(cache, get_timestamp());
+        plink = address_cache_find_link(cache, address);
+    }
+
+    if (cache->free_slots) {
+        link = cache->free_slots;
+        cache->free_slots = address_cache_get_slot(cache, link)->next;
+    } else {
+        link = ++cache->num_slots;
+    }
+
+    slot = address_cache_get_slot(cache, link);
+    memcpy(&slot->address, address, sizeof(address_t));
+    slot->value = value;
+    slot->expiration = expiration;
+    slot->is_referenced = false;
+    slot->next = 0;
+    *plink = link;
+    cache->num_entries++;
+    return true;
+}
+
+/**
+ * \brief Initialize an address_t according to a numeric IP address.
+ *    Unlike address_from_string, it never performs any DNS lookup.
+ * \param str_ip An IPv4 or IPv6 address (string format).
+ * \param address A preallocated address_t instance.
+ * \return true iif successful.
+ */
+
+static bool address_cache_address_from_string(const char * str_ip, address_t * address) {
+    memset(address, 0, sizeof(address_t));
+#ifdef USE_IPV4
+    if (inet_pton(AF_INET, str_ip, &address->ip.ipv4) == 1) {
+        address->family = AF_INET;
+        return true;
+    }
+#endif
+#ifdef USE_IPV6
+    if (inet_pton(AF_INET6, str_ip, &address->ip.ipv6) == 1) {
+        address->family = AF_INET6;
+        return true;
+    }
+#endif
+    return false;
+}
+
+//---------------------------------------------------------------------------
+// address_cache_t
+//---------------------------------------------------------------------------
+
+address_cache_t * address_cache_create_impl(
+    const char * name,
+    size_t       capacity,
+    double       ttl,
+    void *    (* value_dup)(const void *),
+    void      (* value_free)(void *),
+    void      (* value_fprintf)(FILE *, const void *),
+    void *    (* value_from_string)(const char *)
+) {
+    address_cache_t * cache;
+
+    if (!(cache = calloc(1, sizeof(address_cache_t)))) return NULL;
+
+    // Slots are allocated on the first insertion
+    cache->name              = name;
+    cache->capacity          = capacity ? capacity : 1;
+    cache->ttl               = ttl;
+    cache->value_dup         = value_dup;
+    cache->value_free        = value_free;
+    cache->value_fprintf     = value_fprintf;
+    cache->value_from_string = value_from_string;
+    return cache;
+}
+
+void address_cache_free(address_cache_t * cache) {
+    size_t i;
+
+    if (cache) {
+        for (i = 0; i < cache->num_slots; i++) {
+            if (cache->slots[i].value) cache->value_free(cache->slots[i].value);
+        }
+        free(cache->slots);
+        free(cache->buckets);
+        free(cache);
+    }
+}
+
+bool address_cache_set_capacity(address_cache_t * cache, size_t capacity) {
+    address_cache_slot_t * slots = cache->slots,
+                         * slot;
+    size_t               * buckets = cache->buckets,
+                           num_slots = cache->num_slots,
+                           hand = cache->hand,
+                           i;
+    bool                   ret = true;
+
+    if (!capacity) return false;
+    cache->capacity = capacity;
+    if (!slots) return true;
+
+    // Move the entries in new slots, from the oldest to the newest
+    if (!address_cache_allocate(cache)) {
+        cache->slots   = slots;
+        cache->buckets = buckets;
+        return false;
+    }
+
+    for (i = 0; i < num_slots; i++) {
+        slot = &slots[(hand + i) % num_slots];
+        if (slot->value) {
+            ret &= address_cache_insert(cache, &slot->address, slot->value, slot->expiration);
+        }
+    }
+    free(slots);
+    free(buckets);
+    return ret;
+}
+
+void address_cache_set_ttl(address_cache_t * cache, double ttl) {
+    cache->ttl = ttl;
+}
+
+const void * address_cache_find(address_cache_t * cache, const address_t * address) {
+    address_cache_slot_t * slot;
+    size_t               * plink;
+
+    if (cache->num_entries && *(plink = address_cache_find_link(cache, address))) {
+        slot = address_cache_get_slot(cache, *plink);
+        if (!address_cache_slot_has_expired(slot, get_timestamp())) {
+            slot->is_referenced = true;
+            cache->num_hits++;
+            return slot->value;
+        }
+        address_cache_remove(cache, plink);
+        cache->num_expirations++;
+    }
+
+    cache->num_misses++;
+    return NULL;
+}
+
+bool address_cache_update(address_cache_t * cache, const address_t * address, const void * value) {
+    void * dup;
+
+    if (!(dup = cache->value_dup(value))) return false;
+    return address_cache_insert(cache, address, dup, cache->ttl > 0 ? get_timestamp() + cache->ttl : 0);
+}
+
+size_t address_cache_get_size(const address_cache_t * cache) {
+    return cache->num_entries;
+}
+
+bool address_cache_save(const address_cache_t * cache, FILE * out) {
+    const address_cache_slot_t * slot;
+    double                       now = get_timestamp();
+    size_t                       i;
+
+    for (i = 0; i < cache->num_slots; i++) {
+        slot = &cache->slots[i];
+        if (!slot->value || address_cache_slot_has_expired(slot, now)) continue;
+
+        fprintf(out, "%s ", cache->name);
+        address_fprintf(out, &slot->address);
+        fprintf(out, " %.0lf ", slot->expiration);
+        cache->value_fprintf(out, slot->value);
+        fprintf(out, "\n");
+    }
+    return !ferror(out);
+}
+
+bool address_cache_load(address_cache_t * cache, FILE * in) {
+    char        line[ADDRESS_CACHE_LINE_SIZE],
+                str_name[ADDRESS_CACHE_LINE_SIZE],
+                str_ip[ADDRESS_CACHE_LINE_SIZE],
+                str_value[ADDRESS_CACHE_LINE_SIZE];
+    address_t   address;
+    double      expiration,
+                now = get_timestamp();
+    void      * value;
+    size_t      num_line = 0;
+
+    while (fgets(line, ADDRESS_CACHE_LINE_SIZE, in)) {
+        num_line++;
+        if (line[0] == '#' || line[0] == '\n') continue;
+
+        if (sscanf(line, "%s %s %lf %s", str_name, str_ip, &expiration, str_value) != 4
+        ||  !address_cache_address_from_string(str_ip, &address)
+        ) {
+            fprintf(stderr, "address_cache_load: invalid entry (line %zu)\n", num_line);
+            return false;
+        }
+
+        if (strcmp(str_name, cache->name) != 0) continue;
+        if (expiration && expiration <= now) continue;
+
+        if (!(value = cache->value_from_string(str_value))) {
+            fprintf(stderr, "address_cache_load: invalid %s (line %zu)\n", cache->name, num_line);
+            return false;
+        }
+        if (!address_cache_insert(cache, &address, value, expiration)) return false;
+    }
+    return !ferror(in);
+}
+
+void address_cache_dump_stats(const address_cache_t * cache) {
+    fprintf(stderr,
+        "cache %s: %zu entries (at most %zu), %zu hits, %zu misses, %zu expired, %zu evicted\n",
+        cache->name,
+        cache->num_entries,
+        cache->capacity,
+        cache->num_hits,
+        cache->num_misses,
+        cache->num_expirations,
+        cache->num_evictions
+    );
+}
@@ -0,0 +1,189 @@
+#ifndef LIBPT_ADDRESS_CACHE_H
+#define LIBPT_ADDRESS_CACHE_H
+
+/**
+ * \file address_cache.h
+ * \brief Bounded caches of data related to IP addresses.
+ *
+ * An address_cache_t maps addresses to values (e.g. hostnames or ASNs).
+ * It stores at most a given number of entries in an array of slots,
+ * allocated once and indexed by a hash table. Once it is full, an entry is
+ * evicted according to the CLOCK algorithm (an approximation of LRU):
+ * entries found since the hand of the clock last passed them get a
+ * second chance. An entry also expires after a given delay (TTL).
+ *
+ * An address_cache_t can be saved to (and loaded from) a text file, one
+ * entry per line:
+ *
+ *   name address expiration value
+ *
+ * where name identifies the cache (several caches can share a file) and
+ * expiration is a timestamp (0 if the entry never expires).
+ */
+
+#include <stdbool.h>      // bool
+#include <stddef.h>       // size_t
+#include <stdio.h>        // FILE
+
+#include "address.h"      // address_t
+#include "common.h"       // ELEMENT_*
+
+#define ADDRESS_CACHE_DEFAULT_CAPACITY 65536
+#define ADDRESS_CACHE_DEFAULT_TTL      86400.0  /**< In seconds (0 means that entries never expire) */
+#define ADDRESS_CACHE_LINE_SIZE        1024
+
+/**
+ * \brief Type related to a *_from_string() function.
+ */
+
+#define ELEMENT_FROM_STRING void * (*)(const char *)
+
+typedef struct {
+    address_t     address;        /**< Key of this entry */
+    void        * value;          /**< Value of this entry (NULL if the slot is free) */
+    double        expiration;     /**< Expiration timestamp (0: never) */
+    size_t        next;           /**< Next slot of the same bucket, or next free slot (see address_cache_t) */
+    bool          is_referenced;  /**< True iif the entry has been found since the hand of the clock passed it */
+} address_cache_slot_t;
+
+typedef struct address_cache_s {
+    const char           * name;         /**< Name of the cache (see address_cache_save) */
+    address_cache_slot_t * slots;        /**< Entries (allocated on the first insertion) */
+    size_t                 capacity;     /**< Maximum number of entries */
+    size_t                 num_slots;    /**< Number of slots used so far */
+    size_t                 num_entries;  /**< Number of stored entries */
+    size_t                 free_slots;   /**< First free slot among the num_slots first ones */
+    size_t                 hand;         /**< Hand of the clock */
+    size_t               * buckets;      /**< First slot of each bucket */
+    size_t                 num_buckets;  /**< Number of buckets (a power of 2) */
+    double                 ttl;          /**< Lifetime of the entries, in seconds (0: infinite) */
+
+    // Links between slots (buckets, next, free_slots) store the index of
+    // a slot plus one: 0 stands for no slot, so that zeroed memory is an
+    // empty cache.
+
+    void   * (* value_dup)(const void * value);              /**< Callback used to duplicate a value */
+    void     (* value_free)(void * value);                   /**< Callback used to release a value */
+    void     (* value_fprintf)(FILE * out, const void * value); /**< Callback used to save a value */
+    void   * (* value_from_string)(const char * s);          /**< Callback used to load a value */
+
+    // Statistics
+    size_t                 num_hits;        /**< Number of values found */
+    size_t                 num_misses;      /**< Number of values not found (or expired) */
+    size_t                 num_expirations; /**< Number of entries removed because they have expired */
+    size_t                 num_evictions;   /**< Number of entries evicted to make room for new ones */
+} address_cache_t;
+
+/**
+ * \brief Create an address_cache_t instance.
+ * \param name The name of the cache. It must remain valid while the cache exists.
+ * \param capacity The maximum number of entries.
+ * \param ttl The lifetime of the entries, in seconds (0: infinite).
+ * \param value_dup Callback used to duplicate a value.
+ * \param value_free Callback used to release a value.
+ * \param value_fprintf Callback used to write a value (on a single line,
+ *    without blank) in a file.
+ * \param value_from_string Callback used to allocate a value according
+ *    to its string representation. It returns NULL if the string is invalid.
+ * \return The newly allocated address_cache_t instance, NULL otherwise.
+ */
+
+address_cache_t * address_cache_create_impl(
+    const char * name,
+    size_t       capacity,
+    double       ttl,
+    void *    (* value_dup)(const void *),
+    void      (* value_free)(void *),
+    void      (* value_fprintf)(FILE *, const void *),
+    void *    (* value_from_string)(const char *)
+);
+
+#define address_cache_create(name, capacity, ttl, value_dup, value_free, value_fprintf, value_from_string) \
+    address_cache_create_impl(name, capacity, ttl, \
+        (ELEMENT_DUP)         value_dup, \
+        (ELEMENT_FREE)        value_free, \
+        (ELEMENT_FPRINTF)     value_fprintf, \
+        (ELEMENT_FROM_STRING) value_from_string \
+    )
+
+/**
+ * \brief Release an address_cache_t instance and the values it contains.
+ * \param cache An address_cache_t instance.
+ */
+
+void address_cache_free(address_cache_t * cache);
+
+/**
+ * \brief Change the maximum number of entries of an address_cache_t.
+ *    If needed, entries are evicted.
+ * \param cache An address_cache_t instance.
+ * \param capacity The maximum number of entries (at least 1).
+ * \return true iif successful.
+ */
+
+bool address_cache_set_capacity(address_cache_t * cache, size_t capacity);
+
+/**
+ * \brief Change the lifetime of the entries inserted from now on.
+ * \param cache An address_cache_t instance.
+ * \param ttl The lifetime of the entries, in seconds (0: infinite).
+ */
+
+void address_cache_set_ttl(address_cache_t * cache, double ttl);
+
+/**
+ * \brief Retrieve the value attached to an address.
+ * \param cache An address_cache_t instance.
+ * \param address The searched address.
+ * \return The corresponding value (owned by the cache, and valid until
+ *    the next update of the cache), NULL if not found or expired.
+ */
+
+const void * address_cache_find(address_cache_t * cache, const address_t * address);
+
+/**
+ * \brief Attach a value to an address. If the address is already stored,
+ *    its value is replaced. If the cache is full, an entry is evicted.
+ * \param cache An address_cache_t instance.
+ * \param address The address.
+ * \param value The value (duplicated by the cache). It must not be NULL.
+ * \return true iif successful.
+ */
+
+bool address_cache_update(address_cache_t * cache, const address_t * address, const void * value);
+
+/**
+ * \brief Retrieve the number of entries stored in an address_cache_t.
+ * \param cache An address_cache_t instance.
+ * \return The number of entries (possibly including expired ones).
+ */
+
+size_t address_cache_get_size(const address_cache_t * cache);
+
+/**
+ * \brief Write the entries of an address_cache_t which have not expired.
+ * \param cache An address_cache_t instance.
+ * \param out The stream to write to.
+ * \return true iif successful.
+ */
+
+bool address_cache_save(const address_cache_t * cache, FILE * out);
+
+/**
+ * \brief Add the entries saved by address_cache_save to an address_cache_t.
+ *    The entries of other caches and the expired ones are ignored.
+ * \param cache An address_cache_t instance.
+ * \param in The stream to read.
+ * \return true iif successful.
+ */
+
+bool address_cache_load(address_cache_t * cache, FILE * in);
+
+/**
+ * \brief Print the statistics of an address_cache_t (on stderr).
+ * \param cache An address_cache_t instance.
+ */
+
+void address_cache_dump_stats(const address_cache_t * cache);
+
+#endif // LIBPT_ADDRESS_CACHE_H
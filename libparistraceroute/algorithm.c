@@ -61,18 +61,31 @@ algorithm_instance_t * algorithm_instance_create(
     }
 
     if (!(instance = malloc(sizeof(algorithm_instance_t)))) {
-        return NULL;
+        goto ERR_MALLOC;
+    }
+
+    if (!(instance->pending_probes = dynarray_create())) {
+        goto ERR_PENDING_PROBES;
     }
 
-    instance->id         = loop->next_algorithm_id++;
-    instance->algorithm  = algorithm;
-    instance->options    = options;
-    instance->probe_skel = probe_skel;
-    instance->data       = NULL;
-    instance->events     = dynarray_create();
-    instance->caller     = NULL;
-    instance->loop       = loop;
+    instance->id            = loop->next_algorithm_id++;
+    instance->algorithm     = algorithm;
+    instance->options       = options;
+    instance->probe_skel    = probe_skel;
+    instance->data          = NULL;
+    instance->events        = dynarray_create();
+    instance->caller        = NULL;
+    instance->loop          = loop;
+    instance->num_in_flight = 0;
+    instance->max_in_flight = loop->max_in_flight;
+    instance->max_retries   = loop->max_retries;
+    instance->timer         = 0;
     return instance;
+
+ERR_PENDING_PROBES:
+    free(instance);
+ERR_MALLOC:
+    return NULL;
 }
 
 /**
@@ -82,7 +95,9 @@ algorithm_instance_t * algorithm_instance_create(
 
 void algorithm_instance_free(algorithm_instance_t * instance) {
     if (instance) {
-        algorithm_instance_clear_events(instance);
+        dynarray_free(instance->events, (ELEMENT_FREE) event_free);
+        // Pending probes have never been sent: nobody else refers to them
+        dynarray_free(instance->pending_probes, (ELEMENT_FREE) probe_free);
         free(instance);
     }
 }
@@ -127,6 +142,14 @@ inline void algorithm_instance_clear_events(algorithm_instance_t * instance) {
     }
 }
 
+void algorithm_instance_set_max_in_flight(algorithm_instance_t * instance, size_t max_in_flight) {
+    if (instance) instance->max_in_flight = max_in_flight;
+}
+
+void algorithm_instance_set_max_retries(algorithm_instance_t * instance, size_t max_retries) {
+    if (instance) instance->max_retries = max_retries;
+}
+
 inline unsigned int algorithm_instance_get_num_events(algorithm_instance_t * instance) {
     return instance && instance->events ? instance->events->size : 0;
 }
@@ -238,6 +261,14 @@ void pt_del_instance(
     struct pt_loop_s * loop,
     algorithm_instance_t * instance
 ) {
+    // This instance will not receive replies to stateless probes anymore
+    if (loop->network->unmatched_caller == instance) {
+        network_set_unmatched_caller(loop->network, NULL);
+    }
+
+    // The probes still handled by the network layer refer to this instance
+    network_cancel_probes(loop->network, instance);
+
     pt_algorithm_instance_del(loop, instance);
     algorithm_instance_free(instance);
 }
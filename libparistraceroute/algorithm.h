@@ -58,6 +58,11 @@ typedef struct algorithm_instance_s {
     dynarray_t                  * events;     /**< An array of events received by the algorithm */
     struct algorithm_instance_s * caller;     /**< Reference to the entity that called the algorithm (NULL if called by user program) */
     struct pt_loop_s            * loop;       /**< Pointer to a library context */
+    dynarray_t                  * pending_probes; /**< Probes waiting for a free slot in the in-flight window (see pt_send_probe) */
+    size_t                        num_in_flight;  /**< Number of probe packets sent by this instance and neither answered nor expired */
+    size_t                        max_in_flight;  /**< Size of the in-flight window (0 means unbounded) */
+    size_t                        max_retries;    /**< Number of times an expired probe is sent again before raising a PROBE_TIMEOUT */
+    double                        timer;          /**< Deadline of the timer set by pt_set_timer (0 if none) */
 } algorithm_instance_t;
 
 //--------------------------------------------------------------------
@@ -134,6 +139,25 @@ unsigned   algorithm_instance_get_num_events(algorithm_instance_t * instance);
 void       algorithm_instance_set_data      (algorithm_instance_t * instance, void * data);
 void       algorithm_instance_clear_events  (algorithm_instance_t * instance);
 
+/**
+ * \brief Set the maximum number of probe packets that an algorithm instance
+ *    may have in flight. Probes sent beyond this limit are delayed until
+ *    a reply or a timeout occurs (see pt_send_probe).
+ * \param instance An algorithm instance.
+ * \param max_in_flight The size of the window (0 means unbounded).
+ */
+
+void algorithm_instance_set_max_in_flight(algorithm_instance_t * instance, size_t max_in_flight);
+
+/**
+ * \brief Set how many times an expired probe is sent again by the pt_loop
+ *    before the algorithm instance is notified by a PROBE_TIMEOUT event.
+ * \param instance An algorithm instance.
+ * \param max_retries The retransmission budget of each probe.
+ */
+
+void algorithm_instance_set_max_retries(algorithm_instance_t * instance, size_t max_retries);
+
 //--------------------------------------------------------------------
 // pt_* functions involving an algorithm_instance_t
 // Due to mutual header inclusions, they cannot be declared/implemented
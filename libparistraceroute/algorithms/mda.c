@@ -4,6 +4,7 @@
 #include <stdlib.h>        // malloc, free
 #include <stdbool.h>       // bool
 #include <limits.h>        // INT_MAX
+#include <stdint.h>        // SIZE_MAX
 
 #include "../algorithm.h"  // algorithm_t
 #include "../common.h"     // MAX, ELEMENT_FREE
@@ -16,30 +17,50 @@
 // Private structures
 //---------------------------------------------------------------------------
 
-typedef struct {
-    address_t     * address;
-    lattice_elt_t * result;
-} mda_address_t;
-
 typedef struct {
     uint8_t         ttl;
     uintmax_t       flow_id;
     lattice_elt_t * result;
 } mda_search_data_t;
 
+// Summary of the IP hops discovered at a given hop, used by MDA-Lite
+typedef struct {
+    size_t num_interfaces; /**< Number of IP hops at this hop */
+    size_t num_next;       /**< Number of IP hops at the next hop */
+    bool   is_meshed;      /**< At least one IP hop has several next hops */
+    bool   is_uniform;     /**< Every IP hop is reached by a fair share of the flows */
+} mda_lite_hop_t;
+
+// Number of flows traced through each IP hop of a hop by the meshing test.
+#define MDA_LITE_PHI 2
+
+// A hop is not uniform if one of its IP hops is reached by less than
+// 1 / MDA_LITE_UNIFORMITY_RATIO of the flows it would receive from a
+// uniform load balancer.
+#define MDA_LITE_UNIFORMITY_RATIO 4
+
+// Streaming: number of complete TTLs required after an IP hop to release it
+#define MDA_STREAM_MARGIN 2
+
 //---------------------------------------------------------------------------
 // Options supported by mda.
 // mda also supports options supported by traceroute.
 //---------------------------------------------------------------------------
 
 static unsigned mda_values[10] = OPTIONS_MDA_BOUND_MAXBRANCH;
+static bool     mda_pipeline    = false;
+static bool     mda_lite        = false;
+static bool     mda_stream      = false;
 
 // MDA options
 // TODO: Can only pass integer values for confidence (thus cannot, for
 // example, measure confidence of 99.9999%). Expand functionality.
 static option_t mda_opt_specs[] = {
     // action           short long          metavar                          help    variable
-    {opt_store_int_3,   "B",  "--mda",      "bound,max_branch,max_children", HELP_B, mda_values},
+    {opt_store_int_3,   "B",       "--mda",          "bound,max_branch,max_children", HELP_B,            mda_values},
+    {opt_store_1,       OPT_NO_SF, "--mda-pipeline", OPT_NO_METAVAR,                  HELP_mda_pipeline, &mda_pipeline},
+    {opt_store_1,       OPT_NO_SF, "--mda-lite",     OPT_NO_METAVAR,                  HELP_mda_lite,     &mda_lite},
+    {opt_store_1,       OPT_NO_SF, "--mda-stream",   OPT_NO_METAVAR,                  HELP_mda_stream,   &mda_stream},
     END_OPT_SPECS
     // {opt_store_int, OPT_NO_SF, "confidence", "PERCENTAGE", "level of confidence", 0},
     // per dest
@@ -64,7 +85,19 @@ unsigned options_mda_get_max_children() {
 }
 
 unsigned options_mda_get_is_set() {
-    return mda_values[9];
+    return mda_values[9] || mda_pipeline || mda_lite || mda_stream;
+}
+
+bool options_mda_get_pipeline() {
+    return mda_pipeline;
+}
+
+bool options_mda_get_lite() {
+    return mda_lite;
+}
+
+bool options_mda_get_stream() {
+    return mda_stream;
 }
 
 void options_mda_init(mda_options_t * mda_options)
@@ -72,6 +105,9 @@ void options_mda_init(mda_options_t * mda_options)
     mda_options->bound        = options_mda_get_bound();
     mda_options->max_branch   = options_mda_get_max_branch();
     mda_options->max_children = options_mda_get_max_children();
+    mda_options->pipeline     = options_mda_get_pipeline();
+    mda_options->lite         = options_mda_get_lite();
+    mda_options->stream       = options_mda_get_stream();
 }
 
 inline mda_options_t mda_get_default_options() {
@@ -80,7 +116,10 @@ inline mda_options_t mda_get_default_options() {
          .traceroute_options = traceroute_get_default_options(),
          .bound              = 95,
          .max_branch         = 16,
-         .max_children       = 128
+         .max_children       = 128,
+         .pipeline           = false,
+         .lite               = false,
+         .stream             = false
     };
 
     return mda_options;
@@ -132,21 +171,58 @@ static int mda_stopping_points(unsigned int num_interfaces, unsigned int confide
 }
 */
 
-static bool mda_event_new_link(pt_loop_t * loop, mda_interface_t * src, mda_interface_t * dst)
+/**
+ * \brief Raise a mda event.
+ * \param mda_data The data of the mda instance.
+ * \param type The type of the event.
+ * \param payload The data of the event, released by free(). If NULL,
+ *    the allocation of the payload has failed.
+ * \return true iif successful.
+ */
+
+static bool mda_raise_event(mda_data_t * mda_data, mda_event_type_t type, void * payload)
+{
+    event_t * mda_event;
+
+    if (!payload) goto ERR_PAYLOAD;
+    if (!(mda_event = event_create(type, payload, NULL, free))) goto ERR_MDA_EVENT;
+    return pt_raise_event(mda_data->loop, mda_event);
+
+ERR_MDA_EVENT:
+    free(payload);
+ERR_PAYLOAD:
+    return false;
+}
+
+static bool mda_event_new_link(mda_data_t * mda_data, mda_interface_t * src, mda_interface_t * dst)
 {
-    event_t          * mda_event;
     mda_interface_t ** link;
 
-    if (!(link = malloc(2 * sizeof(mda_interface_t)))) goto ERR_LINK;
+    // The interfaces of a MDA_NEW_LINK may be released before it is processed
+    if (mda_data->stream) return true;
+
+    if (!(link = malloc(2 * sizeof(mda_interface_t)))) return false;
     link[0] = src;
     link[1] = dst;
-    if (!(mda_event = event_create(MDA_NEW_LINK, link, NULL, free))) goto ERR_MDA_EVENT;
-    return pt_raise_event(loop, mda_event);
+    return mda_raise_event(mda_data, MDA_NEW_LINK, link);
+}
 
-ERR_MDA_EVENT:
-    free(link);
-ERR_LINK:
-    return false;
+static bool mda_event_new_hop(mda_data_t * mda_data, const mda_interface_t * interface, uint8_t ttl)
+{
+    return !mda_data->stream
+        || mda_raise_event(mda_data, MDA_NEW_HOP, mda_hop_event_create(interface, ttl, 0));
+}
+
+static bool mda_event_link_probed(
+    mda_data_t            * mda_data,
+    const mda_interface_t * source,
+    const mda_interface_t * target,
+    uint8_t                 ttl,
+    uint16_t                flow_id,
+    double                  rtt
+) {
+    return !mda_data->stream
+        || mda_raise_event(mda_data, MDA_LINK_PROBED, mda_link_event_create(source, target, ttl, flow_id, rtt));
 }
 
 //---------------------------------------------------------------------------
@@ -170,8 +246,367 @@ ERR_LINK:
  * is done, its siblings are complete.
  */
 
+/**
+ * \brief Retrieve the lowest TTL at which an IP hop has been discovered.
+ * \param interface An IP hop discovered by mda.
+ * \return The corresponding TTL.
+ */
+
+static uint8_t mda_interface_get_min_ttl(const mda_interface_t * interface)
+{
+    uint8_t ttl = interface->ttl_set[0];
+    size_t  i;
+
+    for (i = 1; i < interface->num_ttls; i++) {
+        if (interface->ttl_set[i] < ttl) ttl = interface->ttl_set[i];
+    }
+    return ttl;
+}
+
+/**
+ * \brief Retrieve the highest TTL at which an IP hop has been discovered.
+ * \param interface An IP hop discovered by mda.
+ * \return The corresponding TTL.
+ */
+
+static uint8_t mda_interface_get_max_ttl(const mda_interface_t * interface)
+{
+    uint8_t ttl = interface->ttl_set[0];
+    size_t  i;
+
+    for (i = 1; i < interface->num_ttls; i++) {
+        if (interface->ttl_set[i] > ttl) ttl = interface->ttl_set[i];
+    }
+    return ttl;
+}
+
+/**
+ * \brief Start a new walk over the siblings of a lattice node. A sibling
+ *    may appear several times in elt->siblings (once per IP hop of the
+ *    previous hop leading to it): the mda_interface_t visited by the walk
+ *    are marked, so that each of them is processed once in O(1).
+ * \param mda_data The data of the mda instance.
+ * \return The mark of the new walk.
+ */
+
+static size_t mda_lite_new_mark(mda_data_t * mda_data)
+{
+    return ++mda_data->lite_mark;
+}
+
+/**
+ * \brief Retrieve the i-th sibling of a lattice node unless a walk has
+ *    already visited it, and mark it as visited.
+ * \param elt A lattice node.
+ * \param i The index of the sibling.
+ * \param mark The mark of the walk (see mda_lite_new_mark).
+ * \return The lattice node of the sibling, NULL if this sibling is a
+ *    duplicate.
+ */
+
+static const lattice_elt_t * mda_lite_visit_sibling(const lattice_elt_t * elt, size_t i, size_t mark)
+{
+    const lattice_elt_t * sibling   = dynarray_get_ith_element(elt->siblings, i);
+    mda_interface_t     * interface = lattice_elt_get_data(sibling);
+
+    if (interface->lite_mark == mark) return NULL;
+    interface->lite_mark = mark;
+    return sibling;
+}
+
+/**
+ * \brief Count the distinct siblings of a lattice node (itself included).
+ * \param elt A lattice node.
+ * \param mda_data The data of the mda instance.
+ * \return The number of distinct siblings.
+ */
+
+static size_t mda_lite_get_num_distinct_siblings(const lattice_elt_t * elt, mda_data_t * mda_data)
+{
+    size_t i, num_siblings = lattice_elt_get_num_siblings(elt), num_distinct = 0,
+           mark = mda_lite_new_mark(mda_data);
+
+    for (i = 0; i < num_siblings; i++) {
+        if (mda_lite_visit_sibling(elt, i, mark)) num_distinct++;
+    }
+    return num_distinct;
+}
+
+/**
+ * \brief Summarize the hop of an IP hop: its IP hops, the IP hops
+ *    of the next hop, and how the flows spread over them. It runs in
+ *    linear time in the number of siblings of elt.
+ * \param hop The mda_lite_hop_t instance to fill.
+ * \param elt The lattice node of an IP hop discovered by mda.
+ * \param mda_data The data of the mda instance.
+ */
+
+static void mda_lite_hop_init(mda_lite_hop_t * hop, const lattice_elt_t * elt, mda_data_t * mda_data)
+{
+    const lattice_elt_t   * sibling,
+                          * next_elt = NULL;
+    const mda_interface_t * interface;
+    size_t                  i, num_next, num_flows,
+                            num_siblings = lattice_elt_get_num_siblings(elt),
+                            total_flows  = 0,
+                            min_flows    = SIZE_MAX,
+                            mark         = mda_lite_new_mark(mda_data);
+
+    hop->num_interfaces = 0;
+    hop->num_next       = 0;
+    hop->is_meshed      = false;
+
+    for (i = 0; i < num_siblings; i++) {
+        if (!(sibling = mda_lite_visit_sibling(elt, i, mark))) continue;
+        interface = lattice_elt_get_data(sibling);
+        hop->num_interfaces++;
+
+        // The siblings of a next hop are the next hops of this hop
+        num_next = lattice_elt_get_num_next(sibling);
+        if (num_next > 1) hop->is_meshed = true;
+        if (num_next > 0 && !next_elt) next_elt = dynarray_get_ith_element(sibling->next, 0);
+
+        // Flows which have reached this IP hop
+        num_flows = mda_interface_get_num_ttl_flows(interface) - interface->num_flows[MDA_FLOW_TESTING];
+        total_flows += num_flows;
+        if (num_flows < min_flows) min_flows = num_flows;
+    }
+
+    // Counted once the walk over this hop is over, as it starts a new walk
+    if (next_elt) hop->num_next = mda_lite_get_num_distinct_siblings(next_elt, mda_data);
+    hop->is_uniform = min_flows * hop->num_interfaces * MDA_LITE_UNIFORMITY_RATIO >= total_flows;
+}
+
+/**
+ * \brief Compute how many probes an IP hop must send to enumerate its
+ *    next hops.
+ *
+ * The full MDA uses the stopping point of each IP hop, i.e. bound_get_nk()
+ * applied to its own next hops. MDA-Lite assumes load balancers are
+ * uniform and not meshed: the stopping point of the whole hop is applied
+ * to the next hops of all its IP hops, and shared by these IP hops. Each
+ * of them still sends MDA_LITE_PHI probes so that a meshed hop is detected.
+ * A hop which turns out to be meshed or not uniform falls back to the
+ * full MDA.
+ * \param elt The lattice node of an IP hop discovered by mda.
+ * \param mda_data The data of the mda instance.
+ * \return The number of probes to send through this IP hop.
+ */
+
+static size_t mda_interface_get_num_to_send(lattice_elt_t * elt, mda_data_t * mda_data)
+{
+    mda_interface_t * interface = lattice_elt_get_data(elt);
+    mda_lite_hop_t    hop;
+    size_t            num_to_send;
+
+    if (mda_data->lite && !interface->lite_fallback) {
+        mda_lite_hop_init(&hop, elt, mda_data);
+        if (hop.num_interfaces > 1 && (hop.is_meshed || !hop.is_uniform)) {
+            interface->lite_fallback = true;
+        } else {
+            num_to_send = bound_get_nk(mda_data->bound, MAX(hop.num_next + 1, 2));
+            num_to_send = (num_to_send + hop.num_interfaces - 1) / hop.num_interfaces;
+            return MAX(num_to_send, MDA_LITE_PHI);
+        }
+    }
+
+    return bound_get_nk(mda_data->bound, MAX(lattice_elt_get_num_next(elt) + 1, 2));
+}
+
+/**
+ * \brief Check whether an IP hop has sent every probe required to
+ *    enumerate its next hops. This is always the case in the default mode
+ *    when all its probes are answered or expired. In pipeline mode, an IP
+ *    hop probed speculatively sends its probes in several batches.
+ * \param elt The lattice node of an IP hop discovered by mda.
+ * \param mda_data The data of the mda instance.
+ * \return true iif the IP hop has sent enough probes.
+ */
+
+static bool mda_interface_has_sent_enough(lattice_elt_t * elt, mda_data_t * mda_data)
+{
+    const mda_interface_t * interface = lattice_elt_get_data(elt);
+
+    return !mda_data->pipeline
+        || interface->sent >= mda_interface_get_num_to_send(elt, mda_data);
+}
+
+/**
+ * \brief Send a flow at a given TTL to check whether it reaches an IP hop
+ *    (MDA_FLOW_TESTING).
+ * \param elt The lattice node of the IP hop.
+ * \param mda_data The data of the mda instance.
+ * \param ttl The TTL of the probe.
+ * \param flow_id The flow identifier.
+ * \return true iif successful.
+ */
+
+static bool mda_send_testing_flow(lattice_elt_t * elt, mda_data_t * mda_data, uint8_t ttl, uintmax_t flow_id)
+{
+    probe_t * probe;
+
+    if (!mda_data_add_flow(mda_data, elt, ttl, flow_id, MDA_FLOW_TESTING)) goto ERR_ADD_FLOW;
+    if (!(probe = probe_dup(mda_data->skel)))                              goto ERR_PROBE_DUP;
+
+    // I16 casts flow_id into a uint16_t before memcpy
+    probe_set_fields(probe, I8("ttl", ttl), I16("flow_id", flow_id), NULL); // TODO control returned value, free fields
+    return pt_send_probe(mda_data->loop, probe);
+
+ERR_PROBE_DUP:
+    mda_data_del_testing_flow(mda_data, ttl, flow_id);
+ERR_ADD_FLOW:
+    return false;
+}
+
+/**
+ * \brief Send through an IP hop the flows known to reach its previous
+ *    hops which have not been used yet by these previous hops. Such a
+ *    flow also probes the next hops of the previous hop it belongs to, and
+ *    reaches the IP hop with a probability 1 / (number of next hops of the
+ *    previous hop) instead of 1 / (number of IP hops at this TTL).
+ * \param elt The lattice node of the IP hop.
+ * \param mda_data The data of the mda instance.
+ * \param num_flows The maximum number of flows to send.
+ * \return The number of flows sent, -1 in case of failure.
+ */
+
+static int mda_send_previous_hop_flows(lattice_elt_t * elt, mda_data_t * mda_data, int num_flows)
+{
+    mda_interface_t      * interface = lattice_elt_get_data(elt),
+                         * prev_interface;
+    lattice_elt_t        * prev_elt;
+    const mda_ttl_flow_t * mda_ttl_flow;
+    size_t                 i, j, num_ttl_flows = mda_interface_get_num_ttl_flows(interface);
+    uintmax_t              flow_id;
+    uint8_t                ttl;
+    int                    num_sent = 0;
+
+    for (i = 0; i < num_ttl_flows && num_sent < num_flows; i++) {
+        // Sending flows alters interface->ttl_flows, hence the copies.
+        mda_ttl_flow = mda_interface_get_ith_ttl_flow(interface, i);
+        ttl          = mda_ttl_flow->ttl;
+        flow_id      = mda_ttl_flow->mda_flow.flow_id;
+        if (mda_ttl_flow->mda_flow.state == MDA_FLOW_TESTING || ttl <= 1) continue;
+
+        // The previous hop through which this flow has reached this IP hop
+        if (!(prev_elt = mda_data_get_flow_interface(mda_data, ttl - 1, flow_id))) continue;
+        prev_interface = lattice_elt_get_data(prev_elt);
+
+        for (j = prev_interface->next_available;
+             j < mda_interface_get_num_ttl_flows(prev_interface)
+             && mda_interface_get_num_flows(prev_interface, MDA_FLOW_AVAILABLE) > 0
+             && num_sent < num_flows;
+             j++
+        ) {
+            mda_ttl_flow = mda_interface_get_ith_ttl_flow(prev_interface, j);
+            flow_id      = mda_ttl_flow->mda_flow.flow_id;
+            if (mda_ttl_flow->mda_flow.state != MDA_FLOW_AVAILABLE
+            ||  mda_ttl_flow->ttl != ttl - 1
+            ||  mda_data_is_flow_used(mda_data, ttl, flow_id)) {
+                continue;
+            }
+
+            mda_interface_set_ith_flow_state(prev_interface, j, MDA_FLOW_UNAVAILABLE);
+            prev_interface->sent++;
+            if (!mda_send_testing_flow(elt, mda_data, ttl, flow_id)) return -1;
+            num_sent++;
+        }
+    }
+
+    return num_sent;
+}
+
+/**
+ * \brief Send through an IP hop the flows which have reached it during
+ *    previous instances toward the same destination (see topology_cache_t).
+ * \param elt The lattice node of the IP hop.
+ * \param mda_data The data of the mda instance.
+ * \param num_flows The maximum number of flows to send.
+ * \return The number of flows sent, -1 in case of failure.
+ */
+
+static int mda_send_cached_flows(lattice_elt_t * elt, mda_data_t * mda_data, int num_flows)
+{
+    const mda_interface_t * interface = lattice_elt_get_data(elt);
+    const uint16_t        * flow_ids;
+    size_t                  i, j, num_flow_ids;
+    uint8_t                 ttl;
+    int                     num_sent = 0;
+
+    if (!interface->address) return 0;
+
+    for (i = 0; i < interface->num_ttls && num_sent < num_flows; i++) {
+        ttl = interface->ttl_set[i];
+        num_flow_ids = topology_cache_get_flow_ids(
+            mda_data->topology_cache, mda_data->src_ip, mda_data->dst_ip,
+            ttl, interface->address, &flow_ids
+        );
+        for (j = 0; j < num_flow_ids && num_sent < num_flows; j++) {
+            if (mda_data_is_flow_used(mda_data, ttl, flow_ids[j])) continue;
+            if (!mda_send_testing_flow(elt, mda_data, ttl, flow_ids[j])) return -1;
+            num_sent++;
+        }
+    }
+
+    return num_sent;
+}
+
+/**
+ * \brief Send flows which may reach an IP hop having siblings, so that
+ *    it gets enough flows to enumerate its next hops. The flows the most
+ *    likely to reach it are sent first:
+ *    - the unused flows of its previous hops;
+ *    - the flows which have reached it during previous instances toward
+ *      the same destination (per-flow load balancers hash it too);
+ *    - brand-new flows.
+ * \param elt The lattice node of the IP hop.
+ * \param mda_data The data of the mda instance.
+ * \param num_flows The number of flows to send.
+ * \return true iif successful.
+ */
+
+static bool mda_send_testing_flows(lattice_elt_t * elt, mda_data_t * mda_data, int num_flows)
+{
+    const mda_interface_t * interface = lattice_elt_get_data(elt);
+    uintmax_t               flow_id;
+    uint8_t                 ttl;
+    int                     i, num_sent;
+
+    if ((num_sent = mda_send_previous_hop_flows(elt, mda_data, num_flows)) < 0) goto ERR_SEND;
+    num_flows -= num_sent;
+    if ((num_sent = mda_send_cached_flows(elt, mda_data, num_flows)) < 0)       goto ERR_SEND;
+    num_flows -= num_sent;
+
+    for (i = 0; i < num_flows; i++) {
+        /* Note: we are not sure all probes will go to the right interface, and
+         * we might go though us, though it might alimentate other interfaces at
+         * the same ttl... thus we need to share the probes in flight when we
+         * explore hops at the same ttl : we should set one potential probe in
+         * flight for each interface ? or multiply the number of probes in
+         * flight by the number of interface (might overestimate ?)*/
+        ttl = interface->ttl_set[i % interface->num_ttls]; // Vary ttl over all possible
+        // Every flow identifier has been used: this hop cannot be enumerated further
+        if (!(flow_id = mda_data_get_new_flow_id(mda_data, ttl))) break;
+        if (!mda_send_testing_flow(elt, mda_data, ttl, flow_id)) goto ERR_SEND;
+    }
+
+    return true;
+
+ERR_SEND:
+    return false;
+}
+
 /**
  * \brief Discover next hops of a given IP hop.
+ *
+ * By default, the next hops of an IP hop are probed once every previous
+ * hop has been fully enumerated (LATTICE_INTERRUPT_NEXT). If mda_data->pipeline
+ * is set, the lattice is walked in level-order and the next hops are
+ * also visited. An IP hop whose previous hops are still being enumerated
+ * is enumerated "speculatively": it only uses the flows already known to
+ * reach it, since new flows may reach its (not yet discovered) siblings.
+ * In both cases, the number of probes sent per IP hop follows
+ * bound_get_nk().
  * \param elt The current IP hop.
  * \param data
  * \return
@@ -181,8 +616,6 @@ static lattice_return_t mda_enumerate(lattice_elt_t * elt, mda_data_t * mda_data
 {
     mda_interface_t * interface = lattice_elt_get_data(elt);
     mda_ttl_flow_t  * mda_ttl_flow;
-    /* Number of interfaces at the same TTL */
-    size_t    num_nexthops = 0;
     probe_t * probe;
     uintmax_t flow_id = 0;
     uint8_t   ttl;
@@ -192,14 +625,11 @@ static lattice_return_t mda_enumerate(lattice_elt_t * elt, mda_data_t * mda_data
     int       num_flows_avail = 0;
     int       num_flows_testing = 0;
     int       num_siblings = 0;
+    bool      is_speculative;
 
-    // Determine the number of next hop interfaces
-    num_nexthops = lattice_elt_get_num_next(elt);
-
-    // ... and thus deduce how many packets we have to send
-    /*to_send = mda_stopping_points(MAX(num_nexthops + 1, 2),
-     * mda_data->confidence) - interface->sent;*/
-    to_send = bound_get_nk(mda_data->bound, MAX(num_nexthops + 1, 2)) - interface->sent;
+    // Determine the number of next hop interfaces, and thus deduce how
+    // many packets we have to send
+    to_send = mda_interface_get_num_to_send(elt, mda_data) - interface->sent;
 
     //printf("find next hops of %s (to_send= %zu)\n", interface->address, to_send);
     //printf("Interface %s : to_send %d - sent %zu - received %zu\n", interface->address, to_send, interface->sent, interface->received);
@@ -216,7 +646,21 @@ static lattice_return_t mda_enumerate(lattice_elt_t * elt, mda_data_t * mda_data
     /* How many interfaces at current ttl */
     // Only if the previous is done enumerating
     num_siblings = lattice_elt_get_num_siblings(elt);
-    if (num_siblings > 1) {
+
+    // No flow is known to reach a star (an IP hop which never replies): if it
+    // has siblings, flows would be searched for it endlessly.
+    if (!interface->address && num_siblings > 1) {
+        return LATTICE_DONE;
+    }
+    is_speculative = mda_data->pipeline
+        && mda_data->num_incomplete > 0
+        && mda_data->min_incomplete_ttl < mda_interface_get_min_ttl(interface);
+
+    if (is_speculative) {
+        // Siblings are not yet known: only use flows known to reach us.
+        num_flows_avail = mda_interface_get_num_flows(interface, MDA_FLOW_AVAILABLE);
+        num_siblings = MAX(num_siblings, 2);
+    } else if (num_siblings > 1) {
         /* There are many interfaces at this TTL, we must ensure we have enough
          * flows available at the current ttl */
 
@@ -227,20 +671,8 @@ static lattice_return_t mda_enumerate(lattice_elt_t * elt, mda_data_t * mda_data
             // potentially divided by num_siblings
             num_flows_testing = mda_interface_get_num_flows(interface, MDA_FLOW_TESTING);
             num_flows_missing = to_send - num_flows_avail - num_flows_testing;
-            for (i = 0; i < num_flows_missing; i++) {
-                /* Note: we are not sure all probes will go to the right interface, and
-                 * we might go though us, though it might alimentate other interfaces at
-                 * the same ttl... thus we need to share the probes in flight when we
-                 * explore hops at the same ttl : we should set one potential probe in
-                 * flight for each interface ? or multiply the number of probes in
-                 * flight by the number of interface (might overestimate ?)*/
-                ttl = interface->ttl_set[i % interface->num_ttls]; // Vary ttl over all possible
-                probe = probe_dup(mda_data->skel);
-                flow_id = ++mda_data->last_flow_id;
-                mda_interface_add_flow_id(interface, ttl, flow_id, MDA_FLOW_TESTING); // TODO control returned value
-                // I16 casts flow_id into a uint16_t before memcpy
-                probe_set_fields(probe, I8("ttl", ttl), I16("flow_id", flow_id), NULL); // TODO control returned value, free fields
-                pt_send_probe(mda_data->loop, probe); // TODO control returned value
+            if (num_flows_missing > 0 && !mda_send_testing_flows(elt, mda_data, num_flows_missing)) {
+                goto ERR_SEND_TESTING_FLOWS;
             }
         }
     } else {
@@ -260,14 +692,14 @@ static lattice_return_t mda_enumerate(lattice_elt_t * elt, mda_data_t * mda_data
     for (i = 0; i < num_flows_avail; i++) {
         // Get a new ttl flow_id tuple to send, or break/return
         // TODO manage properly break/return
-        mda_ttl_flow = mda_interface_get_available_flow_id(interface, num_siblings, mda_data);
+        mda_ttl_flow = mda_interface_get_available_flow_id(elt, num_siblings, mda_data);
         if (!mda_ttl_flow) {
             fprintf(stderr, "Not enough flows found reaching: ");
             address_dump(interface->address);
             break;
         }
         
-        flow_id = mda_ttl_flow->mda_flow->flow_id;
+        flow_id = mda_ttl_flow->mda_flow.flow_id;
         ttl     = mda_ttl_flow->ttl;
         // Send corresponding probe with ttl + 1
         if (!(probe = probe_dup(mda_data->skel))) {
@@ -278,9 +710,19 @@ static lattice_return_t mda_enumerate(lattice_elt_t * elt, mda_data_t * mda_data
         interface->sent++;
     }
 
+    if (mda_data->pipeline) {
+        // Enumeration not complete, but the next hops can already be probed
+        ttl = mda_interface_get_min_ttl(interface);
+        if (mda_data->num_incomplete++ == 0 || ttl < mda_data->min_incomplete_ttl) {
+            mda_data->min_incomplete_ttl = ttl;
+        }
+        return LATTICE_CONTINUE;
+    }
+
     return LATTICE_INTERRUPT_NEXT; // OK, but enumeration not complete, interrupt walk
 
 ERR_PROBE_DUP:
+ERR_SEND_TESTING_FLOWS:
     return LATTICE_ERROR;
 }
 
@@ -339,7 +781,14 @@ static int mda_classify(lattice_elt_t * elt, mda_data_t * data)
 static lattice_return_t mda_process_interface(lattice_elt_t * elt, void * data)
 {
     mda_data_t       * mda_data = data;
+    mda_interface_t  * interface = lattice_elt_get_data(elt);
     lattice_return_t   ret;
+    uint8_t            ttl;
+
+    // Streaming: this IP hop and its outgoing links are complete
+    if (interface->is_released) {
+        return LATTICE_DONE;
+    }
 
     // 1) Enumeration phase:
     //
@@ -367,6 +816,11 @@ static lattice_return_t mda_process_interface(lattice_elt_t * elt, void * data)
         goto ERR_CLASSIFY;
     }
 
+    if (mda_data->stream && ret != LATTICE_DONE) {
+        ttl = mda_interface_get_min_ttl(interface);
+        if (ttl < mda_data->min_pending_ttl) mda_data->min_pending_ttl = ttl;
+    }
+
     return ret;
 
 ERR_FIND_NEXT_HOPS:
@@ -374,79 +828,63 @@ ERR_CLASSIFY:
     return LATTICE_ERROR;
 }
 
-static lattice_return_t mda_search_source(lattice_elt_t * elt, void * data)
+/**
+ * \brief Release the IP hops whose TTLs are all lower than
+ *    mda_data->released_ttl and raise the corresponding MDA_HOP_COMPLETED.
+ * \param elt The lattice node of an IP hop.
+ * \param data The data of the mda instance.
+ * \return The lattice_walk() instruction.
+ */
+
+static lattice_return_t mda_release_interface(lattice_elt_t * elt, void * data)
 {
-    mda_interface_t   * interface = lattice_elt_get_data(elt);
-    mda_search_data_t * search    = data;
-    mda_flow_t        * mda_flow;
-    mda_ttl_flow_t    * mda_ttl_flow;
-    size_t              i, j, size;
-    uint8_t             ttl;
+    mda_data_t      * mda_data = data;
+    mda_interface_t * interface = lattice_elt_get_data(elt);
 
-    for (i = 0; i < interface->num_ttls; ++i) {
-        ttl = interface->ttl_set[i];
-        if (ttl == search->ttl) {
-            size = dynarray_get_size(interface->ttl_flows);
-            for (j = 0; j < size; j++) {
-                mda_ttl_flow = dynarray_get_ith_element(interface->ttl_flows, j);
-                mda_flow = mda_ttl_flow->mda_flow;
-                if ((mda_flow->flow_id == search->flow_id) 
-                && (mda_ttl_flow->ttl == search->ttl)
-                &&  (mda_flow->state != MDA_FLOW_TESTING)) {
-                    search->result = elt;
-                    return LATTICE_INTERRUPT_ALL;
-                }
-            }
+    // The next hops are even farther
+    if (mda_interface_get_min_ttl(interface) >= mda_data->released_ttl) {
+        return LATTICE_INTERRUPT_NEXT;
+    }
 
-            /**
-             * Note: Awkward check is needed because in the case of nodes with
-             * multiple ttl_set, it is possible for a pair of nodes to have the
-             * same ttl while simultaneously being in a parent/child
-             * relationship. Thus, if the parent is searched unsuccessfuly at
-             * the correct ttl, we still must search the child as it could
-             * have both the correct ttl and the correct flow_id. - T.D.
-             */
-            if (interface->num_ttls == 1) {
-                return LATTICE_INTERRUPT_NEXT; // don't process children
-            }
+    if (!interface->is_released && mda_interface_get_max_ttl(interface) < mda_data->released_ttl) {
+        if (!mda_raise_event(mda_data, MDA_HOP_COMPLETED, mda_hop_event_create(
+            interface, mda_interface_get_min_ttl(interface), lattice_elt_get_num_next(elt)
+        ))) {
+            return LATTICE_ERROR;
         }
+        mda_data_release_interface(mda_data, elt);
     }
-    return LATTICE_CONTINUE; // continue until we reach the right ttl
+
+    return LATTICE_CONTINUE;
 }
 
-static lattice_return_t mda_delete_flow(lattice_elt_t * elt, void * data)
-{
-    mda_interface_t    * interface = lattice_elt_get_data(elt);
-    mda_search_data_t  * search    = data;
-    mda_flow_t         * mda_flow;
-    mda_ttl_flow_t     * mda_ttl_flow;
-    size_t               i, j, size;
-    uint8_t              ttl;
+/**
+ * \brief Release the IP hops which can no longer be involved in the
+ *    enumeration (streaming mode). An IP hop lends its flows to its next
+ *    hops and the MDA-Lite tests of a hop involve the next two TTLs, hence
+ *    an IP hop is released once the hops of the next MDA_STREAM_MARGIN
+ *    TTLs are complete.
+ * \param mda_data The data of the mda instance.
+ * \param released_ttl The IP hops whose TTLs are all lower than this value
+ *    are released.
+ * \return true iif successful.
+ */
 
-    for (i = 0; i < interface->num_ttls; ++i) {
-        ttl = interface->ttl_set[i];
-        if (ttl == search->ttl) {
-            size = dynarray_get_size(interface->ttl_flows);
-            for (j = 0; j < size; j++) {
-                mda_ttl_flow = dynarray_get_ith_element(interface->ttl_flows, j);
-                mda_flow     = mda_ttl_flow->mda_flow;
-                if ((mda_flow->flow_id == search->flow_id) && (mda_flow->state == MDA_FLOW_TESTING)) {
-                    dynarray_del_ith_element(interface->ttl_flows, j, (ELEMENT_FREE) mda_ttl_flow_free);
-                    return LATTICE_INTERRUPT_ALL;
-                }
-            }
-            return LATTICE_INTERRUPT_NEXT; // don't process children
-        }
+static bool mda_release_interfaces(mda_data_t * mda_data, unsigned released_ttl)
+{
+    if (released_ttl <= mda_data->released_ttl) {
+        return true;
     }
-    return LATTICE_CONTINUE; // continue until we reach the right ttl
+
+    mda_data->released_ttl = released_ttl;
+    return lattice_walk(mda_data->lattice, mda_release_interface, mda_data, LATTICE_WALK_DFS) != LATTICE_ERROR;
 }
 
 static lattice_return_t mda_timeout_flow(lattice_elt_t * elt, void * data)
 {
     mda_interface_t    * interface = lattice_elt_get_data(elt);
     mda_search_data_t  * search    = data;
-    mda_flow_t         * mda_flow;
-    mda_ttl_flow_t     * mda_ttl_flow;
+    const mda_flow_t   * mda_flow;
     size_t               i, j, size;
     uint8_t              ttl;
 
@@ -454,12 +892,11 @@ static lattice_return_t mda_timeout_flow(lattice_elt_t * elt, void * data)
         ttl = interface->ttl_set[i];
 
         if (ttl == search->ttl) {
-            size = dynarray_get_size(interface->ttl_flows);
+            size = mda_interface_get_num_ttl_flows(interface);
             for (j = 0; j < size; j++) {
-                mda_ttl_flow = dynarray_get_ith_element(interface->ttl_flows, j);
-                mda_flow     = mda_ttl_flow->mda_flow;
+                mda_flow = &mda_interface_get_ith_ttl_flow(interface, j)->mda_flow;
                 if ((mda_flow->flow_id == search->flow_id) && (mda_flow->state == MDA_FLOW_UNAVAILABLE)) {
-                    mda_flow->state = MDA_FLOW_TIMEOUT;
+                    mda_interface_set_ith_flow_state(interface, j, MDA_FLOW_TIMEOUT);
                     return LATTICE_INTERRUPT_ALL;
                 }
             }
@@ -469,18 +906,6 @@ static lattice_return_t mda_timeout_flow(lattice_elt_t * elt, void * data)
     return LATTICE_CONTINUE; // continue until we reach the right ttl
 }
 
-static lattice_return_t mda_search_interface(lattice_elt_t * elt, void * data)
-{
-    mda_interface_t * interface = lattice_elt_get_data(elt);
-    mda_address_t   * search    = data;
-
-    if (interface->address && address_compare(interface->address, search->address) == 0) {
-        search->result = elt;
-        return LATTICE_INTERRUPT_ALL;
-    }
-    return LATTICE_CONTINUE;
-}
-
 //---------------------------------------------------------------------------
 // mda handlers
 //---------------------------------------------------------------------------
@@ -514,22 +939,27 @@ static void mda_handler_init(pt_loop_t * loop, event_t * event, mda_data_t ** pd
     // Create local data structure
     if (!(data = mda_data_create()))                    goto ERR_MDA_DATA_CREATE;
     if (!(probe_extract(skel, "dst_ip", data->dst_ip))) goto ERR_EXTRACT_DST_IP;
+    if (!(probe_extract(skel, "src_ip", data->src_ip))) goto ERR_EXTRACT_SRC_IP;
 
     // Initialize algorithm's data
-    data->skel = skel;
-    data->loop = loop;
+    data->skel     = skel;
+    data->loop     = loop;
+    data->pipeline = options->pipeline;
+    data->lite     = options->lite;
+    data->stream   = options->stream;
     *pdata = data;
 
     // Create a dummy first hop, root of a lattice of discovered interfaces:
     // - not a tree since some interfaces might have several predecessors (diamonds)
     // - we assume the initial hop is not a load balancer
-    if (!lattice_add_element(data->lattice, NULL, mda_interface_create(NULL))) {
+    if (!mda_data_add_interface(data, NULL, mda_interface_create(NULL))) {
         goto ERR_LATTICE_ADD_ELEMENT;
     }
 
     return;
 
 ERR_LATTICE_ADD_ELEMENT:
+ERR_EXTRACT_SRC_IP:
 ERR_EXTRACT_DST_IP:
     mda_data_free(data);
 ERR_MDA_DATA_CREATE:
@@ -553,14 +983,9 @@ static void mda_handler_reply(pt_loop_t * loop, event_t * event, mda_data_t * da
                      * dest_elt;
     mda_interface_t  * source_interface,
                      * dest_interface;
-    mda_search_data_t  search_ttl_flow;
-    mda_address_t      search_interface;
-    mda_ttl_flow_t   * mda_ttl_flow;
-    mda_flow_t       * mda_flow;
     address_t          addr;
     uint16_t           flow_id_u16;
     uint8_t            ttl, src_ttl;
-    int                ret;
     size_t             i, j;
 
     probe = ((const probe_reply_t *) event->data)->probe;
@@ -579,33 +1004,22 @@ static void mda_handler_reply(pt_loop_t * loop, event_t * event, mda_data_t * da
      *  - probe->flow_id : disambiguate between several possible
      *      interfaces at the same ttl, since one flow_id will typically
      *      pass though one only.
-     *  The corresponding addr is searched thanks to
-     *  mda_interface_find_rec, recursively from the root interface
+     *  The corresponding interface is retrieved thanks to data->flows.
      *
-     *  destination: reply->src_ip
+     *  destination: reply->src_ip, retrieved thanks to data->interfaces.
      */
 
-    search_interface.address = &addr;
-    search_interface.result = NULL;
-    ret = lattice_walk(data->lattice, mda_search_interface, &search_interface, LATTICE_WALK_DFS);
-    if (ret == LATTICE_INTERRUPT_ALL) {
+    if ((dest_elt = mda_data_get_interface(data, &addr))) {
         // Destination found
-        dest_elt = search_interface.result;
         dest_interface = lattice_elt_get_data(dest_elt);
     } else {
-        dest_elt = NULL;
         dest_interface = mda_interface_create(&addr);
         dest_interface->ttl_set[0] = ttl; // This interface's first ttl (messy way of doing it: 
                                        // create technically makes first ttl 0, this overwrites).
     }
 
-    search_ttl_flow.ttl = ttl - 1;
-    search_ttl_flow.flow_id = flow_id_u16;
-    search_ttl_flow.result = NULL;
-    ret = lattice_walk(data->lattice, mda_search_source, &search_ttl_flow, LATTICE_WALK_DFS);
-    if (ret == LATTICE_INTERRUPT_ALL) {
+    if ((source_elt = mda_data_get_flow_interface(data, ttl - 1, flow_id_u16))) {
         // Found
-        source_elt = search_ttl_flow.result;
         source_interface = lattice_elt_get_data(source_elt);
 
         if (dest_elt) {
@@ -647,48 +1061,56 @@ static void mda_handler_reply(pt_loop_t * loop, event_t * event, mda_data_t * da
              */
 
         } else {
-            if (!lattice_add_element(data->lattice, source_elt, dest_interface)) {
+            if (!(dest_elt = mda_data_add_interface(data, source_elt, dest_interface))) {
                 goto ERR_LATTICE_ADD_ELEMENT;
             }
+            if (!mda_event_new_hop(data, dest_interface, ttl)) {
+                goto ERR_MDA_EVENT_NEW_HOP;
+            }
         }
 
         source_interface->received++;
 
+        if (!mda_event_link_probed(
+            data, source_interface, dest_interface, ttl, flow_id_u16,
+            1000 * (probe_get_recv_time(reply) - probe_get_sending_time(probe))
+        )) {
+            goto ERR_MDA_EVENT_LINK_PROBED;
+        }
+
         // We have received the last needed flow
-        if (source_interface->received + source_interface->timeout == source_interface->sent) {
-            if (!mda_event_new_link(loop, source_interface, dest_interface)) {
+        if (source_interface->received + source_interface->timeout == source_interface->sent
+        &&  mda_interface_has_sent_enough(source_elt, data)) {
+            if (!mda_event_new_link(data, source_interface, dest_interface)) {
                 goto ERR_MDA_EVENT_NEW_LINK;
             }
         }
     }
 
-    // Insert flow in the right interface
-    if (!(mda_flow = mda_flow_create(flow_id_u16, MDA_FLOW_AVAILABLE))) {
-        goto ERR_MDA_FLOW_CREATE;
+    // Insert flow in the right interface. If the source is unknown, the
+    // newly created interface is not reachable from the lattice.
+    if (!dest_elt) {
+        goto ERR_UNKNOWN_SOURCE;
     }
 
-    if (!(mda_ttl_flow = mda_ttl_flow_create(ttl, mda_flow))) {
-        goto ERR_MDA_TTL_FLOW_CREATE;
-    }
-
-    if (!dynarray_push_element(dest_interface->ttl_flows, mda_ttl_flow)) {
-        goto ERR_DYNARRAY_PUSH_ELEMENT;
+    if (!mda_data_add_flow(data, dest_elt, ttl, flow_id_u16, MDA_FLOW_AVAILABLE)) {
+        goto ERR_MDA_DATA_ADD_FLOW;
     }
 
     // Delete flow in all siblings. Right?
-    search_ttl_flow.ttl = ttl;
-    search_ttl_flow.flow_id = flow_id_u16;
-    search_ttl_flow.result = NULL;
-    lattice_walk(data->lattice, mda_delete_flow, &search_ttl_flow, LATTICE_WALK_DFS);
+    mda_data_del_testing_flow(data, ttl, flow_id_u16);
 
+    // Remember this hop for the next instances toward this destination
+    topology_cache_add(data->topology_cache, data->src_ip, data->dst_ip, ttl, flow_id_u16, &addr);
     return;
 
-ERR_DYNARRAY_PUSH_ELEMENT:
-    mda_flow_free(mda_flow);
-ERR_MDA_TTL_FLOW_CREATE:
-ERR_MDA_FLOW_CREATE:
-ERR_MDA_EVENT_NEW_LINK:
 ERR_LATTICE_ADD_ELEMENT:
+ERR_UNKNOWN_SOURCE:
+    mda_interface_free(dest_interface);
+ERR_MDA_DATA_ADD_FLOW:
+ERR_MDA_EVENT_NEW_LINK:
+ERR_MDA_EVENT_LINK_PROBED:
+ERR_MDA_EVENT_NEW_HOP:
 ERR_LATTICE_CONNECT:
 ERR_EXTRACT_SRC_IP:
 ERR_EXTRACT_FLOW_ID:
@@ -704,7 +1126,6 @@ static void mda_handler_timeout(pt_loop_t *loop, event_t *event, mda_data_t * da
     mda_search_data_t       search_ttl_flow;
     uint16_t                flow_id_u16 = 0;
     uint8_t                 ttl;
-    int                     ret;
     size_t                  i, num_next;
 
     probe = event->data;
@@ -712,23 +1133,24 @@ static void mda_handler_timeout(pt_loop_t *loop, event_t *event, mda_data_t * da
     if (!(probe_extract(probe, "ttl",     &ttl)))     goto ERR_EXTRACT_TTL;
     if (!(probe_extract(probe, "flow_id", &flow_id_u16))) goto ERR_EXTRACT_FLOW_ID;
 
-    search_ttl_flow.ttl = ttl - 1;
-    search_ttl_flow.flow_id = flow_id_u16;
-    search_ttl_flow.result = NULL;
-    ret = lattice_walk(data->lattice, mda_search_source, &search_ttl_flow, LATTICE_WALK_DFS);
-    if (ret == LATTICE_INTERRUPT_ALL) {
+    if ((source_elt = mda_data_get_flow_interface(data, ttl - 1, flow_id_u16))) {
         // Found
-        source_elt = search_ttl_flow.result;
         source_interface = lattice_elt_get_data(source_elt);
         source_interface->timeout++;
 
+        if (!mda_event_link_probed(data, source_interface, NULL, ttl, flow_id_u16, 0)) {
+            goto ERROR;
+        }
+
         // Mark the flow as timeout
         search_ttl_flow.ttl = ttl - 1;
         search_ttl_flow.flow_id = flow_id_u16;
         search_ttl_flow.result = NULL;
         mda_timeout_flow(source_elt, &search_ttl_flow);
 
-        if (source_interface->timeout == source_interface->sent) { // XXX to_send ??
+        if (!mda_interface_has_sent_enough(source_elt, data)) {
+            // More probes will be sent through this interface.
+        } else if (source_interface->timeout == source_interface->sent) { // XXX to_send ??
             // All timeouts, we need to add a star interface, and start a new
             // discovery at the next ttl. Currently, that supposes we have only
             // one interface...
@@ -739,14 +1161,18 @@ static void mda_handler_timeout(pt_loop_t *loop, event_t *event, mda_data_t * da
 
                 new_iface->num_stars = source_interface->num_stars + 1;
 
-                if (!lattice_add_element(data->lattice, source_elt, new_iface)) {
+                if (!mda_data_add_interface(data, source_elt, new_iface)) {
                     goto ERROR;
                 }
 
-                if (!mda_event_new_link(loop, source_interface, new_iface)) {
+                if (!mda_event_new_hop(data, new_iface, ttl)) {
                     goto ERROR;
                 }
-            } else if (!mda_event_new_link(loop, source_interface, NULL)) {
+
+                if (!mda_event_new_link(data, source_interface, new_iface)) {
+                    goto ERROR;
+                }
+            } else if (!mda_event_new_link(data, source_interface, NULL)) {
                 goto ERROR;
             }
         } else if (source_interface->timeout + source_interface->received == source_interface->sent) {
@@ -756,7 +1182,7 @@ static void mda_handler_timeout(pt_loop_t *loop, event_t *event, mda_data_t * da
             for (i = 0; i < num_next; i++) {
                 lattice_elt_t   * next_elt = dynarray_get_ith_element(source_elt->next, i);
                 mda_interface_t * next_iface = lattice_elt_get_data(next_elt);
-                if (!mda_event_new_link(loop, source_interface, next_iface)) {
+                if (!mda_event_new_link(data, source_interface, next_iface)) {
                     goto ERROR;
                 }
             }
@@ -769,9 +1195,14 @@ static void mda_handler_timeout(pt_loop_t *loop, event_t *event, mda_data_t * da
         search_ttl_flow.result = NULL;
 
         // Mark the flow as timeout
-        lattice_walk(data->lattice, mda_timeout_flow, &search_ttl_flow, LATTICE_WALK_DFS);
+        if ((source_elt = mda_data_get_flow_interface(data, ttl, flow_id_u16))) {
+            mda_timeout_flow(source_elt, &search_ttl_flow);
+        }
     }
 
+    // A flow sent to find flows reaching an IP hop has expired: this IP
+    // hop must not wait for it anymore.
+    mda_data_expire_testing_flow(data, ttl, flow_id_u16);
     return;
 
 ERROR:
@@ -822,17 +1253,37 @@ int mda_handler(pt_loop_t * loop, event_t * event, void ** pdata, probe_t * skel
             return 0;
     }
 
-    // Process available interfaces
-    switch (lattice_walk(data->lattice, mda_process_interface, data, LATTICE_WALK_DFS)) {
+    // Process available interfaces. In pipeline mode, hops are visited
+    // level by level so that we know whether a previous hop is incomplete.
+    data->num_incomplete  = 0;
+    data->min_pending_ttl = UINT8_MAX;
+    switch (lattice_walk(data->lattice, mda_process_interface, data, data->pipeline ? LATTICE_WALK_BFS : LATTICE_WALK_DFS)) {
         case LATTICE_ERROR:
             fprintf(stderr, "mda_handler: LATTICE_ERROR\n");
             return -1;
         case LATTICE_DONE:  break;
-        default:            return 0;
+        default:            goto PENDING;
+    }
+
+    if (data->num_incomplete > 0) {
+        goto PENDING;
+    }
+
+    // Every IP hop is complete
+    if (data->stream && !mda_release_interfaces(data, UINT8_MAX + 1)) {
+        return -1;
     }
 
     pt_raise_terminated(loop);
     return 0;
+
+PENDING:
+    if (data->stream
+    &&  data->min_pending_ttl > MDA_STREAM_MARGIN
+    && !mda_release_interfaces(data, data->min_pending_ttl - MDA_STREAM_MARGIN)) {
+        return -1;
+    }
+    return 0;
 }
 
 static algorithm_t mda = {
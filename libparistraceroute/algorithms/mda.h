@@ -2,6 +2,7 @@
 #define LIBPT_ALGORITHMS_MDA_H
 
 #include "mda/data.h"
+#include "mda/event.h"
 #include "mda/flow.h"
 #include "mda/interface.h"
 #include "traceroute.h"
@@ -11,6 +12,12 @@
 //mda command line help messages
 #define HELP_B "Multipath tracing  bound: an upper bound on the probability that multipath tracing will fail to find all of the paths (default 0.05) max_branch: the maximum number of branching points that can be encountered for the bound still to hold (default 5)"
 
+#define HELP_mda_pipeline "Multipath tracing: probe the next hops of an IP hop with the flows known to reach it before the previous hops are fully enumerated."
+
+#define HELP_mda_stream "Multipath tracing: report each discovered IP hop, each probed link and each completed IP hop as soon as possible, and release the flows of the completed IP hops."
+
+#define HELP_mda_lite "Multipath tracing: use MDA-Lite, i.e. hop-level stopping points, and only fall back to the full MDA at meshed or non-uniform hops."
+
 //                                   def1 min1 max1 def2 min2 max2     def3  min3 max3     mda_enabled
 #define OPTIONS_MDA_BOUND_MAXBRANCH {95,  0,   100, 5,   1,   INT_MAX, 128,  1,   INT_MAX, 0}
 
@@ -19,10 +26,16 @@ typedef struct {
     unsigned             bound;
     unsigned             max_branch;
     unsigned             max_children;
+    bool                 pipeline;    /**< Enumerate several hops in parallel */
+    bool                 lite;        /**< Use MDA-Lite stopping points */
+    bool                 stream;      /**< Raise streaming events and release completed IP hops */
 } mda_options_t;
 
 typedef enum {
-    MDA_NEW_LINK
+    MDA_NEW_LINK,      /**< data: mda_interface_t *[2] (see mda_link_dump), not raised in streaming mode */
+    MDA_NEW_HOP,       /**< data: mda_hop_event_t *, streaming mode only */
+    MDA_LINK_PROBED,   /**< data: mda_link_event_t *, streaming mode only */
+    MDA_HOP_COMPLETED  /**< data: mda_hop_event_t *, streaming mode only. No more link starts from this IP hop. */
 } mda_event_type_t;
 
 typedef struct {
@@ -35,6 +48,9 @@ typedef struct {
 unsigned options_mda_get_bound();
 unsigned options_mda_get_max_branch();
 unsigned options_mda_get_is_set();
+bool     options_mda_get_pipeline();
+bool     options_mda_get_lite();
+bool     options_mda_get_stream();
 
 const option_t * mda_get_options();
 
@@ -308,6 +308,68 @@ void bound_build(bound_t * bound, size_t end)
         fprintf(stderr, "Provided bound struct contained null values or was itself null\n");
 }
 
+//--------------------------------------------------------------------------
+// Shared bounds
+//--------------------------------------------------------------------------
+
+// Stopping points only depend on (confidence, max_branch), and a table
+// built for n hypotheses is a prefix of the tables built for more
+// hypotheses. Thus a single bound_t instance per (confidence, max_branch)
+// is built (and possibly expanded) for the whole process.
+
+typedef struct bound_shared_s {
+    double                  confidence; /**< Graph-wide failure confidence */
+    size_t                  max_branch; /**< Max number of branching points */
+    bound_t               * bound;      /**< The corresponding stopping points */
+    struct bound_shared_s * next;       /**< Next shared bound */
+} bound_shared_t;
+
+static bound_shared_t * bound_shared = NULL;
+
+bound_t * bound_get_shared(double confidence, size_t max_interfaces, size_t max_branch)
+{
+    bound_shared_t * shared;
+
+    for (shared = bound_shared; shared; shared = shared->next) {
+        if (shared->confidence == confidence && shared->max_branch == max_branch) {
+            if (shared->bound->max_n < max_interfaces) {
+                bound_build(shared->bound, max_interfaces);
+            }
+            return shared->bound;
+        }
+    }
+
+    if (!(shared = malloc(sizeof(bound_shared_t)))) goto ERR_MALLOC;
+    if (!(shared->bound = bound_create(confidence, max_interfaces, max_branch))) {
+        goto ERR_BOUND_CREATE;
+    }
+    shared->confidence = confidence;
+    shared->max_branch = max_branch;
+    shared->next       = bound_shared;
+    bound_shared       = shared;
+    return shared->bound;
+
+ERR_BOUND_CREATE:
+    free(shared);
+ERR_MALLOC:
+    return NULL;
+}
+
+void bound_free_shared()
+{
+    bound_shared_t * shared;
+
+    while ((shared = bound_shared)) {
+        bound_shared = shared->next;
+        bound_free(shared->bound);
+        free(shared);
+    }
+}
+
+//--------------------------------------------------------------------------
+// Accessors
+//--------------------------------------------------------------------------
+
 size_t bound_get_nk(bound_t * bound, size_t k)
 {
     size_t ret = 0;
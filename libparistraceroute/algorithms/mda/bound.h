@@ -50,6 +50,25 @@ typedef struct {
 
 bound_t * bound_create(double confidence, size_t max_interfaces, size_t max_branch);
 
+/**
+ * \brief Retrieve the bound_t structure shared by the whole process for a
+ *    given (confidence, max_branch). It is built the first time it is
+ *    requested, and expanded if it does not cover max_interfaces.
+ * \param confidence User-specified failure confidence
+ * \param max_interfaces User-specified max branching at an interface
+ * \param max_branch User-specified max number of branching points in network
+ * \return Reference to the shared bound_t structure (released by
+ *    bound_free_shared), NULL in case of failure
+ */
+
+bound_t * bound_get_shared(double confidence, size_t max_interfaces, size_t max_branch);
+
+/**
+ * \brief Free every bound_t structure returned by bound_get_shared
+ */
+
+void bound_free_shared();
+
 /**
  * \brief Compute stopping points
  * \param bound Reference to bound_t structure
@@ -1,10 +1,59 @@
+#include <stdio.h>          // fprintf
 #include <stdlib.h>
+#include <stdint.h>         // uintptr_t
 #include "data.h"
 #include "interface.h"
 #include "../mda.h"
 
 #define PERCENT_TO_INVERSE_DECIMAL(X) ((double)(100 - (X)) / 100.0)
 
+//---------------------------------------------------------------------------
+// Indexes (internal usage)
+//---------------------------------------------------------------------------
+
+// Flows are indexed by (ttl, flow_id). The flow_id never exceeds
+// MDA_MAX_FLOW_ID (see mda_data_add_flow), hence the key fits in a pointer
+// and the hashtable_t instances do not refer to the ttl/flow tuples (which
+// move when ttl_flows grows).
+
+#define MDA_FLOW_KEY(ttl, flow_id) \
+    ((const void *) (uintptr_t) (((uintptr_t) (ttl) << 16) | (uintptr_t) (flow_id)))
+
+static size_t mda_flow_key_hash(const void * key) {
+    return hash_uint64((uintptr_t) key);
+}
+
+static int mda_flow_key_compare(const void * key1, const void * key2) {
+    return (uintptr_t) key1 < (uintptr_t) key2 ? -1 :
+           (uintptr_t) key1 > (uintptr_t) key2 ?  1 : 0;
+}
+
+/**
+ * \brief Retrieve the index in which a flow is stored according to its state.
+ * \param data A mda_data_t instance.
+ * \param state The state of the flow.
+ * \return The corresponding index.
+ */
+
+static inline hashtable_t * mda_data_get_flow_index(const mda_data_t * data, mda_flow_state_t state) {
+    return state == MDA_FLOW_TESTING ? data->testing_flows : data->flows;
+}
+
+/**
+ * \brief Retrieve the lattice node stored in an index for a given flow.
+ * \param data A mda_data_t instance.
+ * \param state The state of the flow.
+ * \param key The key of the flow (see MDA_FLOW_KEY).
+ * \return The corresponding lattice node, NULL if not found.
+ */
+
+static lattice_elt_t * mda_data_find_flow_elt(const mda_data_t * data, mda_flow_state_t state, const void * key) {
+    const mda_testing_flow_t * testing_flow;
+
+    if (state != MDA_FLOW_TESTING) return hashtable_find(data->flows, key);
+    return (testing_flow = hashtable_find(data->testing_flows, key)) ? testing_flow->elt : NULL;
+}
+
 mda_data_t * mda_data_create()
 {
     double        failure;
@@ -23,23 +72,52 @@ mda_data_t * mda_data_create()
         goto ERR_ADDRESS_CREATE;
     }
 
+    if (!(data->src_ip = address_create())) {
+        goto ERR_SRC_IP_CREATE;
+    }
+
+    if (!(data->interfaces = hashtable_create(address_hash, address_compare))) {
+        goto ERR_INTERFACES_CREATE;
+    }
+
+    if (!(data->flows = hashtable_create(mda_flow_key_hash, mda_flow_key_compare))) {
+        goto ERR_FLOWS_CREATE;
+    }
+
+    if (!(data->testing_flows = hashtable_create(mda_flow_key_hash, mda_flow_key_compare))) {
+        goto ERR_TESTING_FLOWS_CREATE;
+    }
+
     // Options
     options_mda_init(&mda_options);
 
     failure = PERCENT_TO_INVERSE_DECIMAL(mda_options.bound);
 
-    if (!(data->bound = bound_create(
-        failure, 
-        mda_options.max_children, 
+    if (!(data->bound = bound_get_shared(
+        failure,
+        mda_options.max_children,
         mda_options.max_branch
     ))) {
         goto ERR_BOUND_CREATE;
     }
 
+    if (!(data->topology_cache = topology_cache_get_shared())) {
+        goto ERR_TOPOLOGY_CACHE;
+    }
+
     return data;
 
+ERR_TOPOLOGY_CACHE:
 ERR_BOUND_CREATE:
-    address_free(data->dst_ip); 
+    hashtable_free(data->testing_flows, NULL);
+ERR_TESTING_FLOWS_CREATE:
+    hashtable_free(data->flows, NULL);
+ERR_FLOWS_CREATE:
+    hashtable_free(data->interfaces, NULL);
+ERR_INTERFACES_CREATE:
+    address_free(data->src_ip);
+ERR_SRC_IP_CREATE:
+    address_free(data->dst_ip);
 ERR_ADDRESS_CREATE:
     lattice_free(data->lattice, (ELEMENT_FREE) mda_interface_free);
 ERR_LATTICE_CREATE:
@@ -51,9 +129,209 @@ ERR_MALLOC:
 void mda_data_free(mda_data_t * data)
 {
     if (data) {
+        hashtable_free(data->testing_flows, free);
+        hashtable_free(data->flows, NULL);
+        hashtable_free(data->interfaces, NULL);
         lattice_free(data->lattice, (ELEMENT_FREE) mda_interface_free);
+        address_free(data->src_ip);
         address_free(data->dst_ip);
         free(data);
     }
 }
 
+lattice_elt_t * mda_data_add_interface(mda_data_t * data, lattice_elt_t * predecessor, mda_interface_t * interface)
+{
+    lattice_elt_t * elt;
+
+    if (!(elt = lattice_add_element(data->lattice, predecessor, interface))) {
+        goto ERR_LATTICE_ADD_ELEMENT;
+    }
+
+    // Stars (interfaces without address) are never searched by address
+    if (interface->address && !hashtable_update(data->interfaces, interface->address, elt)) {
+        goto ERR_HASHTABLE_UPDATE;
+    }
+
+    return elt;
+
+ERR_HASHTABLE_UPDATE:
+ERR_LATTICE_ADD_ELEMENT:
+    return NULL;
+}
+
+lattice_elt_t * mda_data_get_interface(const mda_data_t * data, const address_t * address)
+{
+    return hashtable_find(data->interfaces, address);
+}
+
+bool mda_data_add_flow(mda_data_t * data, lattice_elt_t * elt, uint8_t ttl, uintmax_t flow_id, mda_flow_state_t state)
+{
+    mda_interface_t    * interface = lattice_elt_get_data(elt);
+    hashtable_t        * index = mda_data_get_flow_index(data, state);
+    const void         * key = MDA_FLOW_KEY(ttl, flow_id);
+    mda_testing_flow_t * testing_flow = NULL;
+    void               * value = elt;
+
+    // Two flow identifiers would share the same key and the same probes.
+    if (flow_id > MDA_MAX_FLOW_ID) {
+        fprintf(stderr, "mda_data_add_flow: invalid flow identifier %ju\n", flow_id);
+        goto ERR_FLOW_ID;
+    }
+
+    // If several interfaces are reached by the same flow (e.g. per-packet
+    // load balancing), the first one is kept.
+    if (!hashtable_find(index, key)) {
+        // A flow being tested is deleted once answered: its position
+        // avoids to search it in the flows of the interface.
+        if (state == MDA_FLOW_TESTING) {
+            if (!(testing_flow = malloc(sizeof(mda_testing_flow_t)))) goto ERR_MALLOC;
+            testing_flow->elt   = elt;
+            testing_flow->index = mda_interface_get_num_ttl_flows(interface);
+            value = testing_flow;
+        }
+        if (!hashtable_update(index, key, value)) {
+            goto ERR_HASHTABLE_UPDATE;
+        }
+    }
+
+    if (!mda_interface_add_flow_id(interface, ttl, flow_id, state)) {
+        goto ERR_ADD_FLOW_ID;
+    }
+
+    return true;
+
+ERR_ADD_FLOW_ID:
+    if (hashtable_find(index, key) == value) hashtable_erase(index, key);
+ERR_HASHTABLE_UPDATE:
+    free(testing_flow);
+ERR_MALLOC:
+ERR_FLOW_ID:
+    return false;
+}
+
+bool mda_data_is_flow_used(const mda_data_t * data, uint8_t ttl, uintmax_t flow_id)
+{
+    const void * key = MDA_FLOW_KEY(ttl, flow_id);
+
+    // Such a flow cannot be sent
+    if (flow_id > MDA_MAX_FLOW_ID) return true;
+    return hashtable_find(data->flows, key) || hashtable_find(data->testing_flows, key);
+}
+
+uintmax_t mda_data_get_new_flow_id(mda_data_t * data, uint8_t ttl)
+{
+    uintmax_t flow_id;
+
+    // Flows reused from previous instances may already have taken this
+    // flow identifier.
+    do {
+        if (data->last_flow_id == MDA_MAX_FLOW_ID) return 0;
+        flow_id = ++data->last_flow_id;
+    } while (mda_data_is_flow_used(data, ttl, flow_id));
+
+    return flow_id;
+}
+
+lattice_elt_t * mda_data_get_flow_interface(const mda_data_t * data, uint8_t ttl, uintmax_t flow_id)
+{
+    if (flow_id > MDA_MAX_FLOW_ID) return NULL;
+    return hashtable_find(data->flows, MDA_FLOW_KEY(ttl, flow_id));
+}
+
+/**
+ * \brief Remove a flow being tested from data->testing_flows.
+ * \param data A mda_data_t instance.
+ * \param key The key of the flow (see MDA_FLOW_KEY).
+ * \param pelt Points to the lattice node owning the flow.
+ * \param pi Points to the position of the flow in the flows of this node.
+ * \return true iif such a flow has been found.
+ */
+
+static bool mda_data_erase_testing_flow(mda_data_t * data, const void * key, lattice_elt_t ** pelt, size_t * pi)
+{
+    mda_testing_flow_t    * testing_flow;
+    const mda_ttl_flow_t  * mda_ttl_flow;
+    const mda_interface_t * interface;
+
+    if (!(testing_flow = hashtable_erase(data->testing_flows, key))) {
+        return false;
+    }
+
+    *pelt = testing_flow->elt;
+    *pi   = testing_flow->index;
+    free(testing_flow);
+
+    interface = lattice_elt_get_data(*pelt);
+    if (*pi >= mda_interface_get_num_ttl_flows(interface)) return false;
+    mda_ttl_flow = mda_interface_get_ith_ttl_flow(interface, *pi);
+    return mda_ttl_flow->mda_flow.state == MDA_FLOW_TESTING
+        && MDA_FLOW_KEY(mda_ttl_flow->ttl, mda_ttl_flow->mda_flow.flow_id) == key;
+}
+
+bool mda_data_expire_testing_flow(mda_data_t * data, uint8_t ttl, uintmax_t flow_id)
+{
+    const void      * key = MDA_FLOW_KEY(ttl, flow_id);
+    lattice_elt_t   * elt;
+    size_t            i;
+
+    if (!mda_data_erase_testing_flow(data, key, &elt, &i)) {
+        return false;
+    }
+
+    mda_interface_set_ith_flow_state(lattice_elt_get_data(elt), i, MDA_FLOW_TIMEOUT);
+    if (!hashtable_find(data->flows, key)) {
+        hashtable_update(data->flows, key, elt);
+    }
+    return true;
+}
+
+void mda_data_release_interface(mda_data_t * data, lattice_elt_t * elt)
+{
+    mda_interface_t      * interface = lattice_elt_get_data(elt);
+    const mda_ttl_flow_t * mda_ttl_flow;
+    hashtable_t          * index;
+    const void           * key;
+    void                 * value;
+    size_t                 i, num_flows = mda_interface_get_num_ttl_flows(interface);
+
+    for (i = 0; i < num_flows; i++) {
+        mda_ttl_flow = mda_interface_get_ith_ttl_flow(interface, i);
+        index = mda_data_get_flow_index(data, mda_ttl_flow->mda_flow.state);
+        key   = MDA_FLOW_KEY(mda_ttl_flow->ttl, mda_ttl_flow->mda_flow.flow_id);
+        if (mda_data_find_flow_elt(data, mda_ttl_flow->mda_flow.state, key) == elt) {
+            value = hashtable_erase(index, key);
+            if (index == data->testing_flows) free(value);
+        }
+    }
+
+    mda_interface_free_flows(interface);
+    interface->is_released = true;
+}
+
+bool mda_data_del_testing_flow(mda_data_t * data, uint8_t ttl, uintmax_t flow_id)
+{
+    const void           * key = MDA_FLOW_KEY(ttl, flow_id);
+    mda_interface_t      * interface;
+    const mda_ttl_flow_t * mda_ttl_flow;
+    mda_testing_flow_t   * testing_flow;
+    lattice_elt_t        * elt;
+    size_t                 i;
+
+    if (!mda_data_erase_testing_flow(data, key, &elt, &i)) {
+        return false;
+    }
+
+    // The last flow of the interface takes the place of the deleted one:
+    // update its position if it is being tested too.
+    interface = lattice_elt_get_data(elt);
+    mda_interface_del_ith_ttl_flow(interface, i);
+    if (i < mda_interface_get_num_ttl_flows(interface)) {
+        mda_ttl_flow = mda_interface_get_ith_ttl_flow(interface, i);
+        if (mda_ttl_flow->mda_flow.state == MDA_FLOW_TESTING
+        && (testing_flow = hashtable_find(data->testing_flows, MDA_FLOW_KEY(mda_ttl_flow->ttl, mda_ttl_flow->mda_flow.flow_id)))
+        &&  testing_flow->elt == elt) {
+            testing_flow->index = i;
+        }
+    }
+    return true;
+}
@@ -1,19 +1,63 @@
 #ifndef LIBPT_ALGORITHMS_MDA_DATA_H
 #define LIBPT_ALGORITHMS_MDA_DATA_H
 
-#include "bound.h"          // bound_t
-#include "../../address.h"  // address_t
-#include "../../lattice.h"  // lattice_t
-#include "../../pt_loop.h"  // pt_loop_t
-#include "../../probe.h"    // probe_t
+#include <stdint.h>                    // UINT16_MAX
+
+#include "bound.h"                     // bound_t
+#include "flow.h"                      // mda_flow_state_t
+#include "../../address.h"             // address_t
+#include "../../lattice.h"             // lattice_t
+#include "../../pt_loop.h"             // pt_loop_t
+#include "../../probe.h"               // probe_t
+#include "../../topology_cache.h"      // topology_cache_t
+#include "../../containers/hashtable.h" // hashtable_t
+
+struct mda_interface_s;
+
+// Flow identifiers are carried by a 16-bit field of the probes (see mda.c):
+// a larger flow identifier would be truncated on the wire.
+#define MDA_MAX_FLOW_ID UINT16_MAX
+
+// The lattice is indexed to process each reply in O(1) amortized time
+// instead of walking the whole lattice:
+// - interfaces:    address_t -> lattice_elt_t
+// - flows:         (ttl, flow_id) -> lattice_elt_t owning this flow
+//                  (MDA_FLOW_AVAILABLE, MDA_FLOW_UNAVAILABLE, MDA_FLOW_TIMEOUT)
+// - testing_flows: (ttl, flow_id) -> mda_testing_flow_t, i.e. the
+//                  lattice_elt_t owning this flow and its position in the
+//                  ttl_flows of this interface (MDA_FLOW_TESTING)
+// Addresses are owned by the indexed mda_interface_t instances, flow keys
+// are stored by value (see data.c).
+//
+// In streaming mode, the flows of the IP hops whose TTLs are all lower than
+// released_ttl are released (see mda_data_release_interface). Their lattice
+// nodes are kept so that the lattice can still be walked and dumped.
+
+typedef struct {
+    lattice_elt_t * elt;   /**< Lattice node of the interface owning the flow */
+    size_t          index; /**< Position of the flow in the ttl_flows of this interface */
+} mda_testing_flow_t;
 
 typedef struct {
-    lattice_t    * lattice;      /**< Root of the lattice storing the interfaces */
+    lattice_t    * lattice;       /**< Root of the lattice storing the interfaces */
     uintmax_t      last_flow_id;
-    address_t    * dst_ip;       /**< Destination IP */
-    pt_loop_t    * loop;         /**< Main loop */
-    probe_t      * skel;         /**< Probe skeleton */
-    bound_t      * bound;        /**< Bound on probes to send */
+    address_t    * dst_ip;        /**< Destination IP */
+    address_t    * src_ip;        /**< Source IP */
+    pt_loop_t    * loop;          /**< Main loop */
+    probe_t      * skel;          /**< Probe skeleton */
+    bound_t      * bound;         /**< Bound on probes to send (shared, see bound_get_shared) */
+    topology_cache_t * topology_cache; /**< Hops seen by previous instances (shared, see topology_cache_get_shared) */
+    hashtable_t  * interfaces;    /**< Maps an address to its lattice_elt_t */
+    hashtable_t  * flows;         /**< Maps a (ttl, flow_id) to its lattice_elt_t */
+    hashtable_t  * testing_flows; /**< Maps a testing (ttl, flow_id) to its mda_testing_flow_t */
+    bool           pipeline;      /**< Enumerate hops in parallel (see mda_options_t) */
+    bool           lite;          /**< Use MDA-Lite stopping points (see mda_options_t) */
+    size_t         lite_mark;     /**< Identifies the last walk of the siblings of a hop (MDA-Lite only) */
+    size_t         num_incomplete; /**< Number of hops not fully enumerated (pipeline only, reset by each walk) */
+    uint8_t        min_incomplete_ttl; /**< Lowest TTL of these hops (pipeline only, reset by each walk) */
+    bool           stream;        /**< Raise streaming events and release completed hops (see mda_options_t) */
+    uint8_t        min_pending_ttl; /**< Lowest TTL of the hops not fully enumerated (streaming only, reset by each walk) */
+    unsigned       released_ttl;  /**< The hops whose TTLs are all lower have been released (streaming only) */
 } mda_data_t;
 
 /**
@@ -30,4 +74,97 @@ mda_data_t * mda_data_create();
 
 void mda_data_free(mda_data_t * data);
 
+/**
+ * \brief Add an interface in the lattice and index it.
+ * \param data A mda_data_t instance.
+ * \param predecessor The predecessor of this interface in the lattice
+ *    (NULL if this interface is a root).
+ * \param interface The mda_interface_t instance to add.
+ * \return The corresponding lattice node if successful, NULL otherwise.
+ */
+
+lattice_elt_t * mda_data_add_interface(mda_data_t * data, lattice_elt_t * predecessor, struct mda_interface_s * interface);
+
+/**
+ * \brief Retrieve the lattice node of an interface.
+ * \param data A mda_data_t instance.
+ * \param address The address of the interface.
+ * \return The corresponding lattice node, NULL if not found.
+ */
+
+lattice_elt_t * mda_data_get_interface(const mda_data_t * data, const address_t * address);
+
+/**
+ * \brief Attach a flow to an interface and index it.
+ * \param data A mda_data_t instance.
+ * \param elt The lattice node of the interface.
+ * \param ttl The TTL of the flow.
+ * \param flow_id The flow identifier (at most MDA_MAX_FLOW_ID).
+ * \param state The state of the flow.
+ * \return true iif successful.
+ */
+
+bool mda_data_add_flow(mda_data_t * data, lattice_elt_t * elt, uint8_t ttl, uintmax_t flow_id, mda_flow_state_t state);
+
+/**
+ * \brief Test whether a flow has already been sent at a given TTL.
+ * \param data A mda_data_t instance.
+ * \param ttl The TTL of the flow.
+ * \param flow_id The flow identifier.
+ * \return true iif this flow is attached to an interface (whatever its state).
+ */
+
+bool mda_data_is_flow_used(const mda_data_t * data, uint8_t ttl, uintmax_t flow_id);
+
+/**
+ * \brief Allocate a flow identifier which has never been sent at a given TTL.
+ * \param data A mda_data_t instance.
+ * \param ttl The TTL of the flow.
+ * \return The new flow identifier, 0 if every flow identifier up to
+ *    MDA_MAX_FLOW_ID has already been allocated.
+ */
+
+uintmax_t mda_data_get_new_flow_id(mda_data_t * data, uint8_t ttl);
+
+/**
+ * \brief Retrieve the interface reached by a flow which is not
+ *    being tested.
+ * \param data A mda_data_t instance.
+ * \param ttl The TTL of the flow.
+ * \param flow_id The flow identifier.
+ * \return The lattice node of the corresponding interface, NULL if not found.
+ */
+
+lattice_elt_t * mda_data_get_flow_interface(const mda_data_t * data, uint8_t ttl, uintmax_t flow_id);
+
+/**
+ * \brief Delete a flow being tested (MDA_FLOW_TESTING).
+ * \param data A mda_data_t instance.
+ * \param ttl The TTL of the flow.
+ * \param flow_id The flow identifier.
+ * \return true iif such a flow has been deleted.
+ */
+
+bool mda_data_del_testing_flow(mda_data_t * data, uint8_t ttl, uintmax_t flow_id);
+
+/**
+ * \brief Mark a flow being tested (MDA_FLOW_TESTING) as expired
+ *    (MDA_FLOW_TIMEOUT), so that it is neither waited for nor sent again.
+ * \param data A mda_data_t instance.
+ * \param ttl The TTL of the flow.
+ * \param flow_id The flow identifier.
+ * \return true iif such a flow has been found.
+ */
+
+bool mda_data_expire_testing_flow(mda_data_t * data, uint8_t ttl, uintmax_t flow_id);
+
+/**
+ * \brief Release the flows attached to an interface whose enumeration
+ *    is over, and remove them from the indexes.
+ * \param data A mda_data_t instance.
+ * \param elt The lattice node of the interface.
+ */
+
+void mda_data_release_interface(mda_data_t * data, lattice_elt_t * elt);
+
 #endif // LIBPT_ALGORITHMS_MDA_DATA_H
@@ -0,0 +1,90 @@
+#include "event.h"
+
+#include <stdlib.h>         // malloc
+#include <stdio.h>          // fprintf
+#include <string.h>         // memcpy, memset
+
+/**
+ * \brief Initialize a mda_hop_event_t instance.
+ * \param hop_event The mda_hop_event_t instance.
+ * \param interface The IP hop, NULL for a star.
+ * \param ttl The TTL at which this IP hop has been reached.
+ * \param num_next The number of next hops of this IP hop.
+ */
+
+static void mda_hop_event_init(mda_hop_event_t * hop_event, const mda_interface_t * interface, uint8_t ttl, size_t num_next)
+{
+    memset(hop_event, 0, sizeof(mda_hop_event_t));
+    if (interface && interface->address) {
+        memcpy(&hop_event->address, interface->address, sizeof(address_t));
+    } else {
+        hop_event->is_star = true;
+    }
+    hop_event->ttl      = ttl;
+    hop_event->num_next = num_next;
+}
+
+mda_hop_event_t * mda_hop_event_create(const mda_interface_t * interface, uint8_t ttl, size_t num_next)
+{
+    mda_hop_event_t * hop_event;
+
+    if ((hop_event = malloc(sizeof(mda_hop_event_t)))) {
+        mda_hop_event_init(hop_event, interface, ttl, num_next);
+    }
+    return hop_event;
+}
+
+mda_link_event_t * mda_link_event_create(
+    const mda_interface_t * source,
+    const mda_interface_t * target,
+    uint8_t                 ttl,
+    uint16_t                flow_id,
+    double                  rtt
+) {
+    mda_link_event_t * link_event;
+
+    if ((link_event = malloc(sizeof(mda_link_event_t)))) {
+        mda_hop_event_init(&link_event->source, source, ttl - 1, 0);
+        mda_hop_event_init(&link_event->target, target, ttl, 0);
+        link_event->ttl     = ttl;
+        link_event->flow_id = flow_id;
+        link_event->rtt     = rtt;
+    }
+    return link_event;
+}
+
+static void mda_hop_event_address_dump(FILE * out, const mda_hop_event_t * hop_event)
+{
+    if (hop_event->is_star) {
+        fprintf(out, "*");
+    } else {
+        address_fprintf(out, &hop_event->address);
+    }
+}
+
+void mda_hop_event_dump(FILE * out, const mda_hop_event_t * hop_event)
+{
+    fprintf(out, "hop %hhu ", hop_event->ttl);
+    mda_hop_event_address_dump(out, hop_event);
+    fprintf(out, "\n");
+}
+
+void mda_hop_completed_event_dump(FILE * out, const mda_hop_event_t * hop_event)
+{
+    fprintf(out, "done %hhu ", hop_event->ttl);
+    mda_hop_event_address_dump(out, hop_event);
+    fprintf(out, " (%zu next hops)\n", hop_event->num_next);
+}
+
+void mda_link_event_dump(FILE * out, const mda_link_event_t * link_event)
+{
+    fprintf(out, "link %hhu ", link_event->ttl);
+    mda_hop_event_address_dump(out, &link_event->source);
+    fprintf(out, " -> ");
+    mda_hop_event_address_dump(out, &link_event->target);
+    fprintf(out, " [%hu]", link_event->flow_id);
+    if (!link_event->target.is_star) {
+        fprintf(out, " %.3lfms", link_event->rtt);
+    }
+    fprintf(out, "\n");
+}
@@ -0,0 +1,92 @@
+#ifndef LIBPT_ALGORITHMS_MDA_EVENT_H
+#define LIBPT_ALGORITHMS_MDA_EVENT_H
+
+#include <stdbool.h>         // bool
+#include <stddef.h>          // size_t
+#include <stdint.h>          // uint8_t, uint16_t
+#include <stdio.h>           // FILE
+
+#include "interface.h"       // mda_interface_t
+#include "../../address.h"   // address_t
+
+// The payloads of the streaming mda events (see mda_options_t::stream) are
+// snapshots: unlike MDA_NEW_LINK, they do not refer to the lattice, which
+// may have been partially released when the event is processed. Replaying
+// these events is enough to rebuild the lattice on the consumer side.
+
+/**
+ * An IP hop discovered by mda (MDA_NEW_HOP, MDA_HOP_COMPLETED).
+ */
+
+typedef struct {
+    address_t address;   /**< Address of the IP hop (meaningless if is_star) */
+    bool      is_star;   /**< True iif this IP hop has no address (star, or the source for ttl 0) */
+    uint8_t   ttl;       /**< TTL at which this IP hop has been reached */
+    size_t    num_next;  /**< Number of next hops (MDA_HOP_COMPLETED only) */
+} mda_hop_event_t;
+
+/**
+ * A probe sent along a link of the lattice (MDA_LINK_PROBED).
+ */
+
+typedef struct {
+    mda_hop_event_t source;  /**< The IP hop the flow was known to reach */
+    mda_hop_event_t target;  /**< The IP hop which has replied (star if the probe has expired) */
+    uint8_t         ttl;     /**< TTL of the probe */
+    uint16_t        flow_id; /**< Flow identifier of the probe */
+    double          rtt;     /**< Round-trip time in milliseconds (0 if the probe has expired) */
+} mda_link_event_t;
+
+/**
+ * \brief Allocate a mda_hop_event_t instance describing an IP hop.
+ * \param interface The IP hop.
+ * \param ttl The TTL at which this IP hop has been reached.
+ * \param num_next The number of next hops of this IP hop.
+ * \return The newly allocated mda_hop_event_t instance, NULL otherwise.
+ */
+
+mda_hop_event_t * mda_hop_event_create(const mda_interface_t * interface, uint8_t ttl, size_t num_next);
+
+/**
+ * \brief Allocate a mda_link_event_t instance describing a probe.
+ * \param source The IP hop the flow was known to reach (at ttl - 1).
+ * \param target The IP hop which has replied, NULL if the probe has expired.
+ * \param ttl The TTL of the probe.
+ * \param flow_id The flow identifier of the probe.
+ * \param rtt The round-trip time in milliseconds.
+ * \return The newly allocated mda_link_event_t instance, NULL otherwise.
+ */
+
+mda_link_event_t * mda_link_event_create(
+    const mda_interface_t * source,
+    const mda_interface_t * target,
+    uint8_t                 ttl,
+    uint16_t                flow_id,
+    double                  rtt
+);
+
+/**
+ * \brief Print a MDA_NEW_HOP event.
+ * \param out The output stream.
+ * \param hop_event A mda_hop_event_t instance.
+ */
+
+void mda_hop_event_dump(FILE * out, const mda_hop_event_t * hop_event);
+
+/**
+ * \brief Print a MDA_HOP_COMPLETED event.
+ * \param out The output stream.
+ * \param hop_event A mda_hop_event_t instance.
+ */
+
+void mda_hop_completed_event_dump(FILE * out, const mda_hop_event_t * hop_event);
+
+/**
+ * \brief Print a MDA_LINK_PROBED event.
+ * \param out The output stream.
+ * \param link_event A mda_link_event_t instance.
+ */
+
+void mda_link_event_dump(FILE * out, const mda_link_event_t * link_event);
+
+#endif // LIBPT_ALGORITHMS_MDA_EVENT_H
@@ -8,7 +8,8 @@ typedef enum {
     MDA_FLOW_AVAILABLE,
     MDA_FLOW_UNAVAILABLE,
     MDA_FLOW_TESTING,
-    MDA_FLOW_TIMEOUT
+    MDA_FLOW_TIMEOUT,
+    MDA_FLOW_NUM_STATES  /**< Number of flow states (not a valid state) */
 } mda_flow_state_t;
 
 /**
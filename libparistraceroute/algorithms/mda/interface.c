@@ -1,11 +1,13 @@
 #include "interface.h"
 
 #include <stdlib.h>         // free
-#include <stdio.h>          // printf
+#include <stdio.h>          // fprintf
 #include <string.h>         // strdup
 
 #include "../../common.h"   // ELEMENT_FREE 
 
+#define MDA_TTL_FLOWS_SIZE_INIT 8
+
 mda_interface_t * mda_interface_create(const address_t * address)
 {
     mda_interface_t * mda_interface;
@@ -20,18 +22,14 @@ mda_interface_t * mda_interface_create(const address_t * address)
         }
     }
 
-    if (!(mda_interface->ttl_flows = dynarray_create())) {
-        goto ERR_FLOWS;
-    }
-
+    // ttl_flows is allocated once the first flow is attached: stars and
+    // end hosts never get any flow.
     memset(mda_interface->ttl_set, 0, MAX_TTLS);
     mda_interface->num_ttls = 1;
 
     mda_interface->type = MDA_LB_TYPE_UNKNOWN;
     return mda_interface;
 
-ERR_FLOWS:
-    if (mda_interface->address) address_free(mda_interface->address);
 ERR_ADDRESS:
     free(mda_interface);
 ERR_INTERFACE:
@@ -41,7 +39,7 @@ ERR_INTERFACE:
 void mda_interface_free(mda_interface_t * interface)
 {
     if (interface) {
-        dynarray_free(interface->ttl_flows, (ELEMENT_FREE) mda_ttl_flow_free);
+        free(interface->ttl_flows);
         if (interface->address) address_free(interface->address);
         free(interface);
     }
@@ -49,65 +47,104 @@ void mda_interface_free(mda_interface_t * interface)
 
 bool mda_interface_add_flow_id(mda_interface_t * interface, uint8_t ttl, uintmax_t flow_id, mda_flow_state_t state)
 {
-    mda_flow_t     * mda_flow;
-    mda_ttl_flow_t * mda_ttl_flow;
-
-    if (!(mda_flow = mda_flow_create(flow_id, state))) {
-        goto ERR_MDA_FLOW_CREATE;
-    }
-
-    if (!(mda_ttl_flow = mda_ttl_flow_create(ttl, mda_flow))) {
-        goto ERR_TTL_FLOW_CREATE;
-    }
-
-    if (!(dynarray_push_element(interface->ttl_flows, mda_ttl_flow))) {
-        goto ERR_DYNARRAY_PUSH_ELEMENT;
+    mda_ttl_flow_t * ttl_flows,
+                   * mda_ttl_flow;
+    size_t           max_ttl_flows;
+
+    if (interface->num_ttl_flows == interface->max_ttl_flows) {
+        max_ttl_flows = interface->max_ttl_flows ? 2 * interface->max_ttl_flows : MDA_TTL_FLOWS_SIZE_INIT;
+        if (!(ttl_flows = realloc(interface->ttl_flows, max_ttl_flows * sizeof(mda_ttl_flow_t)))) {
+            goto ERR_REALLOC;
+        }
+        interface->ttl_flows     = ttl_flows;
+        interface->max_ttl_flows = max_ttl_flows;
     }
 
+    mda_ttl_flow = &interface->ttl_flows[interface->num_ttl_flows++];
+    mda_ttl_flow->mda_flow.flow_id = flow_id;
+    mda_ttl_flow->mda_flow.state   = state;
+    mda_ttl_flow->ttl              = ttl;
+    interface->num_flows[state]++;
     return true;
 
-ERR_DYNARRAY_PUSH_ELEMENT:
-    mda_ttl_flow_free(mda_ttl_flow);
-ERR_TTL_FLOW_CREATE:
-    mda_flow_free(mda_flow);
-ERR_MDA_FLOW_CREATE:
+ERR_REALLOC:
     return false;
 }
 
-size_t mda_interface_get_num_flows(const mda_interface_t * interface, mda_flow_state_t state)
+inline size_t mda_interface_get_num_ttl_flows(const mda_interface_t * interface) {
+    return interface->num_ttl_flows;
+}
+
+inline mda_ttl_flow_t * mda_interface_get_ith_ttl_flow(const mda_interface_t * interface, size_t i) {
+    return &interface->ttl_flows[i];
+}
+
+void mda_interface_set_ith_flow_state(mda_interface_t * interface, size_t i, mda_flow_state_t state)
+{
+    mda_flow_t * mda_flow = &interface->ttl_flows[i].mda_flow;
+
+    interface->num_flows[mda_flow->state]--;
+    interface->num_flows[state]++;
+    mda_flow->state = state;
+
+    if (state == MDA_FLOW_AVAILABLE && i < interface->next_available) {
+        interface->next_available = i;
+    }
+}
+
+void mda_interface_del_ith_ttl_flow(mda_interface_t * interface, size_t i)
 {
-    const mda_ttl_flow_t * mda_ttl_flow;
-    size_t                 i,
-                           num_flows = dynarray_get_size(interface->ttl_flows),
-                           num_flows_with_state = 0;
-
-    for (i = 0; i < num_flows; i++) {
-        mda_ttl_flow = dynarray_get_ith_element(interface->ttl_flows, i);
-        if (mda_ttl_flow->mda_flow->state == state) {
-            num_flows_with_state++;
+    size_t last = interface->num_ttl_flows - 1;
+
+    // The last tuple takes the place of the deleted one
+    interface->num_flows[interface->ttl_flows[i].mda_flow.state]--;
+    if (i != last) {
+        interface->ttl_flows[i] = interface->ttl_flows[last];
+        if (interface->ttl_flows[i].mda_flow.state == MDA_FLOW_AVAILABLE && i < interface->next_available) {
+            interface->next_available = i;
         }
     }
+    interface->num_ttl_flows--;
+    if (interface->next_available > interface->num_ttl_flows) {
+        interface->next_available = interface->num_ttl_flows;
+    }
+}
 
-    return num_flows_with_state;
+void mda_interface_free_flows(mda_interface_t * interface)
+{
+    free(interface->ttl_flows);
+    interface->ttl_flows      = NULL;
+    interface->num_ttl_flows  = 0;
+    interface->max_ttl_flows  = 0;
+    interface->next_available = 0;
+    memset(interface->num_flows, 0, sizeof(interface->num_flows));
+}
+
+inline size_t mda_interface_get_num_flows(const mda_interface_t * interface, mda_flow_state_t state)
+{
+    return interface->num_flows[state];
 }
 
-mda_ttl_flow_t * mda_interface_get_available_flow_id(mda_interface_t * interface, size_t num_siblings, mda_data_t * data)
+mda_ttl_flow_t * mda_interface_get_available_flow_id(lattice_elt_t * elt, size_t num_siblings, mda_data_t * data)
 {
-    uintmax_t        flow_id;
-    mda_ttl_flow_t * mda_ttl_flow;
-    mda_flow_t *     mda_flow;
-    size_t           i, size = dynarray_get_size(interface->ttl_flows);
-    uint8_t          ttl;
-
-    // Search in the flow list for the first available one
-    for (i = 0; i < size; i++) {
-        mda_ttl_flow = dynarray_get_ith_element(interface->ttl_flows, i);
-        mda_flow = mda_ttl_flow->mda_flow;
-        if (mda_flow->state == MDA_FLOW_AVAILABLE) {
-            mda_flow->state = MDA_FLOW_UNAVAILABLE;
-            return mda_ttl_flow;
+    mda_interface_t * interface = lattice_elt_get_data(elt);
+    uintmax_t         flow_id;
+    size_t            i;
+    uint8_t           ttl;
+
+    // Search in the flow list for the first available one. Flows before
+    // interface->next_available are never available, so that each flow
+    // is skipped at most once.
+    if (interface->num_flows[MDA_FLOW_AVAILABLE] > 0) {
+        for (i = interface->next_available; i < interface->num_ttl_flows; i++) {
+            if (interface->ttl_flows[i].mda_flow.state == MDA_FLOW_AVAILABLE) {
+                mda_interface_set_ith_flow_state(interface, i, MDA_FLOW_UNAVAILABLE);
+                interface->next_available = i + 1;
+                return &interface->ttl_flows[i];
+            }
         }
     }
+    interface->next_available = interface->num_ttl_flows;
 
     // TODO the num ttl_set restriction could be a problem
     if (num_siblings == 1 && interface->num_ttls == 1) {
@@ -116,31 +153,34 @@ mda_ttl_flow_t * mda_interface_get_available_flow_id(mda_interface_t * interface
         // to our flow list and mark it as unavailable. No need to send any 
         // probe to verify.
 
-        flow_id = ++data->last_flow_id; // mda_interface_get_new_flow_id(interface, data);
         ttl = interface->ttl_set[interface->num_ttls - 1];
-        if (!mda_interface_add_flow_id(interface, ttl, flow_id, MDA_FLOW_UNAVAILABLE)) {
+        if (!(flow_id = mda_data_get_new_flow_id(data, ttl))) {
+            return NULL; // every flow id has been used
+        }
+        if (!mda_data_add_flow(data, elt, ttl, flow_id, MDA_FLOW_UNAVAILABLE)) {
             return NULL; // error adding flow id to the list
         }
-        return dynarray_get_ith_element(interface->ttl_flows, size);
+        return &interface->ttl_flows[interface->num_ttl_flows - 1];
     }
 
     return NULL;
 }
 
-static void flow_dump(const mda_interface_t * interface)
+static void flow_dump(FILE * out, const mda_interface_t * interface)
 {
     const  mda_flow_t * mda_flow;
     const  mda_ttl_flow_t * mda_ttl_flow;
     size_t              i, size;
 
     if(!interface) {
-        printf("(null)");
+        fprintf(out, "(null)");
     } else {
-        size = dynarray_get_size(interface->ttl_flows);
+        size = mda_interface_get_num_ttl_flows(interface);
         for (i = 0; i < size; i++) {
-            mda_ttl_flow = dynarray_get_ith_element(interface->ttl_flows, i);
-            mda_flow = mda_ttl_flow->mda_flow;
-            printf(
+            mda_ttl_flow = mda_interface_get_ith_ttl_flow(interface, i);
+            mda_flow = &mda_ttl_flow->mda_flow;
+            fprintf(
+                out,
                 " %d%c%ju%c",
                 mda_ttl_flow->ttl,
                 mda_flow_state_to_char(mda_flow),
@@ -152,72 +192,88 @@ static void flow_dump(const mda_interface_t * interface)
 }
 
 /**
- * \brief Print to the standard output a mda_interface_t instance.
+ * \brief Print a mda_interface_t instance.
+ * \param out The output stream.
  * \param hop The mda_interface_t we want to print.
  * \param hostname The FQDN related to this hop.
  */
 
 // TODO improve the 3 following functions
-static void mda_hop_dump(const mda_interface_t * hop, char * hostname)
+static void mda_hop_dump(FILE * out, const mda_interface_t * hop, char * hostname)
 {
     if (hop->address) {
-        address_dump(hop->address);
-    } else printf("None");
+        address_fprintf(out, hop->address);
+    } else fprintf(out, "None");
     if (hostname) {
-        printf(" (%s)", hostname);
+        fprintf(out, " (%s)", hostname);
     }
 }
 
-static inline void mda_hop_dump_without_resolv(const lattice_elt_t * elt) {
+static inline void mda_hop_dump_without_resolv(FILE * out, const lattice_elt_t * elt) {
     const mda_interface_t * hop = lattice_elt_get_data(elt);
-    mda_hop_dump(hop, NULL);
+    mda_hop_dump(out, hop, NULL);
 }
 
-static inline void mda_hop_dump_with_resolv(const lattice_elt_t * elt) {
+static inline void mda_hop_dump_with_resolv(FILE * out, const lattice_elt_t * elt) {
     const mda_interface_t * hop = lattice_elt_get_data(elt);
     char                  * hostname;
 
     address_resolv(hop->address, &hostname, CACHE_ENABLED);
-    mda_hop_dump(hop, hostname);
+    mda_hop_dump(out, hop, hostname);
     if (hostname) free(hostname);
 }
 
-void mda_link_dump(const mda_interface_t * link[2], bool do_resolv)
+/**
+ * \brief Print an address and its hostname (see resolver_print_hostname).
+ * \param out The output stream.
+ * \param address The address of the hop.
+ * \param hostname The corresponding hostname (NULL if unresolved).
+ */
+
+static void mda_hostname_dump(FILE * out, const address_t * address, const char * hostname)
+{
+    address_fprintf(out, address);
+    if (hostname) {
+        fprintf(out, " (%s)", hostname);
+    }
+}
+
+void mda_link_dump(hole_stream_t * hole_stream, const mda_interface_t * link[2], resolver_t * resolver)
 {
-    char *  hostname = NULL;
+    FILE  * out = hole_stream_get_stream(hole_stream);
     uint8_t ttl;
     size_t  i;
 
     // Print TTL
     for (i = 0; i < link[0]->num_ttls; ++i) {
         ttl = link[0]->ttl_set[i];
-        printf("%hhu ", ttl);
+        fprintf(out, "%hhu ", ttl);
     }
 
     // Print source of the link
-    if (do_resolv && link[0]->address) {
-        address_resolv(link[0]->address, &hostname, CACHE_ENABLED);
+    if (resolver && link[0]->address) {
+        resolver_print_hostname(resolver, hole_stream, link[0]->address, mda_hostname_dump);
+    } else {
+        mda_hop_dump(out, link[0], NULL);
     }
-    mda_hop_dump(link[0], hostname);
-    if (hostname) free(hostname);
 
     // Print target of the link (if any)
     if (link[1]) {
-        printf(" -> ");
-        mda_hop_dump(link[1], NULL);
+        fprintf(out, " -> ");
+        mda_hop_dump(out, link[1], NULL);
     }
 
     // Print flow information
-    printf(" [{");
-    flow_dump(link[0]);
-    printf("} -> { ");
-    flow_dump(link[1]);
-    printf("}]\n");
+    fprintf(out, " [{");
+    flow_dump(out, link[0]);
+    fprintf(out, "} -> { ");
+    flow_dump(out, link[1]);
+    fprintf(out, "}]\n");
 }
 
-void mda_lattice_elt_dump(const lattice_elt_t * lattice_elt) //, bool do_resolv)
+void mda_lattice_elt_dump(FILE * out, const lattice_elt_t * lattice_elt) //, bool do_resolv)
 {
-    size_t                  num_nexthops;
+    size_t                  i, num_nexthops;
 //    const mda_interface_t * curr_hop;
     const dynarray_t      * next_hops;
     char                  * hostname = NULL;
@@ -226,7 +282,7 @@ void mda_lattice_elt_dump(const lattice_elt_t * lattice_elt) //, bool do_resolv)
 
     // Current hop
 //    curr_hop = lattice_elt_get_data(lattice_elt);
-    mda_hop_dump_without_resolv(lattice_elt);
+    mda_hop_dump_without_resolv(out, lattice_elt);
     
     // Get next hops
     if (!(next_hops = lattice_elt->next)) {
@@ -238,10 +294,14 @@ void mda_lattice_elt_dump(const lattice_elt_t * lattice_elt) //, bool do_resolv)
 
     // Print next hops
     if (num_nexthops) {
-        printf(" -> ");
-        dynarray_dump(next_hops, (ELEMENT_DUMP) mda_hop_dump_without_resolv);
+        fprintf(out, " -> [ ");
+        for (i = 0; i < num_nexthops; ++i) {
+            if (i > 0) fprintf(out, ", ");
+            mda_hop_dump_without_resolv(out, dynarray_get_ith_element(next_hops, i));
+        }
+        fprintf(out, " ]");
     }
-    printf("\n");
+    fprintf(out, "\n");
 
 /*
     // Flow information
@@ -3,12 +3,15 @@
 
 #include <stdbool.h>        // bool
 #include <stddef.h>         // size_t
+#include <stdio.h>          // FILE
 
 #include "data.h"           // mda_data_t
 #include "flow.h"           // mda_flow_state_t
 #include "ttl_flow.h"       // mda_ttl_flow_t
 #include "../../address.h"  // address_t
 #include "../../dynarray.h" // dynarray_t
+#include "../../hole.h"     // hole_stream_t
+#include "../../resolver.h" // resolver_t
 
 typedef enum {
     MDA_LB_TYPE_UNKNOWN,             /**< IP hop state not yet classified  */
@@ -20,24 +23,33 @@ typedef enum {
     MDA_LB_TYPE_PDLB                 /**< Per destination load balancer    */
 } mda_lb_type_t;
 
-typedef struct {
-    address_t   * address;           /**< Interface attached to this hop   */
-    size_t        sent,              /**< Number of probes to discover its next hops */
-                  received,
-                  timeout,
-                  num_stars;         /**< Number of timeout for this hop          */
-    dynarray_t  * ttl_flows;         /**< ttl-flow_id tuples related to this hop  */
-    uint8_t       ttl_set[MAX_TTLS]; /**< The set of ttls that can reach this hop.
-                                          This structure is used to improve
-                                          efficiency later in the code.           */
-    size_t        num_ttls;          /**< Number of ttls contained in this hop    */
-    bool          enumeration_done;
-    mda_lb_type_t type;              /**< Type of load balancer            */
+typedef struct mda_interface_s {
+    address_t      * address;           /**< Interface attached to this hop   */
+    size_t           sent,              /**< Number of probes to discover its next hops */
+                     received,
+                     timeout,
+                     num_stars;         /**< Number of timeout for this hop          */
+    mda_ttl_flow_t * ttl_flows;         /**< ttl-flow_id tuples related to this hop
+                                             (see mda_interface_del_ith_ttl_flow)    */
+    size_t           num_ttl_flows;     /**< Number of tuples stored in ttl_flows    */
+    size_t           max_ttl_flows;     /**< Number of tuples allocated in ttl_flows */
+    size_t           num_flows[MDA_FLOW_NUM_STATES]; /**< Number of flows per state  */
+    size_t           next_available;    /**< No flow before this index in ttl_flows
+                                             is MDA_FLOW_AVAILABLE                   */
+    uint8_t          ttl_set[MAX_TTLS]; /**< The set of ttls that can reach this hop.
+                                             This structure is used to improve
+                                             efficiency later in the code.           */
+    size_t           num_ttls;          /**< Number of ttls contained in this hop    */
+    bool             enumeration_done;
+    bool             lite_fallback;     /**< MDA-Lite: this hop is meshed or not
+                                             uniform, and uses the full MDA         */
+    bool             is_released;       /**< Streaming: the flows of this hop have
+                                             been released (see mda_data_release_interface) */
+    size_t           lite_mark;         /**< MDA-Lite: last walk of its hop which has
+                                             visited this hop (see mda_data_t::lite_mark) */
+    mda_lb_type_t    type;              /**< Type of load balancer            */
 } mda_interface_t;
 
-
-void mda_ttl_flow_free(mda_ttl_flow_t * mda_ttl_flow);
-
 /**
  * \brief Allocate a new mda_interface_t instance, which corresponds to
  *    an IP hop discovered by mda.
@@ -56,14 +68,59 @@ mda_interface_t * mda_interface_create(const address_t * address);
 void mda_interface_free(mda_interface_t * interface);
 
 /**
- * \brief Allocate and attach a new mda_flow_t instance to a given
- *    mda_interface_t instance.
+ * \brief Attach a new ttl/flow tuple to a given mda_interface_t instance.
+ * \param interface A mda_interface_t instance.
+ * \param ttl The ttl of the flow.
  * \param flow_id The new flow id.
  * \param flow_state The flow state.
+ * \return true iif successful.
  */
 
 bool mda_interface_add_flow_id(mda_interface_t * interface, uint8_t ttl, uintmax_t flow_id, mda_flow_state_t state);
 
+/**
+ * \brief Retrieve the number of ttl/flow tuples attached to an interface.
+ * \param interface A mda_interface_t instance.
+ * \return The number of ttl/flow tuples.
+ */
+
+size_t mda_interface_get_num_ttl_flows(const mda_interface_t * interface);
+
+/**
+ * \brief Retrieve the i-th ttl/flow tuple attached to an interface.
+ * \param interface A mda_interface_t instance.
+ * \param i The index of the tuple.
+ * \return The corresponding tuple. It remains valid until the next
+ *    flow is attached to or deleted from this interface.
+ */
+
+mda_ttl_flow_t * mda_interface_get_ith_ttl_flow(const mda_interface_t * interface, size_t i);
+
+/**
+ * \brief Change the state of a ttl/flow tuple attached to an interface.
+ * \param interface A mda_interface_t instance.
+ * \param i The index of the tuple.
+ * \param state The new state.
+ */
+
+void mda_interface_set_ith_flow_state(mda_interface_t * interface, size_t i, mda_flow_state_t state);
+
+/**
+ * \brief Delete a ttl/flow tuple attached to an interface in O(1).
+ *    The last tuple is moved to the position of the deleted one.
+ * \param interface A mda_interface_t instance.
+ * \param i The index of the tuple.
+ */
+
+void mda_interface_del_ith_ttl_flow(mda_interface_t * interface, size_t i);
+
+/**
+ * \brief Release every ttl/flow tuple attached to an interface.
+ * \param interface A mda_interface_t instance.
+ */
+
+void mda_interface_free_flows(mda_interface_t * interface);
+
 /**
  * \brief Retrieve the number of flows having a given state.
  * \param state The flow state. This is a value among {MDA_FLOW_AVAILABLE,
@@ -84,7 +141,7 @@ size_t mda_interface_get_num_flows(const mda_interface_t * interface, mda_flow_s
 
 /**
  * \brief Retrieve an available flow id.
- * \param interface An IP hop discovered by mda.
+ * \param elt The lattice node of an IP hop discovered by mda.
  * \param num_siblings The number of interface hops discovered by mda at
  *    this TTL.
  * \param data A mda_data_t instance which stores the last used flow id.
@@ -92,7 +149,7 @@ size_t mda_interface_get_num_flows(const mda_interface_t * interface, mda_flow_s
  * \return A flow-id > 0 if successful, 0 otherwise.
  */
 
-mda_ttl_flow_t * mda_interface_get_available_flow_id(mda_interface_t * interface, size_t num_siblings, mda_data_t * data);
+mda_ttl_flow_t * mda_interface_get_available_flow_id(lattice_elt_t * elt, size_t num_siblings, mda_data_t * data);
 
 /**
  * \brief Print to the standard output the flow related to a given
@@ -103,23 +160,25 @@ mda_ttl_flow_t * mda_interface_get_available_flow_id(mda_interface_t * interface
 void mda_flow_dump(const mda_interface_t * interface);
 
 /**
- * \brief Print to the standard output a pair of mda_interface_t
- *    instances.
+ * \brief Print a pair of mda_interface_t instances.
+ * \param hole_stream The hole_stream_t instance to print in
+ *    (see pt_loop_get_hole_stream).
  * \param link Points to a pair of mda_interface_t interfaces
  *    (link[0] and link[1] must be set).
- * \param do_resolv Pass true to resolv IP address and print
- *    the corresponding FQDN.
+ * \param resolver The resolver_t instance used to print the FQDN
+ *    of link[0] (see pt_loop_get_resolver), NULL to print IP addresses only.
  */
 
-void mda_link_dump(const mda_interface_t * link[2], bool do_resolv);
+void mda_link_dump(hole_stream_t * hole_stream, const mda_interface_t * link[2], resolver_t * resolver);
 
 /**
- * \brief Callback used by lattice_dump
+ * \brief Callback used by lattice_fprintf
+ * \param out The output stream.
  * \param elt A lattice node instance
  * \param do_resolv Pass true to resolv IP address and print
  *    the corresponding FQDN.
  */
 
-void mda_lattice_elt_dump(const lattice_elt_t * elt); //, bool do_resolv);
+void mda_lattice_elt_dump(FILE * out, const lattice_elt_t * elt); //, bool do_resolv);
 
 #endif // LIBPT_ALGORITHMS_MDA_INTERFACE_H
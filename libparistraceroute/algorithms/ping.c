@@ -11,7 +11,8 @@
 #include "../probe.h"
 #include "../event.h"
 #include "../algorithm.h"
-#include "../address.h"         // address_resolv
+#include "../address.h"         // address_fprintf
+#include "../pt_loop.h"         // pt_loop_get_resolver
 #include "../common.h"          // get_timestamp
 #include "../network.h"         // options_network_get_timeout
 
@@ -174,29 +175,30 @@ static double compute_mean_deviation(dynarray_t * array) {
 
 /**
  * \brief print the computed statistics
+ * \param out The output stream.
  * \param ping_data pointer to a ping_data_t instance containing the data of the algorithm
  */
 
-void ping_dump_statistics(ping_data_t * ping_data) {
+void ping_dump_statistics(FILE * out, ping_data_t * ping_data) {
     double max, min, avg, mdev;
 
     if (ping_data == NULL || ping_data->rtt_results == NULL) {
         fprintf(stderr, "An error occured while computing statistics...\n");
     } else {
-        printf("---Ping statistics---\n");
+        fprintf(out, "---Ping statistics---\n");
         max  = compute_maximum(ping_data->rtt_results);
         min  = compute_minimum(ping_data->rtt_results);
         avg  = compute_mean(ping_data->rtt_results);
         mdev = compute_mean_deviation(ping_data->rtt_results);
 
-        printf("%zu packets transmitted, %zu received, %u%% packet loss, time %zums\n",
+        fprintf(out, "%zu packets transmitted, %zu received, %u%% packet loss, time %zums\n",
             ping_data->num_replies,
             ping_data->num_replies - ping_data->num_losses,
             ping_data->num_replies ? (unsigned) (100 * ((float) ping_data->num_losses / ping_data->num_replies)) : 0,
             (size_t) (1000 * (ping_data->last_time - ping_data->start_time))
         );
 
-        printf("rtt max/min/avg/mdev = %.3lf/%.3lf/%.3lf/%.3lf ms\n", max, min, avg, mdev);
+        fprintf(out, "rtt max/min/avg/mdev = %.3lf/%.3lf/%.3lf/%.3lf ms\n", max, min, avg, mdev);
     }
 }
 
@@ -517,38 +519,50 @@ static void ping_data_free(ping_data_t * ping_data) {
 // Ping default handler
 //-----------------------------------------------------------------
 
-static inline void ttl_dump(const probe_t * probe) {
+static inline void ttl_dump(FILE * out, const probe_t * probe) {
     uint8_t ttl;
-    if (probe_extract(probe, "ttl", &ttl)) printf("%2d", ttl);
+    if (probe_extract(probe, "ttl", &ttl)) fprintf(out, "%2d", ttl);
 }
 
-static inline void discovered_ip_dump(const probe_t * reply, bool do_resolv) {
-    address_t   discovered_addr;
-    char      * discovered_hostname;
+/**
+ * \brief Print a discovered address and its hostname (see resolver_print_hostname).
+ * \param out The output stream.
+ * \param address The discovered address.
+ * \param hostname The corresponding hostname (NULL if unresolved).
+ */
 
-    if (probe_extract(reply, "src_ip", &discovered_addr)) {
-        if (do_resolv) {
-            if (address_resolv(&discovered_addr, &discovered_hostname, CACHE_ENABLED)) {
-                printf("%s", discovered_hostname);
-                free(discovered_hostname);
-            } else {
-                address_dump(&discovered_addr);
-            }
-            printf(" (");
-        }
+static void discovered_hostname_dump(FILE * out, const address_t * address, const char * hostname) {
+    if (hostname) {
+        fprintf(out, "%s", hostname);
+    } else {
+        address_fprintf(out, address);
+    }
+    fprintf(out, " (");
+    address_fprintf(out, address);
+    fprintf(out, ")");
+}
 
-        address_dump(&discovered_addr);
+static inline void discovered_ip_dump(pt_loop_t * loop, const probe_t * reply, bool do_resolv) {
+    address_t    discovered_addr;
+    resolver_t * resolver;
+    FILE       * out = pt_loop_get_stream(loop);
 
-        if (do_resolv) {
-            printf(")");
+    if (probe_extract(reply, "src_ip", &discovered_addr)) {
+        // The hostname is printed once resolved, without delaying the probes
+        if (do_resolv && (resolver = pt_loop_get_resolver(loop))) {
+            resolver_print_hostname(resolver, pt_loop_get_hole_stream(loop), &discovered_addr, discovered_hostname_dump);
+        } else if (do_resolv) {
+            discovered_hostname_dump(out, &discovered_addr, NULL);
+        } else {
+            address_fprintf(out, &discovered_addr);
         }
     }
 }
 
-static inline void delay_dump(const probe_t * probe, const probe_t * reply) {
+static inline void delay_dump(FILE * out, const probe_t * probe, const probe_t * reply) {
     double send_time = probe_get_sending_time(probe),
            recv_time = probe_get_recv_time(reply);
-    printf("%.2lf ms", 1000 * (recv_time - send_time));
+    fprintf(out, "%.2lf ms", 1000 * (recv_time - send_time));
 }
 
 static inline double delay_get(const probe_t * probe, const probe_t * reply) {
@@ -565,6 +579,7 @@ void ping_handler(
     const probe_t * reply;
     double        * delay;
     const char    * error;
+    FILE          * out = pt_loop_get_stream(loop);
 
     switch (ping_event->type) {
         case PING_PROBE_REPLY:
@@ -577,17 +592,17 @@ void ping_handler(
 
                 if (ping_options->show_timestamp) {
                     // Option -D enabled
-                    printf("[%lf] ",get_timestamp());
+                    fprintf(out, "[%lf] ",get_timestamp());
                 }
 
-                printf("%zu bytes from ", probe_get_size(reply));
-                discovered_ip_dump(reply, ping_options->do_resolv);
-                printf(": seq=%zu ttl=", ping_data->num_replies);
-                ttl_dump(probe);
-                printf(" time=");
+                fprintf(out, "%zu bytes from ", probe_get_size(reply));
+                discovered_ip_dump(loop, reply, ping_options->do_resolv);
+                fprintf(out, ": seq=%zu ttl=", ping_data->num_replies);
+                ttl_dump(out, probe);
+                fprintf(out, " time=");
                 // Print delay
-                delay_dump(probe, reply);
-                printf("\n");
+                delay_dump(out, probe, reply);
+                fprintf(out, "\n");
             }
 
             if (!(delay = (double *) malloc(sizeof(double)))) {
@@ -604,13 +619,13 @@ void ping_handler(
             break;
 
         case PING_PRINT_STATISTICS:
-            printf("\n");
+            fprintf(out, "\n");
             ping_data = (ping_data_t *) ping_event->data;
-            ping_dump_statistics(ping_data);
+            ping_dump_statistics(out, ping_data);
             break;
 
         case PING_ALL_PROBES_SENT:
-            printf("\n");
+            fprintf(out, "\n");
             break;
 
         case PING_TIMEOUT:
@@ -651,12 +666,12 @@ void ping_handler(
                     break;
             }
             reply = ((const probe_reply_t *) ping_event->data)->reply;
-            printf("From ");
-            discovered_ip_dump(reply, ping_options->do_resolv);
-            printf(" : seq=%zu   %s\n", ping_data->num_replies, error);
+            fprintf(out, "From ");
+            discovered_ip_dump(loop, reply, ping_options->do_resolv);
+            fprintf(out, " : seq=%zu   %s\n", ping_data->num_replies, error);
             break;
         }
-        fflush(stdout);
+        hole_stream_flush(pt_loop_get_hole_stream(loop));
 }
 
 //-----------------------------------------------------------------
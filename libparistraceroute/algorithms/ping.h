@@ -4,6 +4,7 @@
 #include <stdbool.h>     // bool
 #include <stdint.h>      // uint*_t
 #include <stddef.h>      // size_t
+#include <stdio.h>       // FILE
 #include <limits.h>      // INT_MAX
 
 #include "../address.h"  // address_t
@@ -102,10 +103,11 @@ typedef struct {
 
 /**
  * \brief print the computed statistics
+ * \param out The output stream.
  * \param ping_data the data of the algorithm
  */
 
-void ping_dump_statistics(ping_data_t * ping_data);
+void ping_dump_statistics(FILE * out, ping_data_t * ping_data);
 
 //-----------------------------------------------------------------
 // Ping default handler
@@ -8,8 +8,10 @@
 #include "../probe.h"
 #include "../event.h"
 #include "../algorithm.h"
-#include "../address.h"  // address_resolv
-#include "../whois.h"	 // whois_get_asn
+#include "../address.h"  // address_fprintf
+#include "../pt_loop.h"  // pt_loop_get_resolver
+#include "../whois.h"	 // whois_client_print_asn
+#include "../common.h"   // MIN, MAX
 
 //-----------------------------------------------------------------
 // Traceroute options
@@ -20,9 +22,12 @@ static unsigned min_ttl[3]          = OPTIONS_TRACEROUTE_MIN_TTL;
 static unsigned max_ttl[3]          = OPTIONS_TRACEROUTE_MAX_TTL;
 static unsigned max_undiscovered[3] = OPTIONS_TRACEROUTE_MAX_UNDISCOVERED;
 static unsigned num_queries[3]      = OPTIONS_TRACEROUTE_NUM_QUERIES;
+static unsigned doubletree_ttl[3]   = OPTIONS_TRACEROUTE_DOUBLETREE_TTL;
+static unsigned ttl_window[3]       = OPTIONS_TRACEROUTE_TTL_WINDOW;
 static bool     do_resolv           = OPTIONS_TRACEROUTE_DO_RESOLV_DEFAULT;
 static bool     print_ttl           = OPTIONS_TRACEROUTE_PRINT_TTL_DEFAULT;
 static bool     resolv_asn          = OPTIONS_TRACEROUTE_RESOLV_ASN_DEFAULT;
+static bool     use_topology_cache  = OPTIONS_TRACEROUTE_USE_TOPOLOGY_CACHE_DEFAULT;
 
 static option_t traceroute_options[] = {
     // action           short long                  metavar             help    data
@@ -33,6 +38,9 @@ static option_t traceroute_options[] = {
     {opt_store_int_lim, "q",  "--num-queries",      "NUM_QUERIES",      TRACEROUTE_HELP_q, num_queries},
     {opt_store_int_lim, "M",  "--max-undiscovered", "MAX_UNDISCOVERED", TRACEROUTE_HELP_M, max_undiscovered},
     {opt_store_1, OPT_NO_SF,  "--print-ttl",        OPT_NO_METAVAR,     TRACEROUTE_HELP_PRINT_TTL, &print_ttl},
+    {opt_store_int_lim, OPT_NO_SF, "--doubletree",     "START_TTL",        TRACEROUTE_HELP_DOUBLETREE, doubletree_ttl},
+    {opt_store_int_lim, OPT_NO_SF, "--ttl-window",     "NUM_TTLS",         TRACEROUTE_HELP_TTL_WINDOW, ttl_window},
+    {opt_store_1, OPT_NO_SF,  "--topology-cache",   OPT_NO_METAVAR,     TRACEROUTE_HELP_TOPOLOGY_CACHE, &use_topology_cache},
     END_OPT_SPECS
 };
 
@@ -64,6 +72,18 @@ bool options_traceroute_get_resolv_asn() {
     return resolv_asn;
 }
 
+bool options_traceroute_get_use_topology_cache() {
+    return use_topology_cache;
+}
+
+uint8_t options_traceroute_get_doubletree_ttl() {
+    return doubletree_ttl[0];
+}
+
+uint8_t options_traceroute_get_ttl_window() {
+    return ttl_window[0];
+}
+
 const option_t * traceroute_get_options() {
     return traceroute_options;
 }
@@ -78,6 +98,9 @@ void options_traceroute_init(traceroute_options_t * traceroute_options, address_
     traceroute_options->do_resolv        = options_traceroute_get_do_resolv();
     traceroute_options->print_ttl        = options_traceroute_get_print_ttl();
     traceroute_options->resolv_asn       = options_traceroute_get_resolv_asn();
+    traceroute_options->use_topology_cache = options_traceroute_get_use_topology_cache();
+    traceroute_options->doubletree_ttl   = options_traceroute_get_doubletree_ttl();
+    traceroute_options->ttl_window       = options_traceroute_get_ttl_window();
 }
 
 inline traceroute_options_t traceroute_get_default_options() {
@@ -90,6 +113,9 @@ inline traceroute_options_t traceroute_get_default_options() {
         .do_resolv        = OPTIONS_TRACEROUTE_DO_RESOLV_DEFAULT,
         .print_ttl        = OPTIONS_TRACEROUTE_PRINT_TTL_DEFAULT,
         .resolv_asn       = OPTIONS_TRACEROUTE_RESOLV_ASN_DEFAULT,
+        .use_topology_cache = OPTIONS_TRACEROUTE_USE_TOPOLOGY_CACHE_DEFAULT,
+        .doubletree_ttl   = OPTIONS_TRACEROUTE_DOUBLETREE_TTL_DEFAULT,
+        .ttl_window       = OPTIONS_TRACEROUTE_TTL_WINDOW_DEFAULT,
     };
     return traceroute_options;
 };
@@ -105,83 +131,141 @@ inline traceroute_options_t traceroute_get_default_options() {
  */
 
 static traceroute_data_t * traceroute_data_create() {
-    traceroute_data_t * traceroute_data;
-
-    if (!(traceroute_data = calloc(1, sizeof(traceroute_data_t)))) goto ERR_MALLOC;
-    if (!(traceroute_data->probes = dynarray_create()))            goto ERR_PROBES;
-    return traceroute_data;
-
-ERR_PROBES:
-    free(traceroute_data);
-ERR_MALLOC:
-    return NULL;
+    return calloc(1, sizeof(traceroute_data_t));
 }
 
-/**
- * \brief Release a traceroute_data_t instance from the memory
- * \param traceroute_data The traceroute_data_t instance we want to release.
- */
+void traceroute_data_free(traceroute_data_t * traceroute_data) {
+    size_t i;
 
-static void traceroute_data_free(traceroute_data_t * traceroute_data) {
     if (traceroute_data) {
-        if (traceroute_data->probes) {
-            // TODO this will provoke a double free
-            // dynarray_free(traceroute_data->probes, (ELEMENT_FREE) probe_free);
+        if (traceroute_data->hops) {
+            for (i = 0; i < traceroute_data->ttl_window; i++) {
+                dynarray_free(traceroute_data->hops[i].events, (ELEMENT_FREE) event_free);
+            }
+            free(traceroute_data->hops);
         }
         free(traceroute_data);
     }
 }
 
+size_t traceroute_data_get_num_live_probes(const traceroute_data_t * traceroute_data) {
+    size_t i, num_live_probes = traceroute_data->num_sent - traceroute_data->num_replies;
+
+    if (traceroute_data->hops) {
+        for (i = 0; i < traceroute_data->ttl_window; i++) {
+            num_live_probes += dynarray_get_size(traceroute_data->hops[i].events);
+        }
+    }
+    return num_live_probes;
+}
+
+size_t traceroute_data_get_memory_size(const traceroute_data_t * traceroute_data) {
+    size_t size = sizeof(traceroute_data_t);
+
+    if (traceroute_data->hops) {
+        size += traceroute_data->ttl_window * (sizeof(traceroute_hop_t) + sizeof(dynarray_t));
+    }
+    return size + traceroute_data_get_num_live_probes(traceroute_data) * traceroute_data->probe_memory_size;
+}
+
+void traceroute_data_dump_stats(const traceroute_data_t * traceroute_data) {
+    fprintf(stderr,
+        "traceroute: %zu probes sent, at most %zu probes alive (%zu bytes per probe, %zu bytes at most)\n",
+        traceroute_data->num_sent,
+        traceroute_data->max_live_probes,
+        traceroute_data->probe_memory_size,
+        traceroute_data->max_memory_size
+    );
+}
+
 //-----------------------------------------------------------------
 // Traceroute default handler
 //-----------------------------------------------------------------
 
-static inline void ttl_dump(const probe_t * probe) {
+/**
+ * \brief Print the TTL of a probe if it is the first probe printed for
+ *    this TTL. The line related to the previous TTL is ended if needed.
+ * \param out The output stream.
+ * \param probe The probe.
+ * \param pttl_printed Points to the TTL of the current line (0 if none).
+ * \return true iif a new line has been started.
+ */
+
+static inline bool ttl_dump(FILE * out, const probe_t * probe, uint8_t * pttl_printed) {
     uint8_t ttl;
-    if (probe_extract(probe, "ttl", &ttl)) printf("%2d ", ttl);
+
+    if (!probe_extract(probe, "ttl", &ttl) || ttl == *pttl_printed) return false;
+    if (*pttl_printed) fprintf(out, "\n");
+    fprintf(out, "%2d ", ttl);
+    *pttl_printed = ttl;
+    return true;
 }
 
-static inline void discovered_ip_dump(const probe_t * reply, bool do_resolv, bool resolv_asn) {
-    address_t   discovered_addr;
-    char      * discovered_hostname;
+/**
+ * \brief Print a discovered address and its hostname (see resolver_print_hostname).
+ * \param out The output stream.
+ * \param address The discovered address.
+ * \param hostname The corresponding hostname (NULL if unresolved).
+ */
 
-    if (probe_extract(reply, "src_ip", &discovered_addr)) {
-        printf(" ");
-        if (do_resolv) {
-            if (address_resolv(&discovered_addr, &discovered_hostname, CACHE_ENABLED)) {
-                printf("%s", discovered_hostname);
-                free(discovered_hostname);
-            } else {
-                address_dump(&discovered_addr);
-            }
-            printf(" (");
-        }
+static void discovered_hostname_dump(FILE * out, const address_t * address, const char * hostname) {
+    if (hostname) {
+        fprintf(out, "%s", hostname);
+    } else {
+        address_fprintf(out, address);
+    }
+    fprintf(out, " (");
+    address_fprintf(out, address);
+    fprintf(out, ")");
+}
 
-        address_dump(&discovered_addr);
+/**
+ * \brief Print the ASN of a discovered address (see whois_client_print_asn).
+ * \param out The output stream.
+ * \param address The discovered address.
+ * \param asn The corresponding ASN (0 if unknown).
+ */
 
-        if (do_resolv) {
-            printf(")");
+static void discovered_asn_dump(FILE * out, const address_t * address, uint32_t asn) {
+    if (asn) {
+        fprintf(out, "[AS%u] ", asn);
+    }
+}
+
+static inline void discovered_ip_dump(pt_loop_t * loop, const probe_t * reply, bool do_resolv, bool resolv_asn) {
+    address_t        discovered_addr;
+    resolver_t     * resolver;
+    whois_client_t * whois_client;
+    FILE           * out = pt_loop_get_stream(loop);
+
+    if (probe_extract(reply, "src_ip", &discovered_addr)) {
+        fprintf(out, " ");
+
+        // The hostname is printed once resolved, without delaying the probes
+        if (do_resolv && (resolver = pt_loop_get_resolver(loop))) {
+            resolver_print_hostname(resolver, pt_loop_get_hole_stream(loop), &discovered_addr, discovered_hostname_dump);
+        } else if (do_resolv) {
+            discovered_hostname_dump(out, &discovered_addr, NULL);
+        } else {
+            address_fprintf(out, &discovered_addr);
         }
 
-		if (resolv_asn) {
-			uint32_t asn = 0;
-			bool found = whois_get_asn(&discovered_addr, &asn, CACHE_ENABLED);
-			if (found) {
-				printf("[AS%u] ", asn);
-			}
-		}
+        // The ASN is printed once retrieved, without delaying the probes
+        if (resolv_asn && (whois_client = pt_loop_get_whois_client(loop))) {
+            whois_client_print_asn(whois_client, pt_loop_get_hole_stream(loop), &discovered_addr, discovered_asn_dump);
+        }
     }
 }
 
-static inline void delay_dump(const probe_t * probe, const probe_t * reply) {
+static inline void delay_dump(FILE * out, const probe_t * probe, const probe_t * reply) {
     double send_time = probe_get_sending_time(probe),
            recv_time = probe_get_recv_time(reply);
-    printf("  %-5.3lfms  ", 1000 * (recv_time - send_time));
+    fprintf(out, "  %-5.3lfms  ", 1000 * (recv_time - send_time));
 }
 
-static inline void ttl_reply_dump(const probe_t * reply) {
+static inline void ttl_reply_dump(FILE * out, const probe_t * reply) {
     uint8_t ttl_reply;
-    if (probe_extract(reply, "ttl", &ttl_reply)) printf("[%2d] ", ttl_reply);
+    if (probe_extract(reply, "ttl", &ttl_reply)) fprintf(out, "[%2d] ", ttl_reply);
 }
 
 void traceroute_handler(
@@ -192,7 +276,9 @@ void traceroute_handler(
 ) {
     const probe_t * probe;
     const probe_t * reply;
-    static size_t   num_probes_printed = 0;
+    FILE          * out = pt_loop_get_stream(loop);
+    static uint8_t  ttl_printed = 0;        // TTL of the current line (0 if none)
+    static size_t   num_probes_printed = 0; // Number of probes printed on the current line
 
     switch (traceroute_event->type) {
         case TRACEROUTE_PROBE_REPLY:
@@ -202,41 +288,49 @@ void traceroute_handler(
             reply = ((const probe_reply_t *) traceroute_event->data)->reply;
 
             // Print TTL and discovered IP if this is the first probe related to this TTL
-            if (num_probes_printed % traceroute_options->num_probes == 0) {
-                ttl_dump(probe);
-                discovered_ip_dump(reply, traceroute_options->do_resolv, traceroute_options->resolv_asn);
+            if (ttl_dump(out, probe, &ttl_printed)) {
+                num_probes_printed = 0;
+                discovered_ip_dump(loop, reply, traceroute_options->do_resolv, traceroute_options->resolv_asn);
             }
 
             // Print delay
-            delay_dump(probe, reply);
-            if (traceroute_options->print_ttl) ttl_reply_dump(reply);
-            fflush(stdout);
+            delay_dump(out, probe, reply);
+            if (traceroute_options->print_ttl) ttl_reply_dump(out, reply);
+            hole_stream_flush(pt_loop_get_hole_stream(loop));
             num_probes_printed++;
             break;
 
         case TRACEROUTE_STAR:
             probe = (const probe_t *) traceroute_event->data;
-            if (num_probes_printed % traceroute_options->num_probes == 0) {
-                ttl_dump(probe);
+            if (ttl_dump(out, probe, &ttl_printed)) {
+                num_probes_printed = 0;
             }
-            printf(" *");
+            fprintf(out, " *");
             num_probes_printed++;
             break;
 
         case TRACEROUTE_ICMP_ERROR:
-            printf(" !");
+            fprintf(out, " !");
             num_probes_printed++;
             break;
 
         case TRACEROUTE_DESTINATION_REACHED:
         case TRACEROUTE_TOO_MANY_STARS:
         case TRACEROUTE_MAX_TTL_REACHED:
+        case TRACEROUTE_STOP_SET_REACHED:
+        case TRACEROUTE_MIN_TTL_REACHED:
+            // End the line of the last TTL (a hop confirmed thanks to the
+            // topology cache has less than num_probes probes)
+            if (ttl_printed) fprintf(out, "\n");
+            ttl_printed = 0;
+            break;
         default:
             break;
     }
 
-    if (num_probes_printed % traceroute_options->num_probes == 0) {
-        printf("\n");
+    if (ttl_printed && num_probes_printed == traceroute_options->num_probes) {
+        fprintf(out, "\n");
+        ttl_printed = 0;
     }
 }
 
@@ -261,6 +355,19 @@ static inline bool destination_reached(const address_t * dst_addr, const probe_t
     return ret;
 }
 
+/**
+ * \brief Update the peak memory usage of a traceroute instance.
+ * \param traceroute_data Data attached to this instance of traceroute algorithm
+ */
+
+static void traceroute_data_update_stats(traceroute_data_t * traceroute_data) {
+    size_t num_live_probes = traceroute_data_get_num_live_probes(traceroute_data),
+           memory_size     = traceroute_data_get_memory_size(traceroute_data);
+
+    traceroute_data->max_live_probes = MAX(traceroute_data->max_live_probes, num_live_probes);
+    traceroute_data->max_memory_size = MAX(traceroute_data->max_memory_size, memory_size);
+}
+
 /**
  * \brief Send a traceroute probe packet
  * \param loop The main loop
@@ -286,11 +393,14 @@ static bool send_traceroute_probe(
         probe_set_delay(probe, DOUBLE("delay", delay));
     }
     if (!probe_set_fields(probe, I8("ttl", ttl), NULL))         goto ERR_PROBE_SET_FIELDS;
-    if (!dynarray_push_element(traceroute_data->probes, probe)) goto ERR_PROBE_PUSH_ELEMENT;
 
+    // From now, the probe belongs to the network layer, then to the
+    // TRACEROUTE_PROBE_REPLY or TRACEROUTE_STAR event related to it.
+    traceroute_data->num_sent++;
+    traceroute_data->num_hop_probes++;
+    traceroute_data_update_stats(traceroute_data);
     return pt_send_probe(loop, probe);
 
-ERR_PROBE_PUSH_ELEMENT:
 ERR_PROBE_SET_FIELDS:
     probe_free(probe);
 ERR_PROBE_DUP:
@@ -310,11 +420,9 @@ static bool send_traceroute_probe_scheduled(
     // manage corrupted probes.
     if (!(probe = probe_dup(probe_skel)))                       goto ERR_PROBE_DUP;
     if (!probe_set_field(probe, I8("ttl", ttl)))                goto ERR_PROBE_SET_FIELD;
-    if (!dynarray_push_element(traceroute_data->probes, probe)) goto ERR_PROBE_PUSH_ELEMENT;
 
     return pt_send_probe(loop, probe);
 
-ERR_PROBE_PUSH_ELEMENT:
 ERR_PROBE_SET_FIELD:
     probe_free(probe);
 ERR_PROBE_DUP:
@@ -349,6 +457,370 @@ bool send_traceroute_probes(
     return true;
 }
 
+/**
+ * \brief Look up in the topology cache the hop related to a given TTL, and
+ *    prepare its confirmation.
+ * \param traceroute_data Data attached to this instance of traceroute algorithm
+ * \param dst_addr The destination address of this traceroute instance.
+ * \param ttl The TTL of the hop.
+ * \return true iif this hop is cached.
+ */
+
+static bool traceroute_find_cached_hop(traceroute_data_t * traceroute_data, const address_t * dst_addr, uint8_t ttl)
+{
+    const address_t * interface;
+
+    traceroute_data->has_cached_hop = false;
+    traceroute_data->is_cached_hop_confirmed = false;
+
+    if (traceroute_data->topology_cache && (interface = topology_cache_find(
+        traceroute_data->topology_cache,
+        &traceroute_data->src_addr,
+        dst_addr,
+        ttl,
+        traceroute_data->flow_id
+    ))) {
+        memcpy(&traceroute_data->cached_hop, interface, sizeof(address_t));
+        traceroute_data->has_cached_hop = true;
+    }
+
+    return traceroute_data->has_cached_hop;
+}
+
+/**
+ * \brief Record in the topology cache the interface which has replied to
+ *    a probe, and check whether it confirms the cached hop.
+ * \param traceroute_data Data attached to this instance of traceroute algorithm
+ * \param dst_addr The destination address of this traceroute instance.
+ * \param probe The probe.
+ * \param reply The reply.
+ */
+
+static void traceroute_update_cached_hop(
+    traceroute_data_t * traceroute_data,
+    const address_t   * dst_addr,
+    const probe_t     * probe,
+    const probe_t     * reply
+) {
+    address_t discovered_addr;
+    uint8_t   ttl;
+
+    if (!traceroute_data->topology_cache
+    ||  !probe_extract(probe, "ttl", &ttl)
+    ||  !probe_extract(reply, "src_ip", &discovered_addr)) {
+        return;
+    }
+
+    if (traceroute_data->has_cached_hop && address_compare(&traceroute_data->cached_hop, &discovered_addr) == 0) {
+        traceroute_data->is_cached_hop_confirmed = true;
+    }
+
+    topology_cache_add(
+        traceroute_data->topology_cache,
+        &traceroute_data->src_addr,
+        dst_addr,
+        ttl,
+        traceroute_data->flow_id,
+        &discovered_addr
+    );
+}
+
+/**
+ * \brief Record in the Doubletree stop sets the interface which has replied
+ *    to a probe, and check whether the current hop belongs to the stop set
+ *    related to the current direction (global stop set when probing forward,
+ *    local stop set when probing backward).
+ * \param traceroute_data Data attached to this instance of traceroute algorithm
+ * \param dst_addr The destination address of this traceroute instance.
+ * \param reply The reply.
+ * \param instance_id The identifier of this instance.
+ */
+
+static void traceroute_update_stop_sets(
+    traceroute_data_t * traceroute_data,
+    const address_t   * dst_addr,
+    const probe_t     * reply,
+    unsigned            instance_id
+) {
+    stop_set_t * stop_set = traceroute_data->stop_set;
+    address_t    discovered_addr;
+    unsigned     owner;
+
+    if (!stop_set || !probe_extract(reply, "src_ip", &discovered_addr)) {
+        return;
+    }
+
+    // An instance never stops on its own discoveries
+    owner = traceroute_data->is_backward ?
+        stop_set_find_local(stop_set, &discovered_addr) :
+        stop_set_find_global(stop_set, &discovered_addr, dst_addr);
+    if (owner && owner != instance_id) {
+        traceroute_data->stop_set_reached = true;
+    }
+
+    stop_set_add_local(stop_set, &discovered_addr, instance_id);
+    stop_set_add_global(stop_set, &discovered_addr, dst_addr, instance_id);
+}
+
+/**
+ * \brief Start to explore a hop.
+ * \param loop The main loop
+ * \param traceroute_data Data attached to this instance of traceroute algorithm
+ * \param probe_skel The probe skeleton used to craft the probe packets
+ * \param options The options of this instance of traceroute algorithm
+ * \param ttl The TTL of the hop
+ * \return true if successful
+ */
+
+static bool traceroute_explore_hop(
+    pt_loop_t                  * loop,
+    traceroute_data_t          * traceroute_data,
+    probe_t                    * probe_skel,
+    const traceroute_options_t * options,
+    uint8_t                      ttl
+) {
+    size_t num_probes;
+
+    traceroute_data->hop_ttl          = ttl;
+    traceroute_data->num_stars        = 0;
+    traceroute_data->num_hop_probes   = 0;
+    traceroute_data->stop_set_reached = false;
+
+    // A cached hop only needs to be confirmed
+    num_probes = traceroute_find_cached_hop(traceroute_data, options->dst_addr, ttl) ? 1 : options->num_probes;
+    return send_traceroute_probes(loop, traceroute_data, probe_skel, num_probes, ttl);
+}
+
+//-----------------------------------------------------------------
+// Windowed mode
+//-----------------------------------------------------------------
+
+/**
+ * \brief Allocate the hops probed in parallel in windowed mode.
+ * \param traceroute_data Data attached to this instance of traceroute algorithm
+ * \param ttl_window The number of hops probed in parallel.
+ * \return true iif successful
+ */
+
+static bool traceroute_window_create(traceroute_data_t * traceroute_data, size_t ttl_window)
+{
+    size_t i;
+
+    if (!(traceroute_data->hops = calloc(ttl_window, sizeof(traceroute_hop_t)))) goto ERR_CALLOC;
+    traceroute_data->ttl_window = ttl_window;
+
+    for (i = 0; i < ttl_window; i++) {
+        if (!(traceroute_data->hops[i].events = dynarray_create())) goto ERR_DYNARRAY_CREATE;
+    }
+    return true;
+
+ERR_DYNARRAY_CREATE:
+    while (i--) {
+        dynarray_free(traceroute_data->hops[i].events, NULL);
+    }
+    free(traceroute_data->hops);
+    traceroute_data->hops = NULL;
+ERR_CALLOC:
+    return false;
+}
+
+/**
+ * \brief Retrieve the state of a hop in windowed mode.
+ * \param traceroute_data Data attached to this instance of traceroute algorithm
+ * \param ttl The TTL of the hop. It must belong to the current window.
+ * \return The corresponding traceroute_hop_t instance.
+ */
+
+static inline traceroute_hop_t * traceroute_get_hop(const traceroute_data_t * traceroute_data, uint8_t ttl) {
+    return &traceroute_data->hops[ttl % traceroute_data->ttl_window];
+}
+
+/**
+ * \brief Update the state of the hop related to a probe in windowed mode.
+ * \param traceroute_data Data attached to this instance of traceroute algorithm
+ * \param dst_addr The destination address of this traceroute instance.
+ * \param probe The probe.
+ * \param reply The reply, NULL if the probe has expired.
+ */
+
+static void traceroute_update_hop(
+    traceroute_data_t * traceroute_data,
+    const address_t   * dst_addr,
+    const probe_t     * probe,
+    const probe_t     * reply
+) {
+    traceroute_hop_t * hop;
+    uint8_t            ttl;
+
+    if (!traceroute_data->hops || !probe_extract(probe, "ttl", &ttl)) {
+        return;
+    }
+
+    hop = traceroute_get_hop(traceroute_data, ttl);
+    hop->num_replies++;
+    if (reply) {
+        hop->destination_reached |= destination_reached(dst_addr, reply);
+    } else {
+        hop->num_stars++;
+    }
+}
+
+/**
+ * \brief Raise an event related to a probe. In windowed mode, the
+ *    event is delayed until the previous hops are complete, and dropped
+ *    if a stopping condition holds.
+ * \param loop The main loop
+ * \param traceroute_data Data attached to this instance of traceroute algorithm
+ * \param probe The probe related to this event.
+ * \param event The event.
+ * \return true iif successful
+ */
+
+static bool traceroute_raise_probe_event(
+    pt_loop_t         * loop,
+    traceroute_data_t * traceroute_data,
+    const probe_t     * probe,
+    event_t           * event
+) {
+    uint8_t ttl;
+
+    if (!traceroute_data->hops) {
+        return pt_raise_event(loop, event);
+    }
+
+    if (!event || !probe_extract(probe, "ttl", &ttl)) {
+        goto ERR_EVENT;
+    }
+
+    if (traceroute_data->is_stopped) {
+        event_free(event);
+        return true;
+    }
+
+    if (ttl == traceroute_data->hop_ttl) {
+        return pt_raise_event(loop, event);
+    }
+
+    if (!dynarray_push_element(traceroute_get_hop(traceroute_data, ttl)->events, event)) {
+        goto ERR_PUSH_ELEMENT;
+    }
+    return true;
+
+ERR_PUSH_ELEMENT:
+    event_free(event);
+ERR_EVENT:
+    return false;
+}
+
+/**
+ * \brief Raise or drop the events delayed for a hop in windowed mode.
+ * \param loop The main loop
+ * \param hop The hop.
+ * \param do_raise Pass true to raise the events, false to drop them.
+ * \return true iif successful
+ */
+
+static bool traceroute_hop_flush_events(pt_loop_t * loop, traceroute_hop_t * hop, bool do_raise)
+{
+    event_t * event;
+    size_t    i, num_events = dynarray_get_size(hop->events);
+    bool      ret = true;
+
+    for (i = 0; i < num_events; i++) {
+        event = dynarray_get_ith_element(hop->events, i);
+        if (do_raise) {
+            ret &= pt_raise_event(loop, event);
+        } else {
+            event_free(event);
+        }
+    }
+    dynarray_clear(hop->events, NULL);
+    return ret;
+}
+
+/**
+ * \brief Process the completed hops in TTL order and keep the window
+ *    of hops probed in parallel full.
+ * \param loop The main loop
+ * \param traceroute_data Data attached to this instance of traceroute algorithm
+ * \param probe_skel The probe skeleton used to craft the probe packets
+ * \param options The options of this instance of traceroute algorithm
+ * \return true if successful
+ */
+
+static bool traceroute_window_process(
+    pt_loop_t                  * loop,
+    traceroute_data_t          * traceroute_data,
+    probe_t                    * probe_skel,
+    const traceroute_options_t * options
+) {
+    traceroute_hop_t        * hop;
+    traceroute_event_type_t   type;
+    uint8_t                   ttl;
+
+    // Check the stopping conditions hop by hop, as in the default mode
+    while (!traceroute_data->is_stopped && traceroute_data->hop_ttl < traceroute_data->ttl) {
+        hop = traceroute_get_hop(traceroute_data, traceroute_data->hop_ttl);
+        if (hop->num_replies < hop->num_sent) break;
+
+        if (hop->num_stars == hop->num_sent) {
+            ++(traceroute_data->num_undiscovered);
+        } else {
+            traceroute_data->num_undiscovered = 0;
+        }
+
+        if (hop->destination_reached) {
+            // We've reached the destination
+            type = TRACEROUTE_DESTINATION_REACHED;
+        } else if (traceroute_data->hop_ttl >= options->max_ttl) {
+            // We've reached the maximum TTL
+            type = TRACEROUTE_MAX_TTL_REACHED;
+        } else if (traceroute_data->num_undiscovered == options->max_undiscovered) {
+            // We've only discovered stars for the last "max_undiscovered" hops, so give up
+            type = TRACEROUTE_TOO_MANY_STARS;
+        } else {
+            // Report the next hop
+            (traceroute_data->hop_ttl)++;
+            if (traceroute_data->hop_ttl < traceroute_data->ttl
+            && !traceroute_hop_flush_events(loop, traceroute_get_hop(traceroute_data, traceroute_data->hop_ttl), true)) {
+                return false;
+            }
+            continue;
+        }
+
+        pt_raise_event(loop, event_create(type, NULL, NULL, NULL));
+        traceroute_data->is_stopped = true;
+
+        // Drop the events related to the farther hops
+        for (ttl = traceroute_data->hop_ttl + 1; ttl < traceroute_data->ttl; ttl++) {
+            traceroute_hop_flush_events(loop, traceroute_get_hop(traceroute_data, ttl), false);
+        }
+    }
+
+    // Probe the next hops
+    while (!traceroute_data->is_stopped
+    &&     traceroute_data->ttl <= options->max_ttl
+    &&     traceroute_data->ttl < traceroute_data->hop_ttl + traceroute_data->ttl_window
+    ) {
+        hop = traceroute_get_hop(traceroute_data, traceroute_data->ttl);
+        hop->num_sent            = options->num_probes;
+        hop->num_replies         = 0;
+        hop->num_stars           = 0;
+        hop->destination_reached = false;
+        if (!send_traceroute_probes(loop, traceroute_data, probe_skel, options->num_probes, traceroute_data->ttl)) {
+            return false;
+        }
+        (traceroute_data->ttl)++;
+    }
+
+    // Wait for the probes in flight before leaving, their replies refer to this instance
+    if (traceroute_data->is_stopped && traceroute_data->num_replies == traceroute_data->num_sent) {
+        pt_raise_terminated(loop);
+    }
+
+    return true;
+}
+
 /**
  * \brief Handle events to a traceroute algorithm instance
  * \param loop The main loop
@@ -368,6 +840,8 @@ int traceroute_loop_handler(pt_loop_t * loop, event_t * event, void ** pdata, pr
     probe_reply_t        * probe_reply;     // (Probe, Reply) pair
     traceroute_options_t * options = opts;  // Options passed to this instance
     bool                   discover_next_hop = false;
+    bool                   discover_prev_hop = false;
+    bool                   has_probed_forward = false;
     bool                   has_terminated = false;
 
     switch (event->type) {
@@ -386,6 +860,37 @@ int traceroute_loop_handler(pt_loop_t * loop, event_t * event, void ** pdata, pr
             }
             *pdata = data;
             data->ttl = options->min_ttl;
+            data->probe_memory_size = probe_get_memory_size(probe_skel);
+
+            // Doubletree starts mid-path and shares its stop sets with
+            // the other instances of the loop.
+            if (options->doubletree_ttl) {
+                if (!(data->stop_set = pt_loop_get_stop_set(loop))) {
+                    goto FAILURE;
+                }
+                data->ttl = MIN(MAX(options->doubletree_ttl, options->min_ttl), options->max_ttl);
+            }
+            data->start_ttl = data->ttl;
+            data->hop_ttl   = data->ttl;
+
+            // The hops of a Doubletree or a cached trace are not probed in TTL order
+            if (options->ttl_window > 1 && !options->doubletree_ttl && !options->use_topology_cache) {
+                if (!traceroute_window_create(data, options->ttl_window)) {
+                    goto FAILURE;
+                }
+            }
+
+            // Hops are cached per (source, prefix, ttl, flow). ICMP probes
+            // do not carry any flow identifier, they all belong to flow 0.
+            if (options->use_topology_cache
+            &&  probe_extract(probe_skel, "src_ip", &data->src_addr)) {
+                if (!(data->topology_cache = topology_cache_get_shared())) {
+                    goto FAILURE;
+                }
+                if (!probe_extract(probe_skel, "flow_id", &data->flow_id)) {
+                    data->flow_id = 0;
+                }
+            }
             break;
 
         case PROBE_REPLY:
@@ -394,13 +899,21 @@ int traceroute_loop_handler(pt_loop_t * loop, event_t * event, void ** pdata, pr
             reply       = probe_reply->reply;
 
             // Reinitialize star counters, check wether we've discovered an IP address
+            // (in windowed mode, see traceroute_window_process)
             data->num_stars = 0;
-            data->num_undiscovered = 0;
+            if (!data->hops) data->num_undiscovered = 0;
             ++(data->num_replies);
             data->destination_reached |= destination_reached(options->dst_addr, reply);
+            traceroute_update_cached_hop(data, options->dst_addr, probe_reply->probe, reply);
+            traceroute_update_stop_sets(data, options->dst_addr, reply, loop->cur_instance->id);
+            traceroute_update_hop(data, options->dst_addr, probe_reply->probe, reply);
 
             // Notify the caller we've discovered an IP address
-            pt_raise_event(loop, event_create(TRACEROUTE_PROBE_REPLY, probe_reply, NULL, (ELEMENT_FREE) probe_reply_free));
+            if (!traceroute_raise_probe_event(loop, data, probe_reply->probe, event_create(
+                TRACEROUTE_PROBE_REPLY, probe_reply, NULL, (ELEMENT_FREE) probe_reply_deep_free
+            ))) {
+                goto FAILURE;
+            }
             break;
 
         case PROBE_TIMEOUT:
@@ -410,9 +923,14 @@ int traceroute_loop_handler(pt_loop_t * loop, event_t * event, void ** pdata, pr
             // Update counters
             ++(data->num_stars);
             ++(data->num_replies);
+            traceroute_update_hop(data, options->dst_addr, probe, NULL);
 
             // Notify the caller we've got a probe timeout
-            pt_raise_event(loop, event_create(TRACEROUTE_STAR, probe, NULL, (ELEMENT_FREE) probe_free));
+            if (!traceroute_raise_probe_event(loop, data, probe, event_create(
+                TRACEROUTE_STAR, probe, NULL, (ELEMENT_FREE) probe_free
+            ))) {
+                goto FAILURE;
+            }
             break;
 
         case ALGORITHM_TERM:
@@ -430,42 +948,87 @@ int traceroute_loop_handler(pt_loop_t * loop, event_t * event, void ** pdata, pr
             break;
     }
 
-    // Forward event to the caller
-    pt_throw(loop, loop->cur_instance->caller, event);
+    // Forward event to the caller. The probes and the replies carried by
+    // the network events belong to the TRACEROUTE_* events raised above.
+    if (event->type != PROBE_REPLY && event->type != PROBE_TIMEOUT) {
+        pt_throw(loop, loop->cur_instance->caller, event);
+    }
 
-    // Explore next hop
-    if ((data->num_replies % options->num_probes) == 0) {
-        if (data->destination_reached) {
+    if (data->hops) {
+        // Windowed mode
+        if (!traceroute_window_process(loop, data, probe_skel, options)) {
+            goto FAILURE;
+        }
+    } else if (data->num_replies == data->num_sent) {
+        // Explore next hop once every probe sent for the current hop is answered
+        if (data->has_cached_hop && !data->is_cached_hop_confirmed && data->num_hop_probes < options->num_probes) {
+            // The cached hop has not replied, the path may have changed:
+            // probe this hop as usual.
+            data->has_cached_hop = false;
+            if (!send_traceroute_probes(loop, data, probe_skel, options->num_probes - data->num_hop_probes, data->hop_ttl)) {
+                goto FAILURE;
+            }
+        } else if (data->is_backward) {
+            if (data->stop_set_reached) {
+                // The path toward the source is already known
+                pt_raise_event(loop, event_create(TRACEROUTE_STOP_SET_REACHED, NULL, NULL, NULL));
+                pt_raise_terminated(loop);
+            } else if (data->hop_ttl <= options->min_ttl) {
+                // We've reached the minimum TTL
+                pt_raise_event(loop, event_create(TRACEROUTE_MIN_TTL_REACHED, NULL, NULL, NULL));
+                pt_raise_terminated(loop);
+            } else discover_prev_hop = true;
+        } else if (data->destination_reached) {
             // We've reached the destination
             pt_raise_event(loop, event_create(TRACEROUTE_DESTINATION_REACHED, NULL, NULL, NULL));
-            pt_raise_terminated(loop);
+            has_probed_forward = true;
+        } else if (data->stop_set_reached) {
+            // The path toward the destination is already known
+            pt_raise_event(loop, event_create(TRACEROUTE_STOP_SET_REACHED, NULL, NULL, NULL));
+            has_probed_forward = true;
         } else if (data->ttl > options->max_ttl) {
             // We've reached the maximum TTL
             pt_raise_event(loop, event_create(TRACEROUTE_MAX_TTL_REACHED, NULL, NULL, NULL));
-            pt_raise_terminated(loop);
-        } else if (data->num_stars == options->num_probes) {
+            has_probed_forward = true;
+        } else if (data->num_hop_probes > 0 && data->num_stars == data->num_hop_probes) {
             // We've only discovered stars for the current hop
             ++(data->num_undiscovered);
             if (data->num_undiscovered == options->max_undiscovered) {
                 // We've only discovered stars for the last "max_undiscovered" hops, so give up
                 pt_raise_event(loop, event_create(TRACEROUTE_TOO_MANY_STARS, NULL, NULL, NULL));
-                pt_raise_terminated(loop);
+                has_probed_forward = true;
             } else {
                 // Skip this hop and explore the next one
                 discover_next_hop = true;
             }
         } else discover_next_hop = true;
 
-        if (discover_next_hop) {
-            data->num_stars = 0;
+        if (has_probed_forward) {
+            if (data->stop_set && data->start_ttl > options->min_ttl) {
+                // Doubletree: explore the hops preceding the first explored hop
+                data->is_backward = true;
+                data->hop_ttl     = data->start_ttl;
+                discover_prev_hop = true;
+            } else {
+                pt_raise_terminated(loop);
+            }
+        }
 
+        if (discover_next_hop) {
             // Discover the next hop
-            if (!send_traceroute_probes(loop, data, probe_skel, options->num_probes, data->ttl)) {
+            if (!traceroute_explore_hop(loop, data, probe_skel, options, data->ttl)) {
                 goto FAILURE;
             }
             (data->ttl)++;
         }
 
+        if (discover_prev_hop) {
+            // Discover the previous hop (Doubletree)
+            if (!traceroute_explore_hop(loop, data, probe_skel, options, data->hop_ttl - 1)) {
+                goto FAILURE;
+            }
+        }
+
     }
 
 HAS_TERMINATED:
@@ -9,6 +9,8 @@
 #include "../pt_loop.h"  // pt_loop_t
 #include "../dynarray.h" // dynarray_t
 #include "../options.h"  // option_t
+#include "../topology_cache.h" // topology_cache_t
+#include "../stop_set.h"   // stop_set_t
 
 #define OPTIONS_TRACEROUTE_MIN_TTL_DEFAULT            1
 #define OPTIONS_TRACEROUTE_MAX_TTL_DEFAULT            30
@@ -17,11 +19,16 @@
 #define OPTIONS_TRACEROUTE_DO_RESOLV_DEFAULT          true
 #define OPTIONS_TRACEROUTE_RESOLV_ASN_DEFAULT         false
 #define OPTIONS_TRACEROUTE_PRINT_TTL_DEFAULT          false
+#define OPTIONS_TRACEROUTE_USE_TOPOLOGY_CACHE_DEFAULT false
+#define OPTIONS_TRACEROUTE_DOUBLETREE_TTL_DEFAULT     0
+#define OPTIONS_TRACEROUTE_TTL_WINDOW_DEFAULT         1
 
 #define OPTIONS_TRACEROUTE_MIN_TTL          {OPTIONS_TRACEROUTE_MIN_TTL_DEFAULT,          1, 255}
 #define OPTIONS_TRACEROUTE_MAX_TTL          {OPTIONS_TRACEROUTE_MAX_TTL_DEFAULT,          1, 255}
 #define OPTIONS_TRACEROUTE_MAX_UNDISCOVERED {OPTIONS_TRACEROUTE_MAX_UNDISCOVERED_DEFAULT, 1, 255}
 #define OPTIONS_TRACEROUTE_NUM_QUERIES      {OPTIONS_TRACEROUTE_NUM_QUERIES_DEFAULT,      1, 255}
+#define OPTIONS_TRACEROUTE_DOUBLETREE_TTL   {OPTIONS_TRACEROUTE_DOUBLETREE_TTL_DEFAULT,   1, 255}
+#define OPTIONS_TRACEROUTE_TTL_WINDOW       {OPTIONS_TRACEROUTE_TTL_WINDOW_DEFAULT,       1, 255}
 
 #define TRACEROUTE_HELP_A "Perform AS path lookups in routing registries and print results directly after the corresponding addresses."
 #define TRACEROUTE_HELP_f "Start from the MIN_TTL hop (instead from 1), MIN_TTL must be between 1 and 255."
@@ -30,6 +37,9 @@
 #define TRACEROUTE_HELP_q "Set the number of probes per hop (default: 3)."
 #define TRACEROUTE_HELP_PRINT_TTL "Print the TTL of the reply packet."
 #define TRACEROUTE_HELP_M "Set the maximum number of consecutive unresponsive hops which causes the program to abort (default 3)."
+#define TRACEROUTE_HELP_DOUBLETREE "Use Doubletree: start at START_TTL, probe forward until reaching an (interface, destination prefix) pair already discovered in this loop, then backward until reaching an already discovered interface."
+#define TRACEROUTE_HELP_TTL_WINDOW "Probe up to NUM_TTLS consecutive hops in parallel (default: 1). Results are still reported hop by hop. Ignored with --doubletree and --topology-cache."
+#define TRACEROUTE_HELP_TOPOLOGY_CACHE "Confirm with a single probe the hops already discovered toward the same prefix, instead of sending NUM_QUERIES probes."
 
 // Get the different values of traceroute options
 uint8_t options_traceroute_get_min_ttl();
@@ -39,6 +49,9 @@ uint8_t options_traceroute_get_max_undiscovered();
 bool    options_traceroute_get_do_resolv();
 bool    options_traceroute_get_print_ttl();
 bool    options_traceroute_get_resolv_asn();
+bool    options_traceroute_get_use_topology_cache();
+uint8_t options_traceroute_get_doubletree_ttl();
+uint8_t options_traceroute_get_ttl_window();
 
 /*
  * Principle: (from man page)
@@ -53,19 +66,44 @@ bool    options_traceroute_get_resolv_asn();
  * Algorithm:
  *
  *     INIT:
- *         cur_ttl = min_ttl
+ *         cur_ttl = doubletree_ttl if set, min_ttl otherwise
  *         SEND
  *
  *     SEND:
- *         send num_probes probes with TTL = cur_ttl
+ *         if use_topology_cache and the hop at cur_ttl is cached
+ *             send 1 probe with TTL = cur_ttl
+ *         else
+ *             send num_probes probes with TTL = cur_ttl
+ *
+ *     CONFIRM:
+ *         (the cached hop has not replied, the path may have changed)
+ *         send num_probes - 1 probes with TTL = cur_ttl
  *
  *     PROBE_REPLY:
- *         if < num_probes
+ *         if some probes sent for cur_ttl are pending
  *             continue waiting
- *             if all_stars or destination_reached or stopping ICMP error
- *                 EXIT
- *             cur_ttl += 1
- *             SEND
+ *         else
+ *             if a cached hop is not confirmed
+ *                 CONFIRM
+ *             else if all_stars or destination_reached or stopping ICMP error
+ *             or (doubletree_ttl is set and a hop is in the global stop set)
+ *                 BACKWARD
+ *             else
+ *                 cur_ttl += 1
+ *                 SEND
+ *
+ *     BACKWARD: (Doubletree only, once forward probing is over)
+ *         probe cur_ttl = doubletree_ttl - 1, doubletree_ttl - 2... like in SEND
+ *         until min_ttl or a hop in the local stop set, then EXIT
+ *
+ * Doubletree stop sets are shared by the instances of a pt_loop_t
+ * (see stop_set_t and pt_loop_get_stop_set).
+ *
+ * If ttl_window > 1, the hops [cur_ttl, cur_ttl + ttl_window) are probed
+ * in parallel. The events related to a hop are delayed until the previous
+ * hops are complete, and the stopping conditions are checked hop by hop,
+ * as above. Once a stopping condition holds, the instance waits for the
+ * probes still in flight and drops the corresponding events.
  */
 
 //--------------------------------------------------------------------
@@ -81,6 +119,9 @@ typedef struct {
     bool              do_resolv;        /**< Resolv each discovered IP hop. */
     bool              print_ttl;      /**< Print the TTL of the reply. */
     bool              resolv_asn;       /**< Perform AS path lookups for each discovered IP hop. */
+    bool              use_topology_cache; /**< Confirm the hops cached by previous instances with a single probe. */
+    uint8_t           doubletree_ttl;   /**< TTL at which Doubletree starts probing, 0 to probe from min_ttl without stop sets. */
+    uint8_t           ttl_window;       /**< Number of hops probed in parallel. */
 } traceroute_options_t;
 
 const option_t * traceroute_get_options();
@@ -101,7 +142,9 @@ typedef enum {
     TRACEROUTE_ICMP_ERROR,          // | probe_t *       | The probe which has provoked the ICMP error
     TRACEROUTE_STAR,                // | probe_t *       | The probe which has been lost
     TRACEROUTE_MAX_TTL_REACHED,     // | NULL            | N/A
-    TRACEROUTE_TOO_MANY_STARS       // | NULL            | N/A
+    TRACEROUTE_TOO_MANY_STARS,      // | NULL            | N/A
+    TRACEROUTE_STOP_SET_REACHED,    // | NULL            | N/A (Doubletree: forward or backward probing stops)
+    TRACEROUTE_MIN_TTL_REACHED      // | NULL            | N/A (Doubletree: backward probing stops)
 } traceroute_event_type_t;
 
 // TODO since this structure should exactly match with a standard event_t, define a macro allowing to define custom events
@@ -113,15 +156,83 @@ typedef struct {
     void                  * zero;
 } traceroute_event_t;
 
+/**
+ * State of a hop probed in windowed mode (see traceroute_options_t::ttl_window).
+ */
+
+typedef struct {
+    size_t        num_sent;            /**< Number of probes sent at this TTL          */
+    size_t        num_replies;         /**< Number of probes answered or expired at this TTL */
+    size_t        num_stars;           /**< Number of probes lost at this TTL          */
+    bool          destination_reached; /**< True iif the destination has replied at this TTL */
+    dynarray_t  * events;              /**< traceroute_event_t raised once the previous hops are complete */
+} traceroute_hop_t;
+
 typedef struct {
     bool          destination_reached; /**< True iif the destination has been reached at least once for the current TTL */
-    uint8_t       ttl;                 /**< TTL currently explored                   */
-    size_t        num_replies;         /**< Total of probe sent for this instance    */
+    uint8_t       ttl;                 /**< Next TTL to explore forward              */
+    uint8_t       start_ttl;           /**< TTL of the first explored hop            */
+    uint8_t       hop_ttl;             /**< TTL of the current hop                   */
+    size_t        num_replies;         /**< Total of probe answered for this instance */
+    size_t        num_sent;            /**< Total of probe sent for this instance    */
+    size_t        num_hop_probes;      /**< Number of probe sent for the current hop */
     size_t        num_undiscovered;    /**< Number of consecutive undiscovered hops  */
     size_t        num_stars;           /**< Number of probe lost for the current hop */
-    dynarray_t  * probes;              /**< Probe instances allocated by traceroute  */
+    topology_cache_t * topology_cache; /**< Hops seen by previous instances (shared), NULL if not used */
+    address_t     src_addr;            /**< Source of the probes (key of the topology cache) */
+    uint16_t      flow_id;             /**< Flow of the probes (key of the topology cache) */
+    bool          has_cached_hop;      /**< True iif the current hop has been probed according to the topology cache */
+    bool          is_cached_hop_confirmed; /**< True iif the cached interface has replied for the current hop */
+    address_t     cached_hop;          /**< Interface expected for the current hop (if has_cached_hop) */
+    stop_set_t  * stop_set;            /**< Doubletree stop sets (shared by the instances of the loop), NULL if not used */
+    bool          is_backward;         /**< True iif probing backward (Doubletree) */
+    bool          stop_set_reached;    /**< True iif the current hop is in the stop set of the current direction */
+    traceroute_hop_t * hops;           /**< Windowed mode: the hop of TTL t is hops[t % ttl_window], NULL otherwise */
+    size_t        ttl_window;          /**< Windowed mode: number of hops probed in parallel */
+    bool          is_stopped;          /**< Windowed mode: true iif a stopping condition holds */
+    size_t        probe_memory_size;   /**< Memory allocated for each probe (see probe_get_memory_size) */
+    size_t        max_live_probes;     /**< Peak of traceroute_data_get_num_live_probes */
+    size_t        max_memory_size;     /**< Peak of traceroute_data_get_memory_size */
 } traceroute_data_t;
 
+// A probe sent by traceroute belongs to the network layer while it is in
+// flight, then to the TRACEROUTE_PROBE_REPLY or TRACEROUTE_STAR event
+// raised for it (in windowed mode, this event may be delayed). It is
+// released along with this event, so the memory of a trace depends on
+// the number of probes in flight rather than on the number of probes sent.
+
+/**
+ * \brief Release a traceroute_data_t instance from the memory
+ * \param traceroute_data The traceroute_data_t instance we want to release.
+ */
+
+void traceroute_data_free(traceroute_data_t * traceroute_data);
+
+/**
+ * \brief Retrieve the number of probes still owned by a traceroute instance,
+ *    i.e. in flight or carried by a delayed event (windowed mode).
+ * \param traceroute_data Data related to this instance of traceroute.
+ * \return The number of live probes.
+ */
+
+size_t traceroute_data_get_num_live_probes(const traceroute_data_t * traceroute_data);
+
+/**
+ * \brief Estimate the memory currently used by a traceroute instance
+ *    (its data and its live probes).
+ * \param traceroute_data Data related to this instance of traceroute.
+ * \return The corresponding number of bytes.
+ */
+
+size_t traceroute_data_get_memory_size(const traceroute_data_t * traceroute_data);
+
+/**
+ * \brief Print the memory statistics of a traceroute instance.
+ * \param traceroute_data Data related to this instance of traceroute.
+ */
+
+void traceroute_data_dump_stats(const traceroute_data_t * traceroute_data);
+
 //-----------------------------------------------------------------
 // Traceroute default handler
 //-----------------------------------------------------------------
@@ -0,0 +1,331 @@
+#include "yarrp.h"
+
+#include <errno.h>       // errno, EINVAL
+#include <stdlib.h>      // malloc, free
+#include <stdio.h>       // fprintf
+#include <string.h>      // memcpy
+#include <unistd.h>      // getpid
+#include <arpa/inet.h>   // htonl, ntohl
+#include <sys/socket.h>  // AF_INET
+
+#include "../probe.h"
+#include "../event.h"
+#include "../algorithm.h"
+#include "../common.h"   // get_timestamp, MAX
+#include "../containers/hashtable.h" // hash_uint64
+
+// Minimal delay between two batches of probes (in seconds)
+#define YARRP_MIN_DELAY 0.001
+
+//-----------------------------------------------------------------
+// Yarrp options
+//-----------------------------------------------------------------
+
+// Bounded integer parameters
+static unsigned prefix_len[3] = OPTIONS_YARRP_PREFIX_LEN;
+static unsigned rate[3]       = OPTIONS_YARRP_RATE;
+
+static option_t yarrp_options[] = {
+    // action           short      long                 metavar       help                   data
+    {opt_store_int_lim, OPT_NO_SF, "--yarrp-prefix-len", "PREFIX_LEN", YARRP_HELP_PREFIX_LEN, prefix_len},
+    {opt_store_int_lim, OPT_NO_SF, "--yarrp-rate",       "RATE",       YARRP_HELP_RATE,       rate},
+    END_OPT_SPECS
+};
+
+uint8_t options_yarrp_get_prefix_len() {
+    return prefix_len[0];
+}
+
+unsigned options_yarrp_get_rate() {
+    return rate[0];
+}
+
+const option_t * yarrp_get_options() {
+    return yarrp_options;
+}
+
+yarrp_options_t yarrp_get_default_options() {
+    yarrp_options_t yarrp_options = {
+        .traceroute_options = traceroute_get_default_options(),
+        .prefix_len         = OPTIONS_YARRP_PREFIX_LEN_DEFAULT,
+        .rate               = OPTIONS_YARRP_RATE_DEFAULT,
+        .key                = 0
+    };
+    return yarrp_options;
+}
+
+void options_yarrp_init(yarrp_options_t * yarrp_options) {
+    yarrp_options->prefix_len = options_yarrp_get_prefix_len();
+    yarrp_options->rate       = options_yarrp_get_rate();
+}
+
+//-----------------------------------------------------------------
+// Yarrp events
+//-----------------------------------------------------------------
+
+void yarrp_reply_dump(FILE * out, const yarrp_reply_t * reply)
+{
+    address_fprintf(out, &reply->dst_addr);
+    fprintf(out, " %hhu ", reply->ttl);
+    address_fprintf(out, &reply->hop_addr);
+    fprintf(out, " %.3lfms%s\n", reply->rtt, reply->is_destination ? " !D" : "");
+}
+
+//-----------------------------------------------------------------
+// Yarrp algorithm's data
+//-----------------------------------------------------------------
+
+/**
+ * \brief Allocate a yarrp_data_t instance.
+ * \param options The options of the yarrp instance.
+ * \param probe_skel The probe skeleton of the yarrp instance.
+ * \return The newly allocated yarrp_data_t instance, NULL otherwise.
+ */
+
+static yarrp_data_t * yarrp_data_create(const yarrp_options_t * options, const probe_t * probe_skel)
+{
+    yarrp_data_t               * data;
+    const traceroute_options_t * traceroute_options = &options->traceroute_options;
+
+    if (!traceroute_options->dst_addr || traceroute_options->dst_addr->family != AF_INET) {
+        fprintf(stderr, "yarrp: only IPv4 destinations are supported\n");
+        errno = EINVAL;
+        goto ERR_INVALID_OPTIONS;
+    }
+
+    if (traceroute_options->min_ttl > traceroute_options->max_ttl || options->prefix_len > 32 || !options->rate) {
+        errno = EINVAL;
+        goto ERR_INVALID_OPTIONS;
+    }
+
+    if (!(data = malloc(sizeof(yarrp_data_t)))) goto ERR_MALLOC;
+
+    address_get_prefix(traceroute_options->dst_addr, options->prefix_len, &data->prefix);
+    data->num_ttls    = traceroute_options->max_ttl - traceroute_options->min_ttl + 1;
+    data->num_probes  = (UINT64_C(1) << (32 - options->prefix_len)) * data->num_ttls;
+    data->num_sent    = 0;
+    data->num_replies = 0;
+    data->start_time  = 0;
+    data->key         = options->key ? options->key : hash_uint64((uint64_t) (get_timestamp() * 1000000) ^ ((uint64_t) getpid() << 32));
+
+    if (!(data->permutation = permutation_create(data->num_probes, data->key))) goto ERR_PERMUTATION_CREATE;
+    if (!(data->probe = probe_dup(probe_skel)))                                 goto ERR_PROBE_DUP;
+
+    return data;
+
+ERR_PROBE_DUP:
+    permutation_free(data->permutation);
+ERR_PERMUTATION_CREATE:
+    free(data);
+ERR_MALLOC:
+ERR_INVALID_OPTIONS:
+    return NULL;
+}
+
+void yarrp_data_free(yarrp_data_t * data)
+{
+    if (data) {
+        probe_free(data->probe);
+        permutation_free(data->permutation);
+        free(data);
+    }
+}
+
+//-----------------------------------------------------------------
+// Probe encoding
+//-----------------------------------------------------------------
+
+/**
+ * \brief Compute the byte checking that a reply is related to a probe
+ *    sent by a yarrp instance toward a given destination.
+ * \param data The data of the yarrp instance.
+ * \param dst_addr The destination of the probe.
+ * \return The corresponding byte.
+ */
+
+static uint8_t yarrp_get_check(const yarrp_data_t * data, const address_t * dst_addr) {
+    return (uint8_t) hash_uint64(data->key ^ ntohl(dst_addr->ip.ipv4.s_addr));
+}
+
+/**
+ * \brief Retrieve the number of milliseconds elapsed since the first probe.
+ * \param data The data of the yarrp instance.
+ * \param time A timestamp (see get_timestamp).
+ * \return The elapsed time in milliseconds, modulo 2^16.
+ */
+
+static uint16_t yarrp_get_elapsed_ms(const yarrp_data_t * data, double time) {
+    return (uint16_t) (uint64_t) ((time - data->start_time) * 1000);
+}
+
+/**
+ * \brief Forge and send the probe related to a given (destination, TTL) pair.
+ * \param loop The main loop.
+ * \param data The data of the yarrp instance.
+ * \param options The options of the yarrp instance.
+ * \param index The index of the (destination, TTL) pair.
+ * \return true iif successful
+ */
+
+static bool yarrp_send_probe(pt_loop_t * loop, yarrp_data_t * data, const yarrp_options_t * options, uint64_t index)
+{
+    address_t dst_addr;
+    uint8_t   ttl = options->traceroute_options.min_ttl + index % data->num_ttls;
+
+    memcpy(&dst_addr, &data->prefix, sizeof(address_t));
+    dst_addr.ip.ipv4.s_addr = htonl(ntohl(dst_addr.ip.ipv4.s_addr) + (uint32_t) (index / data->num_ttls));
+
+    if (!probe_set_fields(
+        data->probe,
+        ADDRESS("dst_ip", &dst_addr),
+        I8("ttl", ttl),
+        I16("identification", (ttl << 8) | yarrp_get_check(data, &dst_addr)),
+        NULL
+    )) {
+        return false;
+    }
+
+    return pt_send_stateless_probe(loop, data->probe, yarrp_get_elapsed_ms(data, get_timestamp()));
+}
+
+/**
+ * \brief Send the probes allowed by the rate, then set the timer
+ *    according to the next probe to send.
+ * \param loop The main loop.
+ * \param data The data of the yarrp instance.
+ * \param options The options of the yarrp instance.
+ * \return true iif successful
+ */
+
+static bool yarrp_send_probes(pt_loop_t * loop, yarrp_data_t * data, const yarrp_options_t * options)
+{
+    double   elapsed = get_timestamp() - data->start_time;
+    uint64_t num_allowed = MIN((uint64_t) (elapsed * options->rate) + 1, data->num_probes);
+
+    for (; data->num_sent < num_allowed; data->num_sent++) {
+        // A probe which cannot be sent (e.g. toward a broadcast address)
+        // does not stop the measurement.
+        yarrp_send_probe(loop, data, options, permutation_get(data->permutation, data->num_sent));
+    }
+
+    // Once every probe is sent, wait for the last replies.
+    return pt_set_timer(loop,
+        data->num_sent < data->num_probes ?
+            MAX((double) data->num_sent / options->rate - elapsed, YARRP_MIN_DELAY) :
+            network_get_timeout(loop->network)
+    );
+}
+
+//-----------------------------------------------------------------
+// Reply decoding
+//-----------------------------------------------------------------
+
+/**
+ * \brief Rebuild a yarrp_reply_t from a reply.
+ * \param data The data of the yarrp instance.
+ * \param options The options of the yarrp instance.
+ * \param reply A reply matching no flying probe.
+ * \param yarrp_reply The yarrp_reply_t to fill.
+ * \return true iif the reply is related to a probe of this yarrp instance.
+ */
+
+static bool yarrp_reply_decode(
+    const yarrp_data_t    * data,
+    const yarrp_options_t * options,
+    const probe_t         * reply,
+    yarrp_reply_t         * yarrp_reply
+) {
+    uint16_t id, tag;
+    uint8_t  ttl;
+
+    // The reply must be an IPv4 / ICMP / IPv4 / * packet: the quoted IP
+    // header is the 3rd layer and the tag is its 3rd checksum.
+    if (!probe_extract(reply, "src_ip", &yarrp_reply->hop_addr)
+    ||  !probe_extract_ext(reply, "dst_ip", 2, &yarrp_reply->dst_addr)
+    ||  !probe_extract_ext(reply, "identification", 2, &id)
+    ||  !probe_extract_ext(reply, "checksum", 3, &tag)
+    ||  yarrp_reply->dst_addr.family != AF_INET
+    ) {
+        return false;
+    }
+
+    ttl = id >> 8;
+    if ((uint8_t) id != yarrp_get_check(data, &yarrp_reply->dst_addr)
+    ||  ttl < options->traceroute_options.min_ttl
+    ||  ttl > options->traceroute_options.max_ttl
+    ) {
+        return false;
+    }
+
+    yarrp_reply->ttl            = ttl;
+    yarrp_reply->rtt            = (uint16_t) (yarrp_get_elapsed_ms(data, probe_get_recv_time(reply)) - tag);
+    yarrp_reply->is_destination = (address_compare(&yarrp_reply->hop_addr, &yarrp_reply->dst_addr) == 0);
+    return true;
+}
+
+//-----------------------------------------------------------------
+// Yarrp handler
+//-----------------------------------------------------------------
+
+int yarrp_handler(pt_loop_t * loop, event_t * event, void ** pdata, probe_t * probe_skel, void * opts)
+{
+    yarrp_data_t          * data = *pdata;
+    const yarrp_options_t * options = opts;
+    yarrp_reply_t         * yarrp_reply;
+
+    switch (event->type) {
+        case ALGORITHM_INIT:
+            if (!(data = yarrp_data_create(options, probe_skel))) goto FAILURE;
+            *pdata = data;
+            data->start_time = get_timestamp();
+            if (!yarrp_send_probes(loop, data, options)) goto FAILURE;
+            break;
+
+        case ALGORITHM_TIMER:
+            if (!data) break;
+            if (data->num_sent == data->num_probes) {
+                // Every probe has been sent and the last replies have been waited for
+                pt_raise_terminated(loop);
+            } else if (!yarrp_send_probes(loop, data, options)) {
+                goto FAILURE;
+            }
+            break;
+
+        case PROBE_UNMATCHED_REPLY:
+            // The reply is released once this event is processed
+            if (!data) break;
+            if (!(yarrp_reply = malloc(sizeof(yarrp_reply_t)))) goto FAILURE;
+            if (!yarrp_reply_decode(data, options, event->data, yarrp_reply)) {
+                // This reply is not related to this instance
+                free(yarrp_reply);
+                break;
+            }
+            data->num_replies++;
+            pt_raise_event(loop, event_create(YARRP_REPLY, yarrp_reply, NULL, free));
+            break;
+
+        case ALGORITHM_TERM:
+            // The caller allows us to free yarrp's data
+            yarrp_data_free(data);
+            *pdata = NULL;
+            pt_raise_terminated(loop);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+
+FAILURE:
+    pt_raise_error(loop);
+    return EINVAL;
+}
+
+static algorithm_t yarrp = {
+    .name    = "yarrp",
+    .handler = yarrp_handler,
+    .options = (const option_t *) &yarrp_options
+};
+
+ALGORITHM_REGISTER(yarrp);
@@ -0,0 +1,168 @@
+#ifndef LIBPT_ALGORITHMS_YARRP_H
+#define LIBPT_ALGORITHMS_YARRP_H
+
+#include <stdbool.h>          // bool
+#include <stdint.h>           // uint*_t
+#include <stdio.h>            // FILE
+
+#include "traceroute.h"       // traceroute_options_t
+#include "../address.h"       // address_t
+#include "../permutation.h"   // permutation_t
+#include "../probe.h"         // probe_t
+#include "../pt_loop.h"       // pt_loop_t
+#include "../options.h"       // option_t
+
+/*
+ * Principle: (Yarrp, "Yelling at Random Routers Progressively")
+ *
+ * Stateless randomized traceroute: every (destination, TTL) pair of
+ * dst_addr/prefix_len x [min_ttl, max_ttl] is probed exactly once, in the
+ * order given by a keyed pseudo-random permutation (see permutation_t), at
+ * a fixed rate. Consecutive probes are thus spread over many destinations
+ * and many routers, which avoids ICMP rate limiting.
+ *
+ * No state is kept per probe nor per destination: each probe carries the
+ * information needed to interpret its reply:
+ *   - the IPv4 identification field stores the TTL (high byte) and a
+ *     checksum of the destination and of the key (low byte), which allows
+ *     to discard the replies to other probes,
+ *   - the tag (see pt_send_stateless_probe) stores the sending time in
+ *     milliseconds, modulo 2^16,
+ * and the quoted IP header provides the destination. Each valid reply is
+ * reported by a YARRP_REPLY event as soon as it is sniffed; the traces
+ * are rebuilt by sorting these events per destination and per TTL.
+ *
+ * Algorithm:
+ *
+ *     INIT, ALGORITHM_TIMER:
+ *         if every probe has been sent (and their replies have been waited for)
+ *             EXIT
+ *         send the probes allowed by the rate since the beginning
+ *         set a timer for the next probe (or for the network timeout
+ *         once every probe has been sent)
+ *
+ *     PROBE_UNMATCHED_REPLY:
+ *         if the reply is related to a probe of this instance
+ *             raise YARRP_REPLY
+ *
+ * Only IPv4 is supported, and the destinations must quote the probe in
+ * their replies (e.g. ICMP port unreachable in response to UDP probes).
+ */
+
+#define OPTIONS_YARRP_PREFIX_LEN_DEFAULT 32
+#define OPTIONS_YARRP_RATE_DEFAULT       100
+
+#define OPTIONS_YARRP_PREFIX_LEN {OPTIONS_YARRP_PREFIX_LEN_DEFAULT, 8, 32}
+#define OPTIONS_YARRP_RATE       {OPTIONS_YARRP_RATE_DEFAULT,       1, 1000000}
+
+#define YARRP_HELP_PREFIX_LEN "Yarrp: trace every address of the /PREFIX_LEN prefix of the destination (default: 32, i.e. the destination only). PREFIX_LEN must be between 8 and 32."
+#define YARRP_HELP_RATE       "Yarrp: set the number of probes sent per second (default: 100)."
+
+uint8_t  options_yarrp_get_prefix_len();
+unsigned options_yarrp_get_rate();
+
+//--------------------------------------------------------------------
+// Options
+//--------------------------------------------------------------------
+
+typedef struct {
+    traceroute_options_t traceroute_options; /**< Only min_ttl, max_ttl and dst_addr are used */
+    uint8_t              prefix_len;         /**< Every address of dst_addr/prefix_len is traced */
+    unsigned             rate;               /**< Number of probes sent per second */
+    uint64_t             key;                /**< Key of the permutation, 0 to draw it randomly */
+} yarrp_options_t;
+
+const option_t * yarrp_get_options();
+
+/**
+ * \brief Retrieve the default options of yarrp.
+ * \return The corresponding yarrp_options_t structure.
+ */
+
+yarrp_options_t yarrp_get_default_options();
+
+/**
+ * \brief Initialize the yarrp options according to the command-line.
+ *    The traceroute options must be initialized separately
+ *    (see options_traceroute_init).
+ * \param yarrp_options The yarrp options.
+ */
+
+void options_yarrp_init(yarrp_options_t * yarrp_options);
+
+//--------------------------------------------------------------------
+// Custom-events raised by yarrp algorithm
+//--------------------------------------------------------------------
+
+typedef enum {
+    YARRP_REPLY  /**< data: yarrp_reply_t * */
+} yarrp_event_type_t;
+
+typedef struct {
+    yarrp_event_type_t type;
+    void             * data;
+    void            (* data_free)(void *); /**< Called in event_free to release data. Ignored if NULL. */
+    void             * zero;
+} yarrp_event_t;
+
+/**
+ * A reply to a yarrp probe, rebuilt from the reply alone.
+ */
+
+typedef struct {
+    address_t dst_addr;       /**< Destination of the probe */
+    address_t hop_addr;       /**< Address of the IP hop which has replied */
+    uint8_t   ttl;            /**< TTL of the probe */
+    double    rtt;            /**< Round-trip time in milliseconds (1ms resolution) */
+    bool      is_destination; /**< True iif the destination itself has replied */
+} yarrp_reply_t;
+
+/**
+ * \brief Print a YARRP_REPLY event.
+ * \param out The output stream.
+ * \param reply A yarrp_reply_t instance.
+ */
+
+void yarrp_reply_dump(FILE * out, const yarrp_reply_t * reply);
+
+//--------------------------------------------------------------------
+// Data
+//--------------------------------------------------------------------
+
+typedef struct {
+    permutation_t * permutation;  /**< Order in which the (destination, TTL) pairs are probed */
+    probe_t       * probe;        /**< Probe altered and sent again for each (destination, TTL) pair */
+    address_t       prefix;       /**< First destination (dst_addr/prefix_len) */
+    uint8_t         num_ttls;     /**< Number of TTLs probed per destination */
+    uint64_t        key;          /**< Key of the permutation, also used to check the replies */
+    uint64_t        num_probes;   /**< Number of (destination, TTL) pairs */
+    uint64_t        num_sent;     /**< Number of probes sent so far */
+    uint64_t        num_replies;  /**< Number of valid replies received so far */
+    double          start_time;   /**< Time at which the first probe has been sent */
+} yarrp_data_t;
+
+/**
+ * \brief Release the data of a yarrp instance from the memory.
+ * \param data A yarrp_data_t instance.
+ */
+
+void yarrp_data_free(yarrp_data_t * data);
+
+//-----------------------------------------------------------------
+// Yarrp handler
+//-----------------------------------------------------------------
+
+/**
+ * \brief Handle events related to a yarrp instance.
+ * \param loop The main loop.
+ * \param event The event related to this instance.
+ * \param pdata Points to the yarrp_data_t of this instance.
+ * \param probe_skel The probe skeleton (its ports, protocol and payload
+ *    are used by every probe).
+ * \param options Points to a yarrp_options_t instance.
+ * \return 0 if successful, an errno value otherwise.
+ */
+
+int yarrp_handler(pt_loop_t * loop, event_t * event, void ** pdata, probe_t * probe_skel, void * options);
+
+#endif // LIBPT_ALGORITHMS_YARRP_H
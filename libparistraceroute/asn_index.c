@@ -0,0 +1,522 @@
+#include "use.h"
+#include "config.h"
+
+#include <errno.h>          // errno, EINVAL
+#include <stdlib.h>         // malloc, calloc, free, strtoul
+#include <string.h>         // memcmp, memcpy, memset, strchr, strtok_r
+#include <ctype.h>          // isdigit
+#include <fcntl.h>          // open, O_RDONLY
+#include <unistd.h>         // close, unlink
+#include <arpa/inet.h>      // htonl, ntohl, inet_pton
+#include <sys/mman.h>       // mmap, munmap
+#include <sys/stat.h>       // fstat
+#include <sys/socket.h>     // AF_INET, AF_INET6
+
+#include "asn_index.h"
+
+#define ASN_INDEX_KEY_SIZE_IPV4 4
+#define ASN_INDEX_KEY_SIZE_IPV6 16
+#define ASN_INDEX_LINE_SIZE     1024
+
+//---------------------------------------------------------------------------
+// Prefixes (internal usage)
+//---------------------------------------------------------------------------
+
+static inline int prefix_get_bit(const uint8_t * prefix, size_t i) {
+    return (prefix[i / 8] >> (7 - i % 8)) & 1;
+}
+
+/**
+ * \brief Compute the number of leading bits shared by two prefixes.
+ * \param x A prefix.
+ * \param y A prefix.
+ * \param max_length The number of bits to compare.
+ * \return The length of the common prefix.
+ */
+
+static size_t prefix_get_common_length(const uint8_t * x, const uint8_t * y, size_t max_length) {
+    size_t i;
+
+    for (i = 0; i < max_length && x[i / 8] == y[i / 8]; i += 8);
+    for (; i < max_length && prefix_get_bit(x, i) == prefix_get_bit(y, i); i++);
+    return i < max_length ? i : max_length;
+}
+
+/**
+ * \brief Check whether the leading bits of a key match a prefix.
+ * \param prefix The prefix (its bits beyond length are 0).
+ * \param key The key.
+ * \param length The length of the prefix.
+ * \return true iif the key belongs to the prefix.
+ */
+
+static inline bool prefix_match(const uint8_t * prefix, const uint8_t * key, size_t length) {
+    size_t num_bytes = length / 8;
+
+    if (memcmp(prefix, key, num_bytes) != 0) return false;
+    return length % 8 == 0
+        || prefix[num_bytes] == (key[num_bytes] & (0xff << (8 - length % 8)));
+}
+
+/**
+ * \brief Clear the bits of a prefix beyond its length.
+ * \param prefix The prefix.
+ * \param length The length of the prefix.
+ * \param key_size The size (in bytes) of prefix.
+ */
+
+static void prefix_mask(uint8_t * prefix, size_t length, size_t key_size) {
+    size_t num_bytes = length / 8;
+
+    if (length % 8) prefix[num_bytes++] &= 0xff << (8 - length % 8);
+    memset(prefix + num_bytes, 0, key_size - num_bytes);
+}
+
+//---------------------------------------------------------------------------
+// Trie built in memory by asn_index_build (internal usage)
+//---------------------------------------------------------------------------
+
+typedef struct asn_index_node_s {
+    uint8_t                   prefix[ASN_INDEX_KEY_SIZE_IPV6]; /**< Prefix of this node */
+    size_t                    length;    /**< Length of the prefix */
+    uint32_t                  asn;       /**< Origin AS of the prefix, 0 if none */
+    uint32_t                  index;     /**< Position of this node in the index file */
+    struct asn_index_node_s * child[2];  /**< Subtrees */
+} asn_index_node_t;
+
+static asn_index_node_t * asn_index_node_create(const uint8_t * prefix, size_t length, uint32_t asn, size_t key_size) {
+    asn_index_node_t * node;
+
+    if ((node = calloc(1, sizeof(asn_index_node_t)))) {
+        memcpy(node->prefix, prefix, key_size);
+        prefix_mask(node->prefix, length, key_size);
+        node->length = length;
+        node->asn    = asn;
+    }
+    return node;
+}
+
+static void asn_index_node_free(asn_index_node_t * node) {
+    if (node) {
+        asn_index_node_free(node->child[0]);
+        asn_index_node_free(node->child[1]);
+        free(node);
+    }
+}
+
+/**
+ * \brief Insert a prefix in a path-compressed trie.
+ * \param proot Points to the root of the trie (NULL if empty).
+ * \param prefix The prefix (its bits beyond length are 0).
+ * \param length The length of the prefix.
+ * \param asn The origin AS of the prefix.
+ * \param key_size The size (in bytes) of prefix.
+ * \return true iif successful.
+ */
+
+static bool asn_index_node_insert(asn_index_node_t ** proot, const uint8_t * prefix, size_t length, uint32_t asn, size_t key_size) {
+    asn_index_node_t ** pnode = proot,
+                      * node,
+                      * parent,
+                      * leaf;
+    size_t              common_length;
+
+    while ((node = *pnode)) {
+        common_length = prefix_get_common_length(node->prefix, prefix, length < node->length ? length : node->length);
+
+        if (common_length == node->length) {
+            if (length == node->length) {
+                node->asn = asn;
+                return true;
+            }
+            pnode = &node->child[prefix_get_bit(prefix, node->length)];
+            continue;
+        }
+
+        // The prefix diverges from node (or contains it): insert a new parent
+        if (!(parent = asn_index_node_create(prefix, common_length, 0, key_size))) return false;
+        parent->child[prefix_get_bit(node->prefix, common_length)] = node;
+        if (common_length == length) {
+            parent->asn = asn;
+        } else {
+            if (!(leaf = asn_index_node_create(prefix, length, asn, key_size))) {
+                free(parent);
+                return false;
+            }
+            parent->child[prefix_get_bit(prefix, common_length)] = leaf;
+        }
+        *pnode = parent;
+        return true;
+    }
+
+    return (*pnode = asn_index_node_create(prefix, length, asn, key_size)) != NULL;
+}
+
+/**
+ * \brief Number the nodes of a trie in preorder.
+ * \param node The root of the trie (possibly NULL).
+ * \param pnum_nodes Points to the number of nodes already numbered.
+ */
+
+static void asn_index_node_number(asn_index_node_t * node, uint32_t * pnum_nodes) {
+    if (node) {
+        node->index = (*pnum_nodes)++;
+        asn_index_node_number(node->child[0], pnum_nodes);
+        asn_index_node_number(node->child[1], pnum_nodes);
+    }
+}
+
+static inline uint8_t * asn_index_put_uint32(uint8_t * p, uint32_t x) {
+    x = htonl(x);
+    memcpy(p, &x, sizeof(x));
+    return p + sizeof(x);
+}
+
+static inline uint32_t asn_index_get_uint32(const uint8_t * p) {
+    uint32_t x;
+
+    memcpy(&x, p, sizeof(x));
+    return ntohl(x);
+}
+
+/**
+ * \brief Write the nodes of a trie in preorder (see asn_index_node_number).
+ * \param out The stream to write to.
+ * \param node The root of the trie (possibly NULL).
+ * \param key_size The size (in bytes) of the prefixes.
+ * \return true iif successful.
+ */
+
+static bool asn_index_node_write(FILE * out, const asn_index_node_t * node, size_t key_size) {
+    uint8_t   buffer[ASN_INDEX_NODE_SIZE + ASN_INDEX_KEY_SIZE_IPV6] = {0},
+            * p = buffer;
+
+    if (!node) return true;
+
+    p = asn_index_put_uint32(p, node->child[0] ? node->child[0]->index : 0);
+    p = asn_index_put_uint32(p, node->child[1] ? node->child[1]->index : 0);
+    p = asn_index_put_uint32(p, node->asn);
+    *p = node->length;
+    memcpy(buffer + ASN_INDEX_NODE_SIZE, node->prefix, key_size);
+
+    return fwrite(buffer, ASN_INDEX_NODE_SIZE + key_size, 1, out) == 1
+        && asn_index_node_write(out, node->child[0], key_size)
+        && asn_index_node_write(out, node->child[1], key_size);
+}
+
+/**
+ * \brief Fill the jump table of a trie (see asn_index.h).
+ * \param node The root of the trie (possibly NULL).
+ * \param table The jump table, whose nodes are initially UINT32_MAX and
+ *    whose ASNs are initially 0.
+ */
+
+static void asn_index_node_fill_table(const asn_index_node_t * node, uint8_t * table) {
+    size_t first, last, i;
+
+    if (!node) return;
+
+    // Parents are visited before their children, which override their ASN
+    first = (node->prefix[0] << 8 | node->prefix[1]) >> (16 - ASN_INDEX_STRIDE);
+    if (node->length >= ASN_INDEX_STRIDE) {
+        asn_index_put_uint32(table + 8 * first, node->index);
+        if (node->length == ASN_INDEX_STRIDE && node->asn) {
+            asn_index_put_uint32(table + 8 * first + 4, node->asn);
+        }
+        return;
+    }
+
+    if (node->asn) {
+        last = first + (1 << (ASN_INDEX_STRIDE - node->length));
+        for (i = first; i < last; i++) {
+            asn_index_put_uint32(table + 8 * i + 4, node->asn);
+        }
+    }
+    asn_index_node_fill_table(node->child[0], table);
+    asn_index_node_fill_table(node->child[1], table);
+}
+
+/**
+ * \brief Write a trie (see asn_index.h).
+ * \param out The stream to write to.
+ * \param root The root of the trie (possibly NULL).
+ * \param key_size The size (in bytes) of the prefixes.
+ * \return true iif successful.
+ */
+
+static bool asn_index_write_trie(FILE * out, const asn_index_node_t * root, size_t key_size) {
+    uint8_t * table;
+    size_t    i;
+    bool      ret;
+
+    if (!(table = calloc(1, ASN_INDEX_TABLE_SIZE))) return false;
+    for (i = 0; i < ASN_INDEX_TABLE_SIZE; i += 8) {
+        asn_index_put_uint32(table + i, UINT32_MAX);
+    }
+    asn_index_node_fill_table(root, table);
+
+    ret = fwrite(table, ASN_INDEX_TABLE_SIZE, 1, out) == 1
+       && asn_index_node_write(out, root, key_size);
+    free(table);
+    return ret;
+}
+
+/**
+ * \brief Parse a line of a prefix-to-AS dump (see asn_index_build).
+ * \param line The line (modified by this function).
+ * \param pfamily Points to an int where the family of the prefix is written.
+ * \param prefix A buffer of ASN_INDEX_KEY_SIZE_IPV6 bytes where the prefix is written.
+ * \param plength Points to a size_t where the length of the prefix is written.
+ * \param pasn Points to an uint32_t where the origin AS is written.
+ * \return true iif successful.
+ */
+
+static bool asn_index_parse_line(char * line, int * pfamily, uint8_t * prefix, size_t * plength, uint32_t * pasn) {
+    const char    * delimiters = " \t\r\n";
+    char          * str_prefix,
+                  * str_length,
+                  * str_asn,
+                  * slash,
+                  * end,
+                  * saveptr;
+    unsigned long   x;
+
+    if (!(str_prefix = strtok_r(line, delimiters, &saveptr))) return false;
+    if ((slash = strchr(str_prefix, '/'))) {
+        *slash = '\0';
+        str_length = slash + 1;
+    } else if (!(str_length = strtok_r(NULL, delimiters, &saveptr))) {
+        return false;
+    }
+    if (!(str_asn = strtok_r(NULL, delimiters, &saveptr))) return false;
+
+    *pfamily = strchr(str_prefix, ':') ? AF_INET6 : AF_INET;
+    if (inet_pton(*pfamily, str_prefix, prefix) != 1) return false;
+
+    x = strtoul(str_length, &end, 10);
+    if (end == str_length || *end || x > 8 * (*pfamily == AF_INET ? ASN_INDEX_KEY_SIZE_IPV4 : ASN_INDEX_KEY_SIZE_IPV6)) return false;
+    *plength = x;
+
+    // Skip "AS", "{", ... and keep the first origin of a multi-origin prefix
+    while (*str_asn && !isdigit(*str_asn)) str_asn++;
+    x = strtoul(str_asn, &end, 10);
+    if (end == str_asn || x > UINT32_MAX) return false;
+    *pasn = x;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// asn_index_t
+//---------------------------------------------------------------------------
+
+bool asn_index_build(FILE * dump, const char * filename, size_t * pnum_prefixes) {
+    asn_index_node_t * root_ipv4 = NULL,
+                     * root_ipv6 = NULL;
+    char               line[ASN_INDEX_LINE_SIZE],
+                     * s;
+    uint8_t            header[ASN_INDEX_HEADER_SIZE] = {0},
+                       prefix[ASN_INDEX_KEY_SIZE_IPV6];
+    int                family;
+    size_t             length,
+                       num_lines = 0,
+                       num_prefixes = 0;
+    uint32_t           asn,
+                       num_nodes_ipv4 = 0,
+                       num_nodes_ipv6 = 0;
+    bool               ret = false;
+    FILE             * out;
+
+    while (fgets(line, ASN_INDEX_LINE_SIZE, dump)) {
+        num_lines++;
+        for (s = line; isspace(*s); s++);
+        if (*s == '\0' || *s == '#') continue;
+
+        if (!asn_index_parse_line(s, &family, prefix, &length, &asn)) {
+            fprintf(stderr, "asn_index_build: invalid line %zu\n", num_lines);
+            goto ERR_PARSE_LINE;
+        }
+
+        if (!(family == AF_INET ?
+            asn_index_node_insert(&root_ipv4, prefix, length, asn, ASN_INDEX_KEY_SIZE_IPV4) :
+            asn_index_node_insert(&root_ipv6, prefix, length, asn, ASN_INDEX_KEY_SIZE_IPV6)
+        )) {
+            perror("asn_index_build");
+            goto ERR_NODE_INSERT;
+        }
+        num_prefixes++;
+    }
+
+    if (ferror(dump)) {
+        perror("asn_index_build");
+        goto ERR_READ_DUMP;
+    }
+
+    asn_index_node_number(root_ipv4, &num_nodes_ipv4);
+    asn_index_node_number(root_ipv6, &num_nodes_ipv6);
+
+    memcpy(header, ASN_INDEX_MAGIC, 4);
+    header[4] = ASN_INDEX_VERSION >> 8;
+    header[5] = ASN_INDEX_VERSION & 0xff;
+    asn_index_put_uint32(header + 8, num_nodes_ipv4);
+    asn_index_put_uint32(header + 12, num_nodes_ipv6);
+
+    if (!(out = fopen(filename, "wb"))) {
+        perror(filename);
+        goto ERR_FOPEN;
+    }
+
+    if (fwrite(header, ASN_INDEX_HEADER_SIZE, 1, out) != 1
+    ||  !asn_index_write_trie(out, root_ipv4, ASN_INDEX_KEY_SIZE_IPV4)
+    ||  !asn_index_write_trie(out, root_ipv6, ASN_INDEX_KEY_SIZE_IPV6)
+    ) {
+        perror(filename);
+        fclose(out);
+        goto ERR_WRITE;
+    }
+
+    if (fclose(out) != 0) {
+        perror(filename);
+        goto ERR_WRITE;
+    }
+
+    if (pnum_prefixes) *pnum_prefixes = num_prefixes;
+    ret = true;
+    goto SUCCESS;
+
+ERR_WRITE:
+    unlink(filename);
+SUCCESS:
+ERR_FOPEN:
+ERR_READ_DUMP:
+ERR_NODE_INSERT:
+ERR_PARSE_LINE:
+    asn_index_node_free(root_ipv4);
+    asn_index_node_free(root_ipv6);
+    return ret;
+}
+
+asn_index_t * asn_index_open(const char * filename) {
+    asn_index_t     * index;
+    struct stat       st;
+    const uint8_t   * header;
+    uint64_t          size;
+    int               fd;
+
+    if (!(index = malloc(sizeof(asn_index_t))))               goto ERR_MALLOC;
+    if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) == -1)    goto ERR_OPEN;
+    if (fstat(fd, &st) == -1)                                 goto ERR_FSTAT;
+    if (st.st_size < ASN_INDEX_HEADER_SIZE) {
+        errno = EINVAL;
+        goto ERR_INVALID_SIZE;
+    }
+
+    index->size = st.st_size;
+    if ((index->map = mmap(NULL, index->size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) goto ERR_MMAP;
+
+    // Check the header and the size of both tries
+    header = index->map;
+    index->num_nodes_ipv4 = asn_index_get_uint32(header + 8);
+    index->num_nodes_ipv6 = asn_index_get_uint32(header + 12);
+    size = ASN_INDEX_HEADER_SIZE + 2 * ASN_INDEX_TABLE_SIZE
+        + (uint64_t) index->num_nodes_ipv4 * (ASN_INDEX_NODE_SIZE + ASN_INDEX_KEY_SIZE_IPV4)
+        + (uint64_t) index->num_nodes_ipv6 * (ASN_INDEX_NODE_SIZE + ASN_INDEX_KEY_SIZE_IPV6);
+
+    if (memcmp(header, ASN_INDEX_MAGIC, 4) != 0
+    ||  ((header[4] << 8) | header[5]) != ASN_INDEX_VERSION
+    ||  size != index->size
+    ) {
+        errno = EINVAL;
+        goto ERR_INVALID_HEADER;
+    }
+
+    index->table_ipv4 = header + ASN_INDEX_HEADER_SIZE;
+    index->nodes_ipv4 = index->table_ipv4 + ASN_INDEX_TABLE_SIZE;
+    index->table_ipv6 = index->nodes_ipv4 + index->num_nodes_ipv4 * (ASN_INDEX_NODE_SIZE + ASN_INDEX_KEY_SIZE_IPV4);
+    index->nodes_ipv6 = index->table_ipv6 + ASN_INDEX_TABLE_SIZE;
+    close(fd);
+    return index;
+
+ERR_INVALID_HEADER:
+    munmap(index->map, index->size);
+ERR_MMAP:
+ERR_INVALID_SIZE:
+ERR_FSTAT:
+    close(fd);
+ERR_OPEN:
+    free(index);
+ERR_MALLOC:
+    return NULL;
+}
+
+void asn_index_close(asn_index_t * index) {
+    if (index) {
+        munmap(index->map, index->size);
+        free(index);
+    }
+}
+
+/**
+ * \brief Find the longest prefix matching a key in a trie of an index file.
+ * \param table The jump table of the trie.
+ * \param nodes The nodes of the trie.
+ * \param num_nodes The number of nodes of the trie.
+ * \param key The key.
+ * \param key_size The size (in bytes) of the key.
+ * \param asn The address of an uint32_t, where the ASN will be written
+ *    (iff successful).
+ * \return true iif a prefix matches the key.
+ */
+
+static bool asn_index_find_key(const uint8_t * table, const uint8_t * nodes, uint32_t num_nodes, const uint8_t * key, size_t key_size, uint32_t * asn) {
+    const uint8_t * node;
+    size_t          node_size = ASN_INDEX_NODE_SIZE + key_size,
+                    max_length = 8 * key_size,
+                    min_length = ASN_INDEX_STRIDE,
+                    length;
+    uint32_t        i,
+                    node_asn;
+    bool            found = false;
+
+    // The jump table resolves the leading bits of the key
+    table += 8 * ((key[0] << 8 | key[1]) >> (16 - ASN_INDEX_STRIDE));
+    if ((node_asn = asn_index_get_uint32(table + 4))) {
+        *asn = node_asn;
+        found = true;
+    }
+
+    for (i = asn_index_get_uint32(table); i < num_nodes; min_length = length + 1) {
+        node = nodes + i * node_size;
+        length = node[12];
+
+        // The prefixes strictly lengthen along a path
+        if (length < min_length || length > max_length) break;
+        if (!prefix_match(node + ASN_INDEX_NODE_SIZE, key, length)) break;
+
+        if ((node_asn = asn_index_get_uint32(node + 8))) {
+            *asn = node_asn;
+            found = true;
+        }
+
+        // The root is never a child: index 0 stands for no child
+        if (length == max_length) break;
+        if (!(i = asn_index_get_uint32(node + 4 * prefix_get_bit(key, length)))) break;
+    }
+    return found;
+}
+
+bool asn_index_find(const asn_index_t * index, const address_t * address, uint32_t * asn) {
+    switch (address->family) {
+        case AF_INET:
+            return asn_index_find_key(
+                index->table_ipv4, index->nodes_ipv4, index->num_nodes_ipv4,
+                (const uint8_t *) &address->ip.ipv4, ASN_INDEX_KEY_SIZE_IPV4, asn
+            );
+        case AF_INET6:
+            return asn_index_find_key(
+                index->table_ipv6, index->nodes_ipv6, index->num_nodes_ipv6,
+                (const uint8_t *) &address->ip.ipv6, ASN_INDEX_KEY_SIZE_IPV6, asn
+            );
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef LIBPT_ASN_INDEX_H
+#define LIBPT_ASN_INDEX_H
+
+/**
+ * \file asn_index.h
+ * \brief Offline IP to ASN lookups.
+ *
+ * An asn_index_t maps IPv4 and IPv6 prefixes to their origin AS. It is
+ * built once from a prefix-to-AS dump (e.g. derived from a BGP RIB) by
+ * asn_index_build(), and memory-mapped by asn_index_open(), so that
+ * loading it costs nothing and a lookup is a longest prefix match which
+ * does not need any network traffic.
+ */
+
+// Index file format
+//
+// An index file starts with a header:
+//
+//   magic (4 bytes, "PTAI") | version (uint16) | reserved (uint16)
+//   | num_nodes_ipv4 (uint32) | num_nodes_ipv6 (uint32)
+//
+// followed by the IPv4 trie, then by the IPv6 trie. Each trie is a
+// path-compressed binary trie, stored as a jump table followed by its
+// nodes (num_nodes_ipv4 or num_nodes_ipv6). The root is the first node.
+//
+// A node is stored as:
+//
+//   child[0] (uint32) | child[1] (uint32) | asn (uint32) | length (uint8)
+//   | reserved (3 bytes) | prefix (4 bytes in IPv4, 16 bytes in IPv6)
+//
+// child[b] is the index of the subtree where the bit following the
+// prefix is b (0 if none). asn is the origin AS of the prefix, 0 if the
+// node only joins two subtrees. The bits of the prefix beyond its length
+// are 0.
+//
+// The jump table skips the first levels of the trie. It has an entry
+// per value of the ASN_INDEX_STRIDE leading bits of an address:
+//
+//   node (uint32) | asn (uint32)
+//
+// node is the index of the first node of at least ASN_INDEX_STRIDE bits
+// on the path of these addresses (UINT32_MAX if none), and asn is the
+// origin AS of their longest prefix of at most ASN_INDEX_STRIDE bits
+// (0 if none). Integers are stored in network byte order.
+
+#include <stdbool.h>      // bool
+#include <stddef.h>       // size_t
+#include <stdint.h>       // uint32_t
+#include <stdio.h>        // FILE
+
+#include "address.h"      // address_t
+
+#define ASN_INDEX_MAGIC       "PTAI"
+#define ASN_INDEX_VERSION     1
+#define ASN_INDEX_HEADER_SIZE 16
+#define ASN_INDEX_NODE_SIZE   16   /**< Size of a node, prefix excluded */
+#define ASN_INDEX_STRIDE      16   /**< Number of bits resolved by a jump table */
+#define ASN_INDEX_TABLE_SIZE  (8 << ASN_INDEX_STRIDE) /**< Size of a jump table */
+
+typedef struct {
+    void          * map;             /**< Memory-mapped index file */
+    size_t          size;            /**< Size of map */
+    const uint8_t * table_ipv4;      /**< Jump table of the IPv4 trie */
+    const uint8_t * nodes_ipv4;      /**< Nodes of the IPv4 trie */
+    uint32_t        num_nodes_ipv4;  /**< Number of nodes of the IPv4 trie */
+    const uint8_t * table_ipv6;      /**< Jump table of the IPv6 trie */
+    const uint8_t * nodes_ipv6;      /**< Nodes of the IPv6 trie */
+    uint32_t        num_nodes_ipv6;  /**< Number of nodes of the IPv6 trie */
+} asn_index_t;
+
+/**
+ * \brief Build an index file from a prefix-to-AS dump.
+ *
+ * Each line of the dump holds a prefix and its origin AS, either as
+ * "PREFIX/LENGTH ASN" or as "ADDRESS LENGTH ASN" (CAIDA pfx2as format).
+ * Fields are separated by blanks. Empty lines and lines starting with
+ * '#' are ignored. If a prefix has several origins ("ASN_ASN",
+ * "ASN,ASN", ...), the first one is kept. If a prefix is listed twice,
+ * the last line wins.
+ *
+ * \param dump The dump to read.
+ * \param filename The path of the index file to write.
+ * \param pnum_prefixes Points to a size_t where the number of prefixes
+ *    read is written. Pass NULL if not needed.
+ * \return true iif successful.
+ */
+
+bool asn_index_build(FILE * dump, const char * filename, size_t * pnum_prefixes);
+
+/**
+ * \brief Open an index file built by asn_index_build.
+ * \param filename The path of the index file.
+ * \return The newly allocated asn_index_t instance, NULL otherwise.
+ */
+
+asn_index_t * asn_index_open(const char * filename);
+
+/**
+ * \brief Release an asn_index_t instance.
+ * \param index An asn_index_t instance.
+ */
+
+void asn_index_close(asn_index_t * index);
+
+/**
+ * \brief Retrieve the origin AS of the longest prefix matching an address.
+ * \param index An asn_index_t instance.
+ * \param address The queried address.
+ * \param asn The address of an uint32_t, where the ASN will be written
+ *    (iff successful).
+ * \return true iif a prefix matches the address.
+ */
+
+bool asn_index_find(const asn_index_t * index, const address_t * address, uint32_t * asn);
+
+#endif // LIBPT_ASN_INDEX_H
@@ -3,14 +3,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/time.h>
+#include <time.h>     // clock_gettime
 
 #include "common.h"
 
-// Note: for measuring intervals !
-//#include <time.h>
-//struct timespec ts;
-//clock_gettime(CLOCK_MONOTONIC, &ts);
-
 double get_timestamp()
 {
     struct timeval tim;
@@ -19,6 +15,14 @@ double get_timestamp()
     return tim.tv_sec + (tim.tv_usec / 1000000.0);
 }
 
+uint64_t get_monotonic_timestamp()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 void print_indent(unsigned int indent)
 {
     unsigned int i;
@@ -1,7 +1,9 @@
 #ifndef LIBPT_COMMON_H
 #define LIBPT_COMMON_H
 
-#include <stdio.h> // FILE *
+#include <stdio.h>  // FILE *
+#include <stdint.h> // uint64_t
+#include <stddef.h> // size_t
 
 //---------------------------------------------------------------------------
 // Callback types.
@@ -39,6 +41,12 @@
 
 #define ELEMENT_COMPARE int (*)(const void *, const void *)
 
+/**
+ * \brief Type related to a *_hash() function
+ */
+
+#define ELEMENT_HASH size_t (*)(const void *)
+
 //---------------------------------------------------------------------------
 // Misc
 //---------------------------------------------------------------------------
@@ -67,6 +75,14 @@
 
 double get_timestamp();
 
+/**
+ * \return The current value of the monotonic clock (in nanoseconds).
+ *    This value is not related to the wall-clock time and must only be
+ *    used to measure intervals or to compute deadlines.
+ */
+
+uint64_t get_monotonic_timestamp();
+
 /**
  * \bruef Print some space characters
  * \param indent The number of space characters to print
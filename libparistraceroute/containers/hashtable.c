@@ -0,0 +1,190 @@
+#include "config.h"
+
+#include <stdlib.h>     // malloc, calloc, free
+#include <stdint.h>     // uint8_t, uint64_t
+#include <assert.h>     // assert
+
+#include "hashtable.h"  // hashtable_t
+
+#define HASHTABLE_NUM_BUCKETS_INIT 64
+
+//---------------------------------------------------------------------------
+// Hash functions
+//---------------------------------------------------------------------------
+
+size_t hash_uint64(uint64_t x) {
+    // Finalizer of MurmurHash3
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return (size_t) x;
+}
+
+size_t hash_bytes(const void * bytes, size_t num_bytes) {
+    const uint8_t * p = bytes;
+    uint64_t        h = 0xcbf29ce484222325ULL;
+    size_t          i;
+
+    for (i = 0; i < num_bytes; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return (size_t) h;
+}
+
+//---------------------------------------------------------------------------
+// Internal usage
+//---------------------------------------------------------------------------
+
+static inline size_t hashtable_get_index(const hashtable_t * hashtable, size_t hash) {
+    return hash & (hashtable->num_buckets - 1);
+}
+
+/**
+ * \brief Retrieve the address of the pointer referencing the entry
+ *    related to a key.
+ * \param hashtable A hashtable_t instance.
+ * \param key The searched key.
+ * \param hash The hash of this key.
+ * \return The address of the pointer referencing the entry (this pointer
+ *    is NULL if the key is not stored in the hashtable_t instance).
+ */
+
+static hashtable_entry_t ** hashtable_find_impl(const hashtable_t * hashtable, const void * key, size_t hash) {
+    hashtable_entry_t ** pentry = &hashtable->buckets[hashtable_get_index(hashtable, hash)];
+
+    for (; *pentry; pentry = &(*pentry)->next) {
+        if ((*pentry)->hash == hash && hashtable->key_compare((*pentry)->key, key) == 0) {
+            break;
+        }
+    }
+    return pentry;
+}
+
+/**
+ * \brief Double the number of buckets of a hashtable_t instance.
+ * \param hashtable A hashtable_t instance.
+ * \return true iif successful.
+ */
+
+static bool hashtable_grow(hashtable_t * hashtable) {
+    hashtable_entry_t ** buckets = hashtable->buckets,
+                       * entry, * next;
+    size_t               i, index, num_buckets = hashtable->num_buckets;
+
+    if (!(hashtable->buckets = calloc(2 * num_buckets, sizeof(hashtable_entry_t *)))) {
+        hashtable->buckets = buckets;
+        return false;
+    }
+    hashtable->num_buckets = 2 * num_buckets;
+
+    for (i = 0; i < num_buckets; i++) {
+        for (entry = buckets[i]; entry; entry = next) {
+            next = entry->next;
+            index = hashtable_get_index(hashtable, entry->hash);
+            entry->next = hashtable->buckets[index];
+            hashtable->buckets[index] = entry;
+        }
+    }
+
+    free(buckets);
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// Public functions
+//---------------------------------------------------------------------------
+
+hashtable_t * hashtable_create_impl(
+    size_t (*key_hash)(const void * key),
+    int    (*key_compare)(const void * key1, const void * key2)
+) {
+    hashtable_t * hashtable;
+
+    assert(key_hash);
+    assert(key_compare);
+
+    if (!(hashtable = malloc(sizeof(hashtable_t)))) goto ERR_MALLOC;
+    if (!(hashtable->buckets = calloc(HASHTABLE_NUM_BUCKETS_INIT, sizeof(hashtable_entry_t *)))) {
+        goto ERR_BUCKETS;
+    }
+
+    hashtable->num_buckets = HASHTABLE_NUM_BUCKETS_INIT;
+    hashtable->num_entries = 0;
+    hashtable->key_hash    = key_hash;
+    hashtable->key_compare = key_compare;
+    return hashtable;
+
+ERR_BUCKETS:
+    free(hashtable);
+ERR_MALLOC:
+    return NULL;
+}
+
+void hashtable_free(hashtable_t * hashtable, void (*data_free)(void * data)) {
+    hashtable_entry_t * entry, * next;
+    size_t              i;
+
+    if (hashtable) {
+        for (i = 0; i < hashtable->num_buckets; i++) {
+            for (entry = hashtable->buckets[i]; entry; entry = next) {
+                next = entry->next;
+                if (data_free) data_free(entry->data);
+                free(entry);
+            }
+        }
+        free(hashtable->buckets);
+        free(hashtable);
+    }
+}
+
+bool hashtable_update(hashtable_t * hashtable, const void * key, void * data) {
+    hashtable_entry_t ** pentry, * entry;
+    size_t               hash = hashtable->key_hash(key);
+
+    pentry = hashtable_find_impl(hashtable, key, hash);
+    if (*pentry) {
+        (*pentry)->key  = key;
+        (*pentry)->data = data;
+        return true;
+    }
+
+    // Keep the load factor under 1 (growing is best effort).
+    if (hashtable->num_entries >= hashtable->num_buckets && hashtable_grow(hashtable)) {
+        pentry = hashtable_find_impl(hashtable, key, hash);
+    }
+
+    if (!(entry = malloc(sizeof(hashtable_entry_t)))) return false;
+    entry->key  = key;
+    entry->data = data;
+    entry->hash = hash;
+    entry->next = NULL;
+    *pentry = entry;
+    hashtable->num_entries++;
+    return true;
+}
+
+void * hashtable_find(const hashtable_t * hashtable, const void * key) {
+    hashtable_entry_t * entry = *hashtable_find_impl(hashtable, key, hashtable->key_hash(key));
+    return entry ? entry->data : NULL;
+}
+
+void * hashtable_erase(hashtable_t * hashtable, const void * key) {
+    hashtable_entry_t ** pentry, * entry;
+    void               * data = NULL;
+
+    pentry = hashtable_find_impl(hashtable, key, hashtable->key_hash(key));
+    if ((entry = *pentry)) {
+        data = entry->data;
+        *pentry = entry->next;
+        free(entry);
+        hashtable->num_entries--;
+    }
+    return data;
+}
+
+size_t hashtable_get_size(const hashtable_t * hashtable) {
+    return hashtable->num_entries;
+}
@@ -0,0 +1,114 @@
+#ifndef LIBPT_CONTAINER_HASHTABLE_H
+#define LIBPT_CONTAINER_HASHTABLE_H
+
+#include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint64_t
+
+#include "common.h"  // ELEMENT_HASH, ELEMENT_COMPARE
+
+/**
+ * hashtable_t maps keys to data in O(1) amortized time (separate chaining).
+ *
+ * The hashtable_t instance only stores references: it never duplicates nor
+ * releases the keys and the data it contains. Hence, each key must remain
+ * valid (and must not be altered) while it is stored in the hashtable_t
+ * instance. Typically, the key is a field of the data it refers to.
+ */
+
+typedef struct hashtable_entry_s {
+    const void               * key;  /**< Key of this entry */
+    void                     * data; /**< Data attached to this key */
+    size_t                     hash; /**< Hash of the key */
+    struct hashtable_entry_s * next; /**< Next entry of the same bucket */
+} hashtable_entry_t;
+
+typedef struct {
+    hashtable_entry_t ** buckets;      /**< Buckets (the number of buckets is a power of 2) */
+    size_t               num_buckets;  /**< Number of buckets */
+    size_t               num_entries;  /**< Number of stored entries */
+    size_t            (* key_hash)(const void * key);                      /**< Callback used to hash keys */
+    int               (* key_compare)(const void * key1, const void * key2); /**< Callback used to compare keys */
+} hashtable_t;
+
+/**
+ * \brief Create a hashtable_t instance.
+ * \param key_hash Callback used to hash keys (mandatory).
+ * \param key_compare Callback used to compare keys (mandatory). It must
+ *    return 0 iif both keys are equal.
+ * \return The newly allocated hashtable_t instance if successful, NULL otherwise.
+ */
+
+hashtable_t * hashtable_create_impl(
+    size_t (*key_hash)(const void * key),
+    int    (*key_compare)(const void * key1, const void * key2)
+);
+
+#define hashtable_create(key_hash, key_compare) hashtable_create_impl(\
+    (ELEMENT_HASH)    key_hash, \
+    (ELEMENT_COMPARE) key_compare \
+)
+
+/**
+ * \brief Release a hashtable_t instance from the memory.
+ * \param hashtable A hashtable_t instance.
+ * \param data_free Callback called on each stored data (may be set to NULL).
+ */
+
+void hashtable_free(hashtable_t * hashtable, void (*data_free)(void * data));
+
+/**
+ * \brief Attach a data to a key. If the key is already stored in the
+ *    hashtable_t instance, its data is replaced.
+ * \param hashtable A hashtable_t instance.
+ * \param key The key. It must remain valid while it is stored.
+ * \param data The data attached to this key.
+ * \return true iif successful.
+ */
+
+bool hashtable_update(hashtable_t * hashtable, const void * key, void * data);
+
+/**
+ * \brief Retrieve the data attached to a key.
+ * \param hashtable A hashtable_t instance.
+ * \param key The searched key.
+ * \return The corresponding data, NULL if not found.
+ */
+
+void * hashtable_find(const hashtable_t * hashtable, const void * key);
+
+/**
+ * \brief Remove a key from a hashtable_t instance.
+ * \param hashtable A hashtable_t instance.
+ * \param key The key to remove.
+ * \return The data which was attached to this key, NULL if not found.
+ */
+
+void * hashtable_erase(hashtable_t * hashtable, const void * key);
+
+/**
+ * \brief Retrieve the number of keys stored in a hashtable_t instance.
+ * \param hashtable A hashtable_t instance.
+ * \return The number of keys.
+ */
+
+size_t hashtable_get_size(const hashtable_t * hashtable);
+
+/**
+ * \brief Mix the bits of an integer (e.g. a key made of several fields).
+ * \param x An integer.
+ * \return The corresponding hash.
+ */
+
+size_t hash_uint64(uint64_t x);
+
+/**
+ * \brief Hash a sequence of bytes (FNV-1a).
+ * \param bytes The address of the first byte.
+ * \param num_bytes The number of bytes.
+ * \return The corresponding hash.
+ */
+
+size_t hash_bytes(const void * bytes, size_t num_bytes);
+
+#endif // LIBPT_CONTAINER_HASHTABLE_H
@@ -98,6 +98,31 @@ void * list_pop_element(list_t * list, void (*element_free)(void * element)) {
     return element;
 }
 
+size_t list_del_elements(
+    list_t * list,
+    bool  (* match)(const void * element, const void * data),
+    const void * data,
+    void  (* element_free)(void * element)
+) {
+    list_cell_t ** plist_cell = &list->head,
+                 * list_cell;
+    size_t         num_deleted = 0;
+
+    list->tail = NULL;
+    while ((list_cell = *plist_cell)) {
+        if (match(list_cell->element, data)) {
+            *plist_cell = list_cell->next;
+            list_cell_free(list_cell, element_free);
+            num_deleted++;
+        } else {
+            list->tail = list_cell;
+            plist_cell = &list_cell->next;
+        }
+    }
+
+    return num_deleted;
+}
+
 void list_fprintf(FILE * out, const list_t * list) {
     if (list->element_fprintf) {
         list_cell_t * cur = list->head;
@@ -97,6 +97,24 @@ bool list_push_element(list_t * list, void * element);
 
 void * list_pop_element(list_t * list, void (*element_free)(void * element));
 
+/**
+ * \brief Remove from a list every element matching a predicate.
+ * \param list Pointer to the list.
+ * \param match Function returning true iif the element passed as first
+ *    parameter must be removed.
+ * \param data The second parameter passed to match.
+ * \param element_free Pointer to a function to delete the removed elements
+ *    (may be set to NULL).
+ * \return The number of removed elements.
+ */
+
+size_t list_del_elements(
+    list_t * list,
+    bool  (* match)(const void * element, const void * data),
+    const void * data,
+    void  (* element_free)(void * element)
+);
+
 /**
  * \brief Print a list into a file.
  * \param out The file descriptor of the output file.
@@ -27,10 +27,12 @@ typedef enum {
     // Such events are dispatched to the appropriate algorithm instances
     PROBE_REPLY,               /**< A reply has been sniffed           */
     PROBE_TIMEOUT,             /**< No reply sniffed for a given probe */
+    PROBE_UNMATCHED_REPLY,     /**< A reply matching no flying probe has been sniffed (see pt_send_stateless_probe) */
 
     // Events handled the algorithm layer
     ALGORITHM_INIT,            /**< An algorithm can start             */
     ALGORITHM_TERM,            /**< An algorithm must terminate        */
+    ALGORITHM_TIMER,           /**< A timer set by an algorithm has expired (see pt_set_timer) */
 
     // Events raised by the algorithm layer
     ALGORITHM_EVENT,           /**< An algorithm has raised an event   */
@@ -0,0 +1,156 @@
+#include "use.h"
+#include "config.h"
+
+#include <stdlib.h>         // calloc, free
+#include <stdio.h>          // FILE, open_memstream, fopencookie
+#include <string.h>         // strdup
+#include <unistd.h>         // isatty
+
+#include "hole.h"
+
+struct hole_s {
+    char          * text;       /**< Text written in place of the hole */
+    bool            is_filled;  /**< True iif the text is known */
+    FILE          * stream;     /**< Text printed after the hole */
+    char          * buffer;     /**< Buffer of stream */
+    size_t          size;       /**< Size of buffer */
+    struct hole_s * next;       /**< Next hole */
+    hole_stream_t * hole_stream; /**< The hole_stream_t containing this hole */
+};
+
+// Holes are ordered according to their position in the stream.
+struct hole_stream_s {
+    FILE          * stream;     /**< Stream written by the caller (see hole_stream_get_stream) */
+    FILE          * out;        /**< Underlying output */
+    hole_t        * first_hole; /**< Oldest hole not yet written */
+    hole_t        * last_hole;  /**< Newest hole, whose stream receives the text printed meanwhile */
+};
+
+/**
+ * \brief Write the leading holes which are filled, followed by the text
+ *    printed after them.
+ * \param hole_stream A hole_stream_t instance.
+ */
+
+static void holes_flush(hole_stream_t * hole_stream) {
+    hole_t * hole;
+    FILE   * out = hole_stream->out;
+
+    while ((hole = hole_stream->first_hole) && hole->is_filled) {
+        hole_stream->first_hole = hole->next;
+        if (!hole_stream->first_hole) {
+            // Nothing is awaited anymore: print directly in the output
+            hole_stream->last_hole = NULL;
+        }
+
+        fclose(hole->stream);
+        if (hole->text) fputs(hole->text, out);
+        fwrite(hole->buffer, 1, hole->size, out);
+        free(hole->buffer);
+        free(hole->text);
+        free(hole);
+    }
+
+    // Like a line buffered stream, a terminal displays the holes as soon
+    // as they are filled. Otherwise, the output is flushed by its owner.
+    if (isatty(fileno(out))) fflush(out);
+}
+
+/**
+ * \brief Write function of the stream of a hole_stream_t (see fopencookie).
+ *    The text goes in the output, or after the last hole if any.
+ * \param cookie The hole_stream_t instance.
+ * \param data The bytes to write.
+ * \param size The number of bytes to write.
+ * \return The number of bytes written, -1 in case of failure.
+ */
+
+static ssize_t hole_stream_write(void * cookie, const char * data, size_t size) {
+    hole_stream_t * hole_stream = cookie;
+    FILE          * out = hole_stream->last_hole ? hole_stream->last_hole->stream : hole_stream->out;
+
+    return fwrite(data, 1, size, out) == size ? (ssize_t) size : -1;
+}
+
+hole_stream_t * hole_stream_create(FILE * out) {
+    hole_stream_t         * hole_stream;
+    cookie_io_functions_t   functions = {
+        .read  = NULL,
+        .write = hole_stream_write,
+        .seek  = NULL,
+        .close = NULL
+    };
+
+    if (!(hole_stream = calloc(1, sizeof(hole_stream_t))))                  goto ERR_CALLOC;
+    if (!(hole_stream->stream = fopencookie(hole_stream, "w", functions))) goto ERR_FOPENCOOKIE;
+
+    // The text is forwarded as soon as it is printed, so that a hole
+    // created afterwards never precedes it. The output keeps its own
+    // buffering (e.g. line buffered on a terminal).
+    setvbuf(hole_stream->stream, NULL, _IONBF, 0);
+    hole_stream->out = out;
+    return hole_stream;
+
+ERR_FOPENCOOKIE:
+    free(hole_stream);
+ERR_CALLOC:
+    return NULL;
+}
+
+void hole_stream_free(hole_stream_t * hole_stream) {
+    hole_t * hole;
+
+    if (hole_stream) {
+        for (hole = hole_stream->first_hole; hole; hole = hole->next) {
+            hole->is_filled = true;
+        }
+        holes_flush(hole_stream);
+        fclose(hole_stream->stream);
+        free(hole_stream);
+    }
+}
+
+FILE * hole_stream_get_stream(hole_stream_t * hole_stream) {
+    return hole_stream->stream;
+}
+
+void hole_stream_set_output(hole_stream_t * hole_stream, FILE * out) {
+    fflush(hole_stream->out);
+    hole_stream->out = out;
+}
+
+void hole_stream_flush(hole_stream_t * hole_stream) {
+    fflush(hole_stream->out);
+}
+
+bool hole_stream_is_pending(const hole_stream_t * hole_stream) {
+    return hole_stream->first_hole != NULL;
+}
+
+hole_t * hole_create(hole_stream_t * hole_stream) {
+    hole_t * hole;
+
+    if (!(hole = calloc(1, sizeof(hole_t))))                          goto ERR_CALLOC;
+    if (!(hole->stream = open_memstream(&hole->buffer, &hole->size))) goto ERR_OPEN_MEMSTREAM;
+
+    // From now on, the text is kept aside until the hole is filled
+    if (hole_stream->last_hole) {
+        hole_stream->last_hole->next = hole;
+    } else {
+        hole_stream->first_hole = hole;
+    }
+    hole_stream->last_hole = hole;
+    hole->hole_stream = hole_stream;
+    return hole;
+
+ERR_OPEN_MEMSTREAM:
+    free(hole);
+ERR_CALLOC:
+    return NULL;
+}
+
+void hole_fill(hole_t * hole, const char * text) {
+    hole->text      = text ? strdup(text) : NULL;
+    hole->is_filled = true;
+    holes_flush(hole->hole_stream);
+}
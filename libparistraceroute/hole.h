@@ -0,0 +1,94 @@
+#ifndef LIBPT_HOLE_H
+#define LIBPT_HOLE_H
+
+/**
+ * \file hole.h
+ * \brief Placeholders in an output stream.
+ *
+ * A hole_t reserves a place in a hole_stream_t for a text which is not yet
+ * known (e.g. a hostname resolved asynchronously, see resolver.h).
+ * Until every hole is filled, the text printed in the hole_stream_t is kept
+ * in memory streams, and is written in the underlying output once the holes
+ * preceding it are filled, so that the output keeps its order.
+ *
+ * The hole_stream_t is owned by its caller (see pt_loop_get_hole_stream):
+ * the global stdout is never modified.
+ */
+
+#include <stdbool.h>      // bool
+#include <stdio.h>        // FILE
+
+typedef struct hole_s        hole_t;
+typedef struct hole_stream_s hole_stream_t;
+
+/**
+ * \brief Create a hole_stream_t instance.
+ * \param out The stream in which the text is written once the holes
+ *    preceding it are filled (e.g. stdout).
+ * \return The newly allocated hole_stream_t instance, NULL otherwise.
+ */
+
+hole_stream_t * hole_stream_create(FILE * out);
+
+/**
+ * \brief Release a hole_stream_t instance. The holes not yet filled are
+ *    left empty, and the pending text is written in the underlying output.
+ *    The underlying output is neither flushed nor closed.
+ * \param hole_stream A hole_stream_t instance.
+ */
+
+void hole_stream_free(hole_stream_t * hole_stream);
+
+/**
+ * \brief Retrieve the stream in which the results must be printed
+ *    to keep their order with respect to the holes.
+ * \param hole_stream A hole_stream_t instance.
+ * \return The corresponding stream, closed by hole_stream_free.
+ */
+
+FILE * hole_stream_get_stream(hole_stream_t * hole_stream);
+
+/**
+ * \brief Change the underlying output of a hole_stream_t. The text already
+ *    written in the previous output is flushed.
+ * \param hole_stream A hole_stream_t instance.
+ * \param out The new underlying output.
+ */
+
+void hole_stream_set_output(hole_stream_t * hole_stream, FILE * out);
+
+/**
+ * \brief Flush the underlying output of a hole_stream_t. The text kept
+ *    until some holes are filled is not written.
+ * \param hole_stream A hole_stream_t instance.
+ */
+
+void hole_stream_flush(hole_stream_t * hole_stream);
+
+/**
+ * \brief Check whether some holes are not yet filled.
+ * \param hole_stream A hole_stream_t instance.
+ * \return true iif some text is kept in memory until some holes are filled.
+ */
+
+bool hole_stream_is_pending(const hole_stream_t * hole_stream);
+
+/**
+ * \brief Reserve a place at the current position of a hole_stream_t.
+ * \param hole_stream A hole_stream_t instance.
+ * \return The newly allocated hole_t instance, NULL otherwise.
+ */
+
+hole_t * hole_create(hole_stream_t * hole_stream);
+
+/**
+ * \brief Fill a hole and release it. The text is written in the underlying
+ *    output, along with what follows it, as soon as the previous holes
+ *    are filled.
+ * \param hole A hole_t instance.
+ * \param text The text to write in place of the hole (NULL to leave it empty).
+ */
+
+void hole_fill(hole_t * hole, const char * text);
+
+#endif // LIBPT_HOLE_H
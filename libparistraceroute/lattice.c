@@ -7,6 +7,8 @@
 
 #include "lattice.h"
 
+#define LATTICE_PENDING_SIZE_INIT 16
+
 //---------------------------------------------------------------------------
 // lattice_elt_t 
 //---------------------------------------------------------------------------
@@ -19,7 +21,8 @@ lattice_elt_t * lattice_elt_create(void * data)
     if (!(elt->next = dynarray_create()))           goto ERR_DYNARRAY_CREATE;
     if (!(elt->siblings = dynarray_create()))       goto ERR_DYNARRAY_CREATE2;
     if (!dynarray_push_element(elt->siblings, elt)) goto ERR_DYNARRAY_PUSH_ELEMENT;
-    elt->data = data;
+    elt->data       = data;
+    elt->generation = 0;
 
     return elt;
 
@@ -75,6 +78,7 @@ void lattice_free(lattice_t * lattice, void (*lattice_element_free)(void *elemen
     //if (lattice_element_free)
     //    lattice_element_free();
 
+    free(lattice->pending);
     free(lattice);
 }
 
@@ -86,66 +90,146 @@ void lattice_set_cmp(lattice_t * lattice, int (*cmp)(const void * x, const void
 }
 */
 
-static lattice_return_t lattice_walk_dfs_rec(
-    lattice_elt_t * elt, 
+/**
+ * \brief Ensure that lattice->pending can store a given number of nodes.
+ * \param lattice A lattice_t instance.
+ * \param num_pending The number of nodes.
+ * \return true iif successful.
+ */
+
+static bool lattice_reserve_pending(lattice_t * lattice, size_t num_pending)
+{
+    lattice_elt_t ** pending;
+    size_t           max_pending = lattice->max_pending ? lattice->max_pending : LATTICE_PENDING_SIZE_INIT;
+
+    if (num_pending <= lattice->max_pending) return true;
+
+    while (max_pending < num_pending) max_pending *= 2;
+    if (!(pending = realloc(lattice->pending, max_pending * sizeof(lattice_elt_t *)))) {
+        return false;
+    }
+    lattice->pending     = pending;
+    lattice->max_pending = max_pending;
+    return true;
+}
+
+/**
+ * \brief Call the visitor on a node and update the state of the walk.
+ * \param elt The visited node.
+ * \param visitor The visitor passed to lattice_walk.
+ * \param data The data passed to lattice_walk.
+ * \param pdone Points to a boolean set to false if the visitor
+ *    returns LATTICE_INTERRUPT_NEXT.
+ * \param pret Points to the value returned by the walk. It is updated
+ *    if the walk must stop.
+ * \return true iif the successors of this node must be visited.
+ */
+
+static inline bool lattice_visit(
+    lattice_elt_t     * elt,
+    lattice_return_t (* visitor)(lattice_elt_t *, void *),
+    void              * data,
+    bool              * pdone,
+    lattice_return_t  * pret
+) {
+    switch (visitor(elt, data)) {
+        case LATTICE_DONE:
+        case LATTICE_CONTINUE:       return true;
+        case LATTICE_INTERRUPT_NEXT: *pdone = false; return false;
+        case LATTICE_INTERRUPT_ALL:  *pret = LATTICE_INTERRUPT_ALL; return false;
+        default:                     *pret = LATTICE_ERROR; return false;
+    }
+}
+
+static lattice_return_t lattice_walk_dfs(
+    lattice_t * lattice,
     lattice_return_t (* visitor)(lattice_elt_t *, void *),
-    void          * data
+    void      * data
 ) {
-    lattice_elt_t    * elt_iter;
-    unsigned int       i, num_next;
-    lattice_return_t   ret;
+    lattice_elt_t    * elt;
+    size_t             i, num_next, num_pending = 0;
+    lattice_return_t   ret = LATTICE_DONE;
     bool               done = true;
 
-    // Process the current node...
-    ret = visitor(elt, data);
-    switch (ret) {
-        case LATTICE_DONE:           break;
-        case LATTICE_CONTINUE:       break;
-        case LATTICE_INTERRUPT_NEXT: return LATTICE_CONTINUE;
-        case LATTICE_INTERRUPT_ALL:  return LATTICE_INTERRUPT_ALL;
-        default:                     return LATTICE_ERROR;
-    }
+    // Push roots (and then successors) in reverse order so that they are
+    // popped (and thus visited) in order, like a recursive DFS does.
+    i = dynarray_get_size(lattice->roots);
+    if (!lattice_reserve_pending(lattice, i)) goto ERR_RESERVE;
+    while (i--) lattice->pending[num_pending++] = dynarray_get_ith_element(lattice->roots, i);
 
-    // ... then recurse on next ones 
-    num_next = dynarray_get_size(elt->next);
-    for (i = 0; i < num_next; i++) {
-        elt_iter = dynarray_get_ith_element(elt->next, i);
-        ret = lattice_walk_dfs_rec(elt_iter, visitor, data);
-        switch (ret) {
-            case LATTICE_DONE:           break;
-            case LATTICE_CONTINUE:       done = false; break;// continue the for
-            case LATTICE_INTERRUPT_ALL:  return LATTICE_INTERRUPT_ALL;
-            default:                     return LATTICE_ERROR;
+    while (num_pending) {
+        elt = lattice->pending[--num_pending];
+
+        // A node having several predecessors is visited only once
+        if (elt->generation == lattice->generation) continue;
+        elt->generation = lattice->generation;
+
+        if (!lattice_visit(elt, visitor, data, &done, &ret)) {
+            if (ret != LATTICE_DONE) return ret;
+            continue;
+        }
+
+        num_next = dynarray_get_size(elt->next);
+        if (!lattice_reserve_pending(lattice, num_pending + num_next)) goto ERR_RESERVE;
+        for (i = num_next; i--; ) {
+            lattice->pending[num_pending++] = dynarray_get_ith_element(elt->next, i);
         }
     }
 
     return done ? LATTICE_DONE : LATTICE_CONTINUE;
+
+ERR_RESERVE:
+    fprintf(stderr, "lattice_walk_dfs: cannot allocate memory\n");
+    return LATTICE_ERROR;
 }
 
-static lattice_return_t lattice_walk_dfs(
-    lattice_t * lattice,         
+static lattice_return_t lattice_walk_bfs(
+    lattice_t * lattice,
     lattice_return_t (* visitor)(lattice_elt_t *, void *),
     void      * data
 ) {
-    lattice_elt_t *  root;
-    size_t           i, num_roots;
-    lattice_return_t ret;
-    bool             done = true;
-    
-    // Process all roots
-    num_roots = dynarray_get_size(lattice->roots);
-    for (i = 0; i < num_roots; i++) {
-        root = dynarray_get_ith_element(lattice->roots, i);
-        ret = lattice_walk_dfs_rec(root, visitor, data);
-        switch (ret) {
-            case LATTICE_DONE:           break;
-            case LATTICE_CONTINUE:       done = false; break;// continue the for
-            case LATTICE_INTERRUPT_ALL:  return LATTICE_INTERRUPT_ALL;
-            default:                     return LATTICE_ERROR;
+    lattice_elt_t    * elt,
+                     * next;
+    size_t             i, num_next, head = 0, tail = 0;
+    lattice_return_t   ret = LATTICE_DONE;
+    bool               done = true;
+
+    // Each node is enqueued once, so the queue never exceeds the number of
+    // nodes: lattice->pending is used as a linear (non-circular) queue.
+    num_next = dynarray_get_size(lattice->roots);
+    if (!lattice_reserve_pending(lattice, num_next)) goto ERR_RESERVE;
+    for (i = 0; i < num_next; i++) {
+        elt = dynarray_get_ith_element(lattice->roots, i);
+        if (elt->generation != lattice->generation) {
+            elt->generation = lattice->generation;
+            lattice->pending[tail++] = elt;
+        }
+    }
+
+    while (head < tail) {
+        elt = lattice->pending[head++];
+
+        if (!lattice_visit(elt, visitor, data, &done, &ret)) {
+            if (ret != LATTICE_DONE) return ret;
+            continue;
+        }
+
+        num_next = dynarray_get_size(elt->next);
+        if (!lattice_reserve_pending(lattice, tail + num_next)) goto ERR_RESERVE;
+        for (i = 0; i < num_next; i++) {
+            next = dynarray_get_ith_element(elt->next, i);
+            if (next->generation != lattice->generation) {
+                next->generation = lattice->generation;
+                lattice->pending[tail++] = next;
+            }
         }
     }
 
     return done ? LATTICE_DONE : LATTICE_CONTINUE;
+
+ERR_RESERVE:
+    fprintf(stderr, "lattice_walk_bfs: cannot allocate memory\n");
+    return LATTICE_ERROR;
 }
 
 lattice_return_t lattice_walk(
@@ -154,12 +238,15 @@ lattice_return_t lattice_walk(
     void              * data,
     lattice_walk_t      walk
 ) {
+    // Nodes stamped with the previous generations are considered as
+    // not yet visited: no need to reset the marks between two walks.
+    lattice->generation++;
+
     switch (walk) {
         case LATTICE_WALK_DFS:
             return lattice_walk_dfs(lattice, visitor, data);
         case LATTICE_WALK_BFS:
-            fprintf(stderr, "lattice_walk: walk = LATTICE_WALK_BFS not yet implemented\n");
-            break;
+            return lattice_walk_bfs(lattice, visitor, data);
         default:
             break;
     }
@@ -205,7 +292,7 @@ static void * lattice_find(lattice_t * lattice, void * data)
 }
 */
 
-bool lattice_add_element(lattice_t * lattice, lattice_elt_t * predecessor, void * data)
+lattice_elt_t * lattice_add_element(lattice_t * lattice, lattice_elt_t * predecessor, void * data)
 {
     lattice_elt_t * elt;
    
@@ -223,13 +310,13 @@ bool lattice_add_element(lattice_t * lattice, lattice_elt_t * predecessor, void
         }
     }
 
-    return true;
+    return elt;
 
 ERR_LATTICE_CONNECT:
 ERR_DYNARRAY_PUSH_ELEMENT:
     lattice_elt_free(elt);
 ERR_LATTICE_ELT_CREATE:
-    return false;
+    return NULL;
 }
 
 bool lattice_connect(lattice_t * lattice, lattice_elt_t * u, lattice_elt_t * v)
@@ -295,3 +382,22 @@ static lattice_return_t lattice_element_dump(lattice_elt_t * elt, void * data) {
 void lattice_dump(lattice_t * lattice, void (*element_dump)(const void *)) {
     lattice_walk(lattice, lattice_element_dump, element_dump, LATTICE_WALK_DFS);
 }
+
+typedef struct {
+    FILE  * out;
+    void (* element_fprintf)(FILE *, const void *);
+} lattice_fprintf_data_t;
+
+static lattice_return_t lattice_element_fprintf(lattice_elt_t * elt, void * data) {
+    lattice_fprintf_data_t * fprintf_data = data;
+    if (fprintf_data->element_fprintf) fprintf_data->element_fprintf(fprintf_data->out, elt);
+    return LATTICE_CONTINUE;
+}
+
+void lattice_fprintf(FILE * out, lattice_t * lattice, void (*element_fprintf)(FILE *, const void *)) {
+    lattice_fprintf_data_t fprintf_data = {
+        .out             = out,
+        .element_fprintf = element_fprintf
+    };
+    lattice_walk(lattice, lattice_element_fprintf, &fprintf_data, LATTICE_WALK_DFS);
+}
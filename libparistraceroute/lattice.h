@@ -1,6 +1,9 @@
 #ifndef LIBPT_LATTICE_H
 #define LIBPT_LATTICE_H
 
+#include <stdint.h>   // uint64_t
+#include <stdio.h>    // FILE
+
 #include "dynarray.h"
 
 typedef enum {
@@ -21,9 +24,10 @@ typedef enum {
 //---------------------------------------------------------------------------
 
 typedef struct {
-    dynarray_t * next;     /**< Successors of this node */
-    dynarray_t * siblings; /**< Sibling elements (element having the same depth from the root) */
-    void       * data;     /**< Data stored in this node */
+    dynarray_t * next;       /**< Successors of this node */
+    dynarray_t * siblings;   /**< Sibling elements (element having the same depth from the root) */
+    void       * data;       /**< Data stored in this node */
+    uint64_t     generation; /**< Generation of the last lattice_walk() which has reached this node */
 } lattice_elt_t;
 
 /**
@@ -50,8 +54,11 @@ void * lattice_elt_get_data(const lattice_elt_t * elt);
 
 typedef struct {
     //lattice_elt_t *root;
-    dynarray_t * roots;
-    int       (* cmp)(const void *, const void *);
+    dynarray_t     * roots;
+    int           (* cmp)(const void *, const void *);
+    uint64_t         generation;   /**< Incremented by each lattice_walk(), used to mark visited nodes */
+    lattice_elt_t ** pending;      /**< Stack (DFS) or queue (BFS) used by lattice_walk() */
+    size_t           max_pending;  /**< Number of nodes that can be stored in pending */
 } lattice_t;
 
 /**
@@ -91,6 +98,26 @@ size_t lattice_elt_get_num_siblings(const lattice_elt_t * elt);
 
 //void lattice_set_cmp(lattice_t * lattice, int (*cmp)(const void *, const void *));
 
+/**
+ * \brief Visit each node reachable from the roots of a lattice exactly
+ *    once, even if it has several predecessors.
+ * \param lattice A lattice_t instance.
+ * \param visitor The callback called on each visited node. It returns:
+ *    - LATTICE_DONE or LATTICE_CONTINUE to visit its successors;
+ *    - LATTICE_INTERRUPT_NEXT to skip its successors (they may still be
+ *      visited through another predecessor);
+ *    - LATTICE_INTERRUPT_ALL to stop the walk;
+ *    - LATTICE_ERROR to abort the walk.
+ * \param data This pointer is passed to visitor.
+ * \param walk LATTICE_WALK_DFS (depth-first, pre-order) or LATTICE_WALK_BFS
+ *    (level-order).
+ * \return LATTICE_DONE if no visited node has returned LATTICE_INTERRUPT_NEXT,
+ *    LATTICE_CONTINUE otherwise, or the value returned by the visitor in
+ *    case of interruption or error.
+ * \warning Walks must not be nested: visitor must not call lattice_walk() on
+ *    the same lattice.
+ */
+
 lattice_return_t lattice_walk(lattice_t * lattice, lattice_return_t (*visitor)(lattice_elt_t *, void *), void * data, lattice_walk_t walk);
 
 /**
@@ -107,9 +134,10 @@ bool lattice_connect(lattice_t * lattice, lattice_elt_t * u, lattice_elt_t * v);
  * \param predecessor The predecessor of this node in the lattice.
  *    You may pass NULL if there is no predecessor. In this case, the new
  *    nodes is stored in lattice->roots.
+ * \return The newly created node if successful, NULL otherwise.
  */
 
-bool lattice_add_element(lattice_t * lattice, lattice_elt_t * predecessor, void * data);
+lattice_elt_t * lattice_add_element(lattice_t * lattice, lattice_elt_t * predecessor, void * data);
 
 /**
  * \brief Dump a lattice_t structure to the standard output.
@@ -119,4 +147,13 @@ bool lattice_add_element(lattice_t * lattice, lattice_elt_t * predecessor, void
  */
 void lattice_dump(lattice_t * lattice, void (* element_dump)(const void *));
 
+/**
+ * \brief Print a lattice_t structure.
+ * \param out The output stream.
+ * \param lattice A lattice_t instance.
+ * \param element_fprintf A function that print lattice_elt->data. You may
+ *    pass NULL if unused.
+ */
+void lattice_fprintf(FILE * out, lattice_t * lattice, void (* element_fprintf)(FILE *, const void *));
+
 #endif // LIBPT_LATTICE_H
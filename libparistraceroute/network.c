@@ -5,7 +5,7 @@
 #include <stdio.h>          // fprintf
 #include <stdbool.h>        // bool
 #include <time.h>           // time_t
-#include <unistd.h>         // close
+#include <unistd.h>         // close, read
 #include "os/sys/timerfd.h" // timerfd_create, timerfd_settime
 #include <arpa/inet.h>      // htons
 #include <limits.h>         // INT_MAX
@@ -18,6 +18,7 @@
 #include "options.h"        // option_t
 #include "probe.h"          // probe_extract_ext, probe_set_field_ext
 #include "algorithm.h"      // pt_algorithm_throw
+#include "uring.h"          // uring_set_timer
 
 // TODO static variable as timeout. Control extra_delay and timeout values consistency
 #define EXTRA_DELAY 0.01 // this extra delay provokes a probe timeout event if a probe will expires in less than EXTRA_DELAY seconds. Must be less than network->timeout.
@@ -27,11 +28,13 @@
 // Network options
 //---------------------------------------------------------------------------
 
-static double timeout[3] = OPTIONS_NETWORK_WAIT;
+static double   timeout[3]          = OPTIONS_NETWORK_WAIT;
+static unsigned recv_buffer_size[3] = OPTIONS_NETWORK_RECV_BUFFER_SIZE;
 
 static option_t network_options[] = {
-    // action              short long          metavar         help    variable
-    {opt_store_double_lim, "w",  "--wait",     "TIMEOUT",      HELP_w, timeout},
+    // action              short      long         metavar        help                   variable
+    {opt_store_double_lim, "w",       "--wait",    "TIMEOUT",     HELP_w,                timeout},
+    {opt_store_int_lim,    OPT_NO_SF, "--rcvbuf",  "BYTES",       HELP_recv_buffer_size, recv_buffer_size},
     END_OPT_SPECS
 };
 
@@ -43,6 +46,10 @@ double options_network_get_timeout() {
     return timeout[0];
 }
 
+int options_network_get_recv_buffer_size() {
+    return recv_buffer_size[0];
+}
+
 void network_set_is_verbose(network_t * network, bool verbose) {
      network->is_verbose = verbose;
 }
@@ -50,6 +57,11 @@ void network_set_is_verbose(network_t * network, bool verbose) {
 void options_network_init(network_t * network, bool verbose) {
     network_set_is_verbose(network, verbose);
     network_set_timeout(network, options_network_get_timeout());
+    if (options_network_get_recv_buffer_size() != SNIFFER_DEFAULT_RECV_BUFFER_SIZE) {
+        if (!network_set_recv_buffer_size(network, options_network_get_recv_buffer_size())) {
+            perror("options_network_init: cannot set the size of the receive buffer");
+        }
+    }
 }
 
 //---------------------------------------------------------------------------
@@ -170,7 +182,7 @@ static void itimerspec_set_delay(struct itimerspec * timer, double delay) {
     time_t delay_sec = (time_t) delay;
 
     timer->it_value.tv_sec     = delay_sec;
-    timer->it_value.tv_nsec    = 1000000 * (delay - delay_sec);
+    timer->it_value.tv_nsec    = 1000000000 * (delay - delay_sec);
     timer->it_interval.tv_sec  = 0;
     timer->it_interval.tv_nsec = 0;
 }
@@ -199,6 +211,16 @@ ERR_INVALID_DELAY:
     return false;
 }
 
+bool update_timer_uring(struct uring_s * uring, int timerfd, double delay) {
+    if (!uring) return update_timer(timerfd, delay);
+
+    if (delay < 0) {
+        fprintf(stderr, "update_timer_uring: invalid delay (delay = %lf)\n", delay);
+        return false;
+    }
+    return uring_set_timer(uring, timerfd, delay);
+}
+
 /**
  * \brief Update network->timerfd file descriptor to make it activated
  *   if a timeout occurs for oldest probe.
@@ -217,7 +239,7 @@ static bool network_update_next_timeout(network_t * network)
         // The timer will be disarmed since there is no more flying probes
         next_timeout = 0;
     }
-    return update_timer(network->timerfd, next_timeout);
+    return update_timer_uring(network->uring, network->timerfd, next_timeout);
 }
 
 /**
@@ -352,12 +374,12 @@ network_t * network_create()
     if (!(network->sendq = queue_create(probe_free,  probe_fprintf)))  goto ERR_SENDQ;
     if (!(network->recvq = queue_create(packet_free, packet_fprintf))) goto ERR_RECVQ;
 
-    if ((network->timerfd = timerfd_create(CLOCK_REALTIME, 0)) == -1) {
+    if ((network->timerfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK)) == -1) {
         goto ERR_TIMERFD;
     }
 
 #ifdef USE_SCHEDULING
-    if ((network->scheduled_timerfd = timerfd_create(CLOCK_REALTIME, 0)) == -1) {
+    if ((network->scheduled_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) == -1) {
         goto ERR_GROUP_TIMERFD;
     }
     if (!(network->scheduled_probes = probe_group_create(network->scheduled_timerfd))) {
@@ -371,7 +393,9 @@ network_t * network_create()
     if (!(network->probes = dynarray_create())) goto ERR_PROBES;
 
     network->last_tag = 0;
+    network->unmatched_caller = NULL;
     network->timeout = NETWORK_DEFAULT_TIMEOUT;
+    network->uring = NULL;
     network->is_verbose = false;
     return network;
 
@@ -410,6 +434,7 @@ void network_free(network_t * network)
         socketpool_free(network->socketpool);
 #ifdef USE_SCHEDULING
         probe_group_free(network->scheduled_probes);
+        close(network->scheduled_timerfd);
 #endif
         free(network);
     }
@@ -431,6 +456,14 @@ inline int network_get_recvq_fd(network_t * network) {
     return queue_get_fd(network->recvq);
 }
 
+bool network_set_recv_buffer_size(network_t * network, int recv_buffer_size) {
+    return sniffer_set_recv_buffer_size(network->sniffer, recv_buffer_size);
+}
+
+size_t network_get_num_sniffer_drops(const network_t * network) {
+    return sniffer_get_num_drops(network->sniffer);
+}
+
 #ifdef USE_IPV4
 inline int network_get_icmpv4_sockfd(network_t * network) {
     return sniffer_get_icmpv4_sockfd(network->sniffer);
@@ -443,6 +476,14 @@ inline int network_get_icmpv6_sockfd(network_t * network) {
 }
 #endif
 
+void network_set_uring(network_t * network, struct uring_s * uring) {
+    network->uring             = uring;
+    network->socketpool->uring = uring;
+#ifdef USE_SCHEDULING
+    network->scheduled_probes->uring = uring;
+#endif
+}
+
 inline int network_get_timerfd(network_t * network) {
     return network->timerfd;
 }
@@ -457,7 +498,15 @@ probe_group_t * network_get_scheduled_probes(network_t * network) {
 }
 #endif
 
-bool network_tag_probe(network_t * network, probe_t * probe)
+/**
+ * \brief Write a tag in a probe. The tag is stored in its UDP/TCP/ICMP
+ *    checksum, and its payload is updated to keep the packet well-formed.
+ * \param probe The probe to tag.
+ * \param tag_probe The tag (host-side endianness).
+ * \return true iif successful
+ */
+
+static bool probe_write_tag(probe_t * probe, uint16_t tag_probe)
 {
     uint16_t   tag,         // Network-side endianness
                checksum;    // Host-side endianness
@@ -485,7 +534,7 @@ bool network_tag_probe(network_t * network, probe_t * probe)
      * encode information. */
 
     if (num_layers < 2 || !(last_layer = probe_get_layer(probe, num_layers - 2))) {
-        fprintf(stderr, "network_tag_probe: not enough layer (num_layers = %d)\n", (unsigned int)num_layers);
+        fprintf(stderr, "probe_write_tag: not enough layer (num_layers = %d)\n", (unsigned int)num_layers);
         goto ERR_GET_LAYER;
     }
 
@@ -496,7 +545,7 @@ bool network_tag_probe(network_t * network, probe_t * probe)
         tag_in_body = true;
     }
 
-    tag = htons(network_get_available_tag(network));
+    tag = htons(tag_probe);
 
     // Write the tag at offset zero of the payload
     if (tag_in_body) {
@@ -557,6 +606,10 @@ ERR_GET_LAYER:
     return false;
 }
 
+bool network_tag_probe(network_t * network, probe_t * probe) {
+    return probe_write_tag(probe, network_get_available_tag(network));
+}
+
 bool network_send_probe(network_t * network, probe_t * probe)
 {
     // - Best effort probes are directly pushed in our sendq.
@@ -566,8 +619,7 @@ bool network_send_probe(network_t * network, probe_t * probe)
 #ifdef USE_SCHEDULING
     if (probe_get_delay(probe) == DELAY_BEST_EFFORT) {
 #endif
-        probe_set_queueing_time(probe, get_timestamp());
-        return queue_push_element(network->sendq, probe);
+        return network_resend_probe(network, probe);
 #ifdef USE_SCHEDULING
     } else {
        return probe_group_add(network->scheduled_probes, probe);
@@ -575,13 +627,25 @@ bool network_send_probe(network_t * network, probe_t * probe)
 #endif
 }
 
-// TODO This could be replaced by watchers: FD -> action
-bool network_process_sendq(network_t * network)
+bool network_resend_probe(network_t * network, probe_t * probe)
+{
+    // The probe will be tagged again by network_process_sendq, so
+    // a late reply to a previous sending will be discarded.
+    probe_set_queueing_time(probe, get_timestamp());
+    return queue_push_element(network->sendq, probe);
+}
+
+/**
+ * \brief Send a probe popped from network->sendq.
+ * \param network The network layer.
+ * \param probe The probe to send.
+ * \return true iif successful
+ */
+
+static bool network_send_queued_probe(network_t * network, probe_t * probe)
 {
-    probe_t           * probe;
     packet_t          * packet;
     size_t              num_flying_probes;
-    struct itimerspec   new_timeout;
 
     // Probe skeleton when entering the network layer.
     // We have to duplicate the probe since the same address of skeleton
@@ -591,7 +655,6 @@ bool network_process_sendq(network_t * network)
 
     // Do not free probe at the end of this function.
     // Its address will be saved in network->probes and freed later.
-    probe = queue_pop_element(network->sendq, NULL);
 
     // Tag the probe
     if (!network_tag_probe(network, probe)) {
@@ -629,8 +692,7 @@ bool network_process_sendq(network_t * network)
     // So currently, there is no running timer, prepare timerfd.
     num_flying_probes = dynarray_get_size(network->probes);
     if (num_flying_probes == 1) {
-        itimerspec_set_delay(&new_timeout, network_get_timeout(network));
-        if (timerfd_settime(network->timerfd, 0, &new_timeout, NULL) == -1) {
+        if (!update_timer_uring(network->uring, network->timerfd, network_get_timeout(network))) {
             fprintf(stderr, "Can't set timerfd\n");
             goto ERR_TIMERFD;
         }
@@ -646,18 +708,123 @@ ERR_TAG_PROBE:
     return false;
 }
 
-bool network_process_recvq(network_t * network)
+bool network_send_stateless_probe(network_t * network, probe_t * probe, uint16_t tag)
+{
+    packet_t * packet;
+
+    // Unlike network_send_queued_probe, the probe is neither registered
+    // in network->probes nor watched by network->timerfd: its reply
+    // will be delivered to network->unmatched_caller.
+    if (!probe_write_tag(probe, tag)) {
+        fprintf(stderr, "Can't tag probe\n");
+        goto ERR_TAG_PROBE;
+    }
+
+    if (network->is_verbose) {
+        printf("Sending stateless probe packet:\n");
+        probe_dump(probe);
+    }
+
+    if (!(packet = probe_create_packet(probe))) {
+        fprintf(stderr, "Can't create packet\n");
+        goto ERR_CREATE_PACKET;
+    }
+
+    if (!(socketpool_send_packet(network->socketpool, packet))) {
+        fprintf(stderr, "Can't send packet\n");
+        goto ERR_SEND_PACKET;
+    }
+
+    probe_set_sending_time(probe, get_timestamp());
+    return true;
+
+ERR_SEND_PACKET:
+ERR_CREATE_PACKET:
+ERR_TAG_PROBE:
+    return false;
+}
+
+void network_set_unmatched_caller(network_t * network, struct algorithm_instance_s * caller) {
+    network->unmatched_caller = caller;
+}
+
+/**
+ * \brief Test whether a probe has been sent by a given caller.
+ * \param probe A probe_t instance.
+ * \param caller The caller.
+ * \return true iif probe has been sent by caller.
+ */
+
+static bool probe_has_caller(const void * probe, const void * caller) {
+    return probe_get_caller(probe) == caller;
+}
+
+size_t network_cancel_probes(network_t * network, const struct algorithm_instance_s * caller)
+{
+    void    ** probes = dynarray_get_elements(network->probes);
+    size_t     i, j, num_flying_probes = dynarray_get_size(network->probes),
+               num_canceled;
+    bool       is_oldest_canceled = false;
+
+    // Flying probes (compacted in place to keep their order)
+    for (i = 0, j = 0; i < num_flying_probes; i++) {
+        if (probe_has_caller(probes[i], caller)) {
+            if (j == 0) is_oldest_canceled = true;
+            probe_free(probes[i]);
+        } else {
+            probes[j++] = probes[i];
+        }
+    }
+    if (j != num_flying_probes) {
+        dynarray_del_n_elements(network->probes, j, num_flying_probes - j, NULL);
+    }
+    num_canceled = num_flying_probes - j;
+
+    // The timer was armed for a canceled probe
+    if (is_oldest_canceled && !network_update_next_timeout(network)) {
+        fprintf(stderr, "network_cancel_probes: Error while updating timeout\n");
+    }
+
+    // Probes not yet sent
+    num_canceled += queue_del_elements(network->sendq, probe_has_caller, caller, (ELEMENT_FREE) probe_free);
+#ifdef USE_SCHEDULING
+    num_canceled += probe_group_del_caller(network->scheduled_probes, caller);
+#endif
+    return num_canceled;
+}
+
+// TODO This could be replaced by watchers: FD -> action
+size_t network_process_sendq(network_t * network)
+{
+    probe_t * probe;
+    size_t    num_probes = 0;
+
+    // Reset the eventfd before draining the queue
+    queue_acknowledge(network->sendq);
+
+    while ((probe = queue_pop_element(network->sendq, NULL))) {
+        if (!network_send_queued_probe(network, probe)) {
+            if (network->is_verbose) fprintf(stderr, "network_process_sendq: Can't send packet\n");
+        }
+        num_probes++;
+    }
+    return num_probes;
+}
+
+/**
+ * \brief Match a packet popped from network->recvq with its probe and
+ *    raise the corresponding PROBE_REPLY event.
+ * \param network The network layer.
+ * \param packet The received packet.
+ * \return true iif successful
+ */
+
+static bool network_process_received_packet(network_t * network, packet_t * packet)
 {
     probe_t       * probe,
                   * reply;
-    packet_t      * packet;
     probe_reply_t * probe_reply;
 
-    // Pop the packet from the queue
-    if (!(packet = queue_pop_element(network->recvq, NULL))) {
-        goto ERR_PACKET_POP;
-    }
-
     // Transform the reply into a probe_t instance
     if(!(reply = probe_wrap_packet(packet))) {
         goto ERR_PROBE_WRAP_PACKET;
@@ -672,6 +839,12 @@ bool network_process_recvq(network_t * network)
     // Find the probe corresponding to this reply
     // The corresponding pointer (if any) is removed from network->probes
     if (!(probe = network_get_matching_probe(network, reply))) {
+        // Replies to stateless probes carry by themselves everything
+        // needed by their caller (see network_send_stateless_probe).
+        if (network->unmatched_caller) {
+            pt_throw(NULL, network->unmatched_caller, event_create(PROBE_UNMATCHED_REPLY, reply, NULL, (ELEMENT_FREE) probe_free));
+            return true;
+        }
         goto ERR_PROBE_DISCARDED;
     }
 
@@ -698,12 +871,32 @@ ERR_PROBE_DISCARDED:
     probe_free(reply);
 ERR_PROBE_WRAP_PACKET:
     //packet_free(packet); TODO provoke segfault in case of stars
-ERR_PACKET_POP:
     return false;
 }
 
-void network_process_sniffer(network_t * network, uint8_t protocol_id) {
-    sniffer_process_packets(network->sniffer, protocol_id);
+size_t network_process_recvq(network_t * network)
+{
+    packet_t * packet;
+    size_t     num_packets = 0;
+
+    // Reset the eventfd before draining the queue
+    queue_acknowledge(network->recvq);
+
+    while ((packet = queue_pop_element(network->recvq, NULL))) {
+        if (!network_process_received_packet(network, packet)) {
+            if (network->is_verbose) fprintf(stderr, "network_process_recvq: Cannot fetch packet\n");
+        }
+        num_packets++;
+    }
+    return num_packets;
+}
+
+size_t network_process_sniffer(network_t * network, uint8_t protocol_id) {
+    return sniffer_process_packets(network->sniffer, protocol_id);
+}
+
+bool network_process_message(network_t * network, uint8_t protocol_id, struct msghdr * msg, size_t num_bytes) {
+    return sniffer_process_message(network->sniffer, protocol_id, msg, num_bytes);
 }
 
 bool network_drop_expired_flying_probe(network_t * network)
@@ -712,6 +905,14 @@ bool network_drop_expired_flying_probe(network_t * network)
     size_t    i, num_flying_probes = dynarray_get_size(network->probes);
     bool      ret = false;
     probe_t * probe;
+    uint64_t  expirations;
+
+    // Acknowledge the timer expiration. The timerfd is non-blocking since it
+    // may have been re-armed (and thus reset) since it has been notified.
+    // With io_uring, the timerfd is never armed.
+    if (!network->uring && read(network->timerfd, &expirations, sizeof(expirations)) == -1) {
+        // Nothing to read (EAGAIN), go on anyway.
+    }
 
     // Is there flying probe(s) ?
     if (num_flying_probes > 0) {
@@ -749,52 +950,53 @@ bool network_drop_expired_flying_probe(network_t * network)
 
 #ifdef USE_SCHEDULING
 
-static bool network_process_probe_node(network_t * network, tree_node_t * node, size_t i)
-{
-    tree_node_probe_t * tree_node_probe = get_node_data(node);
-    probe_t           * probe;
-
-    if (!(tree_node_probe->tag == PROBE))                               goto ERR_TAG;
-    probe = (probe_t *) (tree_node_probe->data.probe);
-    //TODO packet_from_probe must manage generator
+size_t network_process_scheduled_probe(network_t * network) {
+    probe_group_entry_t entry;
+    uint64_t            now, expirations;
+    double              next_delay;
+    size_t              num_probes = 0;
+
+    // Acknowledge the timer expiration. The timerfd is non-blocking since it
+    // may have been re-armed (and thus reset) since epoll has notified it.
+    // With io_uring, the timerfd is never armed.
+    if (!network->uring && read(network->scheduled_timerfd, &expirations, sizeof(expirations)) == -1) {
+        // Nothing to read (EAGAIN), go on anyway.
+    }
+
+    // Handle every probe that must be sent right now
+    now = get_monotonic_timestamp();
+    while (probe_group_pop_expired(network->scheduled_probes, now, &entry)) {
+        num_probes++;
+        probe_set_queueing_time(entry.probe, get_timestamp());
+        if (!(queue_push_element(network->sendq, entry.probe))) {
+            fprintf(stderr, "network_process_scheduled_probe: cannot push probe in sendq\n");
+            continue;
+        }
 
-    probe_set_queueing_time(probe, get_timestamp());
-    if (!(queue_push_element(network->sendq, probe)))                   goto ERR_QUEUE_PUSH;
-    /*
-    probe_set_left_to_send(probe, probe_get_left_to_send(probe) - 1);
-    num_probes_to_send = probe_get_left_to_send(probe);
-
-    if (num_probes_to_send == 0) {
-    */
-    if (--(probe->left_to_send) == 0) {
-        if (!(probe_group_del(network->scheduled_probes, node->parent, i)))  goto ERR_PROBE_GROUP_DEL;
-    } else {
-        get_node_next_delay(node);
-        probe_group_update_delay(network->scheduled_probes, node);
-        return true;
+        // Reschedule this probe if it must be sent several times.
+        if (--(entry.probe->left_to_send) > 0) {
+            next_delay = probe_next_delay(entry.probe);
+            if (!probe_group_add_at(
+                network->scheduled_probes, entry.probe,
+                entry.deadline + (uint64_t) (MAX(next_delay, 0) * 1000000000ULL)
+            )) {
+                fprintf(stderr, "network_process_scheduled_probe: cannot reschedule probe\n");
+            }
+        }
     }
 
-ERR_PROBE_GROUP_DEL:
-ERR_QUEUE_PUSH:
-ERR_TAG:
-    return false;
+    // Arm the timer according to the next scheduled probe (if any)
+    probe_group_update_timer(network->scheduled_probes);
+    return num_probes;
 }
 
-void network_process_scheduled_probe(network_t * network) {
-    tree_node_t * root;
-
-    if ((root = probe_group_get_root(network->scheduled_probes))) {
-        // Handle every probe that must be sent right now
-        probe_group_iter_next_scheduled_probes(
-            probe_group_get_root(network->scheduled_probes),
-            (void (*) (void *, tree_node_t *, size_t)) network_process_probe_node,
-            (void *) network
-        );
-    }
-}
+double network_get_next_scheduled_probe_delay(const network_t * network) {
+    uint64_t deadline = probe_group_get_next_deadline(network->scheduled_probes),
+             now;
 
-bool network_update_scheduled_timer(network_t * network, double delay) {
-    return update_timer(network->scheduled_timerfd, delay);
+    if (deadline == PROBE_GROUP_NO_DEADLINE) return DELAY_BEST_EFFORT;
+    now = get_monotonic_timestamp();
+    return deadline > now ? (deadline - now) / 1000000000.0 : 0;
 }
 
 #endif // USE_SCHEDULING
@@ -36,6 +36,10 @@
 #define OPTIONS_NETWORK_WAIT {NETWORK_DEFAULT_TIMEOUT, 0, INT_MAX}
 #define HELP_w "Set the number of seconds to wait for response to a probe (default is 5.0)"
 
+// Size of the receive buffer of the sniffer sockets (in bytes).
+#define OPTIONS_NETWORK_RECV_BUFFER_SIZE {SNIFFER_DEFAULT_RECV_BUFFER_SIZE, 0, INT_MAX}
+#define HELP_recv_buffer_size "Set the size (in bytes) of the receive buffer of the sniffer sockets (default is 1048576)."
+
 /**
  * \struct network_t
  * \brief Structure describing a network
@@ -113,11 +117,13 @@ typedef struct network_s {
     dynarray_t    * probes;            /**< Probes in transit, from the oldest probe_t instance to the youngest one. */
     int             timerfd;           /**< Used for probe timeouts. Linux specific. Activated when a probe timeout occurs */
     uint16_t        last_tag;          /**< Last probe ID used */
+    struct algorithm_instance_s * unmatched_caller; /**< Instance receiving the replies matching no flying probe (NULL: discard them) */
     double          timeout;           /**< The timeout value used by this network (in seconds) */
 #ifdef USE_SCHEDULING
     int             scheduled_timerfd; /**< Used for probe delays. Activated when a probe delay occurs */
     probe_group_t * scheduled_probes;  /**< Scheduled probes */
 #endif
+    struct uring_s * uring;            /**< If set, probes are sent and timers are armed through this io_uring instance (see network_set_uring) */
     bool            is_verbose;        /**< Print debug messages*/
 } network_t;
 
@@ -129,6 +135,14 @@ typedef struct network_s {
 
 double options_network_get_timeout();
 
+/**
+ * \brief Retrieve the size of the receive buffer of the sniffer sockets
+ *    set in the network options.
+ * \return The corresponding size (in bytes).
+ */
+
+int options_network_get_recv_buffer_size();
+
 /**
  * \brief Get the command-line options related to the layer network.
  * \return A pointer to a structure containing the options.
@@ -182,6 +196,24 @@ void network_set_is_verbose(network_t * network, bool verbose);
 
 void network_set_timeout(network_t * network, double new_timeout);
 
+/**
+ * \brief Set the size of the receive buffer of the sniffer sockets.
+ * \param network The network layer.
+ * \param recv_buffer_size The new size (in bytes).
+ * \return true iif successful
+ */
+
+bool network_set_recv_buffer_size(network_t * network, int recv_buffer_size);
+
+/**
+ * \brief Retrieve the number of replies dropped by the kernel because
+ *    the receive buffer of the sniffer was full.
+ * \param network The network layer.
+ * \return The number of dropped replies.
+ */
+
+size_t network_get_num_sniffer_drops(const network_t * network);
+
 /**
  * \brief Retrieve the file descriptor activated whenever a
  *   packet is ready to be sent.
@@ -237,30 +269,43 @@ int network_get_group_timerfd(network_t * network);
 probe_group_t * network_get_group_probes(network_t * network);
 
 /**
- * \brief Send the next packet stored network->sendq
+ * \brief Send every packet stored in network->sendq.
  * \param network The network layer..
- * \return true iif successfull
+ * \return The number of probes popped from network->sendq.
  */
 
-bool network_process_sendq(network_t * network);
+size_t network_process_sendq(network_t * network);
 
 /**
- * \brief Process received packets: match them with a probe, or discard them.
+ * \brief Process every received packet: match them with a probe, or discard them.
  * In practice, the receive queue stores all the packets handled by the sniffer.
  * \param network The network layer.
- * \return true iif successful
+ * \return The number of packets popped from network->recvq.
  */
 
-bool network_process_recvq(network_t * network);
+size_t network_process_recvq(network_t * network);
 
 /**
  * \brief Make the network layer..query its embedded sniffer instance in order
- *   to fetch a received packet.
+ *   to fetch every pending received packet.
  * \param network The network layer..
  * \param protocol_id The family of the packet to fetch (IPPROTO_ICMP, IPPROTO_ICMPV6)
+ * \return The number of sniffed packets.
+ */
+
+size_t network_process_sniffer(network_t * network, uint8_t protocol_id);
+
+/**
+ * \brief Pass to the embedded sniffer a packet already fetched from
+ *    one of its sockets (see sniffer_process_message).
+ * \param network The network layer.
+ * \param protocol_id The family of the packet (IPPROTO_ICMP, IPPROTO_ICMPV6)
+ * \param msg The message returned by recvmsg().
+ * \param num_bytes The number of bytes stored in msg->msg_iov[0].
+ * \return true iif successful.
  */
 
-void network_process_sniffer(network_t * network, uint8_t protocol_id);
+bool network_process_message(network_t * network, uint8_t protocol_id, struct msghdr * msg, size_t num_bytes);
 
 /**
  * \brief Drop the oldest flying probe (if any) attached to a network_t
@@ -274,37 +319,80 @@ void network_process_sniffer(network_t * network, uint8_t protocol_id);
 bool network_drop_expired_flying_probe(network_t * network);
 
 /**
- * \brief handle the scheduled probes when network->scheduled_timerfd is activated
+ * \brief Send a probe. Best effort probes are directly pushed in
+ *    network->sendq, delayed probes are scheduled in network->scheduled_probes.
  * \param network The network layer.
+ * \param probe The probe to send.
+ * \return true iif successful
  */
 
 bool network_send_probe(network_t * network, probe_t * probe);
 
-#ifdef USE_SCHEDULING
+/**
+ * \brief Push a probe in network->sendq regardless of its delay.
+ *    This is used to retransmit a probe which has expired.
+ * \param network The network layer.
+ * \param probe The probe to send.
+ * \return true iif successful
+ */
+
+bool network_resend_probe(network_t * network, probe_t * probe);
 
 /**
- * \brief handle the scheduled probes when network->scheduled_timerfd is activated
+ * \brief Tag and send a probe immediately, without keeping any state about it.
+ *    Unlike network_send_probe, the probe is not registered among the
+ *    flying probes: it never expires and its reply is not matched, but
+ *    delivered to network->unmatched_caller (see network_set_unmatched_caller).
+ *    The caller keeps the ownership of the probe and may reuse it.
  * \param network The network layer.
+ * \param probe The probe to send.
+ * \param tag The tag written in the probe (host-side endianness). It is
+ *    retrieved from the checksum quoted in the reply.
+ * \return true iif successful
  */
 
-void network_process_scheduled_probe(network_t * network);
+bool network_send_stateless_probe(network_t * network, probe_t * probe, uint16_t tag);
 
 /**
- * \brief Retrieve the next delay to send scheduled probes
+ * \brief Set the algorithm instance to which the replies matching
+ *    no flying probe are delivered through PROBE_UNMATCHED_REPLY events.
  * \param network The network layer.
- * \return the next delay.
+ * \param caller The algorithm instance, NULL to discard these replies.
  */
 
-double network_get_next_scheduled_probe_delay(const network_t * network);
+void network_set_unmatched_caller(network_t * network, struct algorithm_instance_s * caller);
 
 /**
- * \brief Refresh the newtork->scheduled_timerfd to next delay value
- * \param network Pointer to handled network instance
- * \param delay The new delay
- * return true iif successful
+ * \brief Forget and release every probe sent by a given algorithm instance
+ *    which is queued, scheduled or flying, so that neither its replies nor
+ *    its timeouts are delivered to this instance anymore.
+ * \param network The network layer.
+ * \param caller The algorithm instance (e.g. before it is deleted).
+ * \return The number of released probes.
  */
 
-bool network_update_scheduled_timer(network_t * network, double delay);
+size_t network_cancel_probes(network_t * network, const struct algorithm_instance_s * caller);
+
+#ifdef USE_SCHEDULING
+
+/**
+ * \brief Push in network->sendq every scheduled probe whose deadline
+ *    has expired, then rearm network->scheduled_timerfd according to
+ *    the next deadline. Called when network->scheduled_timerfd is activated.
+ * \param network The network layer.
+ * \return The number of probes pushed in network->sendq.
+ */
+
+size_t network_process_scheduled_probe(network_t * network);
+
+/**
+ * \brief Retrieve the next delay to send scheduled probes
+ * \param network The network layer.
+ * \return the next delay (in seconds), DELAY_BEST_EFFORT if no probe
+ *    is scheduled.
+ */
+
+double network_get_next_scheduled_probe_delay(const network_t * network);
 
 #endif // USE_SCHEDULING
 
@@ -318,6 +406,29 @@ bool network_update_scheduled_timer(network_t * network, double delay);
 // TODO move this outside network
 bool update_timer(int timerfd, double delay);
 
+/**
+ * \brief Refresh a timer to a new delay value. The timer is armed
+ *    through an io_uring instance if any (see uring_set_timer), otherwise
+ *    through its timerfd.
+ * \param uring An io_uring instance, or NULL.
+ * \param timerfd The timer file descriptor to update. With io_uring, it
+ *    only identifies the timer and is never armed.
+ * \param delay The new delay (0 disarms the timer)
+ * \return true iif successful
+ */
+
+bool update_timer_uring(struct uring_s * uring, int timerfd, double delay);
+
+/**
+ * \brief Send the probes and arm the timers of the network layer through an
+ *    io_uring instance. The timerfds of the network layer are then never
+ *    armed: their expirations are reported by the io_uring instance.
+ * \param network The network layer.
+ * \param uring An io_uring instance (NULL restores sendto and timerfds).
+ */
+
+void network_set_uring(network_t * network, struct uring_s * uring);
+
 #ifdef USE_IPV4
 /**
  * \brief Retrieve the socket file descriptor related to the ICMPv4
@@ -184,6 +184,16 @@ bool options_add_common(options_t * options, char * version)
 
 int options_parse(options_t * options, const char * usage, char ** args)
 {
+    option_t         end = END_OPT_SPECS;
+    size_t           num_options = vector_get_num_cells(options->optspecs);
+    const option_t * last = num_options ? vector_get_ith_element(options->optspecs, num_options - 1) : NULL;
+
+    // opt_parse stops at the first option having no action. The vector
+    // only has such a trailing cell if it is not full, so add it.
+    if (!last || last->action) {
+        vector_push_element(options->optspecs, &end);
+    }
+
     opt_options1st();
     return opt_parse(usage, (struct opt_spec *)(options->optspecs->cells), args);
 }
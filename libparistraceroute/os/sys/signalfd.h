@@ -54,6 +54,9 @@ struct signalfd_siginfo {
     __u8 __pad[46];
 };
 
+/* Flags for signalfd.  */
+#define SFD_NONBLOCK 04000
+
 int signalfd(int fd, const sigset_t *mask, int flags);
 
 #endif
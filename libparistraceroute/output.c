@@ -0,0 +1,239 @@
+#include "use.h"
+#include "config.h"
+
+#include <stdlib.h>         // malloc, free
+#include <stdio.h>          // fopencookie, fflush, fclose
+#include <string.h>         // memcpy
+#include <errno.h>          // errno, EAGAIN, EINTR
+#include <sys/uio.h>        // writev
+
+#include "output.h"
+#include "common.h"         // MIN
+
+//---------------------------------------------------------------------------
+// Ring buffer (internal usage)
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Write the pending bytes of an output_t until its file descriptor
+ *    would block.
+ * \param output An output_t instance.
+ * \return true iif successful (output->is_blocked tells whether some bytes
+ *    are still pending).
+ */
+
+static bool output_write_pending(output_t * output) {
+    struct iovec iov[2];
+    int          iovcnt;
+    size_t       tail;
+    ssize_t      n;
+
+    output->is_blocked = false;
+    while (output->size > 0) {
+        // The pending bytes may wrap around the end of the ring buffer
+        tail = output->capacity - output->head;
+        iov[0].iov_base = output->buffer + output->head;
+        iov[0].iov_len  = MIN(output->size, tail);
+        iov[1].iov_base = output->buffer;
+        iov[1].iov_len  = output->size - iov[0].iov_len;
+        iovcnt = iov[1].iov_len ? 2 : 1;
+
+        if ((n = writev(output->fd, iov, iovcnt)) == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                output->is_blocked = true;
+                output->num_blocked++;
+                return true;
+            }
+            perror("output_write_pending");
+            return false;
+        }
+
+        output->head = (output->head + n) % output->capacity;
+        output->size -= n;
+        output->num_bytes += n;
+    }
+
+    output->head = 0;
+    return true;
+}
+
+/**
+ * \brief Enlarge the ring buffer of an output_t so that it can store
+ *    some more bytes. The pending bytes are moved at its beginning.
+ * \param output An output_t instance.
+ * \param size The number of bytes to store.
+ * \return true iif successful.
+ */
+
+static bool output_grow(output_t * output, size_t size) {
+    uint8_t * buffer;
+    size_t    capacity = output->capacity,
+              tail;
+
+    while (capacity - output->size < size) capacity *= 2;
+    if (!(buffer = malloc(capacity))) return false;
+
+    tail = MIN(output->size, output->capacity - output->head);
+    memcpy(buffer, output->buffer + output->head, tail);
+    memcpy(buffer + tail, output->buffer, output->size - tail);
+    free(output->buffer);
+
+    output->buffer   = buffer;
+    output->capacity = capacity;
+    output->head     = 0;
+    output->num_grown++;
+    return true;
+}
+
+/**
+ * \brief Count bytes which will never be written, and warn the user.
+ * \param output An output_t instance.
+ * \param size The number of bytes lost.
+ */
+
+static void output_lose(output_t * output, size_t size) {
+    output->num_lost += size;
+    fprintf(stderr, "output: %zu bytes lost\n", size);
+}
+
+/**
+ * \brief Write function of the stream of an output_t (see fopencookie).
+ * \param cookie The output_t instance.
+ * \param data The bytes to write.
+ * \param size The number of bytes to write.
+ * \return size: the bytes are either stored or lost (see output_write),
+ *    so that the stream never writes them again.
+ */
+
+static ssize_t output_stream_write(void * cookie, const char * data, size_t size) {
+    output_write(cookie, data, size);
+    return size;
+}
+
+//---------------------------------------------------------------------------
+// output_t
+//---------------------------------------------------------------------------
+
+output_t * output_create(int fd, size_t capacity) {
+    output_t                * output;
+    cookie_io_functions_t     functions = {
+        .read  = NULL,
+        .write = output_stream_write,
+        .seek  = NULL,
+        .close = NULL
+    };
+
+    if (!capacity) {
+        errno = EINVAL;
+        goto ERR_INVALID_CAPACITY;
+    }
+
+    if (!(output = malloc(sizeof(output_t))))                  goto ERR_MALLOC;
+    if (!(output->buffer = malloc(capacity)))                  goto ERR_BUFFER_MALLOC;
+    if (!(output->stream = fopencookie(output, "w", functions))) goto ERR_FOPENCOOKIE;
+    if (setvbuf(output->stream, NULL, _IOFBF, BUFSIZ) != 0)    goto ERR_SETVBUF;
+
+    output->fd          = fd;
+    output->capacity    = capacity;
+    output->head        = 0;
+    output->size        = 0;
+    output->is_blocked  = false;
+    output->num_bytes   = 0;
+    output->num_blocked = 0;
+    output->num_grown   = 0;
+    output->num_lost    = 0;
+    output->max_size    = 0;
+    return output;
+
+ERR_SETVBUF:
+    fclose(output->stream);
+ERR_FOPENCOOKIE:
+    free(output->buffer);
+ERR_BUFFER_MALLOC:
+    free(output);
+ERR_MALLOC:
+ERR_INVALID_CAPACITY:
+    return NULL;
+}
+
+void output_free(output_t * output) {
+    if (output) {
+        // Closing the stream moves its last bytes in the ring buffer
+        fclose(output->stream);
+        output->stream = NULL;
+        output_drain(output);
+        free(output->buffer);
+        free(output);
+    }
+}
+
+FILE * output_get_stream(output_t * output) {
+    return output->stream;
+}
+
+int output_get_fd(const output_t * output) {
+    return output->fd;
+}
+
+bool output_write(output_t * output, const void * data, size_t size) {
+    const uint8_t * bytes = data;
+    size_t          offset, n;
+
+    // Make room for these bytes without waiting for the consumer
+    if (output->capacity - output->size < size) {
+        if (!output_write_pending(output)
+        || (output->capacity - output->size < size && !output_grow(output, size))) {
+            output_lose(output, size);
+            return false;
+        }
+    }
+
+    while (size > 0) {
+        // Copy as many contiguous bytes as possible after the last pending byte
+        offset = (output->head + output->size) % output->capacity;
+        n = MIN(size, offset < output->head ? output->head - offset : output->capacity - offset);
+        memcpy(output->buffer + offset, bytes, n);
+        output->size += n;
+        bytes += n;
+        size -= n;
+    }
+
+    if (output->size > output->max_size) {
+        output->max_size = output->size;
+    }
+    return true;
+}
+
+bool output_flush(output_t * output) {
+    return fflush(output->stream) == 0
+        && output_write_pending(output);
+}
+
+bool output_drain(output_t * output) {
+    if (output->stream) fflush(output->stream);
+
+    // The consumer is not awaited anymore
+    if (!output_write_pending(output) || output->size > 0) {
+        output_lose(output, output->size);
+        output->head = 0;
+        output->size = 0;
+        return false;
+    }
+    return true;
+}
+
+bool output_is_blocked(const output_t * output) {
+    return output->is_blocked;
+}
+
+void output_dump_stats(const output_t * output) {
+    fprintf(stderr,
+        "output: %zu bytes written, fd not writable %zu times, ring buffer grown %zu times (at most %zu bytes pending), %zu bytes lost\n",
+        output->num_bytes,
+        output->num_blocked,
+        output->num_grown,
+        output->max_size,
+        output->num_lost
+    );
+}
@@ -0,0 +1,131 @@
+#ifndef LIBPT_OUTPUT_H
+#define LIBPT_OUTPUT_H
+
+/**
+ * \file output.h
+ * \brief Buffered, non-blocking output sink.
+ *
+ * An output_t stores the bytes written by a program in a ring buffer and
+ * writes them to a file descriptor. The pending bytes are written whenever
+ * the file descriptor becomes writable again (see pt_loop_set_output).
+ * If the file descriptor is non-blocking (O_NONBLOCK is set by the caller,
+ * which owns it), a slow consumer (e.g. a pipe) never delays the main loop.
+ *
+ * An output_t also provides a stdio stream, so that the usual printf-like
+ * functions can feed the ring buffer.
+ *
+ * An output_t never waits for its consumer: when a write does not fit in
+ * the ring buffer, the ring buffer grows, and this backpressure is counted
+ * (num_grown). Bytes are only lost if memory runs out or if the file
+ * descriptor fails, in which case they are counted (num_lost) and a
+ * warning is printed on stderr.
+ */
+
+#include <stdbool.h>      // bool
+#include <stddef.h>       // size_t
+#include <stdint.h>       // uint8_t
+#include <stdio.h>        // FILE
+
+#define OUTPUT_DEFAULT_CAPACITY (1 << 20)
+
+typedef struct output_s {
+    int           fd;              /**< File descriptor the bytes are written to */
+    FILE        * stream;          /**< Stream feeding the ring buffer */
+    uint8_t     * buffer;          /**< Ring buffer */
+    size_t        capacity;        /**< Size of the ring buffer */
+    size_t        head;            /**< Offset of the first pending byte */
+    size_t        size;            /**< Number of pending bytes */
+    bool          is_blocked;      /**< True iif fd was not writable at the last attempt */
+
+    // Statistics
+    size_t        num_bytes;       /**< Number of bytes written to fd */
+    size_t        num_blocked;     /**< Number of times fd was not writable */
+    size_t        num_grown;       /**< Number of times the ring buffer was full and has grown */
+    size_t        num_lost;        /**< Number of bytes which could not be stored nor written */
+    size_t        max_size;        /**< Maximum number of pending bytes */
+} output_t;
+
+/**
+ * \brief Create an output_t instance.
+ * \param fd The file descriptor the bytes are written to. Its flags are
+ *    not modified: the caller sets O_NONBLOCK so that the writes never block.
+ * \param capacity The initial size of the ring buffer (e.g. OUTPUT_DEFAULT_CAPACITY).
+ * \return The newly allocated output_t instance, NULL otherwise.
+ */
+
+output_t * output_create(int fd, size_t capacity);
+
+/**
+ * \brief Write the pending bytes (see output_drain) and release an
+ *    output_t instance. The file descriptor is not closed.
+ * \param output An output_t instance.
+ */
+
+void output_free(output_t * output);
+
+/**
+ * \brief Retrieve the stdio stream feeding an output_t. This stream is
+ *    fully buffered and is closed by output_free.
+ * \param output An output_t instance.
+ * \return The corresponding stream.
+ */
+
+FILE * output_get_stream(output_t * output);
+
+/**
+ * \brief Retrieve the file descriptor the bytes are written to.
+ * \param output An output_t instance.
+ * \return The corresponding file descriptor.
+ */
+
+int output_get_fd(const output_t * output);
+
+/**
+ * \brief Append bytes in the ring buffer of an output_t. If they do not
+ *    fit, the pending bytes are written until the file descriptor would
+ *    block. If they still do not fit, the ring buffer grows.
+ * \param output An output_t instance.
+ * \param data The bytes to write.
+ * \param size The number of bytes to write.
+ * \return true iif the bytes have been stored, false if they have been lost.
+ */
+
+bool output_write(output_t * output, const void * data, size_t size);
+
+/**
+ * \brief Write the bytes buffered in the stream and in the ring buffer
+ *    until the file descriptor would block.
+ * \param output An output_t instance.
+ * \return true iif successful (even if some bytes are still pending, see
+ *    output_is_blocked).
+ */
+
+bool output_flush(output_t * output);
+
+/**
+ * \brief Write every pending byte. The bytes a non-blocking file
+ *    descriptor does not accept are lost: the caller restores the
+ *    flags of the file descriptor beforehand to write them all.
+ * \param output An output_t instance.
+ * \return true iif every pending byte has been written.
+ */
+
+bool output_drain(output_t * output);
+
+/**
+ * \brief Check whether some bytes are waiting for the file descriptor
+ *    to become writable.
+ * \param output An output_t instance.
+ * \return true iif the last output_flush() has not written every byte.
+ */
+
+bool output_is_blocked(const output_t * output);
+
+/**
+ * \brief Print the statistics of an output_t (on stderr).
+ * \param output An output_t instance.
+ */
+
+void output_dump_stats(const output_t * output);
+
+#endif // LIBPT_OUTPUT_H
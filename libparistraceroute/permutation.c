@@ -0,0 +1,75 @@
+#include "use.h"
+#include "config.h"
+
+#include <errno.h>          // errno, EINVAL
+#include <stdlib.h>         // malloc, free
+
+#include "permutation.h"
+#include "containers/hashtable.h" // hash_uint64
+
+#define PERMUTATION_GOLDEN_RATIO UINT64_C(0x9e3779b97f4a7c15)
+
+/**
+ * \brief Apply the Feistel network to an integer.
+ * \param permutation A permutation_t instance.
+ * \param x An integer made of 2 * permutation->half_bits bits.
+ * \return The encrypted integer (2 * permutation->half_bits bits).
+ */
+
+static uint64_t permutation_encrypt(const permutation_t * permutation, uint64_t x)
+{
+    unsigned half_bits = permutation->half_bits;
+    uint64_t mask      = (UINT64_C(1) << half_bits) - 1,
+             left      = x >> half_bits,
+             right     = x & mask,
+             tmp;
+    size_t   i;
+
+    for (i = 0; i < PERMUTATION_NUM_ROUNDS; i++) {
+        tmp   = right;
+        right = left ^ (hash_uint64(right ^ permutation->keys[i]) & mask);
+        left  = tmp;
+    }
+
+    return (left << half_bits) | right;
+}
+
+permutation_t * permutation_create(uint64_t domain, uint64_t key)
+{
+    permutation_t * permutation;
+    size_t          i;
+
+    if (domain == 0 || domain > PERMUTATION_MAX_DOMAIN) {
+        errno = EINVAL;
+        goto ERR_INVALID_DOMAIN;
+    }
+
+    if (!(permutation = malloc(sizeof(permutation_t)))) goto ERR_MALLOC;
+
+    permutation->domain = domain;
+    for (permutation->half_bits = 1; (UINT64_C(1) << (2 * permutation->half_bits)) < domain; permutation->half_bits++);
+    for (i = 0; i < PERMUTATION_NUM_ROUNDS; i++) {
+        permutation->keys[i] = hash_uint64(key + (i + 1) * PERMUTATION_GOLDEN_RATIO);
+    }
+
+    return permutation;
+
+ERR_MALLOC:
+ERR_INVALID_DOMAIN:
+    return NULL;
+}
+
+void permutation_free(permutation_t * permutation) {
+    if (permutation) free(permutation);
+}
+
+uint64_t permutation_get(const permutation_t * permutation, uint64_t i)
+{
+    // The Feistel network is a permutation of [0, 4^half_bits): each cycle
+    // crossing [0, domain) leads back to it.
+    do {
+        i = permutation_encrypt(permutation, i);
+    } while (i >= permutation->domain);
+
+    return i;
+}
@@ -0,0 +1,51 @@
+#ifndef LIBPT_PERMUTATION_H
+#define LIBPT_PERMUTATION_H
+
+#include <stdbool.h>  // bool
+#include <stdint.h>   // uint64_t
+
+// A permutation_t is a keyed pseudo-random permutation of [0, domain),
+// computed on the fly in constant memory: i -> permutation_get(p, i)
+// enumerates each integer of [0, domain) exactly once, in an order which
+// only depends on the key.
+//
+// It is a balanced Feistel network over the smallest even number of bits
+// covering the domain. Values falling outside of the domain are encrypted
+// again (cycle walking), which takes less than 4 rounds on average.
+
+#define PERMUTATION_NUM_ROUNDS 4
+#define PERMUTATION_MAX_DOMAIN (UINT64_C(1) << 62)
+
+typedef struct {
+    uint64_t domain;                          /**< The permuted integers are [0, domain) */
+    unsigned half_bits;                       /**< Number of bits of each half of the Feistel network */
+    uint64_t keys[PERMUTATION_NUM_ROUNDS];    /**< Round keys, derived from the key of the permutation */
+} permutation_t;
+
+/**
+ * \brief Create a permutation_t instance.
+ * \param domain The number of permuted integers. It must be between 1
+ *    and PERMUTATION_MAX_DOMAIN.
+ * \param key The key of the permutation.
+ * \return The newly allocated permutation_t instance, NULL otherwise.
+ */
+
+permutation_t * permutation_create(uint64_t domain, uint64_t key);
+
+/**
+ * \brief Release a permutation_t instance from the memory.
+ * \param permutation A permutation_t instance.
+ */
+
+void permutation_free(permutation_t * permutation);
+
+/**
+ * \brief Retrieve the image of an integer.
+ * \param permutation A permutation_t instance.
+ * \param i An integer of [0, permutation->domain).
+ * \return The image of i, which belongs to [0, permutation->domain).
+ */
+
+uint64_t permutation_get(const permutation_t * permutation, uint64_t i);
+
+#endif // LIBPT_PERMUTATION_H
@@ -660,6 +660,23 @@ size_t probe_get_size(const probe_t * probe) {
     return packet_get_size(probe->packet);
 }
 
+size_t probe_get_memory_size(const probe_t * probe) {
+    size_t size = sizeof(probe_t);
+
+    if (probe->layers) {
+        size += sizeof(dynarray_t) + probe->layers->max_size * sizeof(void *)
+             +  probe_get_num_layers(probe) * sizeof(layer_t);
+    }
+    if (probe->packet) {
+        size += sizeof(packet_t) + sizeof(buffer_t) + sizeof(address_t)
+             +  packet_get_size(probe->packet);
+    }
+#ifdef USE_SCHEDULING
+    if (probe->delay) size += sizeof(field_t);
+#endif
+    return size;
+}
+
 bool probe_payload_resize(probe_t * probe, size_t payload_size)
 {
     layer_t * payload_layer;
@@ -925,7 +942,7 @@ double probe_next_delay(probe_t * probe)
     if (field_delay) {
         switch (field_delay->type) {
             case TYPE_DOUBLE :
-                field_delay->value.dbl += field_delay->value.dbl;
+                // Constant delay: the probe is sent periodically.
                 delay = field_delay->value.dbl;
                 break;
             case TYPE_GENERATOR :
@@ -949,6 +966,10 @@ void probe_set_left_to_send(probe_t * probe, size_t num_left) {
     probe->left_to_send = num_left;
 }
 
+size_t probe_get_num_retries(const probe_t * probe) {
+    return probe->num_retries;
+}
+
 // Iterator
 
 typedef struct {
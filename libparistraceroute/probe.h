@@ -38,6 +38,7 @@ typedef struct {
     field_t    * delay;         /**< The time to send this probe */
 #endif
     size_t       left_to_send;  /**< Number of times left to use this probe instance to send packets */
+    size_t       num_retries;   /**< Number of times this probe has been sent again because it has expired */
 } probe_t;
 
 /**
@@ -69,6 +70,15 @@ void probe_free(probe_t * probe);
 
 size_t probe_get_size(const probe_t * probe);
 
+/**
+ * \brief Estimate the memory allocated for a probe_t instance.
+ * \param probe A probe_t instance.
+ * \return The number of bytes allocated for the probe, its layers and
+ *    its packet (allocator overhead excluded).
+ */
+
+size_t probe_get_memory_size(const probe_t * probe);
+
 /**
  * \brief Create a probe_t according to a packet_t instance.
  *   The previous value of probe->packet (if any) is not freed.
@@ -336,11 +346,12 @@ bool probe_set_delay(probe_t * probe, field_t * delay);
 double probe_get_delay(const probe_t * probe);
 
 /**
- * \brief Update the delay related to a probe skeleton.
+ * \brief Update the delay related to a probe skeleton. This is used to
+ *    reschedule a probe that must be sent several times (see left_to_send).
  * \param probe The probe skeleton used to craft the probe packet.
- *    Its delay is updated.
- * \return The updated delay (>= 0) if scheduled, DELAY_BEST_EFFORT
- *    otherwise.
+ *    Its delay is updated if it is produced by a generator.
+ * \return The delay (in seconds) between the previous and the next sending
+ *    of this probe (>= 0) if scheduled, DELAY_BEST_EFFORT otherwise.
  */
 
 double probe_next_delay(probe_t * probe);
@@ -349,6 +360,15 @@ size_t probe_get_left_to_send(probe_t * probe);
 
 void probe_set_left_to_send(probe_t * probe, size_t num_left);
 
+/**
+ * \brief Retrieve how many times a probe has been retransmitted
+ *    after a timeout (see pt_send_probe).
+ * \param probe A probe_t instance.
+ * \return The number of retransmissions of this probe.
+ */
+
+size_t probe_get_num_retries(const probe_t * probe);
+
 /**
  * \brief Update a probe_t instance according to a set of protocol names.
  * \param probe The probe we're altering
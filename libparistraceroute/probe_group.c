@@ -1,274 +1,253 @@
 #include "config.h"
 
-#include <stdio.h>   // printf
-#include <stdlib.h>  // malloc, free
-#include <float.h>   // DBL_MAX
+#include <stdio.h>          // printf
+#include <stdlib.h>         // malloc, free
+#include <string.h>         // memset
+#include <inttypes.h>       // PRIu64
+#include "os/sys/timerfd.h" // timerfd_settime
 
 #include "probe_group.h"
 
-#include "network.h" // update_timer
-#include "common.h"  // MIN
+#include "common.h"         // get_monotonic_timestamp
+#include "uring.h"          // uring_set_timer
 
-tree_node_probe_t * get_node_data(const tree_node_t * node) {
-    return (tree_node_probe_t *) tree_node_get_data(node);
-}
+#define PROBE_GROUP_SIZE_INIT 16
+#define NSEC_PER_SEC          1000000000ULL
 
-static bool is_probe(const tree_node_t * node) {
-    tree_node_probe_t * data = get_node_data(node);
-
-    if (node) {
-        switch (data->tag) {
-            case DOUBLE:
-                return false;
-            case PROBE:
-                return true;
-            default:
-                return false;
-        }
-    }
-    return false;
-}
+//---------------------------------------------------------------------------
+// Binary heap (internal usage)
+//---------------------------------------------------------------------------
 
-static double get_node_delay(const tree_node_t * node) {
-    tree_node_probe_t * data = get_node_data(node);
+/**
+ * \brief Compare two entries of the heap.
+ * \param x The left operand.
+ * \param y The right operand.
+ * \return true iif x must be popped before y.
+ */
 
-    switch (data->tag) {
-        case DOUBLE:
-            return data->data.delay;
-        case PROBE:
-            return probe_get_delay((probe_t *)(data->data.probe));
-        default:
-            return DBL_MAX;
-    }
+static inline bool probe_group_entry_lt(const probe_group_entry_t * x, const probe_group_entry_t * y) {
+    return x->deadline < y->deadline
+        || (x->deadline == y->deadline && x->seq < y->seq);
 }
 
-double get_node_next_delay(const tree_node_t * node) {
-    tree_node_probe_t * data = get_node_data(node);
+static void probe_group_sift_up(probe_group_t * probe_group, size_t i) {
+    probe_group_entry_t * entries = probe_group->entries;
+    probe_group_entry_t   entry   = entries[i];
+    size_t                parent;
 
-    switch (data->tag) {
-        case DOUBLE:
-            return data->data.delay;
-        case PROBE:
-            return probe_next_delay((probe_t *)(data->data.probe));
-        default:
-            return DBL_MAX;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!probe_group_entry_lt(&entry, &entries[parent])) break;
+        entries[i] = entries[parent];
+        i = parent;
     }
+    entries[i] = entry;
 }
 
-static void set_node_delay(tree_node_t * node, double delay) {
-    field_t           * delay_field;
-    tree_node_probe_t * data = get_node_data(node);
-
-    switch (data->tag) {
-        case DOUBLE:
-            data->data.delay = delay;
-            break;
-        case PROBE:
-            delay_field = DOUBLE("delay", delay);
-            probe_set_delay((probe_t *)(data->data.probe), delay_field);
-            field_free(delay_field);
-            break;
-        default:
-            fprintf(stderr, "Uknown type of data\n");
-            break;
-    }
-}
-
-void  probe_group_update_delay(probe_group_t * probe_group, tree_node_t * node) {
-    double parent_node_delay, node_delay = get_node_delay(node);
+static void probe_group_sift_down(probe_group_t * probe_group, size_t i) {
+    probe_group_entry_t * entries = probe_group->entries;
+    probe_group_entry_t   entry   = entries[i];
+    size_t                child, n = probe_group->num_entries;
 
-    if (node->parent) {
-        parent_node_delay = get_node_delay(node->parent);
-        if (parent_node_delay > node_delay) {
-            set_node_delay(node->parent, node_delay);
-            probe_group_update_delay(probe_group, node->parent);
+    while ((child = 2 * i + 1) < n) {
+        if (child + 1 < n && probe_group_entry_lt(&entries[child + 1], &entries[child])) {
+            child++;
         }
-    } else {
-        if (probe_group_get_next_delay(probe_group) < DBL_MAX) {
-            if (probe_group_get_next_delay(probe_group) - probe_group_get_last_delay(probe_group) <= 0) {
-                probe_group_set_last_delay(probe_group, 0);
-            }
-
-            update_timer(
-                probe_group->scheduling_timerfd,
-                probe_group_get_next_delay(probe_group) - probe_group_get_last_delay(probe_group)
-            );
-
-            probe_group_set_last_delay(
-                probe_group,
-                probe_group_get_next_delay(probe_group)
-            );
-        } else update_timer(probe_group->scheduling_timerfd, 0);
+        if (!probe_group_entry_lt(&entries[child], &entry)) break;
+        entries[i] = entries[child];
+        i = child;
     }
+    entries[i] = entry;
 }
 
-void tree_node_probe_free(tree_node_probe_t * tree_node_probe) {
-    if (tree_node_probe) {
-        if (tree_node_probe->tag == PROBE) {
-            probe_free(tree_node_probe->data.probe);
-        }
-        free(tree_node_probe);
-    }
-}
+static bool probe_group_reserve(probe_group_t * probe_group) {
+    probe_group_entry_t * entries;
+    size_t                max_entries;
 
-static void tree_node_probe_dump(const tree_node_probe_t * tree_node_probe) {
-    if (tree_node_probe) {
-        switch (tree_node_probe->tag) {
-            case PROBE:
-                probe_dump((probe_t *)(tree_node_probe->data.probe));
-                break;
-            case DOUBLE:
-                printf("%lf", (double)tree_node_probe->data.delay);
-                break;
-        }
+    if (probe_group->num_entries < probe_group->max_entries) return true;
+
+    max_entries = 2 * probe_group->max_entries;
+    if (!(entries = realloc(probe_group->entries, max_entries * sizeof(probe_group_entry_t)))) {
+        return false;
     }
+    probe_group->entries     = entries;
+    probe_group->max_entries = max_entries;
+    return true;
 }
 
-tree_node_probe_t * tree_node_probe_create(tree_node_probe_tag_t tag, void * data) {
-    tree_node_probe_t * tree_node_probe;
-
-    if (!(tree_node_probe = calloc(1, sizeof(tree_node_probe_t)))) goto ERR_CALLOC;
-    tree_node_probe->tag = tag;
-    switch (tag) {
-        case DOUBLE:
-            tree_node_probe->data.delay = *((double *) data);
-            break;
-        case PROBE:
-            tree_node_probe->data.probe = (probe_t *) data;
-            break;
-        default:
-            break;
-    }
-    return tree_node_probe;
+/**
+ * \brief Convert a delay in seconds in a number of nanoseconds.
+ * \param delay A delay (in seconds). Negative delays are treated as 0.
+ * \return The corresponding number of nanoseconds.
+ */
 
-ERR_CALLOC:
-    return NULL;
+static inline uint64_t delay_to_nsec(double delay) {
+    return delay > 0 ? (uint64_t) (delay * NSEC_PER_SEC) : 0;
 }
 
+//---------------------------------------------------------------------------
+// Public functions
+//---------------------------------------------------------------------------
+
 probe_group_t * probe_group_create(int fd) {
-    probe_group_t           * probe_group;
-    tree_node_probe_t       * tree_node_probe;
-    double                    delay = DBL_MAX;
+    probe_group_t * probe_group;
 
     if (!(probe_group = malloc(sizeof(probe_group_t)))) goto ERR_MALLOC;
-    if (!(tree_node_probe = tree_node_probe_create(DOUBLE, &delay)))  goto ERR_TREE_NODE_PROBE_CREATE;
-    if (!(probe_group->tree_probes = tree_create(
-        tree_node_probe_free,
-        tree_node_probe_dump
-    ))) goto ERR_TREE_CREATE;
-
-    if (!(tree_add_root(probe_group->tree_probes, (tree_node_probe_t *)tree_node_probe))) goto ERR_ADD_ROOT;
+    if (!(probe_group->entries = malloc(PROBE_GROUP_SIZE_INIT * sizeof(probe_group_entry_t)))) {
+        goto ERR_ENTRIES;
+    }
 
+    probe_group->num_entries        = 0;
+    probe_group->max_entries        = PROBE_GROUP_SIZE_INIT;
+    probe_group->next_seq           = 0;
+    probe_group->armed_deadline     = PROBE_GROUP_NO_DEADLINE;
     probe_group->scheduling_timerfd = fd;
-    probe_group->last_delay = 0;
+    probe_group->uring              = NULL;
     return probe_group;
 
-ERR_ADD_ROOT:
-    tree_free(probe_group->tree_probes);
-ERR_TREE_CREATE:
-    tree_node_probe_free(tree_node_probe);
-ERR_TREE_NODE_PROBE_CREATE:
+ERR_ENTRIES:
     free(probe_group);
 ERR_MALLOC:
     return NULL;
 }
 
 void probe_group_free(probe_group_t * probe_group) {
+    size_t i;
+
     if (probe_group) {
-        if (probe_group->tree_probes) tree_free(probe_group->tree_probes);
+        for (i = 0; i < probe_group->num_entries; i++) {
+            probe_free(probe_group->entries[i].probe);
+        }
+        free(probe_group->entries);
         free(probe_group);
     }
 }
 
-static bool probe_group_add_impl(probe_group_t * probe_group, tree_node_t * node_caller, tree_node_probe_tag_t tag, void * data) {
-    bool                ret = false;
-    tree_node_t       * new_child;
-    tree_node_probe_t * tree_node_probe;
+bool probe_group_add_at(probe_group_t * probe_group, probe_t * probe, uint64_t deadline) {
+    probe_group_entry_t * entry;
+
+    if (!probe_group_reserve(probe_group)) goto ERR_RESERVE;
 
-    if (!node_caller) node_caller = probe_group_get_root(probe_group);
-    if (!(tree_node_probe = tree_node_probe_create(tag, data))) goto ERR_CREATE;
-    if ((new_child = tree_node_add_child(node_caller, tree_node_probe))) {
-        probe_group_update_delay(probe_group, new_child);
-        ret = true;
+    entry = &probe_group->entries[probe_group->num_entries];
+    entry->deadline = deadline;
+    entry->seq      = probe_group->next_seq++;
+    entry->probe    = probe;
+    probe_group_sift_up(probe_group, probe_group->num_entries++);
+
+    // Refresh the timer only if this probe is now the next one to send
+    if (deadline < probe_group->armed_deadline) {
+        return probe_group_update_timer(probe_group);
     }
+    return true;
 
-    return ret;
-ERR_CREATE:
+ERR_RESERVE:
+    fprintf(stderr, "probe_group_add_at: cannot allocate memory\n");
     return false;
 }
 
 bool probe_group_add(probe_group_t * probe_group, probe_t * probe) {
-    return probe_group_add_impl(probe_group, NULL, PROBE, probe);
+    return probe_group_add_at(
+        probe_group, probe,
+        get_monotonic_timestamp() + delay_to_nsec(probe_get_delay(probe))
+    );
 }
 
-tree_node_t * probe_group_get_root(probe_group_t * probe_group) {
-    return tree_get_root(probe_group->tree_probes);
-}
+bool probe_group_pop_expired(probe_group_t * probe_group, uint64_t now, probe_group_entry_t * entry) {
+    if (probe_group->num_entries == 0 || probe_group->entries[0].deadline > now) {
+        return false;
+    }
 
-bool probe_group_del(probe_group_t * probe_group, tree_node_t * node_caller, size_t index) {
-    tree_node_t * node_del;
-    size_t        i, num_children;
-    double        delay_del, delay;
+    *entry = probe_group->entries[0];
+    if (--probe_group->num_entries > 0) {
+        probe_group->entries[0] = probe_group->entries[probe_group->num_entries];
+        probe_group_sift_down(probe_group, 0);
+    }
+    return true;
+}
 
-    if (!(node_del = tree_node_get_ith_child(node_caller, index))) goto ERR_CHILD_NOT_FOUND;
+size_t probe_group_del_caller(probe_group_t * probe_group, const void * caller) {
+    size_t    i, j, num_entries = probe_group->num_entries;
+    probe_t * probe;
 
-    delay_del = get_node_delay(node_del);
-    if (delay_del <= get_node_delay(node_caller)) {
-        if (!(tree_node_del_ith_child(node_caller, index))) goto ERR_DEL_CHILD;
-        num_children = tree_node_get_num_children(node_caller);
-        delay = DBL_MAX;
-        for (i = 0; i < num_children; ++i) {
-            delay = MIN(delay, get_node_delay(tree_node_get_ith_child(node_caller, i)));
+    // Compact the remaining entries, then restore the heap property in O(n)
+    for (i = 0, j = 0; i < num_entries; i++) {
+        probe = probe_group->entries[i].probe;
+        if (probe_get_caller(probe) == caller) {
+            probe_free(probe);
+        } else {
+            probe_group->entries[j++] = probe_group->entries[i];
         }
-        set_node_delay(node_caller, delay);
-        probe_group_update_delay(probe_group, node_caller);
+    }
+    probe_group->num_entries = j;
+    if (j == num_entries) return 0;
 
-        return true;
+    for (i = j / 2; i-- > 0;) {
+        probe_group_sift_down(probe_group, i);
     }
+    probe_group_update_timer(probe_group);
+    return num_entries - j;
+}
 
-ERR_DEL_CHILD:
-ERR_CHILD_NOT_FOUND:
-    return false;
+uint64_t probe_group_get_next_deadline(const probe_group_t * probe_group) {
+    return probe_group && probe_group->num_entries > 0 ?
+        probe_group->entries[0].deadline :
+        PROBE_GROUP_NO_DEADLINE;
 }
 
-void probe_group_iter_next_scheduled_probes(
-    tree_node_t * node,
-    void (* callback)(void * param_callback, tree_node_t * node, size_t index),
-    void * param_callback
-) {
-    tree_node_t * child;
-    size_t        i, num_children;
-    double        delay = get_node_delay(node);
-
-    // Explore each next scheduled probes
-    num_children = tree_node_get_num_children(node);
-    for (i = 0; i < num_children; ++i) {
-        child = tree_node_get_ith_child(node, i);
-        if (!child) {
-            fprintf(stderr, "child not found\n");
-        } else if (is_probe(child) && get_node_delay(child) == delay) {
-            if (callback) callback(param_callback, child, i);
-            num_children = tree_node_get_num_children(node);
-
-			// See https://github.com/libparistraceroute/libparistraceroute/pull/19
-            i = -1;
-        } else probe_group_iter_next_scheduled_probes(child, callback, param_callback);
-    }
+size_t probe_group_get_num_probes(const probe_group_t * probe_group) {
+    return probe_group ? probe_group->num_entries : 0;
 }
 
+bool probe_group_update_timer(probe_group_t * probe_group) {
+    struct itimerspec timer;
+    uint64_t          deadline = probe_group_get_next_deadline(probe_group),
+                      now;
 
-double probe_group_get_next_delay(const probe_group_t * probe_group) {
-    return probe_group ? get_node_delay(tree_get_root(probe_group->tree_probes)) : -1;
-}
+    // io_uring timers are relative: a deadline already reached still
+    // needs the timer to expire (as soon as possible).
+    if (probe_group->uring) {
+        now = get_monotonic_timestamp();
+        if (!uring_set_timer(
+            probe_group->uring, probe_group->scheduling_timerfd,
+            deadline == PROBE_GROUP_NO_DEADLINE ? 0 :
+            (deadline > now ? deadline - now : 1) / (double) NSEC_PER_SEC
+        )) {
+            perror("probe_group_update_timer");
+            return false;
+        }
+        probe_group->armed_deadline = deadline;
+        return true;
+    }
 
-void probe_group_dump(const probe_group_t * probe_group) {
-    if (probe_group) tree_dump(probe_group->tree_probes);
-}
+    // A zeroed itimerspec disarms the timer
+    memset(&timer, 0, sizeof(struct itimerspec));
+    if (deadline != PROBE_GROUP_NO_DEADLINE) {
+        // Note: a deadline equal to 0 would disarm the timer, whereas
+        // the monotonic clock never returns 0.
+        timer.it_value.tv_sec  = deadline / NSEC_PER_SEC;
+        timer.it_value.tv_nsec = deadline % NSEC_PER_SEC;
+    }
+
+    if (timerfd_settime(probe_group->scheduling_timerfd, TFD_TIMER_ABSTIME, &timer, NULL) == -1) {
+        perror("probe_group_update_timer");
+        return false;
+    }
 
-void probe_group_set_last_delay(probe_group_t * probe_group, double new_last_delay) {
-    probe_group->last_delay = new_last_delay;
+    probe_group->armed_deadline = deadline;
+    return true;
 }
 
-double probe_group_get_last_delay(probe_group_t * probe_group) {
-    return probe_group->last_delay;
+void probe_group_dump(const probe_group_t * probe_group) {
+    size_t i;
+
+    if (probe_group) {
+        printf("%zu scheduled probe(s)\n", probe_group->num_entries);
+        for (i = 0; i < probe_group->num_entries; i++) {
+            printf("deadline = %" PRIu64 " ns (seq = %" PRIu64 ")\n",
+                probe_group->entries[i].deadline,
+                probe_group->entries[i].seq
+            );
+            probe_dump(probe_group->entries[i].probe);
+        }
+    }
 }
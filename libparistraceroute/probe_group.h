@@ -1,39 +1,51 @@
 #ifndef LIBPT_PROBE_GROUP_H
 #define LIBPT_PROBE_GROUP_H
 
-#include <stddef.h> // size_t
-
-#include "tree.h"   // tree_t
-#include "probe.h"  // probe_t
+/**
+ * \file probe_group.h
+ * \brief Scheduler of delayed probes.
+ *
+ * A probe_group_t stores (deadline, probe) entries in a binary min-heap.
+ * Deadlines are absolute integer timestamps (in nanoseconds) read from
+ * the monotonic clock (see get_monotonic_timestamp()). Adding a probe and
+ * popping the next expired probe are O(log n), retrieving the next deadline
+ * is O(1). Probes sharing the same deadline are popped in their insertion
+ * order.
+ *
+ * The probe_group owns a timerfd (CLOCK_MONOTONIC) which is armed in order
+ * to expire at the earliest deadline stored in the heap. If an io_uring
+ * instance is set, the timer is armed through this instance instead (see
+ * uring_set_timer), and identified by this timerfd.
+ */
 
-typedef tree_t tree_probe_t;
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint64_t
+#include <stdbool.h> // bool
 
-typedef enum {
-    DOUBLE,                 /**< The node stores a double.      */
-    PROBE                   /**< The node stores a (probe_t *). */
-} tree_node_probe_tag_t;
+#include "probe.h"   // probe_t
 
-typedef union {
-    double    delay;        /**< Value of a data as a double.  */
-    probe_t * probe;        /**< Pointer to probe_t instance.  */
-} tree_node_probe_data_t;
+#define PROBE_GROUP_NO_DEADLINE UINT64_MAX // Returned by probe_group_get_next_deadline if no probe is scheduled
 
 typedef struct {
-    tree_node_probe_tag_t  tag;   /**< Tag to know the type of data stored in the node. */
-    tree_node_probe_data_t data;  /**< Data stored in the node. */
-} tree_node_probe_t;
+    uint64_t   deadline;                 /**< When the probe must be sent (in nanoseconds, monotonic clock). */
+    uint64_t   seq;                      /**< Insertion counter, used to break ties between equal deadlines. */
+    probe_t  * probe;                    /**< The scheduled probe. */
+} probe_group_entry_t;
 
 typedef struct {
-    tree_probe_t * tree_probes;          /**< Point to the tree of probes (if any), NULL otherwise. */
-    int            scheduling_timerfd;   /**< A timerfd which expires when a scheduled probe must be sent. */
-    double         last_delay;           /**< The time reference to schedule the probes to send. It is set when the first node is added. */
+    probe_group_entry_t * entries;            /**< Binary min-heap of scheduled probes. */
+    size_t                num_entries;        /**< Number of scheduled probes. */
+    size_t                max_entries;        /**< Number of allocated entries. */
+    uint64_t              next_seq;           /**< Sequence number assigned to the next added probe. */
+    uint64_t              armed_deadline;     /**< Deadline currently armed in scheduling_timerfd, PROBE_GROUP_NO_DEADLINE if disarmed. */
+    int                   scheduling_timerfd; /**< A timerfd (CLOCK_MONOTONIC) which expires when a scheduled probe must be sent. */
+    struct uring_s      * uring;              /**< If set, the timer is armed through this io_uring instance. */
 } probe_group_t;
 
-tree_node_probe_t * get_node_data(const tree_node_t * node);
-
 /**
  * \brief Create a new probe_group_t instance.
- * \param timerfd The timerfd managed by the probe_group
+ * \param fd The timerfd managed by the probe_group. It must
+ *    have been created with CLOCK_MONOTONIC.
  * \return The newly created probe_group_t instance.
  */
 
@@ -42,83 +54,85 @@ probe_group_t * probe_group_create(int fd);
 
 /**
  * \brief Release a probe_group_t instance from the memory.
+ *    Probes still scheduled are released too.
  * \param probe_group A pointer to a probe_group_t instance.
  */
 
 void probe_group_free(probe_group_t * probe_group);
 
 /**
- * \brief Retrieve the root of a probe_group_t instance
- * \param probe_group A pointer to a probe_group_t instance.
- * \return A pointer to the root (if any), NULL otherwise
+ * \brief Schedule a probe according to its delay (see probe_get_delay()).
+ *    The probe will expire probe_get_delay(probe) seconds after this call.
+ * \param probe_group A probe_group_t instance.
+ * \param probe A probe instance that we add in the probe group.
+ * \return true iif successful.
  */
 
-tree_node_t * probe_group_get_root(probe_group_t * probe_group);
+bool probe_group_add(probe_group_t * probe_group, probe_t * probe);
 
 /**
- * \brief Add a probe in the probe_group.
+ * \brief Schedule a probe at a given deadline.
  * \param probe_group A probe_group_t instance.
  * \param probe A probe instance that we add in the probe group.
+ * \param deadline When the probe must be sent (in nanoseconds,
+ *    see get_monotonic_timestamp()).
  * \return true iif successful.
  */
 
-bool probe_group_add(probe_group_t * probe_group, probe_t * probe);
+bool probe_group_add_at(probe_group_t * probe_group, probe_t * probe, uint64_t deadline);
 
 /**
- * \brief Delete a probe from the probe_group.
- * \param node_caller The node related to the calling instance (pass NULL if not needed).
- * \return true iif successful.
+ * \brief Remove the scheduled probe having the earliest deadline
+ *    if this deadline is not in the future.
+ * \param probe_group A probe_group_t instance.
+ * \param now The current time (in nanoseconds).
+ * \param entry The entry in which the popped (deadline, probe) is written.
+ * \return true iif an expired probe has been popped.
  */
 
-bool probe_group_del(probe_group_t * probe_group, tree_node_t * node_caller, size_t index);
+bool probe_group_pop_expired(probe_group_t * probe_group, uint64_t now, probe_group_entry_t * entry);
 
 /**
- * \brief Iterate on scheduled probes of probe_group_t structure.
- * \param node Node to explore.
- * \param callback Function called for each probe that be send.
- * \param param_callback This pointer is passed to the callback.
+ * \brief Remove and release the scheduled probes forged by a given caller
+ *    (see probe_get_caller()), and refresh the timer accordingly.
+ * \param probe_group A probe_group_t instance.
+ * \param caller The caller (e.g. an algorithm instance being deleted).
+ * \return The number of removed probes.
  */
 
-void probe_group_iter_next_scheduled_probes(
-    tree_node_t * node,
-    void (* callback)(void * param_callback, tree_node_t * node, size_t index),
-    void * param_callback
-);
+size_t probe_group_del_caller(probe_group_t * probe_group, const void * caller);
 
 /**
- * \brief Retrieve the next delay in the probe_group.
+ * \brief Retrieve the earliest deadline stored in the probe_group.
  * \param probe_group The probe_group_t instance.
- * \return The delay, -1 otherwise.
+ * \return The deadline (in nanoseconds), PROBE_GROUP_NO_DEADLINE
+ *    if no probe is scheduled.
  */
 
-double probe_group_get_next_delay(const probe_group_t * probe_group);
+uint64_t probe_group_get_next_deadline(const probe_group_t * probe_group);
 
 /**
- * \brief Dump A probe_group instance.
- * \param probe_group The probe_group instance to dump.
+ * \brief Retrieve the number of probes scheduled in the probe_group.
+ * \param probe_group The probe_group_t instance.
+ * \return The number of scheduled probes.
  */
 
-void probe_group_dump(const probe_group_t * probe_group);
+size_t probe_group_get_num_probes(const probe_group_t * probe_group);
 
-/*
- * \brief Get the new delay contained in a node in the probe_group.
- * \param node The node containing the new delay value.
- * \return The value of the next delay in the node
+/**
+ * \brief Arm probe_group->scheduling_timerfd according to the earliest
+ *    deadline, or disarm it if no probe is scheduled.
+ * \param probe_group The probe_group_t instance.
+ * \return true iif successful.
  */
 
-double get_node_next_delay(const tree_node_t * node);
+bool probe_group_update_timer(probe_group_t * probe_group);
 
-/*
- * \brief Update delay from the actuel node up to the root in the probe_group.
- * \param probe_group The probe_group instance to handle .
- * \param node The node containing the delay value.
- * \param delay The delay value.
+/**
+ * \brief Dump A probe_group instance.
+ * \param probe_group The probe_group instance to dump.
  */
 
-void probe_group_update_delay(probe_group_t * probe_group, tree_node_t * node);
-
-double probe_group_get_last_delay(probe_group_t * probe_group);
-
-void probe_group_set_last_delay(probe_group_t * probe_group, double new_last_delay);
+void probe_group_dump(const probe_group_t * probe_group);
 
 #endif // LIBPT_PROBE_GROUP_H
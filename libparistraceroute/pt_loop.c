@@ -5,7 +5,7 @@
 #include <stdbool.h>            // bool
 #include <stdio.h>              // perror
 #include <stdlib.h>             // malloc, free
-#include <string.h>             // memset
+#include <string.h>             // memset, strerror
 #include <errno.h>              // perror
 #include <unistd.h>             // close
 #include <signal.h>             // SIGINT, SIGQUIT
@@ -14,13 +14,24 @@
 #include "os/sys/epoll.h"       // epoll_ctl
 #include "os/sys/eventfd.h"     // eventfd
 #include "os/sys/signalfd.h"    // signalfd
+#include "os/sys/timerfd.h"     // timerfd_create
 #include "os/netinet/in.h"      // IPPROTO_ICMP, IPPROTO_ICMPV6
 #include "probe.h"              // probe_t
 #include "pt_loop.h"            // pt_loop.h
 #include "algorithm.h"
+#include "uring.h"              // uring_t
+#include "common.h"             // get_timestamp, MAX
 
 #define MAXEVENTS 100
 
+// With io_uring, each packet sent is a request: a large submission queue
+// allows to send a whole batch of probes per io_uring_enter() call.
+#define MAXSUBMISSIONS 1024
+
+// A timer (see pt_set_timer) expiring in less than PT_LOOP_TIMER_PRECISION
+// seconds is considered as expired.
+#define PT_LOOP_TIMER_PRECISION 0.0001
+
 static pt_loop_t * s_loop = NULL; // Needed while we use twalk.
 
 //---------------------------------------------------------------------------
@@ -28,11 +39,31 @@ static pt_loop_t * s_loop = NULL; // Needed while we use twalk.
 //---------------------------------------------------------------------------
 
 //static int    timeout[4]     = {180,    0,   UINT16_MAX, 1};
-static double timeout[3] = OPTIONS_PT_LOOP_TIMEOUT;
+static double   timeout[3]       = OPTIONS_PT_LOOP_TIMEOUT;
+static unsigned max_in_flight[3] = OPTIONS_PT_LOOP_MAX_IN_FLIGHT;
+static unsigned max_retries[3]   = OPTIONS_PT_LOOP_MAX_RETRIES;
+static unsigned output_buffer[3] = OPTIONS_PT_LOOP_OUTPUT_BUFFER;
+static unsigned dns_max_in_flight[3] = OPTIONS_PT_LOOP_DNS_MAX_IN_FLIGHT;
+static struct opt_str whois_server = {NULL, 0};
+static struct opt_str asn_index    = {NULL, 0};
+static unsigned cache_size[3]    = OPTIONS_PT_LOOP_CACHE_SIZE;
+static double   cache_ttl[3]     = OPTIONS_PT_LOOP_CACHE_TTL;
+static struct opt_str cache_file   = {NULL, 0};
+static bool     use_io_uring     = false;
 
 static option_t pt_loop_options[] = {
-    // action              short long          metavar    help    variable
-    {opt_store_double_lim, "t",  "--timeout",  "TIMEOUT", HELP_t, timeout},
+    // action              short      long               metavar          help                variable
+    {opt_store_double_lim, "t",       "--timeout",       "TIMEOUT",       HELP_t,             timeout},
+    {opt_store_int_lim,    OPT_NO_SF, "--max-in-flight", "MAX_IN_FLIGHT", HELP_max_in_flight, max_in_flight},
+    {opt_store_int_lim,    OPT_NO_SF, "--retries",       "RETRIES",       HELP_retries,       max_retries},
+    {opt_store_1,          OPT_NO_SF, "--io-uring",      OPT_NO_METAVAR,  HELP_io_uring,      &use_io_uring},
+    {opt_store_int_lim,    OPT_NO_SF, "--output-buffer", "SIZE",          HELP_output_buffer, output_buffer},
+    {opt_store_int_lim,    OPT_NO_SF, "--dns-max-in-flight", "NUM",       HELP_dns_max_in_flight, dns_max_in_flight},
+    {opt_store_str,        OPT_NO_SF, "--whois-server",  "HOST",          HELP_whois_server,  &whois_server},
+    {opt_store_str,        OPT_NO_SF, "--asn-index",     "FILE",          HELP_asn_index,     &asn_index},
+    {opt_store_int_lim,    OPT_NO_SF, "--cache-size",    "NUM",           HELP_cache_size,    cache_size},
+    {opt_store_double_lim, OPT_NO_SF, "--cache-ttl",     "SECONDS",       HELP_cache_ttl,     cache_ttl},
+    {opt_store_str,        OPT_NO_SF, "--cache-file",    "FILE",          HELP_cache_file,    &cache_file},
     END_OPT_SPECS
 };
 
@@ -44,14 +75,175 @@ double options_pt_loop_get_timeout() {
     return timeout[0];
 }
 
+unsigned options_pt_loop_get_max_in_flight() {
+    return max_in_flight[0];
+}
+
+unsigned options_pt_loop_get_max_retries() {
+    return max_retries[0];
+}
+
+pt_loop_backend_t options_pt_loop_get_backend() {
+    return use_io_uring ? PT_LOOP_BACKEND_IO_URING : PT_LOOP_BACKEND_EPOLL;
+}
+
+unsigned options_pt_loop_get_output_buffer() {
+    return output_buffer[0];
+}
+
+unsigned options_pt_loop_get_dns_max_in_flight() {
+    return dns_max_in_flight[0];
+}
+
+const char * options_pt_loop_get_whois_server() {
+    return whois_server.s ? whois_server.s : WHOIS_BULK_SERVER;
+}
+
+const char * options_pt_loop_get_asn_index() {
+    return asn_index.s;
+}
+
+unsigned options_pt_loop_get_cache_size() {
+    return cache_size[0];
+}
+
+double options_pt_loop_get_cache_ttl() {
+    return cache_ttl[0];
+}
+
+const char * options_pt_loop_get_cache_file() {
+    return cache_file.s;
+}
+
+/**
+ * \brief Bound the hostname and ASN caches shared by the loops.
+ * \param capacity The maximum number of entries of each cache.
+ * \param ttl The lifetime of the entries, in seconds (0: infinite).
+ */
+
+static void pt_loop_bound_caches(size_t capacity, double ttl) {
+    address_cache_t * caches[] = {address_get_hostname_cache(), whois_get_asn_cache()};
+    size_t            i;
+
+    for (i = 0; i < sizeof(caches) / sizeof(caches[0]); i++) {
+        if (caches[i]) {
+            address_cache_set_capacity(caches[i], capacity);
+            address_cache_set_ttl(caches[i], ttl);
+        }
+    }
+}
+
 void options_pt_loop_init(pt_loop_t * loop) {
     pt_loop_set_timeout(loop, options_pt_loop_get_timeout());
+    pt_loop_set_max_in_flight(loop, options_pt_loop_get_max_in_flight());
+    pt_loop_set_max_retries(loop, options_pt_loop_get_max_retries());
+    pt_loop_set_dns_max_in_flight(loop, options_pt_loop_get_dns_max_in_flight());
+    pt_loop_set_whois_server(loop, options_pt_loop_get_whois_server());
+
+    if (options_pt_loop_get_asn_index() && !whois_load_asn_index(options_pt_loop_get_asn_index())) {
+        fprintf(stderr, "Cannot load the ASN index %s: %s\n", options_pt_loop_get_asn_index(), strerror(errno));
+    }
+
+    pt_loop_bound_caches(options_pt_loop_get_cache_size(), options_pt_loop_get_cache_ttl());
+    if (options_pt_loop_get_cache_file()) {
+        pt_loop_set_cache_file(loop, options_pt_loop_get_cache_file());
+    }
 }
 
 void pt_loop_set_timeout(pt_loop_t * loop, double new_timeout) {
     loop->timeout = new_timeout;
 }
 
+void pt_loop_set_max_in_flight(pt_loop_t * loop, size_t new_max_in_flight) {
+    loop->max_in_flight = new_max_in_flight;
+}
+
+void pt_loop_set_max_retries(pt_loop_t * loop, size_t new_max_retries) {
+    loop->max_retries = new_max_retries;
+}
+
+void pt_loop_set_output(pt_loop_t * loop, output_t * output) {
+    loop->output = output;
+    loop->output_is_watched = false;
+    hole_stream_set_output(loop->hole_stream, output ? output_get_stream(output) : stdout);
+}
+
+hole_stream_t * pt_loop_get_hole_stream(pt_loop_t * loop) {
+    return loop->hole_stream;
+}
+
+FILE * pt_loop_get_stream(pt_loop_t * loop) {
+    return hole_stream_get_stream(loop->hole_stream);
+}
+
+stop_set_t * pt_loop_get_stop_set(pt_loop_t * loop) {
+    if (!loop->stop_set) {
+        loop->stop_set = stop_set_create(STOP_SET_PREFIX_LEN_IPV4, STOP_SET_PREFIX_LEN_IPV6);
+    }
+    return loop->stop_set;
+}
+
+void pt_loop_set_dns_max_in_flight(pt_loop_t * loop, size_t new_dns_max_in_flight) {
+    loop->dns_max_in_flight = new_dns_max_in_flight;
+}
+
+void pt_loop_set_whois_server(pt_loop_t * loop, const char * new_whois_server) {
+    loop->whois_server = new_whois_server;
+}
+
+bool pt_loop_set_cache_file(pt_loop_t * loop, const char * new_cache_file) {
+    address_cache_t * caches[] = {address_get_hostname_cache(), whois_get_asn_cache()};
+    FILE            * file;
+    size_t            i;
+    bool              ret = true;
+
+    loop->cache_file = new_cache_file;
+    if (!(file = fopen(new_cache_file, "r"))) {
+        // The file is created by pt_loop_free
+        if (errno == ENOENT) return true;
+        perror(new_cache_file);
+        return false;
+    }
+
+    // Each cache reads its own entries
+    for (i = 0; i < sizeof(caches) / sizeof(caches[0]); i++) {
+        if (caches[i]) {
+            rewind(file);
+            ret &= address_cache_load(caches[i], file);
+        }
+    }
+    fclose(file);
+    return ret;
+}
+
+/**
+ * \brief Save the hostname and ASN caches (see pt_loop_set_cache_file).
+ * \param loop The libparistraceroute loop.
+ * \return true iif successful.
+ */
+
+static bool pt_loop_save_caches(const pt_loop_t * loop) {
+    address_cache_t * caches[] = {address_get_hostname_cache(), whois_get_asn_cache()};
+    FILE            * file;
+    size_t            i;
+    bool              ret = true;
+
+    if (!(file = fopen(loop->cache_file, "w"))) goto ERR_FOPEN;
+
+    fprintf(file, "# cache address expiration value\n");
+    for (i = 0; i < sizeof(caches) / sizeof(caches[0]); i++) {
+        if (caches[i]) ret &= address_cache_save(caches[i], file);
+    }
+
+    if (fclose(file) != 0) goto ERR_FCLOSE;
+    return ret;
+
+ERR_FCLOSE:
+ERR_FOPEN:
+    perror(loop->cache_file);
+    return false;
+}
+
 //----------------------------------------------------------------
 // Static functions
 //----------------------------------------------------------------
@@ -59,7 +251,7 @@ void pt_loop_set_timeout(pt_loop_t * loop, double new_timeout) {
 /**
  * \brief process algorithm events (internal usage, see visitor for twalk)
  * \param node Current instance
- * \param visit Unused
+ * \param visit Ignored unless postorder or leaf (each node is visited once).
  * \param level Unused
  */
 
@@ -72,7 +264,7 @@ static void pt_process_instance(
 /**
  * \brief Free algorithm instances (internal usage, see visitor for twalk)
  * \param node Current instance
- * \param visit Unused
+ * \param visit Ignored unless postorder or leaf (each node is visited once).
  * \param level Unused
  */
 
@@ -117,10 +309,18 @@ static bool register_efd(pt_loop_t * loop, int fd) {
     // Check whether the fd is fine or not
     if (fd == -1) goto ERR_FD;
 
+    if (loop->backend == PT_LOOP_BACKEND_IO_URING) {
+        if (!uring_poll_add(loop->uring, fd)) {
+            perror("Error uring_poll_add");
+            goto ERR_URING_POLL_ADD;
+        }
+        return true;
+    }
+
     // Prepare epoll event structure
     memset(&event, 0, sizeof(struct epoll_event));
     event.data.fd = fd;
-    event.events = EPOLLIN; // | EPOLLET;
+    event.events = EPOLLIN | EPOLLET; // Each fd is drained whenever it is activated
 
     // Register fd in pt_loop
     if (epoll_ctl(loop->efd, EPOLL_CTL_ADD, fd, &event) == -1) {
@@ -129,20 +329,266 @@ static bool register_efd(pt_loop_t * loop, int fd) {
     }
     return true;
 
+ERR_URING_POLL_ADD:
 ERR_EPOLL_CTL:
 ERR_FD:
     return false;
 }
 
 /**
- * \brief Prepare a EFD_SEMAPHORE event_fd.
+ * \brief Register a timerfd in Paris Traceroute loop. With io_uring, the
+ *    timer is armed through the io_uring instance (see update_timer_uring)
+ *    which reports its expirations: the timerfd is not watched.
+ * \param loop The main loop.
+ * \param fd A timerfd.
+ * \return true iif successful.
+ */
+
+static bool register_timerfd(pt_loop_t * loop, int fd) {
+    return loop->backend == PT_LOOP_BACKEND_IO_URING ?
+        fd != -1 :
+        register_efd(loop, fd);
+}
+
+/**
+ * \brief Pass a packet received by a multishot receive to the network layer.
+ * \param fd The sniffer socket which has received the packet.
+ * \param msg The received message.
+ * \param num_bytes The size of the received message.
+ * \param data The main loop.
+ */
+
+static void pt_loop_process_message(int fd, struct msghdr * msg, size_t num_bytes, void * data) {
+    pt_loop_t * loop = data;
+    uint8_t     protocol_id = 0;
+
+#ifdef USE_IPV4
+    if (fd == network_get_icmpv4_sockfd(loop->network)) protocol_id = IPPROTO_ICMP;
+#endif
+#ifdef USE_IPV6
+    if (fd == network_get_icmpv6_sockfd(loop->network)) protocol_id = IPPROTO_ICMPV6;
+#endif
+    loop->num_processed_events++;
+    network_process_message(loop->network, protocol_id, msg, num_bytes);
+}
+
+/**
+ * \brief Register a sniffer socket in Paris Traceroute loop. With io_uring,
+ *    the socket is read by a multishot receive if possible.
+ * \param loop The main loop.
+ * \param sockfd A sniffer socket.
+ * \return true iif successful.
+ */
+
+static bool register_sniffer(pt_loop_t * loop, int sockfd) {
+    if (loop->backend == PT_LOOP_BACKEND_IO_URING
+    &&  uring_recvmsg_multishot(loop->uring, sockfd, pt_loop_process_message, loop)
+    ) {
+        return true;
+    }
+    return register_efd(loop, sockfd);
+}
+
+/**
+ * \brief Submit the requests queued in the io_uring instance (if any),
+ *    e.g. the probes just sent by the network layer. Otherwise, they would
+ *    wait for the next pt_loop_wait() call, which would delay them.
+ * \param loop The main loop.
+ */
+
+static inline void pt_loop_submit(pt_loop_t * loop) {
+    if (loop->uring && !uring_submit(loop->uring)) {
+        perror("Error uring_submit");
+    }
+}
+
+resolver_t * pt_loop_get_resolver(pt_loop_t * loop) {
+    resolver_t * resolver;
+
+    if (!loop->resolver) {
+        if (!(resolver = resolver_create(loop->dns_max_in_flight))) {
+            perror("Cannot create the DNS resolver");
+            return NULL;
+        }
+
+        // The answers and the timeouts are processed by pt_loop()
+        resolver_set_uring(resolver, loop->uring);
+        if (!register_efd(loop, resolver_get_sockfd(resolver))
+        ||  !register_timerfd(loop, resolver_get_timerfd(resolver))
+        ) {
+            resolver_set_uring(resolver, NULL);
+            resolver_free(resolver);
+            return NULL;
+        }
+        loop->resolver = resolver;
+    }
+    return loop->resolver;
+}
+
+whois_client_t * pt_loop_get_whois_client(pt_loop_t * loop) {
+    whois_client_t * whois_client;
+    address_t        server_address;
+    int              family;
+
+    if (!loop->whois_client) {
+        // The server is resolved once (this may block), unless the ASNs
+        // are retrieved offline.
+        if (whois_has_asn_index()) {
+            whois_client = whois_client_create(NULL);
+        } else {
+            if (!address_guess_family(loop->whois_server, &family)) family = AF_INET;
+            if (address_from_string(family, loop->whois_server, &server_address) != 0) {
+                fprintf(stderr, "Cannot resolve the whois server %s\n", loop->whois_server);
+                return NULL;
+            }
+            whois_client = whois_client_create(&server_address);
+        }
+
+        if (!whois_client) {
+            perror("Cannot create the whois client");
+            return NULL;
+        }
+
+        // Its socket is watched by pt_loop_watch_whois_client()
+        whois_client_set_uring(whois_client, loop->uring);
+        if (!register_timerfd(loop, whois_client_get_timerfd(whois_client))) {
+            whois_client_set_uring(whois_client, NULL);
+            whois_client_free(whois_client);
+            return NULL;
+        }
+        loop->whois_client = whois_client;
+        loop->whois_client_is_watched = false;
+    }
+    return loop->whois_client;
+}
+
+/**
+ * \brief Prepare the backend used by the main loop to wait for events.
+ * \param loop The main loop. loop->backend is updated if the requested
+ *    backend is not available.
+ * \param backend The requested backend.
+ * \return true iif successful.
+ */
+
+static bool pt_loop_backend_create(pt_loop_t * loop, pt_loop_backend_t backend) {
+    loop->efd   = -1;
+    loop->uring = NULL;
+
+    if (backend == PT_LOOP_BACKEND_IO_URING) {
+        if ((loop->uring = uring_create(MAXSUBMISSIONS))) {
+            loop->backend = PT_LOOP_BACKEND_IO_URING;
+            return true;
+        }
+        perror("Error uring_create (using epoll)");
+    }
+
+    loop->backend = PT_LOOP_BACKEND_EPOLL;
+    if ((loop->efd = epoll_create1(0)) == -1) {
+        perror("Error epoll_create1");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * \brief Release the backend used by the main loop.
+ * \param loop The main loop.
+ */
+
+static void pt_loop_backend_free(pt_loop_t * loop) {
+    if (loop->uring)     uring_free(loop->uring);
+    if (loop->efd != -1) close(loop->efd);
+}
+
+/**
+ * \brief Wait until at least one file descriptor watched by the main loop
+ *    is ready.
+ * \param loop The main loop. Ready file descriptors are written in
+ *    loop->epoll_events.
+ * \return The number of ready file descriptors, -1 in case of failure.
+ */
+
+static inline int pt_loop_wait(pt_loop_t * loop) {
+    return loop->backend == PT_LOOP_BACKEND_IO_URING ?
+        uring_wait(loop->uring, loop->epoll_events, MAXEVENTS) :
+        epoll_wait(loop->efd, loop->epoll_events, MAXEVENTS, -1);
+}
+
+/**
+ * \brief Wait (once) for some events on a file descriptor which is not
+ *    permanently registered in the main loop (see register_efd).
+ * \param loop The main loop.
+ * \param fd The file descriptor.
+ * \param events The awaited events (EPOLLIN or EPOLLOUT).
+ * \return true iif successful.
+ */
+
+static bool pt_loop_watch_once(pt_loop_t * loop, int fd, uint32_t events) {
+    struct epoll_event event;
+
+    if (loop->backend == PT_LOOP_BACKEND_IO_URING) {
+        return uring_poll_add_once(loop->uring, fd, events);
+    }
+
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.data.fd = fd;
+    event.events = events | EPOLLONESHOT;
+
+    // The fd is registered the first time, and then re-armed.
+    if (epoll_ctl(loop->efd, EPOLL_CTL_MOD, fd, &event) == -1
+    && (errno != ENOENT || epoll_ctl(loop->efd, EPOLL_CTL_ADD, fd, &event) == -1)) {
+        perror("Error epoll_ctl");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * \brief Write the pending bytes of the output attached to the main loop
+ *    without blocking. If its file descriptor is not writable, the backend
+ *    waits for it along with the other file descriptors.
+ * \param loop The main loop.
+ */
+
+static void pt_loop_flush_output(pt_loop_t * loop) {
+    if (!loop->output) return;
+
+    if (loop->output_is_watched) {
+        // The remaining bytes will be written once the fd is writable
+        fflush(output_get_stream(loop->output));
+    } else if (output_flush(loop->output) && output_is_blocked(loop->output)) {
+        loop->output_is_watched = pt_loop_watch_once(loop, output_get_fd(loop->output), EPOLLOUT);
+    }
+}
+
+/**
+ * \brief Wait for the socket of the whois client attached to the main
+ *    loop, which changes from one batch to another.
+ * \param loop The main loop.
+ */
+
+static void pt_loop_watch_whois_client(pt_loop_t * loop) {
+    uint32_t events;
+    int      fd;
+
+    if (!loop->whois_client || loop->whois_client_is_watched) return;
+
+    if ((events = whois_client_get_events(loop->whois_client))) {
+        fd = whois_client_get_sockfd(loop->whois_client);
+        loop->whois_client_is_watched = pt_loop_watch_once(loop, fd, events);
+    }
+}
+
+/**
+ * \brief Prepare a non-blocking event_fd. Its counter is reset by
+ *    a single read, which acknowledges every pending notification.
  * \return The corresponding file descriptor, -1 in case of failure.
  */
 
 static inline int make_event_fd() {
     int fd;
 
-    if ((fd = eventfd(0, EFD_SEMAPHORE)) == -1) {
+    if ((fd = eventfd(0, EFD_NONBLOCK)) == -1) {
         perror("Error eventfd");
     }
     return fd;
@@ -168,7 +614,7 @@ static int make_signal_fd() {
         goto ERR_SIGPROCMASK;
     }
 
-    if ((sfd = signalfd(-1, &mask, 0)) == -1) {
+    if ((sfd = signalfd(-1, &mask, SFD_NONBLOCK)) == -1) {
         perror("Error signalfd");
         goto ERR_SIGNALFD;
     }
@@ -204,65 +650,243 @@ static bool pt_raise_impl(pt_loop_t * loop, event_type_t type, event_t * nested_
     return true;
 }
 
+/**
+ * \brief Reset the counter of a non-blocking eventfd (see make_event_fd).
+ * \param fd The eventfd.
+ */
+
+static inline void pt_loop_acknowledge_event_fd(int fd) {
+    uint64_t value;
+
+    // read fails (EAGAIN) if the counter is already equal to 0.
+    if (read(fd, &value, sizeof(value)) == -1) {
+        // Nothing to acknowledge, go on anyway.
+    }
+}
+
 /**
  * \brief Process every pending user events (e.g. pt_loop_get_num_user_events(loop) events).
  * \param loop The main loop.
- * \return true iif successful.
+ * \return The number of processed user events.
  */
 
-static int pt_loop_process_user_events(pt_loop_t * loop) {
-    event_t  ** events        = pt_loop_get_user_events(loop);
-    size_t      i, num_events = pt_loop_get_num_user_events(loop);
-    uint64_t    ret;
+static size_t pt_loop_process_user_events(pt_loop_t * loop) {
+    size_t i;
 
-    for (i = 0; i < num_events; i++) {
-        if (read(loop->eventfd_user, &ret, sizeof(ret)) == -1) {
-            return -1;
-        }
-        // TODO decrement the associated eventfd counter
+    pt_loop_acknowledge_event_fd(loop->eventfd_user);
 
+    // The queue may grow while calling the user-defined handler
+    for (i = 0; i < pt_loop_get_num_user_events(loop); i++) {
         // Call user-defined handler and pass the current user event
-        loop->handler_user(loop, events[i], loop->user_data);
+        loop->handler_user(loop, pt_loop_get_user_events(loop)[i], loop->user_data);
     }
-    return 1;
+    return i;
 }
 
 /**
  * \brief Called when pt_loop handles a SIGINT|SIGQUIT to notify algorithms
  *   they must terminate. Sends a ALGORITHM_TERM event to each running instance.
  * \param node The current algorithm_instance_t.
- * \param visit (unused).
+ * \param visit Ignored unless postorder or leaf (each node is visited once).
  * \param level (unused).
  */
 
 static void pt_process_algorithms_terminate(const void * node, VISIT visit, int level) {
     algorithm_instance_t * instance = *((algorithm_instance_t * const *) node);
 
+    if (visit != postorder && visit != leaf) return;
+
     // The pt_loop_t must send a TERM event to the current instance
     pt_throw(NULL, instance, event_create(ALGORITHM_TERM, NULL, NULL, NULL));
 }
 
+/**
+ * \brief Arm loop->timerfd_algorithm according to loop->next_timer.
+ * \param loop The main loop.
+ * \return true iif successful.
+ */
+
+static bool pt_loop_update_timer(pt_loop_t * loop) {
+    return update_timer_uring(
+        loop->uring, loop->timerfd_algorithm,
+        loop->next_timer ? MAX(loop->next_timer - get_timestamp(), PT_LOOP_TIMER_PRECISION) : 0
+    );
+}
+
+/**
+ * \brief Raise an ALGORITHM_TIMER event to an instance if its timer has
+ *   expired. Otherwise, update the deadline of the next timer.
+ * \param node The current algorithm_instance_t.
+ * \param visit Ignored unless postorder or leaf (each node is visited once).
+ * \param level (unused).
+ */
+
+static void pt_process_instance_timer(const void * node, VISIT visit, int level) {
+    algorithm_instance_t * instance = *((algorithm_instance_t * const *) node);
+    pt_loop_t            * loop = instance->loop;
+
+    if ((visit != postorder && visit != leaf) || !instance->timer) return;
+
+    if (instance->timer - PT_LOOP_TIMER_PRECISION <= get_timestamp()) {
+        instance->timer = 0;
+        loop->num_processed_events++;
+        pt_throw(NULL, instance, event_create(ALGORITHM_TIMER, NULL, NULL, NULL));
+    } else if (!loop->next_timer || instance->timer < loop->next_timer) {
+        loop->next_timer = instance->timer;
+    }
+}
+
+/**
+ * \brief Process the expiration of loop->timerfd_algorithm.
+ * \param loop The main loop.
+ */
+
+static void pt_loop_process_timers(pt_loop_t * loop) {
+    uint64_t expirations;
+
+    // The timerfd is non-blocking since it may have been re-armed.
+    // With io_uring, the timerfd is never armed.
+    if (!loop->uring && read(loop->timerfd_algorithm, &expirations, sizeof(expirations)) == -1) {
+        // Nothing to read (EAGAIN), go on anyway.
+    }
+
+    loop->next_timer = 0;
+    pt_instance_iter(loop, pt_process_instance_timer);
+    if (!pt_loop_update_timer(loop)) {
+        fprintf(stderr, "Can't set the algorithm timer\n");
+    }
+}
+
+/**
+ * \brief Compute how many packets will be sent for a given probe.
+ * \param probe A probe_t instance.
+ * \return The number of slots this probe takes in the in-flight window.
+ */
+
+static size_t probe_get_num_packets(const probe_t * probe) {
+#ifdef USE_SCHEDULING
+    // Scheduled probes are sent left_to_send times (see network_process_scheduled_probe)
+    if (probe_get_delay(probe) != DELAY_BEST_EFFORT && probe->left_to_send > 1) {
+        return probe->left_to_send;
+    }
+#endif
+    return 1;
+}
+
+/**
+ * \brief Check whether an algorithm instance may send a probe right now.
+ * \param instance An algorithm instance.
+ * \param num_packets The number of packets we want to send.
+ * \return true iif the in-flight window of this instance is large enough.
+ */
+
+static inline bool pt_instance_can_send(const algorithm_instance_t * instance, size_t num_packets) {
+    // If nothing is in flight, send anyway to not get stuck on probes
+    // requiring more than max_in_flight packets.
+    return !instance->max_in_flight
+        || !instance->num_in_flight
+        || instance->num_in_flight + num_packets <= instance->max_in_flight;
+}
+
+/**
+ * \brief Send a probe on behalf of an algorithm instance and
+ *    update its in-flight window accordingly.
+ * \param loop The main loop.
+ * \param instance The algorithm instance which has forged the probe
+ *    (NULL if sent by the user program).
+ * \param probe The probe to send.
+ * \return true iif successful.
+ */
+
+static bool pt_instance_send_probe(pt_loop_t * loop, algorithm_instance_t * instance, probe_t * probe) {
+    size_t num_packets = probe_get_num_packets(probe);
+
+    if (!network_send_probe(loop->network, probe)) return false;
+    if (instance) instance->num_in_flight += num_packets;
+    return true;
+}
+
+/**
+ * \brief Send the pending probes of an algorithm instance which now
+ *    fit in its in-flight window.
+ * \param instance An algorithm instance.
+ */
+
+static void pt_instance_flush_pending_probes(algorithm_instance_t * instance) {
+    size_t    i, num_pending = dynarray_get_size(instance->pending_probes);
+    probe_t * probe;
+
+    for (i = 0; i < num_pending; i++) {
+        probe = dynarray_get_ith_element(instance->pending_probes, i);
+        if (!pt_instance_can_send(instance, probe_get_num_packets(probe))) break;
+        if (!pt_instance_send_probe(instance->loop, instance, probe)) {
+            fprintf(stderr, "pt_loop: cannot send pending probe\n");
+        }
+    }
+
+    if (i != 0) {
+        dynarray_del_n_elements(instance->pending_probes, 0, i, NULL);
+    }
+}
+
+/**
+ * \brief Update the in-flight window of an algorithm instance
+ *    before dispatching a PROBE_REPLY or a PROBE_TIMEOUT event.
+ * \param instance The algorithm instance receiving the event.
+ * \param event The PROBE_REPLY or PROBE_TIMEOUT event.
+ * \return true iif the event must be ignored because the
+ *    expired probe has been sent again.
+ */
+
+static bool pt_instance_handle_probe_event(algorithm_instance_t * instance, event_t * event) {
+    probe_t * probe;
+
+    if (event->type == PROBE_TIMEOUT) {
+        probe = event->data;
+        if (probe->num_retries < instance->max_retries) {
+            // The probe keeps its slot in the window
+            probe->num_retries++;
+            if (network_resend_probe(instance->loop->network, probe)) {
+                return true;
+            }
+            fprintf(stderr, "pt_loop: cannot retransmit probe\n");
+        }
+    }
+
+    if (instance->num_in_flight > 0) instance->num_in_flight--;
+    return false;
+}
+
 //----------------------------------------------------------------
 // Non static functions
 //----------------------------------------------------------------
 
 pt_loop_t * pt_loop_create(void (*handler_user)(pt_loop_t *, event_t *, void *), void * user_data)
 {
+    return pt_loop_create_backend(handler_user, user_data, PT_LOOP_BACKEND_EPOLL);
+}
+
+pt_loop_t * pt_loop_create_backend(
+    void (*handler_user)(pt_loop_t *, event_t *, void *),
+    void * user_data,
+    pt_loop_backend_t backend
+) {
     pt_loop_t * loop;
 
     if (!(loop = malloc(sizeof(pt_loop_t)))) goto ERR_MALLOC;
     loop->handler_user = handler_user;
 
-    // Prepare epoll file descriptor
-    if ((loop->efd = epoll_create1(0)) == -1) {
-        perror("Error epoll_create1");
-        goto ERR_EPOLL;
-    }
+    // Prepare epoll file descriptor (or io_uring instance)
+    if (!pt_loop_backend_create(loop, backend)) goto ERR_EPOLL;
 
     // Prepare algorithm events fd and register it in loop->efd
     if ((loop->eventfd_algorithm = make_event_fd()) == -1) goto ERR_MAKE_EVENTFD_ALGORITHM;
     if (!register_efd(loop, loop->eventfd_algorithm))      goto ERR_EVENTFD_ALGORITHM;
 
+    // Prepare the timer shared by the algorithms and register it in loop->efd
+    if ((loop->timerfd_algorithm = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK)) == -1) goto ERR_MAKE_TIMERFD_ALGORITHM;
+    if (!register_timerfd(loop, loop->timerfd_algorithm))  goto ERR_TIMERFD_ALGORITHM;
+
     // Prepare user events fd and register it in loop->efd
     if ((loop->eventfd_user = make_event_fd()) == -1)      goto ERR_MAKE_EVENTFD_USER;
     if (!register_efd(loop, loop->eventfd_user))           goto ERR_EVENTFD_USER;
@@ -273,16 +897,17 @@ pt_loop_t * pt_loop_create(void (*handler_user)(pt_loop_t *, event_t *, void *),
 
     // Prepare network layer and register it in pt_loop
     if (!(loop->network = network_create()))                           goto ERR_NETWORK_CREATE;
+    if (loop->uring) network_set_uring(loop->network, loop->uring);
     if (!register_efd(loop, network_get_sendq_fd(loop->network)))      goto ERR_EVENTFD_SENDQ;
     if (!register_efd(loop, network_get_recvq_fd(loop->network)))      goto ERR_EVENTFD_RECVQ;
 #ifdef USE_IPV4
-    if (!register_efd(loop, network_get_icmpv4_sockfd(loop->network))) goto ERR_EVENTFD_SNIFFER_ICMPV4;
+    if (!register_sniffer(loop, network_get_icmpv4_sockfd(loop->network))) goto ERR_EVENTFD_SNIFFER_ICMPV4;
 #endif
 #ifdef USE_IPV6
-    if (!register_efd(loop, network_get_icmpv6_sockfd(loop->network))) goto ERR_EVENTFD_SNIFFER_ICMPV6;
+    if (!register_sniffer(loop, network_get_icmpv6_sockfd(loop->network))) goto ERR_EVENTFD_SNIFFER_ICMPV6;
 #endif
-    if (!register_efd(loop, network_get_timerfd(loop->network)))       goto ERR_EVENTFD_TIMEOUT;
-    if (!register_efd(loop, network_get_group_timerfd(loop->network))) goto ERR_EVENTFD_GROUP;
+    if (!register_timerfd(loop, network_get_timerfd(loop->network)))       goto ERR_EVENTFD_TIMEOUT;
+    if (!register_timerfd(loop, network_get_group_timerfd(loop->network))) goto ERR_EVENTFD_GROUP;
 
     // Buffer where pending events are stored
     if (!(loop->epoll_events = calloc(MAXEVENTS, sizeof(struct epoll_event)))) {
@@ -293,14 +918,36 @@ pt_loop_t * pt_loop_create(void (*handler_user)(pt_loop_t *, event_t *, void *),
         goto ERR_EVENTS_USER;
     }
 
+    // The results are printed on stdout unless an output is attached
+    if (!(loop->hole_stream = hole_stream_create(stdout))) {
+        goto ERR_HOLE_STREAM_CREATE;
+    }
+
     loop->user_data = user_data;
     loop->status = PT_LOOP_CONTINUE;
+    loop->max_in_flight = PT_LOOP_DEFAULT_MAX_IN_FLIGHT;
+    loop->max_retries = PT_LOOP_DEFAULT_MAX_RETRIES;
+    loop->stop_set = NULL;
+    loop->resolver = NULL;
+    loop->dns_max_in_flight = RESOLVER_DEFAULT_MAX_IN_FLIGHT;
+    loop->whois_client = NULL;
+    loop->whois_client_is_watched = false;
+    loop->whois_server = WHOIS_BULK_SERVER;
+    loop->cache_file = NULL;
+    loop->output = NULL;
+    loop->output_is_watched = false;
+    loop->next_timer = 0;
+    loop->num_waits = 0;
+    loop->num_processed_events = 0;
+    loop->max_processed_events = 0;
     loop->next_algorithm_id = 1; // 0 means unaffected ?
     loop->cur_instance = NULL;
     loop->algorithm_instances_root = NULL;
 
     return loop;
 
+ERR_HOLE_STREAM_CREATE:
+    dynarray_free(loop->events_user, NULL);
 ERR_EVENTS_USER:
     free(loop->epoll_events);
 ERR_EVENTS:
@@ -319,13 +966,16 @@ ERR_NETWORK_CREATE:
 ERR_SIGNALFD:
     close(loop->sfd);
 ERR_MAKE_SIGNALFD:
-    close(loop->eventfd_user);
 ERR_EVENTFD_USER:
-    close(loop->eventfd_algorithm);
+    close(loop->eventfd_user);
 ERR_MAKE_EVENTFD_USER:
+ERR_TIMERFD_ALGORITHM:
+    close(loop->timerfd_algorithm);
+ERR_MAKE_TIMERFD_ALGORITHM:
 ERR_EVENTFD_ALGORITHM:
-    close(loop->efd);
+    close(loop->eventfd_algorithm);
 ERR_MAKE_EVENTFD_ALGORITHM:
+    pt_loop_backend_free(loop);
 ERR_EPOLL:
     free(loop);
 ERR_MALLOC:
@@ -337,14 +987,29 @@ void pt_loop_free(pt_loop_t * loop)
     if (loop) {
         if (loop->events_user)  dynarray_free(loop->events_user, (ELEMENT_FREE) event_free);
         if (loop->epoll_events) free(loop->epoll_events);
+
+        // The packets queued in the io_uring instance are sent before
+        // their sockets are closed. Timers are then armed by their timerfd.
+        if (loop->resolver)     resolver_set_uring(loop->resolver, NULL);
+        if (loop->whois_client) whois_client_set_uring(loop->whois_client, NULL);
+        if (loop->uring)        network_set_uring(loop->network, NULL);
+        pt_loop_backend_free(loop);
+
         network_free(loop->network);
         close(loop->sfd);
         close(loop->eventfd_user);
+        close(loop->timerfd_algorithm);
         close(loop->eventfd_algorithm);
-        close(loop->efd);
 
         // Events are cleared while destroying algorithm instances
         pt_instance_iter(loop, pt_free_instance);
+        stop_set_free(loop->stop_set);
+
+        // The awaited hostnames and ASNs are printed before the remaining output
+        whois_client_free(loop->whois_client);
+        resolver_free(loop->resolver);
+        if (loop->cache_file) pt_loop_save_caches(loop);
+        hole_stream_free(loop->hole_stream);
         free(loop);
     }
 }
@@ -371,22 +1036,26 @@ inline void pt_instance_iter(
 void pt_process_instance(const void * node, VISIT visit, int level)
 {
     algorithm_instance_t * instance = *((algorithm_instance_t * const *) node);
-    size_t                 i, num_events;
-    uint64_t               ret;
-    ssize_t                count;
+    size_t                 i;
+
+    if (visit != postorder && visit != leaf) return;
 
     // Save temporarily this algorithm context.
     instance->loop->cur_instance = instance;
 
-    // Execute algorithm handler for each events.
-    num_events = dynarray_get_size(instance->events);
-    for (i = 0; i < num_events; i++) {
+    // Execute algorithm handler for each events. The handler may raise
+    // new events for this instance: they are processed in this pass.
+    for (i = 0; i < dynarray_get_size(instance->events); i++) {
         event_t * event;
 
-        count = read(instance->loop->eventfd_algorithm, &ret, sizeof(ret));
-        if (count == -1) return;
-
         event = dynarray_get_ith_element(instance->events, i);
+        instance->loop->num_processed_events++;
+
+        // Update the in-flight window, and retransmit expired probes if allowed.
+        if (event->type == PROBE_REPLY || event->type == PROBE_TIMEOUT) {
+            if (pt_instance_handle_probe_event(instance, event)) continue;
+        }
+
         instance->algorithm->handler(
             instance->loop, event,
             &instance->data,
@@ -396,10 +1065,15 @@ void pt_process_instance(const void * node, VISIT visit, int level)
 
         // Next events for this instance are ignored.
         if (event->type == ALGORITHM_TERM) {
+            // Pending probes will never be sent.
+            dynarray_clear(instance->pending_probes, (ELEMENT_FREE) probe_free);
             break;
         }
     }
 
+    // Some slots may have been released in the in-flight window.
+    pt_instance_flush_pending_probes(instance);
+
     // Restore the algorithm context
     instance->loop->cur_instance = NULL;
 
@@ -415,11 +1089,25 @@ void pt_free_instance(
     int          level
 ) {
     algorithm_instance_t * instance = *((algorithm_instance_t * const *) node);
+
+    if (visit != postorder && visit != leaf) return;
     algorithm_instance_free(instance); // No notification
 }
 
+/**
+ * \brief Check whether the main loop still awaits some hostnames or ASNs.
+ * \param loop The main loop.
+ * \return true iif the resolver or the whois client has pending lookups.
+ */
+
+static bool pt_loop_has_pending_lookups(const pt_loop_t * loop) {
+    return (loop->resolver     && resolver_is_pending(loop->resolver))
+        || (loop->whois_client && whois_client_is_pending(loop->whois_client));
+}
+
 int pt_loop(pt_loop_t * loop) {
     int n, i, cur_fd;
+    size_t num_processed_events;
 
     // TODO set a flag to avoid issues due to several threads
     // and put a critical section to manage this flag
@@ -436,6 +1124,7 @@ int pt_loop(pt_loop_t * loop) {
     int network_group_timerfd = network_get_group_timerfd(loop->network);
     ssize_t s;
     struct signalfd_siginfo fdsi;
+    bool is_interrupted = false;
 
     // This boolean is used to avoid to terminate twice when --timeout is used.
     bool max_time_has_expired = false;
@@ -449,12 +1138,14 @@ int pt_loop(pt_loop_t * loop) {
         double elapsed_time = difftime(time(NULL), starting_time_algorithm);
         if (max_time && elapsed_time > max_time && !max_time_has_expired) {
             pt_instance_iter(loop, pt_process_algorithms_terminate);
-            fprintf(stdout, "Algorithm terminated because of a time expiry\n");
+            fprintf(pt_loop_get_stream(loop), "Algorithm terminated because of a time expiry\n");
             max_time_has_expired = true;
         }
 
         // Wait for events.
-        n = epoll_wait(loop->efd, loop->epoll_events, MAXEVENTS, -1);
+        n = pt_loop_wait(loop);
+        loop->num_waits++;
+        num_processed_events = loop->num_processed_events;
 
         /* XXX What kind of events do we have
          * - sockets (packets received, timeouts, etc.)
@@ -467,6 +1158,31 @@ int pt_loop(pt_loop_t * loop) {
             // the corresponding event.
             cur_fd = loop->epoll_events[i].data.fd;
 
+            // The output can be written again (see pt_loop_flush_output)
+            if (loop->output && cur_fd == output_get_fd(loop->output)) {
+                loop->output_is_watched = false;
+                continue;
+            }
+
+            // The resolver retrieves its pending errors (e.g. no name
+            // server) by reading its socket.
+            if (loop->resolver && cur_fd == resolver_get_sockfd(loop->resolver)) {
+                loop->num_processed_events += resolver_process_answers(loop->resolver);
+                continue;
+            } else if (loop->resolver && cur_fd == resolver_get_timerfd(loop->resolver)) {
+                loop->num_processed_events += resolver_process_timeouts(loop->resolver);
+                continue;
+            } else if (loop->whois_client && cur_fd == whois_client_get_sockfd(loop->whois_client)) {
+                loop->whois_client_is_watched = false;
+                loop->num_processed_events += whois_client_process_socket(loop->whois_client);
+                continue;
+            } else if (loop->whois_client && cur_fd == whois_client_get_timerfd(loop->whois_client)) {
+                // The current batch may have been replaced
+                loop->whois_client_is_watched = false;
+                loop->num_processed_events += whois_client_process_timer(loop->whois_client);
+                continue;
+            }
+
             // Handle errors on fds
             if ((loop->epoll_events[i].events & EPOLLERR)
             ||  (loop->epoll_events[i].events & EPOLLHUP)
@@ -478,27 +1194,30 @@ int pt_loop(pt_loop_t * loop) {
                 continue;
             }
 
+            // Every fd is registered in edge-triggered mode: each fd must be
+            // drained, otherwise it will not be notified anymore.
             if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == network_sendq_fd) {
-                if (!network_process_sendq(loop->network)) {
-                    if (loop->network->is_verbose) fprintf(stderr, "pt_loop: Can't send packet\n");
-                }
+                loop->num_processed_events += network_process_sendq(loop->network);
+                pt_loop_submit(loop);
             } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == network_recvq_fd) {
-                if (!network_process_recvq(loop->network)) {
-                    if (loop->network->is_verbose) fprintf(stderr, "pt_loop: Cannot fetch packet\n");
-                }
+                loop->num_processed_events += network_process_recvq(loop->network);
             } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == network_group_timerfd) {
-                 //printf("pt_loop processing scheduled probes\n");
-                network_process_scheduled_probe(loop->network);
+                loop->num_processed_events += network_process_scheduled_probe(loop->network);
 #ifdef USE_IPV4
             } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == network_icmpv4_sockfd) {
-                network_process_sniffer(loop->network, IPPROTO_ICMP);
+                loop->num_processed_events += network_process_sniffer(loop->network, IPPROTO_ICMP);
 #endif
 #ifdef USE_IPV6
             } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == network_icmpv6_sockfd) {
-                network_process_sniffer(loop->network, IPPROTO_ICMPV6);
+                loop->num_processed_events += network_process_sniffer(loop->network, IPPROTO_ICMPV6);
 #endif
             } else if (cur_fd == loop->eventfd_algorithm) {
 
+                // Acknowledge every notification before processing the
+                // events, so that events raised meanwhile activate again
+                // this fd.
+                pt_loop_acknowledge_event_fd(loop->eventfd_algorithm);
+
                 // There is one common queue shared by every instancied algorithms.
                 // We call pt_process_algorithms_iter() to find for which instance
                 // the event has been raised. Then we process this event thanks
@@ -513,49 +1232,144 @@ int pt_loop(pt_loop_t * loop) {
             } else if (cur_fd == loop->eventfd_user) {
 
                 // Throw this event to the user-defined handler
-                pt_loop_process_user_events(loop);
+                loop->num_processed_events += pt_loop_process_user_events(loop);
 
                 // Flush the queue
                 pt_loop_clear_user_events(loop);
 
             } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == loop->sfd) {
 
-                // Handling signals (ctrl-c, etc.)
-                s = read(loop->sfd, &fdsi, sizeof(struct signalfd_siginfo));
-                if (s != sizeof(struct signalfd_siginfo)) {
+                // Handling signals (ctrl-c, etc.). The interruption is
+                // honoured once the other ready fds have been drained,
+                // since they would not be notified again.
+                while ((s = read(loop->sfd, &fdsi, sizeof(struct signalfd_siginfo))) == sizeof(struct signalfd_siginfo)) {
+                    loop->num_processed_events++;
+                    if (fdsi.ssi_signo == SIGINT || fdsi.ssi_signo == SIGQUIT) {
+                        is_interrupted = true;
+                    } else {
+                        fprintf(stderr, "Read unexpected signal (%d)\n", fdsi.ssi_signo);
+                    }
+                }
+                if (s == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
                     perror("read");
-                    continue;
                 }
 
-                if (fdsi.ssi_signo == SIGINT || fdsi.ssi_signo == SIGQUIT) {
-                    pt_instance_iter(loop, pt_process_algorithms_terminate);
-                } else {
-                    perror("Read unexpected signal\n");
-                }
-                loop->status = PT_LOOP_INTERRUPTED;
-                break;
+            } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == loop->timerfd_algorithm) {
+
+                // At least one timer set by an algorithm has expired
+                s_loop = loop;
+                pt_loop_process_timers(loop);
+                s_loop = NULL;
 
             } else if (loop->status != PT_LOOP_INTERRUPTED && cur_fd == network_timerfd) {
 
                 // Timer managing timeout in network layer has expired
                 // At least one probe has expired
+                loop->num_processed_events++;
                 if (!network_drop_expired_flying_probe(loop->network)) {
                     fprintf(stderr, "Error while processing timeout\n");
                 }
             }
         }
-    } while (loop->status == PT_LOOP_CONTINUE || loop->status == PT_LOOP_INTERRUPTED);
+
+        // Interrupt the algorithms. If the loop was only waiting for the
+        // resolver, it stops now.
+        if (is_interrupted && loop->status == PT_LOOP_CONTINUE) {
+            pt_instance_iter(loop, pt_process_algorithms_terminate);
+            loop->status = PT_LOOP_INTERRUPTED;
+        }
+
+        // Write what the handlers have printed
+        pt_loop_flush_output(loop);
+        pt_loop_watch_whois_client(loop);
+
+        num_processed_events = loop->num_processed_events - num_processed_events;
+        if (num_processed_events > loop->max_processed_events) {
+            loop->max_processed_events = num_processed_events;
+        }
+    } while (loop->status == PT_LOOP_CONTINUE
+        ||   loop->status == PT_LOOP_INTERRUPTED
+        // Wait for the hostnames and ASNs still awaited by the output
+        ||  (loop->status == PT_LOOP_TERMINATE && !is_interrupted && pt_loop_has_pending_lookups(loop))
+    );
+
+    if (loop->network->is_verbose) pt_loop_dump_stats(loop);
 
     // Process internal events
     return loop->status == PT_LOOP_TERMINATE ? 0 : -1;
 }
 
 bool pt_send_probe(pt_loop_t * loop, probe_t * probe) {
+    algorithm_instance_t * instance = loop->cur_instance;
+
     // Annotate which algorithm has generated this probe
-    probe_set_caller(probe, loop->cur_instance);
+    probe_set_caller(probe, instance);
+
+    // Wait for a free slot if the in-flight window is full (or if
+    // older probes are already waiting, to preserve the sending order).
+    if (instance && (
+        dynarray_get_size(instance->pending_probes) > 0
+    || !pt_instance_can_send(instance, probe_get_num_packets(probe))
+    )) {
+        return dynarray_push_element(instance->pending_probes, probe);
+    }
 
     // Tagging is achieved by network layer
-    return network_send_probe(loop->network, probe);
+    return pt_instance_send_probe(loop, instance, probe);
+}
+
+bool pt_send_stateless_probe(pt_loop_t * loop, probe_t * probe, uint16_t tag) {
+    algorithm_instance_t * instance = loop->cur_instance;
+
+    // The replies are delivered to the latest instance which has sent
+    // a stateless probe.
+    probe_set_caller(probe, instance);
+    network_set_unmatched_caller(loop->network, instance);
+    return network_send_stateless_probe(loop->network, probe, tag);
+}
+
+bool pt_set_timer(pt_loop_t * loop, double delay) {
+    algorithm_instance_t * instance = loop->cur_instance;
+
+    if (!instance || delay < 0) return false;
+
+    instance->timer = get_timestamp() + delay;
+    if (!loop->next_timer || instance->timer < loop->next_timer) {
+        loop->next_timer = instance->timer;
+        return pt_loop_update_timer(loop);
+    }
+    return true;
+}
+
+/**
+ * \brief Print the statistics of a cache, if it has been used.
+ * \param cache An address_cache_t instance (possibly NULL).
+ */
+
+static void pt_loop_dump_cache_stats(const address_cache_t * cache) {
+    if (cache && (cache->num_hits || cache->num_misses || address_cache_get_size(cache))) {
+        address_cache_dump_stats(cache);
+    }
+}
+
+void pt_loop_dump_stats(const pt_loop_t * loop) {
+    fprintf(stderr,
+        "pt_loop: %zu events processed in %zu waits (%.2lf events per wait, at most %zu)\n",
+        loop->num_processed_events,
+        loop->num_waits,
+        loop->num_waits ? (double) loop->num_processed_events / loop->num_waits : 0.0,
+        loop->max_processed_events
+    );
+    fprintf(stderr,
+        "pt_loop: %zu replies dropped by the kernel (receive buffer full)\n",
+        network_get_num_sniffer_drops(loop->network)
+    );
+    if (loop->resolver) resolver_dump_stats(loop->resolver);
+    if (loop->whois_client) whois_client_dump_stats(loop->whois_client);
+    pt_loop_dump_cache_stats(address_get_hostname_cache());
+    pt_loop_dump_cache_stats(whois_get_asn_cache());
+    if (loop->output) output_dump_stats(loop->output);
+    if (loop->uring) uring_dump_stats(loop->uring);
 }
 
 void pt_loop_terminate(pt_loop_t * loop) {
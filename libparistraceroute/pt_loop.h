@@ -22,17 +22,62 @@
 #include "probe.h"
 #include "network.h"
 #include "event.h"
+#include "stop_set.h"
+#include "output.h"
+#include "hole.h"
+#include "address_cache.h"
+#include "resolver.h"
+#include "whois.h"
 
 //---------------------------------------------------------------------------
 // pt_loop options
 //---------------------------------------------------------------------------
 
+typedef enum pt_loop_backend_e {
+    PT_LOOP_BACKEND_EPOLL,    /**< Wait for events thanks to epoll (default) */
+    PT_LOOP_BACKEND_IO_URING  /**< Wait for events thanks to io_uring (Linux only, see uring.h) */
+} pt_loop_backend_t;
+
 // Maximum time spent inside the pt_loop
 #define PT_LOOP_DEFAULT_TIMEOUT 180
 
 #define OPTIONS_PT_LOOP_TIMEOUT {PT_LOOP_DEFAULT_TIMEOUT, 0, INT_MAX}
 #define HELP_t "Set the timeout in seconds of the measurement (default is 180 seconds, pass 0 to set it to infinity)."
 
+// Maximum number of probe packets in flight per algorithm instance (0: unbounded)
+#define PT_LOOP_DEFAULT_MAX_IN_FLIGHT 0
+
+#define OPTIONS_PT_LOOP_MAX_IN_FLIGHT {PT_LOOP_DEFAULT_MAX_IN_FLIGHT, 0, INT_MAX}
+#define HELP_max_in_flight "Set the maximum number of probes in flight per algorithm instance (default is 0, i.e. unbounded)."
+
+// Number of retransmissions of an expired probe before raising a PROBE_TIMEOUT
+#define PT_LOOP_DEFAULT_MAX_RETRIES 0
+
+#define OPTIONS_PT_LOOP_MAX_RETRIES {PT_LOOP_DEFAULT_MAX_RETRIES, 0, 255}
+#define HELP_retries "Set the number of times an unanswered probe is sent again (default is 0)."
+
+#define HELP_io_uring "Use the io_uring backend instead of epoll to wait for events (Linux only)."
+
+// Size of the ring buffer of the standard output (0: stdio is used as is)
+#define PT_LOOP_DEFAULT_OUTPUT_BUFFER 0
+
+#define OPTIONS_PT_LOOP_OUTPUT_BUFFER {PT_LOOP_DEFAULT_OUTPUT_BUFFER, 0, INT_MAX}
+#define HELP_output_buffer "Store the standard output in a ring buffer of SIZE bytes, written without delaying the probes. The ring buffer grows when the standard output is not read fast enough (default is 0, i.e. disabled)."
+
+#define OPTIONS_PT_LOOP_DNS_MAX_IN_FLIGHT {RESOLVER_DEFAULT_MAX_IN_FLIGHT, 1, UINT16_MAX}
+#define HELP_dns_max_in_flight "Set the maximum number of reverse DNS queries in flight (default is 16)."
+
+#define HELP_whois_server "Set the whois server used to retrieve ASNs. It must support the bulk mode (default is " WHOIS_BULK_SERVER ")."
+#define OPTIONS_PT_LOOP_CACHE_SIZE {ADDRESS_CACHE_DEFAULT_CAPACITY, 1, INT_MAX}
+#define HELP_cache_size "Set the maximum number of hostnames and of ASNs kept in memory (default is 65536 each)."
+
+#define OPTIONS_PT_LOOP_CACHE_TTL {ADDRESS_CACHE_DEFAULT_TTL, 0, INT_MAX}
+#define HELP_cache_ttl "Set the lifetime (in seconds) of the cached hostnames and ASNs (default is 86400, 0 means infinite)."
+
+#define HELP_cache_file "Load the cached hostnames and ASNs from FILE (if it exists) and save them to FILE once done."
+
+#define HELP_asn_index "Retrieve ASNs offline from an index built by paris-convert --asn-index. The whois servers are not queried."
+
 /**
  * \brief Retrieve the timeout defined for the pt_loop.
  * \return The value set in the network layer (in seconds)
@@ -40,6 +85,77 @@
 
 double options_pt_loop_get_timeout();
 
+/**
+ * \brief Retrieve the in-flight window defined for the algorithm instances.
+ * \return The maximum number of probes in flight (0 means unbounded).
+ */
+
+unsigned options_pt_loop_get_max_in_flight();
+
+/**
+ * \brief Retrieve the retransmission budget defined for the probes.
+ * \return The number of times an expired probe is sent again.
+ */
+
+unsigned options_pt_loop_get_max_retries();
+
+/**
+ * \brief Retrieve the backend that the pt_loop must use.
+ * \return The pt_loop backend selected by the user.
+ */
+
+pt_loop_backend_t options_pt_loop_get_backend();
+
+/**
+ * \brief Retrieve the size of the ring buffer of the standard output.
+ * \return The size of the ring buffer (0 means that the standard
+ *    output is not buffered by an output_t).
+ */
+
+unsigned options_pt_loop_get_output_buffer();
+
+/**
+ * \brief Retrieve the maximum number of reverse DNS queries in flight.
+ * \return The maximum number of queries in flight.
+ */
+
+unsigned options_pt_loop_get_dns_max_in_flight();
+
+/**
+ * \brief Retrieve the whois server used to retrieve ASNs.
+ * \return The hostname or the IP address of the whois server.
+ */
+
+const char * options_pt_loop_get_whois_server();
+
+/**
+ * \brief Retrieve the ASN index used to retrieve ASNs offline.
+ * \return The path of the index file, NULL if none.
+ */
+
+const char * options_pt_loop_get_asn_index();
+
+/**
+ * \brief Retrieve the maximum number of entries of the hostname and ASN caches.
+ * \return The maximum number of entries of each cache.
+ */
+
+unsigned options_pt_loop_get_cache_size();
+
+/**
+ * \brief Retrieve the lifetime of the cached hostnames and ASNs.
+ * \return The lifetime in seconds (0 means infinite).
+ */
+
+double options_pt_loop_get_cache_ttl();
+
+/**
+ * \brief Retrieve the file storing the cached hostnames and ASNs.
+ * \return The path of the file, NULL if none.
+ */
+
+const char * options_pt_loop_get_cache_file();
+
 /**
  * \brief Get the command-line options related to the pt_loop.
  * \return A pointer to a structure containing the options.
@@ -65,6 +181,8 @@ typedef struct pt_loop_s {
     void                        * algorithm_instances_root;
     unsigned int                  next_algorithm_id;
     int                           eventfd_algorithm;
+    int                           timerfd_algorithm;        /**< Activated when the earliest timer set by pt_set_timer expires */
+    double                        next_timer;               /**< Deadline of the earliest timer set by pt_set_timer (0 if none) */
 
     // User
     int                           eventfd_user;             /**< User notification */
@@ -81,15 +199,36 @@ typedef struct pt_loop_s {
 
     pt_loop_status_t              status;                   /**< State of the loop. See pt_loop_status_t for further details. */
     double                        timeout;                  /**< Lifetime of the pt-loop. 0 means infinite lifetime. */
+    size_t                        max_in_flight;            /**< Default in-flight window of the algorithm instances (0 means unbounded). */
+    size_t                        max_retries;              /**< Default retransmission budget of the algorithm instances. */
+    stop_set_t                  * stop_set;                 /**< Doubletree stop sets shared by the algorithm instances (see pt_loop_get_stop_set). */
+    resolver_t                  * resolver;                 /**< Reverse DNS resolver (see pt_loop_get_resolver). */
+    size_t                        dns_max_in_flight;        /**< Maximum number of reverse DNS queries in flight. */
+    whois_client_t              * whois_client;             /**< ASN lookups (see pt_loop_get_whois_client). */
+    bool                          whois_client_is_watched;  /**< True iif the backend waits for the socket of whois_client. */
+    const char                  * whois_server;             /**< Hostname or IP address of the whois server. */
+    const char                  * cache_file;               /**< File storing the hostname and ASN caches (see pt_loop_set_cache_file). */
 
     // Signal data
     int                           sfd;                      // signalfd
 
     // Epoll data
-    int                           efd;
-    struct epoll_event          * epoll_events;
+    pt_loop_backend_t             backend;                  /**< Backend used to wait for events. */
+    int                           efd;                      /**< epoll file descriptor (-1 if backend != PT_LOOP_BACKEND_EPOLL). */
+    struct uring_s              * uring;                    /**< io_uring instance (NULL if backend != PT_LOOP_BACKEND_IO_URING). */
+    struct epoll_event          * epoll_events;             /**< Buffer in which the backend writes the ready file descriptors. */
     struct algorithm_instance_s * cur_instance;
 
+    // Output
+    hole_stream_t               * hole_stream;              /**< Stream in which the results are printed (see pt_loop_get_stream). */
+    output_t                    * output;                   /**< Sink written whenever its file descriptor is writable (NULL if none). */
+    bool                          output_is_watched;        /**< True iif the backend waits for the file descriptor of output. */
+
+    // Statistics
+    size_t                        num_waits;                /**< Number of times the loop has waited for events. */
+    size_t                        num_processed_events;     /**< Number of processed events (probes sent, packets sniffed, algorithm and user events...). */
+    size_t                        max_processed_events;     /**< Maximum number of events processed after a single wait. */
+
 } pt_loop_t;
 
 /**
@@ -112,6 +251,22 @@ typedef struct pt_loop_s {
 
 pt_loop_t * pt_loop_create(void (*handler_user)(pt_loop_t *, event_t *, void *), void * user_data);
 
+/**
+ * \brief Create the event loop using a given backend.
+ *    If the io_uring backend is not supported by the system,
+ *    the loop falls back to epoll.
+ * \param handler_user See pt_loop_create().
+ * \param user_data See pt_loop_create().
+ * \param backend The backend used to wait for events.
+ * \return A pointer to a loop if successfull, NULL otherwise.
+ */
+
+pt_loop_t * pt_loop_create_backend(
+    void (*handler_user)(pt_loop_t *, event_t *, void *),
+    void * user_data,
+    pt_loop_backend_t backend
+);
+
 /**
  * \brief Close properly the paristraceroute loop
  * \param loop The libparistraceroute loop
@@ -141,7 +296,9 @@ void pt_loop_free(pt_loop_t * loop);
 int pt_loop(pt_loop_t * loop);
 
 /**
- * \brief Init the options related to pt_loop.
+ * \brief Init the options related to pt_loop. --output-buffer is handled
+ *    by the program, which owns the standard output (see pt_loop_set_output
+ *    and options_pt_loop_get_output_buffer).
  * \param loop The libparistraceroute loop.
  */
 
@@ -155,6 +312,119 @@ void options_pt_loop_init(pt_loop_t * loop);
 
 void pt_loop_set_timeout(pt_loop_t * loop, double new_timeout);
 
+/**
+ * \brief Set the in-flight window of the algorithm instances
+ *    that will be created by the libparistraceroute loop.
+ * \param loop The libparistraceroute loop.
+ * \param max_in_flight The maximum number of probes in flight
+ *    per instance (0 means unbounded).
+ */
+
+void pt_loop_set_max_in_flight(pt_loop_t * loop, size_t max_in_flight);
+
+/**
+ * \brief Set the retransmission budget of the algorithm instances
+ *    that will be created by the libparistraceroute loop.
+ * \param loop The libparistraceroute loop.
+ * \param max_retries The number of times an expired probe is sent again.
+ */
+
+void pt_loop_set_max_retries(pt_loop_t * loop, size_t max_retries);
+
+/**
+ * \brief Attach an output sink to a libparistraceroute loop. Its pending
+ *    bytes are written after each batch of events and whenever its file
+ *    descriptor becomes writable, so that a slow consumer never delays
+ *    the probes. The results are printed in its stream (see
+ *    pt_loop_get_stream).
+ * \param loop The libparistraceroute loop.
+ * \param output The output_t instance (NULL to print on stdout). It remains
+ *    owned by the caller, which releases it after pt_loop_free.
+ */
+
+void pt_loop_set_output(pt_loop_t * loop, output_t * output);
+
+/**
+ * \brief Retrieve the hole_stream_t in which the results are printed, so
+ *    that the hostnames and ASNs printed once known keep their place
+ *    (see resolver_print_hostname, whois_client_print_asn).
+ * \param loop The libparistraceroute loop.
+ * \return The hole_stream_t instance of this loop, released by pt_loop_free.
+ */
+
+hole_stream_t * pt_loop_get_hole_stream(pt_loop_t * loop);
+
+/**
+ * \brief Retrieve the stream in which the results are printed. It writes
+ *    in the output attached to the loop (see pt_loop_set_output), stdout
+ *    otherwise.
+ * \param loop The libparistraceroute loop.
+ * \return The stream of the hole_stream_t of this loop.
+ */
+
+FILE * pt_loop_get_stream(pt_loop_t * loop);
+
+/**
+ * \brief Retrieve the Doubletree stop sets shared by the algorithm
+ *    instances running in a libparistraceroute loop. They are created
+ *    the first time they are requested and released by pt_loop_free.
+ * \param loop The libparistraceroute loop.
+ * \return The stop_set_t instance of this loop, NULL in case of failure.
+ */
+
+stop_set_t * pt_loop_get_stop_set(pt_loop_t * loop);
+
+/**
+ * \brief Set the maximum number of reverse DNS queries in flight. It must
+ *    be called before the first call to pt_loop_get_resolver.
+ * \param loop The libparistraceroute loop.
+ * \param dns_max_in_flight The maximum number of queries in flight.
+ */
+
+void pt_loop_set_dns_max_in_flight(pt_loop_t * loop, size_t dns_max_in_flight);
+
+/**
+ * \brief Retrieve the reverse DNS resolver of a libparistraceroute loop.
+ *    It is created the first time it is requested and released by
+ *    pt_loop_free. Its answers are processed by the loop, which keeps
+ *    running until the pending queries are answered or expire.
+ * \param loop The libparistraceroute loop.
+ * \return The resolver_t instance of this loop, NULL in case of failure.
+ */
+
+resolver_t * pt_loop_get_resolver(pt_loop_t * loop);
+
+/**
+ * \brief Set the whois server used to retrieve ASNs. It must be called
+ *    before the first call to pt_loop_get_whois_client.
+ * \param loop The libparistraceroute loop.
+ * \param whois_server The hostname or the IP address of the whois server
+ *    (it is not duplicated).
+ */
+
+void pt_loop_set_whois_server(pt_loop_t * loop, const char * whois_server);
+
+/**
+ * \brief Retrieve the whois client of a libparistraceroute loop. It is
+ *    created the first time it is requested and released by pt_loop_free.
+ *    Its batches are processed by the loop, which keeps running until the
+ *    pending lookups complete.
+ * \param loop The libparistraceroute loop.
+ * \return The whois_client_t instance of this loop, NULL in case of failure.
+ */
+
+whois_client_t * pt_loop_get_whois_client(pt_loop_t * loop);
+
+/**
+ * \brief Load the hostname and ASN caches (see address_cache.h) from a
+ *    file, if it exists. The caches are saved to this file by pt_loop_free.
+ * \param loop The libparistraceroute loop.
+ * \param cache_file The path of the file (it is not duplicated).
+ * \return true iif successful.
+ */
+
+bool pt_loop_set_cache_file(pt_loop_t * loop, const char * cache_file);
+
 /**
  * \brief Retrieve the user events stored in the user queue.
  * \param loop The libparistraceroute loop.
@@ -173,16 +443,55 @@ event_t ** pt_loop_get_user_events(pt_loop_t * loop);
 size_t pt_loop_get_num_user_events(pt_loop_t * loop);
 
 /**
- * \brief Send a probe packet across a network
- * \param network Pointer to the network to use
+ * \brief Send a probe packet across a network.
+ *    If the current algorithm instance has reached its in-flight window,
+ *    the probe is kept aside and sent as soon as a reply or a timeout
+ *    frees a slot. Expired probes are sent again according to the
+ *    retransmission budget of the instance before a PROBE_TIMEOUT is raised.
+ * \param loop The libparistraceroute loop.
  * \param probe Pointer to the probe to use
- * \param callback Function pointer to a callback function
- *     (Does not appear to be used currently)
  * \return true iif successful
  */
 
 bool pt_send_probe(pt_loop_t * loop, probe_t * probe);
 
+/**
+ * \brief (Used by algorithm) Send a probe packet immediately, without
+ *    keeping any state about it (see network_send_stateless_probe).
+ *    It never expires and its reply is delivered to the current algorithm
+ *    instance through a PROBE_UNMATCHED_REPLY event, whose reply is
+ *    released once processed. Such replies can only be matched thanks to
+ *    the information the algorithm has encoded in the probe.
+ * \param loop The libparistraceroute loop.
+ * \param probe The probe to send. The caller keeps its ownership and may
+ *    alter and send it again.
+ * \param tag The tag written in the probe. It is quoted in the reply
+ *    (third "checksum" field of an IP / ICMP / IP / * reply).
+ * \return true iif successful
+ */
+
+bool pt_send_stateless_probe(pt_loop_t * loop, probe_t * probe, uint16_t tag);
+
+/**
+ * \brief (Used by algorithm) Raise an ALGORITHM_TIMER event to the current
+ *    algorithm instance once a given delay has elapsed. It replaces the timer
+ *    previously set by this instance (if any).
+ * \param loop The libparistraceroute loop.
+ * \param delay The delay (in seconds).
+ * \return true iif successful
+ */
+
+bool pt_set_timer(pt_loop_t * loop, double delay);
+
+/**
+ * \brief Print how many events have been processed each time
+ *    the loop has waited for events. They are printed when the
+ *    loop ends if the network layer is verbose.
+ * \param loop The main loop
+ */
+
+void pt_loop_dump_stats(const pt_loop_t * loop);
+
 /**
  * \brief Stop the main loop. It is usually used to break the pt_loop call in the main program.
  * \param loop The main loop
@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include <stdlib.h>         // malloc, free
+#include <stdint.h>         // uint64_t
 #include <unistd.h>         // read
 #include "os/sys/eventfd.h" // event_fd
 
@@ -18,7 +19,7 @@ queue_t * queue_create_impl(
     }
 
     // Create an eventfd
-    if ((queue->eventfd = eventfd(0, EFD_SEMAPHORE)) == -1) {
+    if ((queue->eventfd = eventfd(0, EFD_NONBLOCK)) == -1) {
         goto ERR_EVENTFD;
     }
 
@@ -51,11 +52,24 @@ inline bool queue_push_element(queue_t *queue, void * element) {
         && (eventfd_write(queue->eventfd, 1) != -1);
 }
 
-void * queue_pop_element(queue_t *queue, void (*element_free)(void * element)) {
+uint64_t queue_acknowledge(queue_t * queue) {
     eventfd_t value;
-    return (read(queue->eventfd, &value, sizeof(value)) != -1) ?
-        list_pop_element(queue->elements, element_free) :
-        NULL;
+
+    // The eventfd is non-blocking: read fails (EAGAIN) if nothing was pushed.
+    return read(queue->eventfd, &value, sizeof(value)) == sizeof(value) ? value : 0;
+}
+
+void * queue_pop_element(queue_t *queue, void (*element_free)(void * element)) {
+    return list_pop_element(queue->elements, element_free);
+}
+
+size_t queue_del_elements(
+    queue_t * queue,
+    bool   (* match)(const void * element, const void * data),
+    const void * data,
+    void   (* element_free)(void * element)
+) {
+    return list_del_elements(queue->elements, match, data, element_free);
 }
 
 inline int queue_get_fd(const queue_t * queue) {
@@ -2,10 +2,17 @@
 #define LIBPT_QUEUE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "common.h"
 #include "containers/list.h"
 
+/**
+ * A queue_t notifies each push through a non-blocking eventfd (counter
+ * semantics). The consumer resets the eventfd thanks to queue_acknowledge()
+ * and then pops every element until queue_pop_element() returns NULL.
+ */
+
 typedef struct {
     list_t * elements; /**< Elements stored in the queue */
     int      eventfd;  /**< File descriptor notifying an update in the queue */
@@ -43,15 +50,44 @@ void queue_free(queue_t * queue);
 
 bool queue_push_element(queue_t * queue, void * element);
 
+/**
+ * \brief Reset the eventfd of a queue. This must be done before
+ *    draining the queue, so that elements pushed afterwards activate
+ *    again the eventfd.
+ * \param queue A pointer to a queue instance.
+ * \return The number of elements pushed since the last call.
+ */
+
+uint64_t queue_acknowledge(queue_t * queue);
+
 /**
  * \brief Pop an element from the queue.
  * \param queue The queue from which we pop an element.
  * \param element_free Function called back to free the poped element.
- * \return The address of the poped element, NULL in case of failure.
+ * \return The address of the poped element, NULL if the queue is empty.
  */
 
 void * queue_pop_element(queue_t * queue, void (*element_free)(void * element));
 
+/**
+ * \brief Remove from the queue every element matching a predicate.
+ *    The file descriptor of the queue is left unchanged, hence it may
+ *    notify more elements than the queue contains.
+ * \param queue The queue.
+ * \param match Function returning true iif the element passed as first
+ *    parameter must be removed.
+ * \param data The second parameter passed to match.
+ * \param element_free Function called back to free the removed elements.
+ * \return The number of removed elements.
+ */
+
+size_t queue_del_elements(
+    queue_t * queue,
+    bool   (* match)(const void * element, const void * data),
+    const void * data,
+    void   (* element_free)(void * element)
+);
+
 /**
  * \brief Retrieve the file descriptor stored in a queue_t instance.
  * \param queue A pointer to a queue instance.
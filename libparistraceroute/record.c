@@ -0,0 +1,453 @@
+#include "use.h"
+#include "config.h"
+
+#include <errno.h>          // errno, EINVAL
+#include <stdlib.h>         // malloc, free
+#include <string.h>         // memcpy, memset, strlen
+#include <arpa/inet.h>      // htons, htonl, ntohs, ntohl
+#include <sys/socket.h>     // AF_INET, AF_INET6, AF_UNSPEC
+
+#include "record.h"
+
+// Size of the largest payload (RECORD_TRACE_START)
+#define RECORD_PAYLOAD_MAX (4 + 8 + 2 * (1 + RECORD_NAME_MAX) + 1 + 16)
+
+// Kind of an encoded address
+#define RECORD_ADDRESS_NONE 0
+#define RECORD_ADDRESS_IPV4 4
+#define RECORD_ADDRESS_IPV6 6
+
+static const char * record_status_names[] = {
+    "interrupted",
+    "completed",
+    "reached",
+    "max-ttl",
+    "too-many-stars",
+    "stop-set",
+    "error"
+};
+
+static const char * record_type_names[] = {
+    NULL,
+    "trace_start",
+    "probe",
+    "hop",
+    "link",
+    "trace_end"
+};
+
+const char * record_status_to_string(record_status_t status) {
+    return status <= RECORD_STATUS_ERROR ? record_status_names[status] : "unknown";
+}
+
+const char * record_type_to_string(record_type_t type) {
+    return type <= RECORD_TRACE_END ? record_type_names[type] : NULL;
+}
+
+bool record_set_probe(record_t * record, uint32_t trace_id, const probe_t * probe, const probe_t * reply)
+{
+    uintmax_t flow_id = 0;
+
+    memset(record, 0, sizeof(record_t));
+    record->type     = RECORD_PROBE;
+    record->trace_id = trace_id;
+
+    if (!probe_extract(probe, "ttl", &record->probe.ttl)) return false;
+
+    // Only some protocols carry a flow identifier
+    probe_extract(probe, "flow_id", &flow_id);
+    record->probe.flow_id = flow_id;
+
+    if (reply) {
+        if (!probe_extract(reply, "src_ip", &record->probe.reply_addr)) return false;
+        record->probe.rtt = 1000 * (probe_get_recv_time(reply) - probe_get_sending_time(probe));
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// Encoding (internal usage)
+//---------------------------------------------------------------------------
+
+static inline uint8_t * record_put_uint8(uint8_t * p, uint8_t x) {
+    *p = x;
+    return p + 1;
+}
+
+static inline uint8_t * record_put_uint16(uint8_t * p, uint16_t x) {
+    x = htons(x);
+    memcpy(p, &x, sizeof(x));
+    return p + sizeof(x);
+}
+
+static inline uint8_t * record_put_uint32(uint8_t * p, uint32_t x) {
+    x = htonl(x);
+    memcpy(p, &x, sizeof(x));
+    return p + sizeof(x);
+}
+
+static inline uint8_t * record_put_uint64(uint8_t * p, uint64_t x) {
+    p = record_put_uint32(p, x >> 32);
+    return record_put_uint32(p, (uint32_t) x);
+}
+
+static uint8_t * record_put_string(uint8_t * p, const char * s) {
+    size_t len = strnlen(s, RECORD_NAME_MAX - 1);
+
+    p = record_put_uint8(p, len);
+    memcpy(p, s, len);
+    return p + len;
+}
+
+static uint8_t * record_put_address(uint8_t * p, const address_t * address) {
+    switch (address->family) {
+        case AF_INET:
+            p = record_put_uint8(p, RECORD_ADDRESS_IPV4);
+            memcpy(p, &address->ip.ipv4, 4);
+            return p + 4;
+        case AF_INET6:
+            p = record_put_uint8(p, RECORD_ADDRESS_IPV6);
+            memcpy(p, &address->ip.ipv6, 16);
+            return p + 16;
+        default:
+            return record_put_uint8(p, RECORD_ADDRESS_NONE);
+    }
+}
+
+/**
+ * \brief Encode the payload of a record.
+ * \param record The record.
+ * \param payload A buffer of at least RECORD_PAYLOAD_MAX bytes.
+ * \return The size of the payload, 0 if the record type is invalid.
+ */
+
+static size_t record_encode_payload(const record_t * record, uint8_t * payload)
+{
+    uint8_t * p = record_put_uint32(payload, record->trace_id);
+
+    switch (record->type) {
+        case RECORD_TRACE_START:
+            p = record_put_uint64(p, (uint64_t) (record->trace_start.start_time * 1000000));
+            p = record_put_string(p, record->trace_start.algorithm);
+            p = record_put_string(p, record->trace_start.protocol);
+            p = record_put_address(p, &record->trace_start.dst_addr);
+            break;
+        case RECORD_PROBE:
+            p = record_put_uint8(p, record->probe.ttl);
+            p = record_put_uint16(p, record->probe.flow_id);
+            p = record_put_uint32(p, record->probe.rtt > 0 ? (uint32_t) (record->probe.rtt * 1000) : 0);
+            p = record_put_address(p, &record->probe.reply_addr);
+            break;
+        case RECORD_HOP:
+            p = record_put_uint8(p, record->hop.ttl);
+            p = record_put_uint8(p, record->hop.flags);
+            p = record_put_uint16(p, record->hop.num_next);
+            p = record_put_address(p, &record->hop.address);
+            break;
+        case RECORD_LINK:
+            p = record_put_uint8(p, record->link.ttl);
+            p = record_put_address(p, &record->link.source);
+            if (record->link.has_target) {
+                p = record_put_address(p, &record->link.target);
+            }
+            break;
+        case RECORD_TRACE_END:
+            p = record_put_uint8(p, record->status);
+            break;
+        default:
+            return 0;
+    }
+
+    return p - payload;
+}
+
+//---------------------------------------------------------------------------
+// Decoding (internal usage)
+//---------------------------------------------------------------------------
+
+// A payload being decoded. Reading past its end sets is_truncated.
+typedef struct {
+    const uint8_t * p;
+    const uint8_t * end;
+    bool            is_truncated;
+} record_cursor_t;
+
+static const uint8_t * record_get_bytes(record_cursor_t * cursor, size_t n) {
+    const uint8_t * bytes = cursor->p;
+
+    if (cursor->is_truncated || (size_t) (cursor->end - cursor->p) < n) {
+        cursor->is_truncated = true;
+        return NULL;
+    }
+    cursor->p += n;
+    return bytes;
+}
+
+static uint8_t record_get_uint8(record_cursor_t * cursor) {
+    const uint8_t * bytes = record_get_bytes(cursor, 1);
+    return bytes ? *bytes : 0;
+}
+
+static uint16_t record_get_uint16(record_cursor_t * cursor) {
+    const uint8_t * bytes = record_get_bytes(cursor, 2);
+    uint16_t        x = 0;
+
+    if (bytes) memcpy(&x, bytes, sizeof(x));
+    return ntohs(x);
+}
+
+static uint32_t record_get_uint32(record_cursor_t * cursor) {
+    const uint8_t * bytes = record_get_bytes(cursor, 4);
+    uint32_t        x = 0;
+
+    if (bytes) memcpy(&x, bytes, sizeof(x));
+    return ntohl(x);
+}
+
+static uint64_t record_get_uint64(record_cursor_t * cursor) {
+    uint64_t x = record_get_uint32(cursor);
+    return (x << 32) | record_get_uint32(cursor);
+}
+
+static void record_get_string(record_cursor_t * cursor, char * s) {
+    size_t          len = record_get_uint8(cursor);
+    const uint8_t * bytes = record_get_bytes(cursor, len);
+
+    if (!bytes || len >= RECORD_NAME_MAX) {
+        cursor->is_truncated = true;
+        len = 0;
+    } else memcpy(s, bytes, len);
+    s[len] = '\0';
+}
+
+static void record_get_address(record_cursor_t * cursor, address_t * address) {
+    const uint8_t * bytes;
+
+    memset(address, 0, sizeof(address_t));
+    switch (record_get_uint8(cursor)) {
+        case RECORD_ADDRESS_IPV4:
+            if ((bytes = record_get_bytes(cursor, 4))) {
+                address->family = AF_INET;
+                memcpy(&address->ip.ipv4, bytes, 4);
+            }
+            break;
+        case RECORD_ADDRESS_IPV6:
+            if ((bytes = record_get_bytes(cursor, 16))) {
+                address->family = AF_INET6;
+                memcpy(&address->ip.ipv6, bytes, 16);
+            }
+            break;
+        case RECORD_ADDRESS_NONE:
+            address->family = AF_UNSPEC;
+            break;
+        default:
+            cursor->is_truncated = true;
+            break;
+    }
+}
+
+/**
+ * \brief Decode the payload of a record.
+ * \param record The record to fill (record->type is already set).
+ * \param payload The payload.
+ * \param size The size of the payload.
+ * \return true iif successful.
+ */
+
+static bool record_decode_payload(record_t * record, const uint8_t * payload, size_t size)
+{
+    record_cursor_t cursor = {
+        .p            = payload,
+        .end          = payload + size,
+        .is_truncated = false
+    };
+
+    record->trace_id = record_get_uint32(&cursor);
+
+    switch (record->type) {
+        case RECORD_TRACE_START:
+            record->trace_start.start_time = record_get_uint64(&cursor) / 1000000.0;
+            record_get_string(&cursor, record->trace_start.algorithm);
+            record_get_string(&cursor, record->trace_start.protocol);
+            record_get_address(&cursor, &record->trace_start.dst_addr);
+            break;
+        case RECORD_PROBE:
+            record->probe.ttl     = record_get_uint8(&cursor);
+            record->probe.flow_id = record_get_uint16(&cursor);
+            record->probe.rtt     = record_get_uint32(&cursor) / 1000.0;
+            record_get_address(&cursor, &record->probe.reply_addr);
+            break;
+        case RECORD_HOP:
+            record->hop.ttl      = record_get_uint8(&cursor);
+            record->hop.flags    = record_get_uint8(&cursor);
+            record->hop.num_next = record_get_uint16(&cursor);
+            record_get_address(&cursor, &record->hop.address);
+            break;
+        case RECORD_LINK:
+            record->link.ttl = record_get_uint8(&cursor);
+            record_get_address(&cursor, &record->link.source);
+            if ((record->link.has_target = (cursor.p < cursor.end))) {
+                record_get_address(&cursor, &record->link.target);
+            }
+            break;
+        case RECORD_TRACE_END:
+            record->status = record_get_uint8(&cursor);
+            break;
+        default:
+            return false;
+    }
+
+    return !cursor.is_truncated;
+}
+
+//---------------------------------------------------------------------------
+// record_writer_t
+//---------------------------------------------------------------------------
+
+record_writer_t * record_writer_create(output_t * output)
+{
+    record_writer_t * writer;
+    uint8_t           header[RECORD_HEADER_SIZE],
+                    * p;
+
+    if (!(writer = malloc(sizeof(record_writer_t)))) goto ERR_MALLOC;
+    writer->output      = output;
+    writer->num_records = 0;
+
+    // File header
+    memcpy(header, RECORD_MAGIC, 4);
+    p = record_put_uint16(header + 4, RECORD_VERSION);
+    p = record_put_uint16(p, 0);
+    if (!output_write(output, header, p - header)) goto ERR_OUTPUT_WRITE;
+    return writer;
+
+ERR_OUTPUT_WRITE:
+    free(writer);
+ERR_MALLOC:
+    return NULL;
+}
+
+void record_writer_free(record_writer_t * writer)
+{
+    if (writer) free(writer);
+}
+
+bool record_write(record_writer_t * writer, const record_t * record)
+{
+    uint8_t buffer[RECORD_PREFIX_SIZE + RECORD_PAYLOAD_MAX],
+          * p;
+    size_t  size;
+
+    if (!(size = record_encode_payload(record, buffer + RECORD_PREFIX_SIZE))) {
+        errno = EINVAL;
+        return false;
+    }
+
+    // The prefix and the payload are written at once
+    p = record_put_uint8(buffer, record->type);
+    p = record_put_uint8(p, 0);
+    p = record_put_uint16(p, size);
+    if (!output_write(writer->output, buffer, RECORD_PREFIX_SIZE + size)) {
+        return false;
+    }
+    writer->num_records++;
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// record_reader_t
+//---------------------------------------------------------------------------
+
+record_reader_t * record_reader_create(FILE * file)
+{
+    record_reader_t * reader;
+    uint8_t           header[RECORD_HEADER_SIZE];
+    record_cursor_t   cursor = {
+        .p            = header + 4,
+        .end          = header + RECORD_HEADER_SIZE,
+        .is_truncated = false
+    };
+
+    if (fread(header, 1, RECORD_HEADER_SIZE, file) != RECORD_HEADER_SIZE
+    ||  memcmp(header, RECORD_MAGIC, 4) != 0) {
+        fprintf(stderr, "record_reader_create: invalid header\n");
+        errno = EINVAL;
+        goto ERR_INVALID_HEADER;
+    }
+
+    if (!(reader = malloc(sizeof(record_reader_t))))         goto ERR_MALLOC;
+    if (!(reader->payload = malloc(UINT16_MAX)))             goto ERR_PAYLOAD_MALLOC;
+
+    reader->file        = file;
+    reader->version     = record_get_uint16(&cursor);
+    reader->num_records = 0;
+    reader->has_failed  = false;
+
+    if (reader->version != RECORD_VERSION) {
+        fprintf(stderr, "record_reader_create: unsupported version (%hu)\n", reader->version);
+        errno = EINVAL;
+        goto ERR_INVALID_VERSION;
+    }
+
+    return reader;
+
+ERR_INVALID_VERSION:
+    free(reader->payload);
+ERR_PAYLOAD_MALLOC:
+    free(reader);
+ERR_MALLOC:
+ERR_INVALID_HEADER:
+    return NULL;
+}
+
+void record_reader_free(record_reader_t * reader)
+{
+    if (reader) {
+        free(reader->payload);
+        free(reader);
+    }
+}
+
+bool record_read(record_reader_t * reader, record_t * record)
+{
+    uint8_t         prefix[RECORD_PREFIX_SIZE];
+    record_cursor_t cursor = {
+        .p            = prefix,
+        .end          = prefix + RECORD_PREFIX_SIZE,
+        .is_truncated = false
+    };
+    uint8_t         type;
+    uint16_t        size;
+    size_t          n;
+
+    while ((n = fread(prefix, 1, RECORD_PREFIX_SIZE, reader->file)) == RECORD_PREFIX_SIZE) {
+        cursor.p = prefix;
+        type = record_get_uint8(&cursor);
+        record_get_uint8(&cursor);
+        size = record_get_uint16(&cursor);
+
+        if (fread(reader->payload, 1, size, reader->file) != size) break;
+
+        // Skip the records introduced by newer writers
+        if (!record_type_to_string(type)) continue;
+
+        memset(record, 0, sizeof(record_t));
+        record->type = type;
+        if (!record_decode_payload(record, reader->payload, size)) {
+            fprintf(stderr, "record_read: invalid %s record\n", record_type_to_string(type));
+            reader->has_failed = true;
+            errno = EINVAL;
+            return false;
+        }
+        reader->num_records++;
+        return true;
+    }
+
+    // A stream may only end between two records
+    if (n > 0 || ferror(reader->file)) {
+        fprintf(stderr, "record_read: truncated stream\n");
+        reader->has_failed = true;
+        errno = EINVAL;
+    }
+    return false;
+}
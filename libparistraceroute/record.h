@@ -0,0 +1,217 @@
+#ifndef LIBPT_RECORD_H
+#define LIBPT_RECORD_H
+
+#include <stdbool.h>                 // bool
+#include <stddef.h>                  // size_t
+#include <stdint.h>                  // uint*_t
+#include <stdio.h>                   // FILE
+
+#include "address.h"                 // address_t
+#include "output.h"                  // output_t
+#include "probe.h"                   // probe_t
+
+// Binary result format
+//
+// A record file starts with a header:
+//
+//   magic (4 bytes, "PTRB") | version (uint16) | reserved (uint16)
+//
+// followed by a sequence of length-prefixed records:
+//
+//   type (uint8) | reserved (uint8) | length (uint16) | payload (length bytes)
+//
+// Integers are stored in network byte order. An address is stored as a
+// kind byte (0: none, 4: IPv4, 6: IPv6) followed by 0, 4 or 16 bytes. A
+// string is stored as its length (uint8) followed by its characters.
+//
+// A reader skips the records whose type it does not know, so new record
+// types can be added without bumping RECORD_VERSION. Changing the payload
+// of an existing record type requires a new RECORD_VERSION.
+//
+// Payloads (in this order):
+// - RECORD_TRACE_START: trace_id (uint32), start_time (uint64, us since
+//   the Epoch), algorithm (string), protocol (string), dst_addr (address)
+// - RECORD_PROBE: trace_id (uint32), ttl (uint8), flow_id (uint16),
+//   rtt (uint32, us), reply_addr (address, none for a star)
+// - RECORD_HOP: trace_id (uint32), ttl (uint8), flags (uint8),
+//   num_next (uint16), address (address, none for a star)
+// - RECORD_LINK: trace_id (uint32), ttl (uint8), source (address),
+//   target (address), absent if the source has no successor
+// - RECORD_TRACE_END: trace_id (uint32), status (uint8)
+
+#define RECORD_MAGIC          "PTRB"
+#define RECORD_VERSION        1
+#define RECORD_HEADER_SIZE    8
+#define RECORD_PREFIX_SIZE    4
+#define RECORD_NAME_MAX       32
+
+#define RECORD_WRITER_DEFAULT_CAPACITY 65536 /**< Suggested size of the output_t of a record_writer_t */
+
+typedef enum {
+    RECORD_TRACE_START = 1,  /**< A measurement starts */
+    RECORD_PROBE,            /**< A probe has been answered or has expired */
+    RECORD_HOP,              /**< An IP hop has been discovered (or completed) */
+    RECORD_LINK,             /**< A link between two IP hops has been discovered */
+    RECORD_TRACE_END         /**< A measurement is over */
+} record_type_t;
+
+typedef enum {
+    RECORD_STATUS_UNKNOWN,         /**< The measurement has been interrupted */
+    RECORD_STATUS_COMPLETED,       /**< The algorithm has completed (mda) */
+    RECORD_STATUS_REACHED,         /**< The destination has been reached */
+    RECORD_STATUS_MAX_TTL,         /**< The maximum TTL has been reached */
+    RECORD_STATUS_TOO_MANY_STARS,  /**< Too many consecutive hops did not reply */
+    RECORD_STATUS_STOP_SET,        /**< The path is already known (Doubletree) */
+    RECORD_STATUS_ERROR            /**< The algorithm has failed */
+} record_status_t;
+
+// RECORD_HOP flags
+#define RECORD_HOP_COMPLETED 0x01  /**< No more link starts from this IP hop */
+
+// In the following structures, an address whose family is AF_UNSPEC
+// stands for a star (no reply).
+
+typedef struct {
+    double          start_time;                 /**< Timestamp (see get_timestamp) */
+    char            algorithm[RECORD_NAME_MAX]; /**< Name of the algorithm */
+    char            protocol[RECORD_NAME_MAX];  /**< Protocol of the probes */
+    address_t       dst_addr;                   /**< Destination of the measurement */
+} record_trace_start_t;
+
+typedef struct {
+    uint8_t         ttl;         /**< TTL of the probe */
+    uint16_t        flow_id;     /**< Flow identifier of the probe */
+    double          rtt;         /**< Round-trip time in milliseconds (0 for a star) */
+    address_t       reply_addr;  /**< Source of the reply */
+} record_probe_t;
+
+typedef struct {
+    uint8_t         ttl;         /**< TTL at which this IP hop has been reached */
+    uint8_t         flags;       /**< RECORD_HOP_* flags */
+    uint16_t        num_next;    /**< Number of next hops (if RECORD_HOP_COMPLETED) */
+    address_t       address;     /**< Address of the IP hop */
+} record_hop_t;
+
+typedef struct {
+    uint8_t         ttl;         /**< TTL of the source of the link */
+    bool            has_target;  /**< False iif the source has no successor */
+    address_t       source;      /**< Source of the link */
+    address_t       target;      /**< Target of the link (if has_target) */
+} record_link_t;
+
+typedef struct {
+    record_type_t   type;        /**< Type of record (selects the member of the union) */
+    uint32_t        trace_id;    /**< Identifies the measurement among the ones of the stream */
+    union {
+        record_trace_start_t trace_start;
+        record_probe_t       probe;
+        record_hop_t         hop;
+        record_link_t        link;
+        record_status_t      status; /**< RECORD_TRACE_END */
+    };
+} record_t;
+
+/**
+ * \brief Retrieve the name of a record_status_t value.
+ * \param status A record_status_t value.
+ * \return The corresponding string (e.g. "reached").
+ */
+
+const char * record_status_to_string(record_status_t status);
+
+/**
+ * \brief Retrieve the name of a record_type_t value.
+ * \param type A record_type_t value.
+ * \return The corresponding string (e.g. "probe"), NULL if unknown.
+ */
+
+const char * record_type_to_string(record_type_t type);
+
+/**
+ * \brief Fill a RECORD_PROBE record.
+ * \param record The record_t to fill.
+ * \param trace_id The identifier of the measurement.
+ * \param probe The probe.
+ * \param reply The corresponding reply, NULL for a star.
+ * \return true iif successful.
+ */
+
+bool record_set_probe(record_t * record, uint32_t trace_id, const probe_t * probe, const probe_t * reply);
+
+//---------------------------------------------------------------------------
+// record_writer_t
+//---------------------------------------------------------------------------
+
+typedef struct {
+    output_t      * output;      /**< Sink the records are written to */
+    size_t          num_records; /**< Number of records written so far */
+} record_writer_t;
+
+/**
+ * \brief Create a record_writer_t instance and write the file header.
+ * \param output The output_t instance the records are written to (see
+ *    output_write). It is flushed and released by its owner, once
+ *    the record_writer_t is released.
+ * \return The newly allocated record_writer_t instance, NULL otherwise.
+ */
+
+record_writer_t * record_writer_create(output_t * output);
+
+/**
+ * \brief Release a record_writer_t instance.
+ * \param writer A record_writer_t instance.
+ */
+
+void record_writer_free(record_writer_t * writer);
+
+/**
+ * \brief Encode a record and write it in the output of a writer.
+ *    A record is either written as a whole or lost (see output_write).
+ * \param writer A record_writer_t instance.
+ * \param record The record to write.
+ * \return true iif successful.
+ */
+
+bool record_write(record_writer_t * writer, const record_t * record);
+
+//---------------------------------------------------------------------------
+// record_reader_t
+//---------------------------------------------------------------------------
+
+typedef struct {
+    FILE          * file;        /**< Stream the records are read from */
+    uint16_t        version;     /**< Version found in the file header */
+    uint8_t       * payload;     /**< Payload of the last record read */
+    size_t          num_records; /**< Number of records read so far */
+    bool            has_failed;  /**< True iif the stream is truncated or corrupted */
+} record_reader_t;
+
+/**
+ * \brief Create a record_reader_t instance and check the file header.
+ * \param file The stream the records are read from. It is not closed
+ *    by record_reader_free.
+ * \return The newly allocated record_reader_t instance, NULL if the
+ *    header is invalid or in case of failure.
+ */
+
+record_reader_t * record_reader_create(FILE * file);
+
+/**
+ * \brief Release a record_reader_t instance.
+ * \param reader A record_reader_t instance.
+ */
+
+void record_reader_free(record_reader_t * reader);
+
+/**
+ * \brief Read the next record. The records of unknown types are skipped.
+ * \param reader A record_reader_t instance.
+ * \param record The record_t to fill.
+ * \return true iif a record has been read, false at the end of the
+ *    stream or if the stream is truncated or corrupted (see
+ *    reader->has_failed).
+ */
+
+bool record_read(record_reader_t * reader, record_t * record);
+
+#endif // LIBPT_RECORD_H
@@ -0,0 +1,689 @@
+#include "use.h"
+#include "config.h"
+
+#include <stdlib.h>         // malloc, free
+#include <stdio.h>          // FILE, fopen, open_memstream
+#include <string.h>         // memcpy, strncmp, strdup
+#include <strings.h>        // strcasecmp
+#include <ctype.h>          // isprint, isspace
+#include <errno.h>          // errno, EAGAIN, ECONNREFUSED
+#include <unistd.h>         // close, read
+#include <arpa/inet.h>      // inet_pton, htons
+#include <sys/socket.h>     // socket, connect, send, recv
+#include <netinet/in.h>     // sockaddr_in, sockaddr_in6
+#include <sys/random.h>     // getrandom
+
+#include "resolver.h"
+#include "hole.h"                   // hole_t
+#include "common.h"                 // get_timestamp, MAX
+#include "network.h"                // update_timer_uring
+#include "containers/hashtable.h"   // hash_uint64
+#include "os/sys/timerfd.h"         // timerfd_create
+
+#define RESOLVER_PACKET_SIZE 512    // Maximum size of a DNS message over UDP
+#define RESOLVER_NAME_SIZE   256    // Maximum size of a domain name
+#define RESOLVER_TYPE_PTR    12
+#define RESOLVER_CLASS_IN    1
+
+// A query expiring in less than RESOLVER_TIMER_PRECISION seconds is
+// considered as expired.
+#define RESOLVER_TIMER_PRECISION 0.0001
+
+typedef struct {
+    resolver_callback_t callback;   /**< Function called once the hostname is known */
+    void              * data;       /**< Data passed to callback */
+} resolver_waiter_t;
+
+typedef struct {
+    address_t           address;    /**< Resolved address */
+    uint16_t            id;         /**< Identifier of the DNS query */
+    double              deadline;   /**< Expiration of the last try (0 if not sent) */
+    unsigned            num_tries;  /**< Number of times the query has been sent */
+    dynarray_t        * waiters;    /**< resolver_waiter_t instances */
+} resolver_query_t;
+
+typedef struct {
+    hole_t            * hole;       /**< Place of the hostname in the output */
+    resolver_print_t    print;      /**< Function printing the address and its hostname */
+} resolver_printer_t;
+
+//---------------------------------------------------------------------------
+// DNS messages (internal usage)
+//---------------------------------------------------------------------------
+
+static uint8_t * resolver_put_uint16(uint8_t * p, uint16_t x) {
+    *p++ = x >> 8;
+    *p++ = x & 0xff;
+    return p;
+}
+
+static uint16_t resolver_get_uint16(const uint8_t * p) {
+    return (p[0] << 8) | p[1];
+}
+
+static uint8_t * resolver_put_label(uint8_t * p, const char * label) {
+    size_t len = strlen(label);
+
+    *p++ = len;
+    memcpy(p, label, len);
+    return p + len;
+}
+
+/**
+ * \brief Write the PTR query related to an address.
+ * \param query The query.
+ * \param packet The buffer (at least RESOLVER_PACKET_SIZE bytes).
+ * \return The size of the query, 0 if the family of the address is not supported.
+ */
+
+static size_t resolver_query_encode(const resolver_query_t * query, uint8_t * packet) {
+    static const char   hex[] = "0123456789abcdef";
+    const uint8_t     * bytes;
+    uint8_t           * p = packet;
+    char                label[4];
+    int                 i;
+
+    // Header: recursion desired, one question
+    p = resolver_put_uint16(p, query->id);
+    p = resolver_put_uint16(p, 0x0100);
+    p = resolver_put_uint16(p, 1);
+    p = resolver_put_uint16(p, 0);
+    p = resolver_put_uint16(p, 0);
+    p = resolver_put_uint16(p, 0);
+
+    // Name: the bytes (IPv4) or the nibbles (IPv6) of the address in reverse order
+    switch (query->address.family) {
+        case AF_INET:
+            bytes = (const uint8_t *) &query->address.ip.ipv4;
+            for (i = 3; i >= 0; i--) {
+                snprintf(label, sizeof(label), "%u", bytes[i]);
+                p = resolver_put_label(p, label);
+            }
+            p = resolver_put_label(p, "in-addr");
+            break;
+        case AF_INET6:
+            bytes = (const uint8_t *) &query->address.ip.ipv6;
+            label[1] = '\0';
+            for (i = 15; i >= 0; i--) {
+                label[0] = hex[bytes[i] & 0x0f];
+                p = resolver_put_label(p, label);
+                label[0] = hex[bytes[i] >> 4];
+                p = resolver_put_label(p, label);
+            }
+            p = resolver_put_label(p, "ip6");
+            break;
+        default:
+            return 0;
+    }
+    p = resolver_put_label(p, "arpa");
+    *p++ = 0;
+
+    p = resolver_put_uint16(p, RESOLVER_TYPE_PTR);
+    p = resolver_put_uint16(p, RESOLVER_CLASS_IN);
+    return p - packet;
+}
+
+/**
+ * \brief Read a (possibly compressed) domain name.
+ * \param packet The DNS message.
+ * \param size The size of the DNS message.
+ * \param poffset Points to the offset of the name. It is updated to point
+ *    to the byte following the name.
+ * \param name The buffer in which the name is written (RESOLVER_NAME_SIZE
+ *    bytes), NULL to skip the name.
+ * \return true iif successful.
+ */
+
+static bool resolver_name_decode(const uint8_t * packet, size_t size, size_t * poffset, char * name) {
+    size_t   offset = *poffset,
+             len = 0;
+    unsigned num_jumps = 0;
+    bool     has_jumped = false;
+    uint8_t  label_len;
+
+    while (offset < size) {
+        label_len = packet[offset];
+
+        if ((label_len & 0xc0) == 0xc0) {
+            // Compression pointer (bounded to avoid loops)
+            if (offset + 1 >= size || ++num_jumps > RESOLVER_NAME_SIZE) return false;
+            if (!has_jumped) *poffset = offset + 2;
+            has_jumped = true;
+            offset = ((label_len & 0x3f) << 8) | packet[offset + 1];
+            continue;
+        }
+
+        if (label_len == 0) {
+            if (!has_jumped) *poffset = offset + 1;
+            if (name) name[len ? len - 1 : 0] = '\0';
+            return true;
+        }
+
+        if (offset + 1 + label_len > size || len + label_len + 1 >= RESOLVER_NAME_SIZE) return false;
+        if (name) {
+            memcpy(name + len, packet + offset + 1, label_len);
+            name[len + label_len] = '.';
+        }
+        len += label_len + 1;
+        offset += 1 + label_len;
+    }
+    return false;
+}
+
+/**
+ * \brief Retrieve the hostname carried by an answer.
+ * \param packet The DNS message.
+ * \param size The size of the DNS message.
+ * \param hostname The buffer in which the hostname is written
+ *    (RESOLVER_NAME_SIZE bytes).
+ * \return true iif the answer carries a PTR record.
+ */
+
+static bool resolver_answer_decode(const uint8_t * packet, size_t size, char * hostname) {
+    size_t   offset = 12, i;
+    uint16_t flags, num_questions, num_answers, type, rdlength;
+    char   * c;
+
+    flags         = resolver_get_uint16(packet + 2);
+    num_questions = resolver_get_uint16(packet + 4);
+    num_answers   = resolver_get_uint16(packet + 6);
+
+    // The message must be a response without error (RCODE)
+    if (!(flags & 0x8000) || (flags & 0x000f)) return false;
+
+    for (i = 0; i < num_questions; i++) {
+        if (!resolver_name_decode(packet, size, &offset, NULL) || (offset += 4) > size) return false;
+    }
+
+    for (i = 0; i < num_answers; i++) {
+        if (!resolver_name_decode(packet, size, &offset, NULL) || offset + 10 > size) return false;
+        type     = resolver_get_uint16(packet + offset);
+        rdlength = resolver_get_uint16(packet + offset + 8);
+        offset += 10;
+        if (offset + rdlength > size) return false;
+
+        if (type == RESOLVER_TYPE_PTR) {
+            if (!resolver_name_decode(packet, size, &offset, hostname) || !*hostname) return false;
+
+            // The hostname is printed as is
+            for (c = hostname; *c; c++) {
+                if (!isprint((unsigned char) *c)) *c = '?';
+            }
+            return true;
+        }
+        offset += rdlength;
+    }
+    return false;
+}
+
+/**
+ * \brief Check whether a DNS message answers a query, i.e. whether it
+ *    carries the identifier and the question (QNAME) of the query.
+ * \param query The query.
+ * \param packet The DNS message.
+ * \param size The size of the DNS message.
+ * \return true iif the DNS message answers the query.
+ */
+
+static bool resolver_answer_matches(const resolver_query_t * query, const uint8_t * packet, size_t size) {
+    uint8_t sent[RESOLVER_PACKET_SIZE];
+    char    sent_name[RESOLVER_NAME_SIZE],
+            name[RESOLVER_NAME_SIZE];
+    size_t  sent_offset = 12,
+            offset = 12;
+
+    if (resolver_get_uint16(packet) != query->id
+    ||  resolver_get_uint16(packet + 4) != 1
+    ||  !resolver_query_encode(query, sent)
+    ||  !resolver_name_decode(sent, sizeof(sent), &sent_offset, sent_name)
+    ||  !resolver_name_decode(packet, size, &offset, name)
+    ||  offset + 4 > size
+    ||  resolver_get_uint16(packet + offset) != RESOLVER_TYPE_PTR
+    ) return false;
+
+    // Name servers may alter the case of the name (see RFC 4343)
+    return strcasecmp(name, sent_name) == 0;
+}
+
+//---------------------------------------------------------------------------
+// Queries (internal usage)
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Draw the identifier of a new query. It is random, so that
+ *    the answers are harder to forge.
+ * \return The identifier.
+ */
+
+static uint16_t resolver_query_id() {
+    uint16_t id;
+
+    if (getrandom(&id, sizeof(id), GRND_NONBLOCK) != sizeof(id)) {
+        // The entropy pool is not ready yet
+        id = hash_uint64((uint64_t) (get_timestamp() * 1000000));
+    }
+    return id;
+}
+
+static void resolver_query_free(resolver_query_t * query) {
+    if (query) {
+        dynarray_free(query->waiters, free);
+        free(query);
+    }
+}
+
+static bool resolver_query_add_waiter(resolver_query_t * query, resolver_callback_t callback, void * data) {
+    resolver_waiter_t * waiter;
+
+    if (!(waiter = malloc(sizeof(resolver_waiter_t)))) return false;
+    waiter->callback = callback;
+    waiter->data     = data;
+    if (!dynarray_push_element(query->waiters, waiter)) {
+        free(waiter);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * \brief Find the query related to an address in a dynarray.
+ * \param queries A dynarray of resolver_query_t instances.
+ * \param address The address.
+ * \return The corresponding query if any, NULL otherwise.
+ */
+
+static resolver_query_t * resolver_find_query(const dynarray_t * queries, const address_t * address) {
+    resolver_query_t * query;
+    size_t             i, num_queries = dynarray_get_size(queries);
+
+    for (i = 0; i < num_queries; i++) {
+        query = dynarray_get_ith_element(queries, i);
+        if (address_compare(&query->address, address) == 0) return query;
+    }
+    return NULL;
+}
+
+/**
+ * \brief Arm the timer of a resolver_t according to the earliest deadline
+ *    of the queries in flight.
+ * \param resolver A resolver_t instance.
+ */
+
+static void resolver_update_timer(resolver_t * resolver) {
+    const resolver_query_t * query;
+    double                   deadline = 0;
+    size_t                   i, num_queries = dynarray_get_size(resolver->queries_in_flight);
+
+    for (i = 0; i < num_queries; i++) {
+        query = dynarray_get_ith_element(resolver->queries_in_flight, i);
+        if (!deadline || query->deadline < deadline) deadline = query->deadline;
+    }
+
+    update_timer_uring(resolver->uring, resolver->timerfd, deadline ? MAX(deadline - get_timestamp(), RESOLVER_TIMER_PRECISION) : 0);
+}
+
+/**
+ * \brief Notify the waiters of a query and release it. The caller must
+ *    have removed it from the queries of the resolver_t.
+ * \param resolver A resolver_t instance.
+ * \param query The query.
+ * \param hostname The hostname, NULL if the query has failed.
+ */
+
+static void resolver_query_complete(resolver_t * resolver, resolver_query_t * query, const char * hostname) {
+    const resolver_waiter_t * waiter;
+    size_t                    i, num_waiters = dynarray_get_size(query->waiters);
+
+    if (hostname) {
+        address_set_cached_hostname(&query->address, hostname);
+    } else {
+        resolver->num_failures++;
+    }
+
+    for (i = 0; i < num_waiters; i++) {
+        waiter = dynarray_get_ith_element(query->waiters, i);
+        waiter->callback(&query->address, hostname, waiter->data);
+    }
+    resolver_query_free(query);
+}
+
+/**
+ * \brief Send a query.
+ * \param resolver A resolver_t instance.
+ * \param query The query.
+ * \return true iif successful.
+ */
+
+static bool resolver_query_send(resolver_t * resolver, resolver_query_t * query) {
+    uint8_t packet[RESOLVER_PACKET_SIZE];
+    size_t  size;
+
+    if (!(size = resolver_query_encode(query, packet))) return false;
+    if (send(resolver->sockfd, packet, size, 0) == -1)  return false;
+    query->num_tries++;
+    query->deadline = get_timestamp() + RESOLVER_TIMEOUT;
+    return true;
+}
+
+/**
+ * \brief Send the waiting queries while the number of queries in flight
+ *    allows it.
+ * \param resolver A resolver_t instance.
+ */
+
+static void resolver_send_waiting_queries(resolver_t * resolver) {
+    resolver_query_t * query;
+
+    while (dynarray_get_size(resolver->queries_waiting) > 0
+    &&     dynarray_get_size(resolver->queries_in_flight) < resolver->max_in_flight
+    ) {
+        query = dynarray_get_ith_element(resolver->queries_waiting, 0);
+        dynarray_del_ith_element(resolver->queries_waiting, 0, NULL);
+
+        if (resolver_query_send(resolver, query) && dynarray_push_element(resolver->queries_in_flight, query)) {
+            resolver->num_queries++;
+        } else {
+            resolver_query_complete(resolver, query, NULL);
+        }
+    }
+    resolver_update_timer(resolver);
+}
+
+/**
+ * \brief Fill the hole related to a hostname (see resolver_print_hostname).
+ * \param address The resolved address.
+ * \param hostname The corresponding hostname, NULL if it cannot be resolved.
+ * \param data The resolver_printer_t instance, released by this function.
+ */
+
+static void resolver_fill_hole(const address_t * address, const char * hostname, void * data) {
+    resolver_printer_t * printer = data;
+    FILE               * stream;
+    char               * text = NULL;
+    size_t               size;
+
+    if ((stream = open_memstream(&text, &size))) {
+        printer->print(stream, address, hostname);
+        fclose(stream);
+    }
+    hole_fill(printer->hole, text);
+    free(text);
+    free(printer);
+}
+
+//---------------------------------------------------------------------------
+// resolver_t
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Create a UDP socket connected to the first name server of RESOLVER_CONF.
+ * \return The corresponding socket, -1 in case of failure.
+ */
+
+static int resolver_socket_create() {
+    FILE                * file;
+    char                  line[256], * ip, * end;
+    struct sockaddr_in    sin;
+    struct sockaddr_in6   sin6;
+    struct sockaddr     * sa = NULL;
+    socklen_t             sa_len = 0;
+    int                   sockfd;
+
+    memset(&sin, 0, sizeof(struct sockaddr_in));
+    memset(&sin6, 0, sizeof(struct sockaddr_in6));
+
+    if ((file = fopen(RESOLVER_CONF, "r"))) {
+        while (!sa && fgets(line, sizeof(line), file)) {
+            if (strncmp(line, "nameserver", 10) != 0 || !isspace((unsigned char) line[10])) continue;
+            for (ip = line + 10; isspace((unsigned char) *ip); ip++);
+            for (end = ip; *end && !isspace((unsigned char) *end); end++);
+            *end = '\0';
+
+            if (inet_pton(AF_INET, ip, &sin.sin_addr) == 1) {
+                sin.sin_family = AF_INET;
+                sa     = (struct sockaddr *) &sin;
+                sa_len = sizeof(struct sockaddr_in);
+            } else if (inet_pton(AF_INET6, ip, &sin6.sin6_addr) == 1) {
+                sin6.sin6_family = AF_INET6;
+                sa     = (struct sockaddr *) &sin6;
+                sa_len = sizeof(struct sockaddr_in6);
+            }
+        }
+        fclose(file);
+    }
+
+    // Like the C library, use the local name server by default
+    if (!sa) {
+        sin.sin_family      = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sa     = (struct sockaddr *) &sin;
+        sa_len = sizeof(struct sockaddr_in);
+    }
+    sin.sin_port   = htons(RESOLVER_PORT);
+    sin6.sin6_port = htons(RESOLVER_PORT);
+
+    if ((sockfd = socket(sa->sa_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) goto ERR_SOCKET;
+    if (connect(sockfd, sa, sa_len) == -1) goto ERR_CONNECT;
+    return sockfd;
+
+ERR_CONNECT:
+    close(sockfd);
+ERR_SOCKET:
+    return -1;
+}
+
+resolver_t * resolver_create(size_t max_in_flight) {
+    resolver_t * resolver;
+
+    if (!(resolver = malloc(sizeof(resolver_t))))                        goto ERR_MALLOC;
+    if ((resolver->sockfd = resolver_socket_create()) == -1)             goto ERR_SOCKET_CREATE;
+    if ((resolver->timerfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK)) == -1) goto ERR_TIMERFD_CREATE;
+    if (!(resolver->queries_in_flight = dynarray_create()))              goto ERR_QUERIES_IN_FLIGHT;
+    if (!(resolver->queries_waiting = dynarray_create()))                goto ERR_QUERIES_WAITING;
+
+    resolver->uring          = NULL;
+    resolver->max_in_flight  = max_in_flight ? max_in_flight : 1;
+    resolver->num_queries    = 0;
+    resolver->num_failures   = 0;
+    resolver->num_cache_hits = 0;
+    return resolver;
+
+ERR_QUERIES_WAITING:
+    dynarray_free(resolver->queries_in_flight, NULL);
+ERR_QUERIES_IN_FLIGHT:
+    close(resolver->timerfd);
+ERR_TIMERFD_CREATE:
+    close(resolver->sockfd);
+ERR_SOCKET_CREATE:
+    free(resolver);
+ERR_MALLOC:
+    return NULL;
+}
+
+void resolver_free(resolver_t * resolver) {
+    resolver_query_t * query;
+
+    if (resolver) {
+        // The awaited hostnames are printed as unresolved
+        while (dynarray_get_size(resolver->queries_in_flight) > 0) {
+            query = dynarray_get_ith_element(resolver->queries_in_flight, 0);
+            dynarray_del_ith_element(resolver->queries_in_flight, 0, NULL);
+            resolver_query_complete(resolver, query, NULL);
+        }
+        while (dynarray_get_size(resolver->queries_waiting) > 0) {
+            query = dynarray_get_ith_element(resolver->queries_waiting, 0);
+            dynarray_del_ith_element(resolver->queries_waiting, 0, NULL);
+            resolver_query_complete(resolver, query, NULL);
+        }
+
+        dynarray_free(resolver->queries_waiting, NULL);
+        dynarray_free(resolver->queries_in_flight, NULL);
+        close(resolver->timerfd);
+        close(resolver->sockfd);
+        free(resolver);
+    }
+}
+
+int resolver_get_sockfd(const resolver_t * resolver) {
+    return resolver->sockfd;
+}
+
+int resolver_get_timerfd(const resolver_t * resolver) {
+    return resolver->timerfd;
+}
+
+void resolver_set_uring(resolver_t * resolver, struct uring_s * uring) {
+    resolver->uring = uring;
+}
+
+bool resolver_resolve(resolver_t * resolver, const address_t * address, resolver_callback_t callback, void * data) {
+    resolver_query_t * query;
+    char             * hostname;
+
+    if (address_get_cached_hostname(address, &hostname)) {
+        resolver->num_cache_hits++;
+        callback(address, hostname, data);
+        free(hostname);
+        return true;
+    }
+
+    // A single query is sent per address
+    if ((query = resolver_find_query(resolver->queries_in_flight, address))
+    ||  (query = resolver_find_query(resolver->queries_waiting, address))
+    ) {
+        return resolver_query_add_waiter(query, callback, data);
+    }
+
+    if (!(query = malloc(sizeof(resolver_query_t))))     goto ERR_MALLOC;
+    if (!(query->waiters = dynarray_create()))           goto ERR_DYNARRAY_CREATE;
+    if (!resolver_query_add_waiter(query, callback, data)) goto ERR_ADD_WAITER;
+    memcpy(&query->address, address, sizeof(address_t));
+    query->id        = resolver_query_id();
+    query->deadline  = 0;
+    query->num_tries = 0;
+    if (!dynarray_push_element(resolver->queries_waiting, query)) goto ERR_PUSH_ELEMENT;
+
+    resolver_send_waiting_queries(resolver);
+    return true;
+
+ERR_PUSH_ELEMENT:
+ERR_ADD_WAITER:
+    dynarray_free(query->waiters, free);
+ERR_DYNARRAY_CREATE:
+    free(query);
+ERR_MALLOC:
+    return false;
+}
+
+bool resolver_print_hostname(resolver_t * resolver, hole_stream_t * hole_stream, const address_t * address, resolver_print_t print) {
+    resolver_printer_t * printer;
+    char               * hostname;
+
+    // Known hostnames are printed immediately (possibly in a pending hole)
+    if (address_get_cached_hostname(address, &hostname)) {
+        resolver->num_cache_hits++;
+        print(hole_stream_get_stream(hole_stream), address, hostname);
+        free(hostname);
+        return true;
+    }
+
+    if (!(printer = malloc(sizeof(resolver_printer_t)))) goto ERR_MALLOC;
+    if (!(printer->hole = hole_create(hole_stream)))     goto ERR_HOLE_CREATE;
+    printer->print = print;
+
+    if (!resolver_resolve(resolver, address, resolver_fill_hole, printer)) {
+        resolver_fill_hole(address, NULL, printer);
+    }
+    return true;
+
+ERR_HOLE_CREATE:
+    free(printer);
+ERR_MALLOC:
+    print(hole_stream_get_stream(hole_stream), address, NULL);
+    return false;
+}
+
+size_t resolver_process_answers(resolver_t * resolver) {
+    uint8_t            packet[RESOLVER_PACKET_SIZE];
+    char               hostname[RESOLVER_NAME_SIZE];
+    resolver_query_t * query;
+    ssize_t            size;
+    size_t             i, num_queries, num_answers = 0;
+
+    // The socket is drained (see pt_loop)
+    for (;;) {
+        if ((size = recv(resolver->sockfd, packet, sizeof(packet), 0)) == -1) {
+            if (errno == EINTR) continue;
+            if (errno == ECONNREFUSED) {
+                // No name server: every query in flight fails.
+                while (dynarray_get_size(resolver->queries_in_flight) > 0) {
+                    query = dynarray_get_ith_element(resolver->queries_in_flight, 0);
+                    dynarray_del_ith_element(resolver->queries_in_flight, 0, NULL);
+                    resolver_query_complete(resolver, query, NULL);
+                }
+                continue;
+            }
+            break;
+        }
+        if (size < 12) continue;
+
+        num_queries = dynarray_get_size(resolver->queries_in_flight);
+        for (i = 0; i < num_queries; i++) {
+            query = dynarray_get_ith_element(resolver->queries_in_flight, i);
+            if (resolver_answer_matches(query, packet, size)) break;
+        }
+        if (i == num_queries) continue; // Late or forged answer
+
+        dynarray_del_ith_element(resolver->queries_in_flight, i, NULL);
+        resolver_query_complete(resolver, query, resolver_answer_decode(packet, size, hostname) ? hostname : NULL);
+        num_answers++;
+    }
+
+    resolver_send_waiting_queries(resolver);
+    return num_answers;
+}
+
+size_t resolver_process_timeouts(resolver_t * resolver) {
+    resolver_query_t * query;
+    uint64_t           num_expirations;
+    double             now = get_timestamp();
+    size_t             i, num_expired = 0;
+
+    // Acknowledge the timer (never armed with io_uring)
+    if (!resolver->uring && read(resolver->timerfd, &num_expirations, sizeof(num_expirations)) == -1) {
+        // The timer has been re-armed meanwhile, go on anyway.
+    }
+
+    for (i = 0; i < dynarray_get_size(resolver->queries_in_flight); ) {
+        query = dynarray_get_ith_element(resolver->queries_in_flight, i);
+        if (query->deadline - RESOLVER_TIMER_PRECISION > now) {
+            i++;
+            continue;
+        }
+
+        num_expired++;
+        if (query->num_tries < RESOLVER_MAX_TRIES && resolver_query_send(resolver, query)) {
+            i++;
+        } else {
+            dynarray_del_ith_element(resolver->queries_in_flight, i, NULL);
+            resolver_query_complete(resolver, query, NULL);
+        }
+    }
+
+    resolver_send_waiting_queries(resolver);
+    return num_expired;
+}
+
+bool resolver_is_pending(const resolver_t * resolver) {
+    return dynarray_get_size(resolver->queries_in_flight) > 0
+        || dynarray_get_size(resolver->queries_waiting) > 0;
+}
+
+void resolver_dump_stats(const resolver_t * resolver) {
+    fprintf(stderr,
+        "resolver: %zu queries sent, %zu failed, %zu hostnames found in the cache\n",
+        resolver->num_queries,
+        resolver->num_failures,
+        resolver->num_cache_hits
+    );
+}
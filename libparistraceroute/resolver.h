@@ -0,0 +1,167 @@
+#ifndef LIBPT_RESOLVER_H
+#define LIBPT_RESOLVER_H
+
+/**
+ * \file resolver.h
+ * \brief Asynchronous reverse DNS resolution.
+ *
+ * A resolver_t sends PTR queries over a non-blocking UDP socket to the
+ * first name server listed in /etc/resolv.conf. Its socket and its timer
+ * are watched by the main loop (see pt_loop_get_resolver), so that a slow
+ * DNS server never delays the probes.
+ *
+ * The number of queries in flight is bounded: the other ones wait until a
+ * query is answered or has expired. Hostnames are stored in the cache of
+ * address_resolv (see address_set_cached_hostname).
+ *
+ * resolver_print_hostname() allows to print a hostname which is not yet
+ * known: its place in the output is kept by a hole (see hole.h).
+ */
+
+#include <stdbool.h>      // bool
+#include <stddef.h>       // size_t
+#include <stdint.h>       // uint16_t
+#include <stdio.h>        // FILE
+
+#include "address.h"      // address_t
+#include "dynarray.h"     // dynarray_t
+#include "hole.h"         // hole_stream_t
+
+#define RESOLVER_CONF                  "/etc/resolv.conf"
+#define RESOLVER_PORT                  53
+#define RESOLVER_TIMEOUT               2.0  /**< Delay (in seconds) before sending a query again */
+#define RESOLVER_MAX_TRIES             2    /**< Number of times a query is sent */
+#define RESOLVER_DEFAULT_MAX_IN_FLIGHT 16
+
+/**
+ * \brief Function called once the hostname of an address is known.
+ * \param address The resolved address.
+ * \param hostname The corresponding hostname, NULL if it cannot be resolved.
+ * \param data The data passed to resolver_resolve.
+ */
+
+typedef void (* resolver_callback_t)(const address_t * address, const char * hostname, void * data);
+
+/**
+ * \brief Function printing an address and its hostname.
+ * \param out The stream to write to.
+ * \param address The address.
+ * \param hostname The corresponding hostname, NULL if it cannot be resolved.
+ */
+
+typedef void (* resolver_print_t)(FILE * out, const address_t * address, const char * hostname);
+
+typedef struct {
+    int               sockfd;            /**< UDP socket connected to the name server */
+    int               timerfd;           /**< Activated when the earliest query in flight expires */
+    struct uring_s  * uring;             /**< If set, the timer is armed through this io_uring instance (see resolver_set_uring) */
+    size_t            max_in_flight;     /**< Maximum number of queries in flight */
+    dynarray_t      * queries_in_flight; /**< Queries sent and not yet answered */
+    dynarray_t      * queries_waiting;   /**< Queries waiting for room in queries_in_flight */
+
+    // Statistics
+    size_t            num_queries;       /**< Number of queries sent (retries excluded) */
+    size_t            num_failures;      /**< Number of queries unanswered or answered without a PTR record */
+    size_t            num_cache_hits;    /**< Number of hostnames found in the cache */
+} resolver_t;
+
+/**
+ * \brief Create a resolver_t instance using the first name server
+ *    listed in RESOLVER_CONF (127.0.0.1 if none).
+ * \param max_in_flight The maximum number of queries in flight.
+ * \return The newly allocated resolver_t instance, NULL otherwise.
+ */
+
+resolver_t * resolver_create(size_t max_in_flight);
+
+/**
+ * \brief Release a resolver_t instance. The pending queries fail,
+ *    and the awaited hostnames are printed as unresolved.
+ * \param resolver A resolver_t instance.
+ */
+
+void resolver_free(resolver_t * resolver);
+
+/**
+ * \brief Retrieve the socket of a resolver_t, readable once answers are received.
+ * \param resolver A resolver_t instance.
+ * \return The corresponding file descriptor.
+ */
+
+int resolver_get_sockfd(const resolver_t * resolver);
+
+/**
+ * \brief Retrieve the timer of a resolver_t, readable once a query expires.
+ * \param resolver A resolver_t instance.
+ * \return The corresponding file descriptor.
+ */
+
+int resolver_get_timerfd(const resolver_t * resolver);
+
+/**
+ * \brief Arm the timer of a resolver_t through an io_uring instance. The
+ *    timerfd is then never armed: its expirations are reported by the
+ *    io_uring instance (see uring_set_timer).
+ * \param resolver A resolver_t instance.
+ * \param uring An io_uring instance (NULL restores the timerfd).
+ */
+
+void resolver_set_uring(resolver_t * resolver, struct uring_s * uring);
+
+/**
+ * \brief Resolve an address. If its hostname is cached, the callback is
+ *    called immediately.
+ * \param resolver A resolver_t instance.
+ * \param address The address to resolve.
+ * \param callback The function called once the hostname is known.
+ * \param data The data passed to callback.
+ * \return true iif successful.
+ */
+
+bool resolver_resolve(resolver_t * resolver, const address_t * address, resolver_callback_t callback, void * data);
+
+/**
+ * \brief Print an address and its hostname in a hole_stream_t. If the
+ *    hostname is not cached, a hole is left until it is known (see hole.h).
+ * \param resolver A resolver_t instance.
+ * \param hole_stream The hole_stream_t instance to print in
+ *    (see pt_loop_get_hole_stream).
+ * \param address The address to print.
+ * \param print The function printing the address and its hostname.
+ * \return true iif successful.
+ */
+
+bool resolver_print_hostname(resolver_t * resolver, hole_stream_t * hole_stream, const address_t * address, resolver_print_t print);
+
+/**
+ * \brief Process the answers received by a resolver_t.
+ * \param resolver A resolver_t instance.
+ * \return The number of processed answers.
+ */
+
+size_t resolver_process_answers(resolver_t * resolver);
+
+/**
+ * \brief Send again or drop the expired queries of a resolver_t.
+ * \param resolver A resolver_t instance.
+ * \return The number of expired queries.
+ */
+
+size_t resolver_process_timeouts(resolver_t * resolver);
+
+/**
+ * \brief Check whether a resolver_t has pending queries.
+ * \param resolver A resolver_t instance.
+ * \return true iif some queries are in flight or waiting.
+ */
+
+bool resolver_is_pending(const resolver_t * resolver);
+
+/**
+ * \brief Print the statistics of a resolver_t (on stderr).
+ * \param resolver A resolver_t instance.
+ */
+
+void resolver_dump_stats(const resolver_t * resolver);
+
+#endif // LIBPT_RESOLVER_H
@@ -2,6 +2,7 @@
 #include "config.h"
 
 #include <stdlib.h>      // malloc
+#include <errno.h>       // errno, EAGAIN, EWOULDBLOCK
 #include <stdio.h>       // perror
 #include <string.h>      // memcpy, memset
 #include <unistd.h>      // fnctl
@@ -18,6 +19,7 @@
 #include "sniffer.h"
 
 #define BUFLEN 4096
+#define CMSG_BUFLEN 512 // Enough for the ancillary data we enable
 
 // Solaris/Sun
 // http://livre.g6.asso.fr/index.php/L%27exemple_%C2%AB_mini-ping_%C2%BB_revisit%C3%A9
@@ -39,15 +41,97 @@
 #  define IPV6_RECVPKTINFO IPV6_PKTINFO
 #endif
 
+/**
+ * \brief Make a socket non-blocking.
+ * \param sockfd A socket file descriptor.
+ * \return true iif successful
+ */
+
+static bool socket_set_nonblocking(int sockfd) {
+    int flags;
+
+    // O_NONBLOCK is a file status flag (F_GETFL/F_SETFL), not
+    // a file descriptor flag (F_GETFD/F_SETFD).
+    if ((flags = fcntl(sockfd, F_GETFL, 0)) == -1) return false;
+    return fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+/**
+ * \brief Set the size of the receive buffer of a socket.
+ * \param sockfd A socket file descriptor.
+ * \param recv_buffer_size The size of the receive buffer (in bytes).
+ * \return true iif successful
+ */
+
+static bool socket_set_recv_buffer_size(int sockfd, int recv_buffer_size) {
+#ifdef SO_RCVBUFFORCE
+    // We are root anyway: ignore net.core.rmem_max if possible.
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUFFORCE, &recv_buffer_size, sizeof(int)) == 0) {
+        return true;
+    }
+#endif
+    return setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &recv_buffer_size, sizeof(int)) == 0;
+}
+
+/**
+ * \brief Prepare the options shared by every sniffer socket: the size of
+ *    the receive buffer and the counter of dropped packets (if supported).
+ * \param sockfd A socket file descriptor.
+ * \param recv_buffer_size The size of the receive buffer (in bytes).
+ * \return true iif successful
+ */
+
+static bool sniffer_socket_init(int sockfd, int recv_buffer_size) {
+#ifdef SO_RXQ_OVFL
+    int on = 1;
+#endif
+
+    if (!socket_set_nonblocking(sockfd)) {
+        perror("sniffer_socket_init: cannot make the socket non-blocking");
+        return false;
+    }
+
+    if (!socket_set_recv_buffer_size(sockfd, recv_buffer_size)) {
+        perror("sniffer_socket_init: cannot set the size of the receive buffer");
+    }
+
+#ifdef SO_RXQ_OVFL
+    // Every packet comes with the number of packets dropped by the kernel
+    // so far because the receive buffer was full.
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) == -1) {
+        perror("sniffer_socket_init: cannot enable SO_RXQ_OVFL");
+    }
+#endif
+    return true;
+}
+
+/**
+ * \brief Update the number of packets dropped by the kernel for a socket.
+ * \param cmsg An ancillary data received along with a packet.
+ * \param pnum_drops Points to the counter to update.
+ * \return true iif cmsg carries this counter.
+ */
+
+static bool cmsg_extract_num_drops(struct cmsghdr * cmsg, uint32_t * pnum_drops) {
+#ifdef SO_RXQ_OVFL
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+        memcpy(pnum_drops, CMSG_DATA(cmsg), sizeof(uint32_t));
+        return true;
+    }
+#endif
+    return false;
+}
+
 
 /**
  * \brief Initialize an ICMPv4 raw socket in a sniffer_t instance
  * \param sniffer A pointer to a sniffer_t instance
  * \param port The listening port
+ * \param recv_buffer_size The size of the receive buffer (in bytes)
  * \return true iif successful
  */
 #ifdef USE_IPV4
-static bool create_icmpv4_socket(sniffer_t * sniffer, uint16_t port)
+static bool create_icmpv4_socket(sniffer_t * sniffer, uint16_t port, int recv_buffer_size)
 {
 	struct sockaddr_in saddr;
 
@@ -58,7 +142,7 @@ static bool create_icmpv4_socket(sniffer_t * sniffer, uint16_t port)
     }
 
     // Make the socket non-blocking
-    if (fcntl(sniffer->icmpv4_sockfd, F_SETFD, O_NONBLOCK) == -1) {
+    if (!sniffer_socket_init(sniffer->icmpv4_sockfd, recv_buffer_size)) {
         goto ERR_FCNTL;
     }
 
@@ -87,10 +171,11 @@ ERR_SOCKET:
  * \brief Initialize an ICMPv6 raw socket in a sniffer_t instance
  * \param sniffer A pointer to a sniffer_t instance
  * \param port The listening port
+ * \param recv_buffer_size The size of the receive buffer (in bytes)
  * \return true iif successful
  */
 #ifdef USE_IPV6
-static bool create_icmpv6_socket(sniffer_t * sniffer, uint16_t port)
+static bool create_icmpv6_socket(sniffer_t * sniffer, uint16_t port, int recv_buffer_size)
 {
     struct in6_addr anyaddr = IN6ADDR_ANY_INIT;
     struct sockaddr_in6 saddr;
@@ -103,7 +188,7 @@ static bool create_icmpv6_socket(sniffer_t * sniffer, uint16_t port)
     }
 
     // Make the socket non-blocking
-    if (fcntl(sniffer->icmpv6_sockfd, F_SETFD, O_NONBLOCK) == -1) {
+    if (!sniffer_socket_init(sniffer->icmpv6_sockfd, recv_buffer_size)) {
         goto ERR_FCNTL;
     }
 
@@ -154,12 +239,12 @@ sniffer_t * sniffer_create(void * recv_param, bool (*recv_callback)(packet_t *,
     // TODO: We currently only listen for ICMP thanks to raw sockets which
     // requires root privileges
 	// Can we set port to 0 to capture all packets wheter ICMP, UDP or TCP?
-    if (!(sniffer = malloc(sizeof(sniffer_t)))) goto ERR_MALLOC;
+    if (!(sniffer = calloc(1, sizeof(sniffer_t)))) goto ERR_MALLOC;
 #ifdef USE_IPV4
-    if (!create_icmpv4_socket(sniffer, 0))      goto ERR_CREATE_ICMPV4_SOCKET;
+    if (!create_icmpv4_socket(sniffer, 0, SNIFFER_DEFAULT_RECV_BUFFER_SIZE)) goto ERR_CREATE_ICMPV4_SOCKET;
 #endif
 #ifdef USE_IPV6
-    if (!create_icmpv6_socket(sniffer, 0))      goto ERR_CREATE_ICMPV6_SOCKET;
+    if (!create_icmpv6_socket(sniffer, 0, SNIFFER_DEFAULT_RECV_BUFFER_SIZE)) goto ERR_CREATE_ICMPV6_SOCKET;
 #endif
     sniffer->recv_param = recv_param;
     sniffer->recv_callback = recv_callback;
@@ -197,6 +282,84 @@ int sniffer_get_icmpv4_sockfd(sniffer_t *sniffer) {
 }
 #endif
 
+bool sniffer_set_recv_buffer_size(sniffer_t * sniffer, int recv_buffer_size) {
+    bool ret = true;
+
+#ifdef USE_IPV4
+    ret &= socket_set_recv_buffer_size(sniffer->icmpv4_sockfd, recv_buffer_size);
+#endif
+#ifdef USE_IPV6
+    ret &= socket_set_recv_buffer_size(sniffer->icmpv6_sockfd, recv_buffer_size);
+#endif
+    return ret;
+}
+
+size_t sniffer_get_num_drops(const sniffer_t * sniffer) {
+    size_t num_drops = 0;
+
+#ifdef USE_IPV4
+    num_drops += sniffer->icmpv4_num_drops;
+#endif
+#ifdef USE_IPV6
+    num_drops += sniffer->icmpv6_num_drops;
+#endif
+    return num_drops;
+}
+
+#ifdef USE_IPV4
+
+/**
+ * \brief Process the ancillary data of an IPv4/ICMP packet.
+ * \param sniffer The sniffer_t instance owning the IPv4 socket.
+ * \param msg The message returned by recvmsg().
+ */
+
+static void sniffer_process_icmpv4_msghdr(sniffer_t * sniffer, struct msghdr * msg) {
+    struct cmsghdr * cmsg;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        cmsg_extract_num_drops(cmsg, &sniffer->icmpv4_num_drops);
+    }
+}
+
+/**
+ * \brief Fetch an IPv4/ICMP packet from an IPv4 socket
+ * \param sniffer The sniffer_t instance owning this socket.
+ * \param bytes A preallocated buffer in which we write the full IPv4 packet.
+ * \param len The size of the preallocated buffer
+ * \param flags
+ * \return The number of bytes written in bytes, -1 if no packet
+ *    can be fetched.
+ */
+
+static ssize_t recv_icmpv4(sniffer_t * sniffer, void * bytes, size_t len, int flags) {
+    char cmsg_buf[CMSG_BUFLEN];
+
+    struct iovec iov = {
+        .iov_base = bytes,
+        .iov_len  = len
+    };
+
+    struct msghdr msg = {
+        .msg_name       = NULL,
+        .msg_namelen    = 0,
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = cmsg_buf,
+        .msg_controllen = sizeof(cmsg_buf),
+        .msg_flags      = 0
+    };
+
+    ssize_t num_bytes = recvmsg(sniffer->icmpv4_sockfd, &msg, flags);
+
+    if (num_bytes != -1) {
+        sniffer_process_icmpv4_msghdr(sniffer, &msg);
+    }
+    return num_bytes;
+}
+
+#endif // USE_IPV4
+
 #ifdef USE_IPV6
 int sniffer_get_icmpv6_sockfd(sniffer_t *sniffer) {
     return sniffer->icmpv6_sockfd;
@@ -212,6 +375,7 @@ int sniffer_get_icmpv6_sockfd(sniffer_t *sniffer) {
  */
 
 static bool rebuild_ipv6_header(
+    sniffer_t                 * sniffer,
     struct ip6_hdr            * ip6_header,
     struct msghdr             * msg,
     const struct sockaddr_in6 * from,
@@ -263,7 +427,7 @@ static bool rebuild_ipv6_header(
                     ret = false;
                     break;
             }
-        } else {
+        } else if (!cmsg_extract_num_drops(cmsg, &sniffer->icmpv6_num_drops)) {
             // This should never occur
             fprintf(stderr, "Ignoring msg (level = %d)\n", cmsg->cmsg_level);
             ret = false;
@@ -273,15 +437,64 @@ static bool rebuild_ipv6_header(
     return ret;
 }
 
+/**
+ * \brief Check an ICMPv6 message returned by recvmsg() and rebuild
+ *    the IPv6 header preceding its bytes.
+ * \param sniffer The sniffer_t instance owning the IPv6 socket.
+ * \param ip6_header The IPv6 header we want to complete.
+ * \param msg The message returned by recvmsg(). Its source address
+ *    must be a struct sockaddr_in6.
+ * \param num_bytes The number of bytes of the message.
+ * \return true iif the packet can be processed.
+ */
+
+static bool sniffer_process_icmpv6_msghdr(
+    sniffer_t      * sniffer,
+    struct ip6_hdr * ip6_header,
+    struct msghdr  * msg,
+    size_t           num_bytes
+) {
+    if (msg->msg_flags & MSG_TRUNC) {
+        fprintf(stderr, "recv_ipv6_header: data truncated\n");
+        goto ERR_MSG_TRUNC;
+    }
+
+    if (msg->msg_flags & MSG_CTRUNC) {
+        fprintf(stderr, "recv_ipv6_header: ancillary data truncated\n");
+        goto ERR_MSG_CTRUNK;
+    }
+
+    if (!msg->msg_name || msg->msg_namelen < sizeof(struct sockaddr_in6)) {
+        fprintf(stderr, "recv_ipv6_header: missing source address\n");
+        goto ERR_MSG_NAME;
+    }
+
+    if(!rebuild_ipv6_header(sniffer, ip6_header, msg, (const struct sockaddr_in6 *) msg->msg_name, num_bytes)) {
+        fprintf(stderr, "recv_ipv6_header: error in rebuild_ipv6_header\n");
+        goto ERR_REBUILD_IPV6_HEADER;
+    }
+
+    return true;
+
+ERR_REBUILD_IPV6_HEADER:
+ERR_MSG_NAME:
+ERR_MSG_CTRUNK:
+ERR_MSG_TRUNC:
+    return false;
+}
+
 /**
  * \brief Fetch an IPv6/ICMPv6 packet from an IPv6 socket
- * \param ipv6_sockfd An IPv6 socket which is sniffing an ICMPv6 packet
+ * \param sniffer The sniffer_t instance owning the IPv6 socket.
  * \param bytes A preallocated buffer in which we write the full IPv6 packet.
  * \param len The size of the preallocated buffer
  * \param flags
+ * \return The number of bytes written in bytes (0 if the packet has been
+ *    ignored), -1 if no packet can be fetched.
  */
 
-static ssize_t recv_icmpv6(int ipv6_sockfd, void * bytes, size_t len, int flags) {
+static ssize_t recv_icmpv6(sniffer_t * sniffer, void * bytes, size_t len, int flags) {
+    int                   ipv6_sockfd = sniffer->icmpv6_sockfd;
     ssize_t               num_bytes;
     char                  cmsg_buf[BUFLEN];
     struct sockaddr_in6   from;
@@ -308,77 +521,152 @@ static ssize_t recv_icmpv6(int ipv6_sockfd, void * bytes, size_t len, int flags)
 
     // Fetch the bytes nested in the IPv6 packet (in the case of traceroute,
     // we fetch ICMPv6/UDP/payload layers).
+    // If the socket has been drained, errno is set to EAGAIN.
     if ((num_bytes = recvmsg(ipv6_sockfd, &msg, flags)) == -1) {
-        fprintf(stderr, "recv_ipv6_header: Can't fetch data\n");
         goto ERR_RECVMSG;
     }
 
-    if (msg.msg_flags & MSG_TRUNC) {
-        fprintf(stderr, "recv_ipv6_header: data truncated\n");
-        goto ERR_MSG_TRUNC;
-    }
-
-    if (msg.msg_flags & MSG_CTRUNC) {
-        fprintf(stderr, "recv_ipv6_header: ancillary data truncated\n");
-        goto ERR_MSG_CTRUNK;
-    }
-
-    if(!rebuild_ipv6_header(ip6_header, &msg, &from, num_bytes)) {
-        fprintf(stderr, "recv_ipv6_header: error in rebuild_ipv6_header\n");
-        goto ERR_REBUILD_IPV6_HEADER;
+    if (!sniffer_process_icmpv6_msghdr(sniffer, ip6_header, &msg, num_bytes)) {
+        return 0;
     }
 
     return num_bytes + sizeof(struct ip6_hdr);
-ERR_REBUILD_IPV6_HEADER:
-ERR_MSG_CTRUNK:
-ERR_MSG_TRUNC:
 ERR_RECVMSG:
-    return 0;
+    return -1;
 }
 
 #endif // USE_IPV6
 
-void sniffer_process_packets(sniffer_t * sniffer, uint8_t protocol_id)
+/**
+ * \brief Fetch the next packet sniffed by a sniffer_t instance.
+ * \param sniffer Points to a sniffer_t instance.
+ * \param protocol_id The family of the packet to fetch (IPPROTO_ICMP, IPPROTO_ICMPV6)
+ * \param recv_bytes A preallocated buffer of BUFLEN bytes.
+ * \return The number of bytes written in recv_bytes (0 if the packet has
+ *    been ignored), -1 if no more packet can be fetched.
+ */
+
+static ssize_t sniffer_recv_packet(sniffer_t * sniffer, uint8_t protocol_id, uint8_t * recv_bytes)
 {
-    uint8_t    recv_bytes[BUFLEN];
-    ssize_t    num_bytes = 0;
-    packet_t * packet;
+    ssize_t num_bytes = -1;
 
+    // Sockets are non-blocking: they are drained until recv fails with EAGAIN.
     switch (protocol_id) {
 #ifdef USE_IPV4
         case IPPROTO_ICMP:
-            num_bytes = recv(sniffer->icmpv4_sockfd, recv_bytes, BUFLEN, 0);
+            num_bytes = recv_icmpv4(sniffer, recv_bytes, BUFLEN, 0);
             break;
 #endif
 #ifdef USE_IPV6
         case IPPROTO_ICMPV6:
-            num_bytes = recv_icmpv6(sniffer->icmpv6_sockfd, recv_bytes, BUFLEN, 0);
+            num_bytes = recv_icmpv6(sniffer, recv_bytes, BUFLEN, 0);
             break;
 #endif
+        default:
+            errno = EINVAL;
+            break;
+    }
+
+    if (num_bytes == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        perror("sniffer_recv_packet: Can't fetch data");
     }
+    return num_bytes;
+}
+
+/**
+ * \brief Pass a sniffed packet to the callback of a sniffer_t instance.
+ * \param sniffer Points to a sniffer_t instance.
+ * \param bytes The bytes of the packet (starting with its IP header).
+ * \param num_bytes The number of bytes of the packet.
+ */
+
+static void sniffer_deliver_packet(sniffer_t * sniffer, uint8_t * bytes, size_t num_bytes)
+{
+    packet_t * packet;
 
-	if (num_bytes >= 4) {
-		// We have to make some modifications on the datagram
-		// received because the raw format varies between
-		// OSes:
-		//  - Linux: the whole packet is in network endianess
-		//  - NetBSD: the packet is in network endianess except
-		//  IP total length and frag ofs(?) are in host-endian
-		//  - FreeBSD: same as NetBSD?
-		//  - Apple: same as NetBSD?
-		//  Bug? On NetBSD, the IP length seems incorrect
+    if (num_bytes < 4) return;
+
+    // We have to make some modifications on the datagram
+    // received because the raw format varies between
+    // OSes:
+    //  - Linux: the whole packet is in network endianess
+    //  - NetBSD: the packet is in network endianess except
+    //  IP total length and frag ofs(?) are in host-endian
+    //  - FreeBSD: same as NetBSD?
+    //  - Apple: same as NetBSD?
+    //  Bug? On NetBSD, the IP length seems incorrect
 #if defined __APPLE__ || __NetBSD__ || __FreeBSD__
-		//uint16_t ip_len = read16(recv_bytes, 2);
-		//writebe16(recv_bytes, 2, ip_len);
-        printf("sniffer_process_packets: something unclear here\n");
+    //uint16_t ip_len = read16(bytes, 2);
+    //writebe16(bytes, 2, ip_len);
+    printf("sniffer_process_packets: something unclear here\n");
 #endif
-		if (sniffer->recv_callback != NULL) {
-            packet = packet_create_from_bytes(recv_bytes, num_bytes);
+    if (sniffer->recv_callback != NULL) {
+        packet = packet_create_from_bytes(bytes, num_bytes);
 
-			if (!(sniffer->recv_callback(packet, sniffer->recv_param))) {
-                fprintf(stderr, "Error in sniffer's callback\n");
-            }
+        if (!(sniffer->recv_callback(packet, sniffer->recv_param))) {
+            fprintf(stderr, "Error in sniffer's callback\n");
+        }
+    }
+}
+
+size_t sniffer_process_packets(sniffer_t * sniffer, uint8_t protocol_id)
+{
+    uint8_t    recv_bytes[BUFLEN];
+    ssize_t    num_bytes;
+    size_t     num_packets = 0;
+    int        last_errno = 0;
+
+    // Fetch every pending packet. The socket is edge-triggered: it must be
+    // drained until recv fails with EAGAIN, otherwise it is not notified anymore.
+    while (true) {
+        if ((num_bytes = sniffer_recv_packet(sniffer, protocol_id, recv_bytes)) == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+            // A pending socket error is reported once: go on draining,
+            // unless the error persists.
+            if (errno == last_errno) break;
+            last_errno = errno;
+            continue;
         }
+
+        last_errno = 0;
+        num_packets++;
+        sniffer_deliver_packet(sniffer, recv_bytes, num_bytes);
 	}
+    return num_packets;
 }
 
+bool sniffer_process_message(sniffer_t * sniffer, uint8_t protocol_id, struct msghdr * msg, size_t num_bytes)
+{
+#ifdef USE_IPV6
+    uint8_t recv_bytes[BUFLEN];
+#endif
+
+    switch (protocol_id) {
+#ifdef USE_IPV4
+        case IPPROTO_ICMP:
+            // The message already starts with the IPv4 header
+            sniffer_process_icmpv4_msghdr(sniffer, msg);
+            sniffer_deliver_packet(sniffer, msg->msg_iov[0].iov_base, num_bytes);
+            return true;
+#endif
+#ifdef USE_IPV6
+        case IPPROTO_ICMPV6:
+            // The IPv6 header is rebuilt in front of the bytes of the message
+            if (num_bytes > BUFLEN - sizeof(struct ip6_hdr)) {
+                msg->msg_flags |= MSG_TRUNC;
+                num_bytes = BUFLEN - sizeof(struct ip6_hdr);
+            }
+            if (sniffer_process_icmpv6_msghdr(sniffer, (struct ip6_hdr *) recv_bytes, msg, num_bytes)) {
+                memcpy(recv_bytes + sizeof(struct ip6_hdr), msg->msg_iov[0].iov_base, num_bytes);
+                sniffer_deliver_packet(sniffer, recv_bytes, num_bytes + sizeof(struct ip6_hdr));
+            }
+            return true;
+#endif
+        default:
+            errno = EINVAL;
+            break;
+    }
+    return false;
+}
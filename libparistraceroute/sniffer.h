@@ -10,9 +10,16 @@
  */
 
 #include <stdbool.h> // bool
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint32_t
+#include <sys/socket.h> // struct msghdr
 #include "packet.h"  // packet_t
 #include "use.h"
 
+// Replies may arrive in bursts (e.g. when many probes are in flight): the
+// default receive buffer of a raw socket would overflow.
+#define SNIFFER_DEFAULT_RECV_BUFFER_SIZE (1 << 20)
+
 /**
  * \struct sniffer_t
  * \brief Structure representing a packet sniffer. The sniffer calls
@@ -24,10 +31,12 @@
 
 typedef struct {
 #ifdef USE_IPV4
-    int     icmpv4_sockfd;  /**< Raw socket for sniffing ICMPv4 packets */
+    int      icmpv4_sockfd;    /**< Raw socket for sniffing ICMPv4 packets */
+    uint32_t icmpv4_num_drops; /**< Packets dropped by the kernel on icmpv4_sockfd (SO_RXQ_OVFL) */
 #endif
 #ifdef USE_IPV6
-    int     icmpv6_sockfd;  /**< Raw socket for sniffing ICMPv6 packets */
+    int      icmpv6_sockfd;    /**< Raw socket for sniffing ICMPv6 packets */
+    uint32_t icmpv6_num_drops; /**< Packets dropped by the kernel on icmpv6_sockfd (SO_RXQ_OVFL) */
 #endif
     void  * recv_param;     /**< This pointer is passed whenever recv_callback is called */
     bool (* recv_callback)(packet_t * packet, void * recv_param); /**< Callback for received packets */
@@ -71,14 +80,47 @@ int sniffer_get_icmpv6_sockfd(sniffer_t * sniffer);
 #endif
 
 /**
- * \brief Fetch a packet from the listening socket. The sniffer then
- *   call recv_callback and pass to this function this packet and
- *   eventual data stored in sniffer->recv_packet. If this callback
+ * \brief Set the size of the receive buffer of the sniffer sockets.
+ * \param sniffer Points to a sniffer_t instance.
+ * \param recv_buffer_size The size of the receive buffer (in bytes).
+ * \return true iif successful
+ */
+
+bool sniffer_set_recv_buffer_size(sniffer_t * sniffer, int recv_buffer_size);
+
+/**
+ * \brief Retrieve the number of packets dropped by the kernel because
+ *    the receive buffer of a sniffer socket was full.
+ * \param sniffer Points to a sniffer_t instance.
+ * \return The number of dropped packets. This counter is always equal
+ *    to 0 if the system does not support SO_RXQ_OVFL.
+ */
+
+size_t sniffer_get_num_drops(const sniffer_t * sniffer);
+
+/**
+ * \brief Fetch every pending packet from the listening socket. For each
+ *   packet, the sniffer calls recv_callback and pass to this function this
+ *   packet and eventual data stored in sniffer->recv_packet. If this callback
  *   returns false, a message is printed.
  * \param sniffer Points to a sniffer_t instance.
  * \param protocol_id The family of the packet to fetch (IPPROTO_ICMP, IPPROTO_ICMPV6)
+ * \return The number of packets fetched from the socket.
+ */
+
+size_t sniffer_process_packets(sniffer_t * sniffer, uint8_t protocol_id);
+
+/**
+ * \brief Process a packet already fetched from a sniffer socket (e.g. by
+ *    a multishot receive, see uring_recvmsg_multishot). The sniffer calls
+ *    recv_callback as sniffer_process_packets does.
+ * \param sniffer Points to a sniffer_t instance.
+ * \param protocol_id The family of the packet (IPPROTO_ICMP, IPPROTO_ICMPV6)
+ * \param msg The message returned by recvmsg() on the corresponding socket.
+ * \param num_bytes The number of bytes stored in msg->msg_iov[0].
+ * \return true iif protocol_id is supported.
  */
 
-void sniffer_process_packets(sniffer_t * sniffer, uint8_t protocol_id);
+bool sniffer_process_message(sniffer_t * sniffer, uint8_t protocol_id, struct msghdr * msg, size_t num_bytes);
 
 #endif // LIBPT_SNIFFER_H
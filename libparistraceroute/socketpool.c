@@ -13,6 +13,7 @@
 #include "socketpool.h"
 
 #include "address.h"            // address_guess_family
+#include "uring.h"              // uring_sendto
 
 /*
 If we send UDP packet, we could get a return error channel.
@@ -61,6 +62,7 @@ socketpool_t * socketpool_create() {
     socketpool_t * socketpool;
     
     if (!(socketpool = malloc(sizeof(socketpool_t))))             goto ERR_MALLOC;
+    socketpool->uring = NULL;
 #ifdef USE_IPV4
     if (!(create_raw_socket(AF_INET,  &socketpool->ipv4_sockfd))) goto ERR_CREATE_RAW_SOCKET_IPV4;
 #endif
@@ -134,8 +136,15 @@ bool socketpool_send_packet(const socketpool_t * socketpool, const packet_t * pa
             goto ERR_INVALID_FAMILY;
     }
 
-    // Send the packet
-    if (sendto(sockfd, packet_get_bytes(packet), packet_get_size(packet), 0, dst_addr, socklen) == -1) {
+    // Send the packet. With io_uring, the packet is queued and sent by the
+    // next io_uring_enter() call: a sending error is reported once the
+    // request completes.
+    if (socketpool->uring) {
+        if (!uring_sendto(socketpool->uring, sockfd, packet_get_bytes(packet), packet_get_size(packet), dst_addr, socklen)) {
+            perror("send_data: Cannot queue the packet");
+            goto ERR_SEND_TO;
+        }
+    } else if (sendto(sockfd, packet_get_bytes(packet), packet_get_size(packet), 0, dst_addr, socklen) == -1) {
         perror("send_data: Sending error in queue");
         goto ERR_SEND_TO;
     }
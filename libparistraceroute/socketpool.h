@@ -11,6 +11,7 @@ typedef struct {
 #ifdef USE_IPV6
     int ipv6_sockfd; /**< File descriptor of the IPv6 raw socket */
 #endif
+    struct uring_s * uring; /**< If set, packets are sent through this io_uring instance (see uring_sendto) */
 } socketpool_t;
 
 /**
@@ -0,0 +1,160 @@
+#include "use.h"
+#include "config.h"
+
+#include <stdlib.h>         // malloc, free
+#include <string.h>         // memcpy, memset
+#include <sys/socket.h>     // AF_INET6
+
+#include "stop_set.h"
+
+//---------------------------------------------------------------------------
+// stop_set_entry_t (internal usage)
+//---------------------------------------------------------------------------
+
+static size_t stop_set_entry_local_hash(const stop_set_entry_t * entry) {
+    return address_hash(&entry->interface);
+}
+
+static int stop_set_entry_local_compare(const stop_set_entry_t * entry1, const stop_set_entry_t * entry2) {
+    return address_compare(&entry1->interface, &entry2->interface);
+}
+
+static size_t stop_set_entry_global_hash(const stop_set_entry_t * entry) {
+    return hash_uint64(address_hash(&entry->interface)) ^ address_hash(&entry->prefix);
+}
+
+static int stop_set_entry_global_compare(const stop_set_entry_t * entry1, const stop_set_entry_t * entry2) {
+    int ret;
+
+    if ((ret = address_compare(&entry1->interface, &entry2->interface))) return ret;
+    return address_compare(&entry1->prefix, &entry2->prefix);
+}
+
+/**
+ * \brief Initialize the key fields of a stop_set_entry_t.
+ * \param stop_set A stop_set_t instance.
+ * \param entry The stop_set_entry_t to initialize.
+ * \param interface The interface.
+ * \param destination The destination (global stop set), NULL otherwise.
+ */
+
+static void stop_set_entry_set_key(
+    const stop_set_t * stop_set,
+    stop_set_entry_t * entry,
+    const address_t  * interface,
+    const address_t  * destination
+) {
+    memset(entry, 0, sizeof(stop_set_entry_t));
+    memcpy(&entry->interface, interface, sizeof(address_t));
+    if (destination) {
+        address_get_prefix(
+            destination,
+            destination->family == AF_INET6 ? stop_set->prefix_len_ipv6 : stop_set->prefix_len_ipv4,
+            &entry->prefix
+        );
+    }
+}
+
+/**
+ * \brief Insert an entry in a stop set (if not yet stored).
+ * \param index The stop set.
+ * \param search The entry to insert.
+ * \return true iif successful.
+ */
+
+static bool stop_set_index_add(hashtable_t * index, const stop_set_entry_t * search)
+{
+    stop_set_entry_t * entry;
+
+    if (hashtable_find(index, search)) return true;
+
+    if (!(entry = malloc(sizeof(stop_set_entry_t)))) goto ERR_MALLOC;
+    memcpy(entry, search, sizeof(stop_set_entry_t));
+    if (!hashtable_update(index, entry, entry)) goto ERR_HASHTABLE_UPDATE;
+    return true;
+
+ERR_HASHTABLE_UPDATE:
+    free(entry);
+ERR_MALLOC:
+    return false;
+}
+
+static unsigned stop_set_index_find(const hashtable_t * index, const stop_set_entry_t * search)
+{
+    const stop_set_entry_t * entry;
+
+    return (entry = hashtable_find(index, search)) ? entry->owner : 0;
+}
+
+//---------------------------------------------------------------------------
+// stop_set_t
+//---------------------------------------------------------------------------
+
+stop_set_t * stop_set_create(uint8_t prefix_len_ipv4, uint8_t prefix_len_ipv6)
+{
+    stop_set_t * stop_set;
+
+    if (!(stop_set = malloc(sizeof(stop_set_t)))) goto ERR_MALLOC;
+
+    if (!(stop_set->local = hashtable_create(stop_set_entry_local_hash, stop_set_entry_local_compare))) {
+        goto ERR_LOCAL_CREATE;
+    }
+
+    if (!(stop_set->global = hashtable_create(stop_set_entry_global_hash, stop_set_entry_global_compare))) {
+        goto ERR_GLOBAL_CREATE;
+    }
+
+    stop_set->prefix_len_ipv4 = prefix_len_ipv4;
+    stop_set->prefix_len_ipv6 = prefix_len_ipv6;
+    return stop_set;
+
+ERR_GLOBAL_CREATE:
+    hashtable_free(stop_set->local, NULL);
+ERR_LOCAL_CREATE:
+    free(stop_set);
+ERR_MALLOC:
+    return NULL;
+}
+
+void stop_set_free(stop_set_t * stop_set)
+{
+    if (stop_set) {
+        hashtable_free(stop_set->global, free);
+        hashtable_free(stop_set->local, free);
+        free(stop_set);
+    }
+}
+
+bool stop_set_add_local(stop_set_t * stop_set, const address_t * interface, unsigned owner)
+{
+    stop_set_entry_t search;
+
+    stop_set_entry_set_key(stop_set, &search, interface, NULL);
+    search.owner = owner;
+    return stop_set_index_add(stop_set->local, &search);
+}
+
+unsigned stop_set_find_local(const stop_set_t * stop_set, const address_t * interface)
+{
+    stop_set_entry_t search;
+
+    stop_set_entry_set_key(stop_set, &search, interface, NULL);
+    return stop_set_index_find(stop_set->local, &search);
+}
+
+bool stop_set_add_global(stop_set_t * stop_set, const address_t * interface, const address_t * destination, unsigned owner)
+{
+    stop_set_entry_t search;
+
+    stop_set_entry_set_key(stop_set, &search, interface, destination);
+    search.owner = owner;
+    return stop_set_index_add(stop_set->global, &search);
+}
+
+unsigned stop_set_find_global(const stop_set_t * stop_set, const address_t * interface, const address_t * destination)
+{
+    stop_set_entry_t search;
+
+    stop_set_entry_set_key(stop_set, &search, interface, destination);
+    return stop_set_index_find(stop_set->global, &search);
+}
@@ -0,0 +1,100 @@
+#ifndef LIBPT_STOP_SET_H
+#define LIBPT_STOP_SET_H
+
+#include <stdbool.h>                 // bool
+#include <stdint.h>                  // uint8_t
+
+#include "address.h"                 // address_t
+#include "containers/hashtable.h"    // hashtable_t
+
+// A stop_set_t gathers the stop sets used by Doubletree to avoid probing
+// the same part of the topology several times:
+// - the local stop set contains the interfaces already discovered from
+//   this source. Backward probing (toward the source) stops at the first
+//   interface it contains.
+// - the global stop set contains the (interface, destination prefix)
+//   pairs already discovered. Forward probing (toward the destination)
+//   stops at the first pair it contains.
+//
+// Each entry remembers the (non-zero) identifier of the algorithm instance
+// which has inserted it, so that an instance does not stop on its own
+// discoveries.
+
+#define STOP_SET_PREFIX_LEN_IPV4 24
+#define STOP_SET_PREFIX_LEN_IPV6 48
+
+typedef struct {
+    address_t   interface;  /**< Discovered interface */
+    address_t   prefix;     /**< Prefix of the destination (global stop set only) */
+    unsigned    owner;      /**< Identifier of the instance which has discovered it */
+} stop_set_entry_t;
+
+typedef struct stop_set_s {
+    hashtable_t * local;           /**< Maps an interface to its stop_set_entry_t (owned) */
+    hashtable_t * global;          /**< Maps an (interface, prefix) pair to its stop_set_entry_t (owned) */
+    uint8_t       prefix_len_ipv4; /**< Length of the IPv4 prefixes */
+    uint8_t       prefix_len_ipv6; /**< Length of the IPv6 prefixes */
+} stop_set_t;
+
+/**
+ * \brief Create a stop_set_t instance.
+ * \param prefix_len_ipv4 The length of the IPv4 destination prefixes
+ *    (e.g. STOP_SET_PREFIX_LEN_IPV4, 32 for the original Doubletree).
+ * \param prefix_len_ipv6 The length of the IPv6 destination prefixes
+ *    (e.g. STOP_SET_PREFIX_LEN_IPV6, 128 for the original Doubletree).
+ * \return The newly allocated stop_set_t instance, NULL otherwise.
+ */
+
+stop_set_t * stop_set_create(uint8_t prefix_len_ipv4, uint8_t prefix_len_ipv6);
+
+/**
+ * \brief Release a stop_set_t instance from the memory.
+ * \param stop_set A stop_set_t instance.
+ */
+
+void stop_set_free(stop_set_t * stop_set);
+
+/**
+ * \brief Add an interface to the local stop set (if not yet stored).
+ * \param stop_set A stop_set_t instance.
+ * \param interface The discovered interface.
+ * \param owner The identifier of the instance which has discovered it.
+ * \return true iif successful.
+ */
+
+bool stop_set_add_local(stop_set_t * stop_set, const address_t * interface, unsigned owner);
+
+/**
+ * \brief Search an interface in the local stop set.
+ * \param stop_set A stop_set_t instance.
+ * \param interface The searched interface.
+ * \return The identifier of the instance which has discovered it, 0 if
+ *    not found.
+ */
+
+unsigned stop_set_find_local(const stop_set_t * stop_set, const address_t * interface);
+
+/**
+ * \brief Add an (interface, destination prefix) pair to the global stop set
+ *    (if not yet stored).
+ * \param stop_set A stop_set_t instance.
+ * \param interface The discovered interface.
+ * \param destination The destination of the probe which has discovered it.
+ * \param owner The identifier of the instance which has discovered it.
+ * \return true iif successful.
+ */
+
+bool stop_set_add_global(stop_set_t * stop_set, const address_t * interface, const address_t * destination, unsigned owner);
+
+/**
+ * \brief Search an (interface, destination prefix) pair in the global stop set.
+ * \param stop_set A stop_set_t instance.
+ * \param interface The searched interface.
+ * \param destination The destination.
+ * \return The identifier of the instance which has discovered it, 0 if
+ *    not found.
+ */
+
+unsigned stop_set_find_global(const stop_set_t * stop_set, const address_t * interface, const address_t * destination);
+
+#endif // LIBPT_STOP_SET_H
@@ -0,0 +1,409 @@
+#include "use.h"
+#include "config.h"
+
+#include <stdlib.h>         // malloc, calloc, realloc, free
+#include <stdio.h>          // FILE, fopen, fgets, fprintf, fclose
+#include <string.h>         // memcpy, memset, strchr
+#include <sys/socket.h>     // AF_INET, AF_INET6
+#include <arpa/inet.h>      // inet_pton
+
+#include "topology_cache.h"
+
+#define TOPOLOGY_CACHE_NUM_FLOW_IDS_INIT 8
+#define TOPOLOGY_CACHE_LINE_SIZE         256
+
+//---------------------------------------------------------------------------
+// Keys (internal usage)
+//---------------------------------------------------------------------------
+
+static size_t topology_cache_hash_key(const address_t * source, const address_t * prefix, uint64_t x) {
+    return hash_uint64(((uint64_t) address_hash(source) << 1) ^ address_hash(prefix)) ^ hash_uint64(x);
+}
+
+static size_t topology_cache_hop_hash(const topology_cache_hop_t * hop) {
+    return topology_cache_hash_key(&hop->source, &hop->prefix, ((uint64_t) hop->ttl << 16) | hop->flow_id);
+}
+
+static int topology_cache_hop_compare(const topology_cache_hop_t * hop1, const topology_cache_hop_t * hop2) {
+    int ret;
+
+    if ((ret = address_compare(&hop1->source, &hop2->source))) return ret;
+    if ((ret = address_compare(&hop1->prefix, &hop2->prefix))) return ret;
+    if (hop1->ttl != hop2->ttl) return hop1->ttl - hop2->ttl;
+    return hop1->flow_id - hop2->flow_id;
+}
+
+static size_t topology_cache_flows_hash(const topology_cache_flows_t * flows) {
+    return topology_cache_hash_key(&flows->source, &flows->destination, ((uint64_t) address_hash(&flows->interface) << 8) | flows->ttl);
+}
+
+static int topology_cache_flows_compare(const topology_cache_flows_t * flows1, const topology_cache_flows_t * flows2) {
+    int ret;
+
+    if ((ret = address_compare(&flows1->source,      &flows2->source)))      return ret;
+    if ((ret = address_compare(&flows1->destination, &flows2->destination))) return ret;
+    if ((ret = address_compare(&flows1->interface,   &flows2->interface)))   return ret;
+    return flows1->ttl - flows2->ttl;
+}
+
+static void topology_cache_flows_free(topology_cache_flows_t * flows) {
+    if (flows) {
+        free(flows->flow_ids);
+        free(flows);
+    }
+}
+
+/**
+ * \brief Retrieve the length of the prefixes of a given address family.
+ * \param topology_cache A topology_cache_t instance.
+ * \param family The address family.
+ * \return The corresponding prefix length.
+ */
+
+static inline uint8_t topology_cache_get_prefix_len(const topology_cache_t * topology_cache, int family) {
+    return family == AF_INET6 ? topology_cache->prefix_len_ipv6 : topology_cache->prefix_len_ipv4;
+}
+
+static void topology_cache_hop_set_key(
+    const topology_cache_t * topology_cache,
+    topology_cache_hop_t   * hop,
+    const address_t        * source,
+    const address_t        * destination,
+    uint8_t                  ttl,
+    uint16_t                 flow_id
+) {
+    memset(hop, 0, sizeof(topology_cache_hop_t));
+    memcpy(&hop->source, source, sizeof(address_t));
+    address_get_prefix(destination, topology_cache_get_prefix_len(topology_cache, destination->family), &hop->prefix);
+    memcpy(&hop->destination, destination, sizeof(address_t));
+    hop->ttl     = ttl;
+    hop->flow_id = flow_id;
+}
+
+static void topology_cache_flows_set_key(topology_cache_flows_t * flows, const topology_cache_hop_t * hop) {
+    memset(flows, 0, sizeof(topology_cache_flows_t));
+    memcpy(&flows->source,      &hop->source,      sizeof(address_t));
+    memcpy(&flows->destination, &hop->destination, sizeof(address_t));
+    memcpy(&flows->interface,   &hop->interface,   sizeof(address_t));
+    flows->ttl = hop->ttl;
+}
+
+//---------------------------------------------------------------------------
+// Flows reaching an interface (internal usage)
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Attach the flow of a hop to the flows reaching its interface.
+ * \param topology_cache A topology_cache_t instance.
+ * \param hop A cached hop.
+ * \return true iif successful.
+ */
+
+static bool topology_cache_add_flow(topology_cache_t * topology_cache, const topology_cache_hop_t * hop)
+{
+    topology_cache_flows_t   search,
+                           * flows;
+    uint16_t               * flow_ids;
+    size_t                   max_flow_ids;
+
+    topology_cache_flows_set_key(&search, hop);
+    if (!(flows = hashtable_find(topology_cache->flows_index, &search))) {
+        if (!(flows = malloc(sizeof(topology_cache_flows_t)))) goto ERR_MALLOC;
+        memcpy(flows, &search, sizeof(topology_cache_flows_t));
+        if (!hashtable_update(topology_cache->flows_index, flows, flows)) goto ERR_HASHTABLE_UPDATE;
+    }
+
+    if (flows->num_flow_ids == flows->max_flow_ids) {
+        max_flow_ids = flows->max_flow_ids ? 2 * flows->max_flow_ids : TOPOLOGY_CACHE_NUM_FLOW_IDS_INIT;
+        if (!(flow_ids = realloc(flows->flow_ids, max_flow_ids * sizeof(uint16_t)))) {
+            goto ERR_REALLOC;
+        }
+        flows->flow_ids     = flow_ids;
+        flows->max_flow_ids = max_flow_ids;
+    }
+
+    flows->flow_ids[flows->num_flow_ids++] = hop->flow_id;
+    return true;
+
+ERR_HASHTABLE_UPDATE:
+    free(flows);
+ERR_MALLOC:
+ERR_REALLOC:
+    return false;
+}
+
+/**
+ * \brief Detach the flow of a hop from the flows reaching its interface.
+ * \param topology_cache A topology_cache_t instance.
+ * \param hop A cached hop.
+ */
+
+static void topology_cache_del_flow(topology_cache_t * topology_cache, const topology_cache_hop_t * hop)
+{
+    topology_cache_flows_t   search,
+                           * flows;
+    size_t                   i;
+
+    topology_cache_flows_set_key(&search, hop);
+    if ((flows = hashtable_find(topology_cache->flows_index, &search))) {
+        for (i = 0; i < flows->num_flow_ids; i++) {
+            if (flows->flow_ids[i] == hop->flow_id) {
+                flows->flow_ids[i] = flows->flow_ids[--flows->num_flow_ids];
+                break;
+            }
+        }
+    }
+}
+
+//---------------------------------------------------------------------------
+// topology_cache_t
+//---------------------------------------------------------------------------
+
+static topology_cache_t * topology_cache_shared = NULL;
+
+topology_cache_t * topology_cache_create(uint8_t prefix_len_ipv4, uint8_t prefix_len_ipv6)
+{
+    topology_cache_t * topology_cache;
+
+    if (!(topology_cache = malloc(sizeof(topology_cache_t)))) goto ERR_MALLOC;
+    if (!(topology_cache->hops = dynarray_create()))          goto ERR_HOPS_CREATE;
+
+    if (!(topology_cache->hop_index = hashtable_create(topology_cache_hop_hash, topology_cache_hop_compare))) {
+        goto ERR_HOP_INDEX_CREATE;
+    }
+
+    if (!(topology_cache->flows_index = hashtable_create(topology_cache_flows_hash, topology_cache_flows_compare))) {
+        goto ERR_FLOWS_INDEX_CREATE;
+    }
+
+    topology_cache->prefix_len_ipv4 = prefix_len_ipv4;
+    topology_cache->prefix_len_ipv6 = prefix_len_ipv6;
+    return topology_cache;
+
+ERR_FLOWS_INDEX_CREATE:
+    hashtable_free(topology_cache->hop_index, NULL);
+ERR_HOP_INDEX_CREATE:
+    dynarray_free(topology_cache->hops, NULL);
+ERR_HOPS_CREATE:
+    free(topology_cache);
+ERR_MALLOC:
+    return NULL;
+}
+
+void topology_cache_free(topology_cache_t * topology_cache)
+{
+    if (topology_cache) {
+        hashtable_free(topology_cache->flows_index, (ELEMENT_FREE) topology_cache_flows_free);
+        hashtable_free(topology_cache->hop_index, NULL);
+        dynarray_free(topology_cache->hops, free);
+        free(topology_cache);
+    }
+}
+
+topology_cache_t * topology_cache_get_shared()
+{
+    if (!topology_cache_shared) {
+        topology_cache_shared = topology_cache_create(
+            TOPOLOGY_CACHE_PREFIX_LEN_IPV4,
+            TOPOLOGY_CACHE_PREFIX_LEN_IPV6
+        );
+    }
+    return topology_cache_shared;
+}
+
+void topology_cache_free_shared()
+{
+    topology_cache_free(topology_cache_shared);
+    topology_cache_shared = NULL;
+}
+
+bool topology_cache_add(
+    topology_cache_t * topology_cache,
+    const address_t  * source,
+    const address_t  * destination,
+    uint8_t            ttl,
+    uint16_t           flow_id,
+    const address_t  * interface
+) {
+    topology_cache_hop_t   search,
+                         * hop;
+
+    topology_cache_hop_set_key(topology_cache, &search, source, destination, ttl, flow_id);
+    if ((hop = hashtable_find(topology_cache->hop_index, &search))) {
+        if (address_compare(&hop->interface, interface) == 0
+        &&  address_compare(&hop->destination, destination) == 0) return true;
+
+        // The path has changed since this hop has been cached, or this
+        // flow has been sent toward another destination of the prefix
+        topology_cache_del_flow(topology_cache, hop);
+        memcpy(&hop->destination, destination, sizeof(address_t));
+        memcpy(&hop->interface, interface, sizeof(address_t));
+    } else {
+        if (!(hop = malloc(sizeof(topology_cache_hop_t)))) goto ERR_MALLOC;
+        memcpy(hop, &search, sizeof(topology_cache_hop_t));
+        memcpy(&hop->interface, interface, sizeof(address_t));
+        if (!dynarray_push_element(topology_cache->hops, hop)) goto ERR_PUSH_ELEMENT;
+        if (!hashtable_update(topology_cache->hop_index, hop, hop)) goto ERR_HASHTABLE_UPDATE;
+    }
+
+    return topology_cache_add_flow(topology_cache, hop);
+
+ERR_HASHTABLE_UPDATE:
+    dynarray_del_ith_element(topology_cache->hops, dynarray_get_size(topology_cache->hops) - 1, NULL);
+ERR_PUSH_ELEMENT:
+    free(hop);
+ERR_MALLOC:
+    return false;
+}
+
+const address_t * topology_cache_find(
+    const topology_cache_t * topology_cache,
+    const address_t        * source,
+    const address_t        * destination,
+    uint8_t                  ttl,
+    uint16_t                 flow_id
+) {
+    topology_cache_hop_t   search;
+    topology_cache_hop_t * hop;
+
+    topology_cache_hop_set_key(topology_cache, &search, source, destination, ttl, flow_id);
+    return (hop = hashtable_find(topology_cache->hop_index, &search)) ? &hop->interface : NULL;
+}
+
+size_t topology_cache_get_flow_ids(
+    const topology_cache_t * topology_cache,
+    const address_t        * source,
+    const address_t        * destination,
+    uint8_t                  ttl,
+    const address_t        * interface,
+    const uint16_t        ** pflow_ids
+) {
+    topology_cache_hop_t     hop;
+    topology_cache_flows_t   search;
+    topology_cache_flows_t * flows;
+
+    topology_cache_hop_set_key(topology_cache, &hop, source, destination, ttl, 0);
+    memcpy(&hop.interface, interface, sizeof(address_t));
+    topology_cache_flows_set_key(&search, &hop);
+
+    if (!(flows = hashtable_find(topology_cache->flows_index, &search))) {
+        *pflow_ids = NULL;
+        return 0;
+    }
+
+    *pflow_ids = flows->flow_ids;
+    return flows->num_flow_ids;
+}
+
+size_t topology_cache_get_num_hops(const topology_cache_t * topology_cache) {
+    return dynarray_get_size(topology_cache->hops);
+}
+
+//---------------------------------------------------------------------------
+// Snapshots
+//---------------------------------------------------------------------------
+
+bool topology_cache_save(const topology_cache_t * topology_cache, const char * filename)
+{
+    FILE                       * file;
+    const topology_cache_hop_t * hop;
+    size_t                       i, num_hops = topology_cache_get_num_hops(topology_cache);
+
+    if (!(file = fopen(filename, "w"))) goto ERR_FOPEN;
+
+    fprintf(file, "# source destination/prefix_len ttl flow_id interface\n");
+    for (i = 0; i < num_hops; i++) {
+        hop = dynarray_get_ith_element(topology_cache->hops, i);
+        address_fprintf(file, &hop->source);
+        fprintf(file, " ");
+        address_fprintf(file, &hop->destination);
+        fprintf(file, "/%hhu %hhu %hu ", topology_cache_get_prefix_len(topology_cache, hop->destination.family), hop->ttl, hop->flow_id);
+        address_fprintf(file, &hop->interface);
+        fprintf(file, "\n");
+    }
+
+    if (fclose(file) != 0) goto ERR_FCLOSE;
+    return true;
+
+ERR_FCLOSE:
+ERR_FOPEN:
+    perror(filename);
+    return false;
+}
+
+/**
+ * \brief Initialize an address_t according to a numeric IP address.
+ *    Unlike address_from_string, it never performs any DNS lookup.
+ * \param str_ip An IPv4 or IPv6 address (string format).
+ * \param address A preallocated address_t instance.
+ * \return true iif successful.
+ */
+
+static bool topology_cache_address_from_string(const char * str_ip, address_t * address)
+{
+    memset(address, 0, sizeof(address_t));
+#ifdef USE_IPV4
+    if (inet_pton(AF_INET, str_ip, &address->ip.ipv4) == 1) {
+        address->family = AF_INET;
+        return true;
+    }
+#endif
+#ifdef USE_IPV6
+    if (inet_pton(AF_INET6, str_ip, &address->ip.ipv6) == 1) {
+        address->family = AF_INET6;
+        return true;
+    }
+#endif
+    return false;
+}
+
+bool topology_cache_load(topology_cache_t * topology_cache, const char * filename)
+{
+    FILE      * file;
+    char        line[TOPOLOGY_CACHE_LINE_SIZE],
+                str_source[TOPOLOGY_CACHE_LINE_SIZE],
+                str_destination[TOPOLOGY_CACHE_LINE_SIZE],
+                str_interface[TOPOLOGY_CACHE_LINE_SIZE],
+              * slash;
+    address_t   source, destination, interface;
+    unsigned    prefix_len, ttl, flow_id;
+    size_t      num_line = 0;
+
+    if (!(file = fopen(filename, "r"))) {
+        perror(filename);
+        goto ERR_FOPEN;
+    }
+
+    while (fgets(line, TOPOLOGY_CACHE_LINE_SIZE, file)) {
+        num_line++;
+        if (line[0] == '#' || line[0] == '\n') continue;
+
+        if (sscanf(line, "%s %s %u %u %s", str_source, str_destination, &ttl, &flow_id, str_interface) != 5
+        ||  !(slash = strchr(str_destination, '/'))
+        ||  sscanf(slash + 1, "%u", &prefix_len) != 1
+        ||  (*slash = '\0', !topology_cache_address_from_string(str_source, &source))
+        ||  !topology_cache_address_from_string(str_destination, &destination)
+        ||  !topology_cache_address_from_string(str_interface, &interface)
+        ||  ttl > UINT8_MAX || flow_id > UINT16_MAX
+        ) {
+            fprintf(stderr, "%s:%zu: invalid hop\n", filename, num_line);
+            goto ERR_PARSE;
+        }
+
+        // Hops cached with another prefix length can't be searched
+        if (prefix_len != topology_cache_get_prefix_len(topology_cache, destination.family)) continue;
+
+        if (!topology_cache_add(topology_cache, &source, &destination, ttl, flow_id, &interface)) {
+            goto ERR_TOPOLOGY_CACHE_ADD;
+        }
+    }
+
+    fclose(file);
+    return true;
+
+ERR_TOPOLOGY_CACHE_ADD:
+ERR_PARSE:
+    fclose(file);
+ERR_FOPEN:
+    return false;
+}
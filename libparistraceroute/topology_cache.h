@@ -0,0 +1,185 @@
+#ifndef LIBPT_TOPOLOGY_CACHE_H
+#define LIBPT_TOPOLOGY_CACHE_H
+
+#include <stdbool.h>                 // bool
+#include <stddef.h>                  // size_t
+#include <stdint.h>                  // uint8_t, uint16_t
+
+#include "address.h"                 // address_t
+#include "dynarray.h"                // dynarray_t
+#include "containers/hashtable.h"    // hashtable_t
+
+// A topology_cache_t remembers which interface has replied to which probe
+// in previous algorithm instances. A hop is identified by:
+// - the source of the probe,
+// - the prefix of its destination (paths toward the destinations of a
+//   prefix usually share their first hops),
+// - its TTL,
+// - its flow identifier (per-flow load balancers hash the flow).
+// Algorithms only use it as a hint: a cached hop is confirmed by a single
+// probe instead of being discovered from scratch.
+//
+// The flows known to reach an interface (used by MDA to pick its testing
+// flows) are indexed per destination instead: per-flow load balancers
+// also hash the destination address, so a flow reaching an interface
+// toward a destination may reach another one toward its neighbours.
+//
+// A topology_cache_t can be saved to (and loaded from) a text file, one
+// hop per line:
+//
+//   source destination/prefix_len ttl flow_id interface
+
+#define TOPOLOGY_CACHE_PREFIX_LEN_IPV4 24
+#define TOPOLOGY_CACHE_PREFIX_LEN_IPV6 48
+
+typedef struct {
+    address_t   source;       /**< Source of the probe */
+    address_t   prefix;       /**< Prefix of the destination of the probe */
+    address_t   destination;  /**< Destination of the last probe cached for this hop */
+    uint8_t     ttl;          /**< TTL of the probe */
+    uint16_t    flow_id;      /**< Flow identifier of the probe */
+    address_t   interface;    /**< Interface which has replied */
+} topology_cache_hop_t;
+
+typedef struct {
+    address_t   source;       /**< Source of the probes */
+    address_t   destination;  /**< Destination of the probes */
+    uint8_t     ttl;          /**< TTL of the probes */
+    address_t   interface;    /**< Interface reached by these flows */
+    uint16_t  * flow_ids;     /**< Flows reaching the interface */
+    size_t      num_flow_ids; /**< Number of flows stored in flow_ids */
+    size_t      max_flow_ids; /**< Number of flows allocated in flow_ids */
+} topology_cache_flows_t;
+
+typedef struct {
+    dynarray_t  * hops;           /**< topology_cache_hop_t instances (owned) */
+    hashtable_t * hop_index;      /**< Maps a (source, prefix, ttl, flow_id) to its topology_cache_hop_t */
+    hashtable_t * flows_index;    /**< Maps a (source, destination, ttl, interface) to its topology_cache_flows_t (owned) */
+    uint8_t       prefix_len_ipv4; /**< Length of the IPv4 prefixes */
+    uint8_t       prefix_len_ipv6; /**< Length of the IPv6 prefixes */
+} topology_cache_t;
+
+/**
+ * \brief Create a topology_cache_t instance.
+ * \param prefix_len_ipv4 The length of the IPv4 prefixes
+ *    (e.g. TOPOLOGY_CACHE_PREFIX_LEN_IPV4, 32 to cache per destination).
+ * \param prefix_len_ipv6 The length of the IPv6 prefixes
+ *    (e.g. TOPOLOGY_CACHE_PREFIX_LEN_IPV6, 128 to cache per destination).
+ * \return The newly allocated topology_cache_t instance, NULL otherwise.
+ */
+
+topology_cache_t * topology_cache_create(uint8_t prefix_len_ipv4, uint8_t prefix_len_ipv6);
+
+/**
+ * \brief Release a topology_cache_t instance from the memory.
+ * \param topology_cache A topology_cache_t instance.
+ */
+
+void topology_cache_free(topology_cache_t * topology_cache);
+
+/**
+ * \brief Retrieve the topology_cache_t instance shared by the whole
+ *    process. It is created the first time it is requested.
+ * \return The shared topology_cache_t instance (released by
+ *    topology_cache_free_shared), NULL in case of failure.
+ */
+
+topology_cache_t * topology_cache_get_shared();
+
+/**
+ * \brief Release the topology_cache_t instance shared by the whole process.
+ */
+
+void topology_cache_free_shared();
+
+/**
+ * \brief Record the interface which has replied to a probe. If this hop
+ *    was already cached, its interface is replaced.
+ * \param topology_cache A topology_cache_t instance.
+ * \param source The source of the probe.
+ * \param destination The destination of the probe.
+ * \param ttl The TTL of the probe.
+ * \param flow_id The flow identifier of the probe.
+ * \param interface The interface which has replied.
+ * \return true iif successful.
+ */
+
+bool topology_cache_add(
+    topology_cache_t * topology_cache,
+    const address_t  * source,
+    const address_t  * destination,
+    uint8_t            ttl,
+    uint16_t           flow_id,
+    const address_t  * interface
+);
+
+/**
+ * \brief Retrieve the interface which has replied to a probe.
+ * \param topology_cache A topology_cache_t instance.
+ * \param source The source of the probe.
+ * \param destination The destination of the probe.
+ * \param ttl The TTL of the probe.
+ * \param flow_id The flow identifier of the probe.
+ * \return The cached interface (valid until the next topology_cache_add
+ *    call), NULL if not found.
+ */
+
+const address_t * topology_cache_find(
+    const topology_cache_t * topology_cache,
+    const address_t        * source,
+    const address_t        * destination,
+    uint8_t                  ttl,
+    uint16_t                 flow_id
+);
+
+/**
+ * \brief Retrieve the flows known to reach an interface toward a
+ *    given destination.
+ * \param topology_cache A topology_cache_t instance.
+ * \param source The source of the probes.
+ * \param destination The destination of the probes.
+ * \param ttl The TTL at which the interface is reached.
+ * \param interface The interface.
+ * \param pflow_ids Address of a pointer set to the corresponding flows
+ *    (valid until the next topology_cache_add call).
+ * \return The number of flows.
+ */
+
+size_t topology_cache_get_flow_ids(
+    const topology_cache_t * topology_cache,
+    const address_t        * source,
+    const address_t        * destination,
+    uint8_t                  ttl,
+    const address_t        * interface,
+    const uint16_t        ** pflow_ids
+);
+
+/**
+ * \brief Retrieve the number of hops stored in a topology_cache_t instance.
+ * \param topology_cache A topology_cache_t instance.
+ * \return The number of hops.
+ */
+
+size_t topology_cache_get_num_hops(const topology_cache_t * topology_cache);
+
+/**
+ * \brief Write the hops of a topology_cache_t instance in a file.
+ * \param topology_cache A topology_cache_t instance.
+ * \param filename The path of the file (overwritten if it exists).
+ * \return true iif successful.
+ */
+
+bool topology_cache_save(const topology_cache_t * topology_cache, const char * filename);
+
+/**
+ * \brief Add the hops stored in a file (see topology_cache_save) to a
+ *    topology_cache_t instance. Hops whose prefix length differs from
+ *    the one of the topology_cache_t instance are ignored.
+ * \param topology_cache A topology_cache_t instance.
+ * \param filename The path of the file.
+ * \return true iif successful.
+ */
+
+bool topology_cache_load(topology_cache_t * topology_cache, const char * filename);
+
+#endif // LIBPT_TOPOLOGY_CACHE_H
@@ -0,0 +1,877 @@
+#include "config.h"
+
+#include <errno.h>              // errno, ENOSYS
+#include <stdlib.h>             // calloc, free
+
+#include "uring.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <stdint.h>             // uint64_t
+#include <stdio.h>              // fprintf
+#include <string.h>             // memcpy, memset, strerror
+#include <unistd.h>             // close, syscall
+#include <poll.h>               // POLLIN
+#include <sys/mman.h>           // mmap, munmap
+#include <sys/syscall.h>        // __NR_io_uring_setup, __NR_io_uring_enter, __NR_io_uring_register
+#include <linux/io_uring.h>     // struct io_uring_params, struct io_uring_sqe, struct io_uring_cqe
+#include <linux/time_types.h>   // struct __kernel_timespec
+
+#include "common.h"             // MIN
+
+// Multishot receives and provided buffer rings appeared in Linux 6.0
+#ifdef IORING_RECV_MULTISHOT
+#  define URING_USE_BUFFER_RING
+#endif
+
+#define URING_BUFFER_GROUP 0
+
+/**
+ * The user_data of a request stores its type in its lowest bits, and
+ * either a pointer (URING_SEND) or a value and a generation (see
+ * uring_make_user_data).
+ */
+
+typedef enum {
+    URING_POLL,      /**< IORING_OP_POLL_ADD, re-armed by uring_wait */
+    URING_POLL_ONCE, /**< IORING_OP_POLL_ADD */
+    URING_RECV,      /**< Multishot IORING_OP_RECVMSG (value: index of the receiver) */
+    URING_SEND,      /**< IORING_OP_SENDMSG (pointer: the uring_send_t) */
+    URING_TIMER,     /**< IORING_OP_TIMEOUT (value: id of the timer) */
+    URING_CANCEL     /**< IORING_OP_TIMEOUT_REMOVE (its completion is ignored) */
+} uring_request_t;
+
+#define URING_REQUEST_BITS 3
+#define URING_REQUEST_MASK ((UINT64_C(1) << URING_REQUEST_BITS) - 1)
+#define URING_GENERATION_SHIFT (32 + URING_REQUEST_BITS)
+#define URING_GENERATION_MASK  ((UINT32_C(1) << (64 - URING_GENERATION_SHIFT)) - 1)
+
+typedef struct {
+    int                       fd;         /**< Socket read by the multishot receive */
+    struct msghdr             msg;        /**< Sizes of the source address and of the ancillary data of the datagrams */
+    uring_recv_callback_t     callback;   /**< Function called for each datagram */
+    void                    * data;       /**< Data passed to callback */
+} uring_receiver_t;
+
+typedef struct {
+    int                       id;         /**< Identifier of the timer */
+    uint32_t                  generation; /**< Incremented whenever the timer is re-armed, so that a former expiration is ignored */
+    bool                      is_armed;   /**< True iif an IORING_OP_TIMEOUT request is pending */
+    struct __kernel_timespec  delay;      /**< Delay of the pending request */
+} uring_timer_t;
+
+typedef struct {
+    struct msghdr             msg;        /**< Message passed to IORING_OP_SENDMSG */
+    struct iovec              iov;        /**< Bytes of the datagram */
+    struct sockaddr_storage   dst_addr;   /**< Destination of the datagram */
+    uint8_t                   bytes[];    /**< Copy of the datagram */
+} uring_send_t;
+
+struct uring_s {
+    int                       fd;            /**< File descriptor returned by io_uring_setup */
+    void                    * sq_ring;       /**< Mapped submission ring */
+    size_t                    sq_ring_size;  /**< Size of the mapped submission ring */
+    void                    * cq_ring;       /**< Mapped completion ring (equals sq_ring if IORING_FEAT_SINGLE_MMAP) */
+    size_t                    cq_ring_size;  /**< Size of the mapped completion ring */
+    struct io_uring_sqe     * sqes;          /**< Mapped submission queue entries */
+    size_t                    sqes_size;     /**< Size of the mapped submission queue entries */
+    unsigned                * sq_head;       /**< Head of the submission ring (updated by the kernel) */
+    unsigned                * sq_tail;       /**< Tail of the submission ring (updated by uring_t) */
+    unsigned                * sq_array;      /**< Indexes of the submitted entries */
+    unsigned                  sq_mask;       /**< Mask applied to a position in the submission ring */
+    unsigned                  sq_entries;    /**< Number of entries of the submission ring */
+    unsigned                * cq_head;       /**< Head of the completion ring (updated by uring_t) */
+    unsigned                * cq_tail;       /**< Tail of the completion ring (updated by the kernel) */
+    struct io_uring_cqe     * cqes;          /**< Completion queue entries */
+    unsigned                  cq_mask;       /**< Mask applied to a position in the completion ring */
+    unsigned                  num_to_submit; /**< Number of queued requests not yet submitted to the kernel */
+
+#ifdef URING_USE_BUFFER_RING
+    struct io_uring_buf_ring * buffer_ring;  /**< Ring of the buffers provided to the multishot receives */
+    uint16_t                  buffer_tail;   /**< Tail of buffer_ring */
+#endif
+    uint8_t                 * buffers;       /**< URING_NUM_BUFFERS buffers of URING_BUFFER_SIZE bytes (NULL if unsupported) */
+    uring_receiver_t          receivers[URING_MAX_RECEIVERS];
+    size_t                    num_receivers;
+    uring_timer_t             timers[URING_MAX_TIMERS];
+    size_t                    num_timers;
+    size_t                    num_sends_in_flight; /**< Number of uring_send_t not yet completed */
+
+    // Statistics
+    size_t                    num_enters;    /**< Number of io_uring_enter() calls */
+    size_t                    num_received;  /**< Number of datagrams received by multishot receives */
+    size_t                    num_sent;      /**< Number of datagrams sent by uring_sendto */
+};
+
+//---------------------------------------------------------------------------
+// Private functions
+//---------------------------------------------------------------------------
+
+static inline int sys_io_uring_setup(unsigned num_entries, struct io_uring_params * params) {
+    return (int) syscall(__NR_io_uring_setup, num_entries, params);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+#ifdef URING_USE_BUFFER_RING
+static inline int sys_io_uring_register(int fd, unsigned opcode, void * arg, unsigned num_args) {
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, num_args);
+}
+#endif
+
+static inline uint64_t uring_make_user_data(uring_request_t request, uint32_t value, uint32_t generation) {
+    return (uint64_t) request
+        | ((uint64_t) value << URING_REQUEST_BITS)
+        | ((uint64_t) generation << URING_GENERATION_SHIFT);
+}
+
+static inline uring_request_t uring_get_request(uint64_t user_data) {
+    return (uring_request_t) (user_data & URING_REQUEST_MASK);
+}
+
+static inline uint32_t uring_get_value(uint64_t user_data) {
+    return (uint32_t) (user_data >> URING_REQUEST_BITS);
+}
+
+static inline uint32_t uring_get_generation(uint64_t user_data) {
+    return (uint32_t) (user_data >> URING_GENERATION_SHIFT);
+}
+
+/**
+ * \brief Pass to the kernel every queued request (if any) and wait
+ *    for min_complete completions.
+ * \param uring A uring_t instance.
+ * \param min_complete The number of completions to wait for.
+ * \return true iif successful.
+ */
+
+static bool uring_enter(uring_t * uring, unsigned min_complete) {
+    int ret;
+
+    ret = sys_io_uring_enter(
+        uring->fd, uring->num_to_submit, min_complete,
+        min_complete ? IORING_ENTER_GETEVENTS : 0
+    );
+    uring->num_enters++;
+
+    // Even if the call has been interrupted, some requests may have been
+    // consumed: the kernel moves sq_head accordingly.
+    uring->num_to_submit = *uring->sq_tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+    return ret != -1;
+}
+
+/**
+ * \brief Retrieve the next free submission queue entry.
+ * \param uring A uring_t instance.
+ * \return The cleared entry, NULL if the submission ring is full.
+ */
+
+static struct io_uring_sqe * uring_get_sqe(uring_t * uring) {
+    struct io_uring_sqe * sqe;
+    unsigned              index, tail = *uring->sq_tail;
+
+    // If the submission ring is full, submit queued requests to make room.
+    if (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) == uring->sq_entries) {
+        if (!uring_enter(uring, 0)) return NULL;
+        if (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) == uring->sq_entries) {
+            errno = EBUSY;
+            return NULL;
+        }
+    }
+
+    index = tail & uring->sq_mask;
+    sqe = &uring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    uring->sq_array[index] = index;
+    return sqe;
+}
+
+/**
+ * \brief Queue the submission queue entry returned by the last
+ *    uring_get_sqe() call. It will be submitted by the next uring_enter().
+ * \param uring A uring_t instance.
+ */
+
+static inline void uring_queue_sqe(uring_t * uring) {
+    __atomic_store_n(uring->sq_tail, *uring->sq_tail + 1, __ATOMIC_RELEASE);
+    uring->num_to_submit++;
+}
+
+/**
+ * \brief Queue a IORING_OP_POLL_ADD request.
+ * \param uring A uring_t instance.
+ * \param fd The watched file descriptor.
+ * \param poll_events The awaited events (POLLIN, POLLOUT...).
+ * \param is_once Pass true if uring_wait() must not re-arm this request.
+ * \return true iif successful.
+ */
+
+static bool uring_poll_add_impl(uring_t * uring, int fd, uint32_t poll_events, bool is_once) {
+    struct io_uring_sqe * sqe;
+
+    if (fd == -1) {
+        errno = EBADF;
+        return false;
+    }
+
+    if (!(sqe = uring_get_sqe(uring))) return false;
+
+#ifdef WORDS_BIGENDIAN
+    // The kernel reads poll32_events as two swapped 16-bit halves
+    poll_events = (poll_events << 16) | (poll_events >> 16);
+#endif
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = fd;
+    sqe->poll32_events = poll_events;
+    sqe->user_data     = uring_make_user_data(is_once ? URING_POLL_ONCE : URING_POLL, (uint32_t) fd, 0);
+    uring_queue_sqe(uring);
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// Multishot receives (internal usage)
+//---------------------------------------------------------------------------
+
+#ifdef URING_USE_BUFFER_RING
+
+/**
+ * \brief Give back a buffer to the kernel.
+ * \param uring A uring_t instance.
+ * \param bid The identifier of the buffer.
+ */
+
+static void uring_recycle_buffer(uring_t * uring, uint16_t bid) {
+    struct io_uring_buf * buf;
+
+    // The tail of the ring overlays the reserved field of the first
+    // entry: the other fields are set one by one.
+    buf = &uring->buffer_ring->bufs[uring->buffer_tail & (URING_NUM_BUFFERS - 1)];
+    buf->addr = (uint64_t) (uintptr_t) (uring->buffers + (size_t) bid * URING_BUFFER_SIZE);
+    buf->len  = URING_BUFFER_SIZE;
+    buf->bid  = bid;
+    __atomic_store_n(&uring->buffer_ring->tail, ++uring->buffer_tail, __ATOMIC_RELEASE);
+}
+
+#endif // URING_USE_BUFFER_RING
+
+/**
+ * \brief Prepare the buffers provided to the multishot receives.
+ * \param uring A uring_t instance.
+ * \return true iif successful (errno is set to ENOSYS if not supported).
+ */
+
+static bool uring_create_buffers(uring_t * uring) {
+#ifdef URING_USE_BUFFER_RING
+    struct io_uring_buf_reg reg;
+    uint16_t                bid;
+
+    // The ring must be page-aligned
+    uring->buffer_ring = mmap(
+        NULL, URING_NUM_BUFFERS * sizeof(struct io_uring_buf),
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+    );
+    if (uring->buffer_ring == MAP_FAILED) goto ERR_MMAP_BUFFER_RING;
+    if (!(uring->buffers = malloc(URING_NUM_BUFFERS * URING_BUFFER_SIZE))) goto ERR_BUFFERS;
+
+    memset(&reg, 0, sizeof(struct io_uring_buf_reg));
+    reg.ring_addr    = (uint64_t) (uintptr_t) uring->buffer_ring;
+    reg.ring_entries = URING_NUM_BUFFERS;
+    reg.bgid         = URING_BUFFER_GROUP;
+    if (sys_io_uring_register(uring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        goto ERR_REGISTER_PBUF_RING;
+    }
+
+    uring->buffer_tail = 0;
+    for (bid = 0; bid < URING_NUM_BUFFERS; bid++) {
+        uring_recycle_buffer(uring, bid);
+    }
+    return true;
+
+ERR_REGISTER_PBUF_RING:
+    free(uring->buffers);
+    uring->buffers = NULL;
+ERR_BUFFERS:
+    munmap(uring->buffer_ring, URING_NUM_BUFFERS * sizeof(struct io_uring_buf));
+ERR_MMAP_BUFFER_RING:
+    uring->buffer_ring = NULL;
+    errno = ENOSYS;
+    return false;
+#else
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
+/**
+ * \brief Release the buffers provided to the multishot receives.
+ *    The ring must be closed beforehand.
+ * \param uring A uring_t instance.
+ */
+
+static void uring_free_buffers(uring_t * uring) {
+#ifdef URING_USE_BUFFER_RING
+    if (uring->buffers) {
+        free(uring->buffers);
+        munmap(uring->buffer_ring, URING_NUM_BUFFERS * sizeof(struct io_uring_buf));
+    }
+#endif
+}
+
+#ifdef URING_USE_BUFFER_RING
+
+/**
+ * \brief Queue the multishot receive of a receiver.
+ * \param uring A uring_t instance.
+ * \param index The index of the receiver in uring->receivers.
+ * \return true iif successful.
+ */
+
+static bool uring_queue_recvmsg(uring_t * uring, size_t index) {
+    struct io_uring_sqe * sqe;
+
+    if (!(sqe = uring_get_sqe(uring))) return false;
+
+    sqe->opcode    = IORING_OP_RECVMSG;
+    sqe->fd        = uring->receivers[index].fd;
+    sqe->addr      = (uint64_t) (uintptr_t) &uring->receivers[index].msg;
+    sqe->len       = 1;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = uring_make_user_data(URING_RECV, (uint32_t) index, 0);
+    uring_queue_sqe(uring);
+    return true;
+}
+
+/**
+ * \brief Pass a datagram written in a provided buffer to its callback.
+ * \param uring A uring_t instance.
+ * \param receiver The receiver of the datagram.
+ * \param buffer The buffer filled by the kernel: a struct
+ *    io_uring_recvmsg_out, followed by the source address, the ancillary
+ *    data and the datagram.
+ * \param size The number of bytes written in the buffer.
+ */
+
+static void uring_deliver_datagram(uring_t * uring, uring_receiver_t * receiver, uint8_t * buffer, size_t size) {
+    struct io_uring_recvmsg_out * out = (struct io_uring_recvmsg_out *) buffer;
+    uint8_t                     * name    = buffer + sizeof(struct io_uring_recvmsg_out),
+                                * control = name + receiver->msg.msg_namelen,
+                                * payload = control + receiver->msg.msg_controllen;
+    struct iovec                  iov;
+    struct msghdr                 msg;
+
+    if (size < (size_t) (payload - buffer)) return;
+
+    // Rebuild the message that recvmsg() would have returned
+    iov.iov_base       = payload;
+    iov.iov_len        = buffer + size - payload;
+    msg.msg_name       = out->namelen ? name : NULL;
+    msg.msg_namelen    = MIN(out->namelen, receiver->msg.msg_namelen);
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = MIN(out->controllen, receiver->msg.msg_controllen);
+    msg.msg_flags      = out->flags;
+
+    uring->num_received++;
+    receiver->callback(receiver->fd, &msg, iov.iov_len, receiver->data);
+}
+
+#endif // URING_USE_BUFFER_RING
+
+//---------------------------------------------------------------------------
+// Completions (internal usage)
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Process the completion of a IORING_OP_POLL_ADD request.
+ * \param uring A uring_t instance.
+ * \param cqe The completion.
+ * \param event The ready file descriptor.
+ * \return true (the file descriptor is always reported).
+ */
+
+static bool uring_process_poll(uring_t * uring, const struct io_uring_cqe * cqe, struct epoll_event * event) {
+    int fd = (int) uring_get_value(cqe->user_data);
+
+    // On Linux, POLL* and EPOLL* flags share the same values.
+    event->data.fd = fd;
+    event->events  = cqe->res < 0 ? EPOLLERR : (uint32_t) cqe->res;
+
+    // Requests are one-shot: watch again this file descriptor unless it
+    // is in error (pt_loop closes such file descriptors) or has been
+    // watched thanks to uring_poll_add_once().
+    if (uring_get_request(cqe->user_data) == URING_POLL && !(event->events & (EPOLLERR | EPOLLHUP))) {
+        uring_poll_add(uring, fd);
+    }
+    return true;
+}
+
+/**
+ * \brief Process the completion of a multishot receive.
+ * \param uring A uring_t instance.
+ * \param cqe The completion.
+ * \param event The socket, if it must be reported.
+ * \return true iif the socket is in error and must be reported.
+ */
+
+static bool uring_process_recv(uring_t * uring, const struct io_uring_cqe * cqe, struct epoll_event * event) {
+#ifdef URING_USE_BUFFER_RING
+    size_t             index    = uring_get_value(cqe->user_data);
+    uring_receiver_t * receiver = &uring->receivers[index];
+    uint16_t           bid;
+
+    if (cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+        bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        uring_deliver_datagram(uring, receiver, uring->buffers + (size_t) bid * URING_BUFFER_SIZE, cqe->res);
+        uring_recycle_buffer(uring, bid);
+    }
+
+    // The receive goes on
+    if (cqe->flags & IORING_CQE_F_MORE) return false;
+
+    if (cqe->res >= 0 || cqe->res == -ENOBUFS) {
+        // The receive has stopped since no buffer was available (they
+        // have been given back meanwhile) or the completion ring was full.
+        if (uring_queue_recvmsg(uring, index)) return false;
+    } else if (cqe->res == -EINVAL) {
+        // The running kernel does not support multishot receives: the
+        // socket is read by the caller once it is ready.
+        if (uring_poll_add(uring, receiver->fd)) return false;
+    }
+
+    event->data.fd = receiver->fd;
+    event->events  = EPOLLERR;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * \brief Process the completion of a IORING_OP_SENDMSG request.
+ * \param uring A uring_t instance.
+ * \param cqe The completion.
+ */
+
+static void uring_process_send(uring_t * uring, const struct io_uring_cqe * cqe) {
+    uring_send_t * send = (uring_send_t *) (uintptr_t) (cqe->user_data & ~URING_REQUEST_MASK);
+
+    if (cqe->res < 0) {
+        fprintf(stderr, "uring_sendto: Sending error: %s\n", strerror(-cqe->res));
+    } else {
+        uring->num_sent++;
+    }
+    free(send);
+    uring->num_sends_in_flight--;
+}
+
+/**
+ * \brief Retrieve the timer having a given identifier.
+ * \param uring A uring_t instance.
+ * \param id The identifier of the timer.
+ * \param is_created Pass true to create the timer if it does not exist.
+ * \return The corresponding timer, NULL if not found.
+ */
+
+static uring_timer_t * uring_get_timer(uring_t * uring, int id, bool is_created) {
+    uring_timer_t * timer;
+    size_t          i;
+
+    for (i = 0; i < uring->num_timers; i++) {
+        if (uring->timers[i].id == id) return &uring->timers[i];
+    }
+
+    if (!is_created || uring->num_timers == URING_MAX_TIMERS) {
+        errno = ENOSPC;
+        return NULL;
+    }
+
+    timer = &uring->timers[uring->num_timers++];
+    memset(timer, 0, sizeof(uring_timer_t));
+    timer->id = id;
+    return timer;
+}
+
+static inline uint64_t uring_timer_get_user_data(const uring_timer_t * timer) {
+    return uring_make_user_data(URING_TIMER, (uint32_t) timer->id, timer->generation);
+}
+
+/**
+ * \brief Process the completion of a IORING_OP_TIMEOUT request.
+ * \param uring A uring_t instance.
+ * \param cqe The completion.
+ * \param event The expired timer.
+ * \return true iif the timer has expired and has not been re-armed since.
+ */
+
+static bool uring_process_timer(uring_t * uring, const struct io_uring_cqe * cqe, struct epoll_event * event) {
+    uring_timer_t * timer;
+
+    // The request has been cancelled, or replaced by a newer one
+    if (cqe->res == -ECANCELED) return false;
+    if (!(timer = uring_get_timer(uring, (int) uring_get_value(cqe->user_data), false))) return false;
+    if (!timer->is_armed || timer->generation != uring_get_generation(cqe->user_data)) return false;
+
+    // -ETIME means that the timer has expired. Other errors are reported
+    // as an expiration as well, so that the owner of the timer re-arms it.
+    timer->is_armed = false;
+    event->data.fd  = timer->id;
+    event->events   = EPOLLIN;
+    return true;
+}
+
+/**
+ * \brief Process a completion.
+ * \param uring A uring_t instance.
+ * \param cqe The completion.
+ * \param event The ready file descriptor, if any.
+ * \return true iif a file descriptor has been written in event.
+ */
+
+static bool uring_process_cqe(uring_t * uring, const struct io_uring_cqe * cqe, struct epoll_event * event) {
+    switch (uring_get_request(cqe->user_data)) {
+        case URING_POLL:
+        case URING_POLL_ONCE:
+            return uring_process_poll(uring, cqe, event);
+        case URING_RECV:
+            return uring_process_recv(uring, cqe, event);
+        case URING_SEND:
+            uring_process_send(uring, cqe);
+            break;
+        case URING_TIMER:
+            return uring_process_timer(uring, cqe, event);
+        default:
+            break;
+    }
+    return false;
+}
+
+/**
+ * \brief Submit the queued requests and wait for the packets in flight,
+ *    which refer to memory owned by the uring_t. Other completions are
+ *    ignored.
+ * \param uring A uring_t instance.
+ */
+
+static void uring_drain(uring_t * uring) {
+    struct io_uring_cqe * cqe;
+    unsigned              head, tail;
+
+    while (uring->num_to_submit > 0 || uring->num_sends_in_flight > 0) {
+        if (!uring_enter(uring, uring->num_sends_in_flight ? 1 : 0) && errno != EINTR && errno != EBUSY) {
+            perror("uring_drain");
+            break;
+        }
+
+        head = *uring->cq_head;
+        tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            cqe = &uring->cqes[head & uring->cq_mask];
+            if (uring_get_request(cqe->user_data) == URING_SEND) {
+                uring_process_send(uring, cqe);
+            }
+        }
+        __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Public functions
+//---------------------------------------------------------------------------
+
+uring_t * uring_create(unsigned num_entries) {
+    uring_t                * uring;
+    struct io_uring_params   params;
+
+    if (!(uring = calloc(1, sizeof(uring_t)))) goto ERR_MALLOC;
+
+    memset(&params, 0, sizeof(struct io_uring_params));
+    if ((uring->fd = sys_io_uring_setup(num_entries, &params)) == -1) {
+        goto ERR_IO_URING_SETUP;
+    }
+
+    // Map the rings
+    uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = params.cq_off.cqes  + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (uring->cq_ring_size > uring->sq_ring_size) uring->sq_ring_size = uring->cq_ring_size;
+        uring->cq_ring_size = uring->sq_ring_size;
+    }
+
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+    if (uring->sq_ring == MAP_FAILED) goto ERR_MMAP_SQ_RING;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        uring->cq_ring = uring->sq_ring;
+    } else {
+        uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING);
+        if (uring->cq_ring == MAP_FAILED) goto ERR_MMAP_CQ_RING;
+    }
+
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED) goto ERR_MMAP_SQES;
+
+    uring->sq_head       = (unsigned *) ((char *) uring->sq_ring + params.sq_off.head);
+    uring->sq_tail       = (unsigned *) ((char *) uring->sq_ring + params.sq_off.tail);
+    uring->sq_array      = (unsigned *) ((char *) uring->sq_ring + params.sq_off.array);
+    uring->sq_mask       = *(unsigned *) ((char *) uring->sq_ring + params.sq_off.ring_mask);
+    uring->sq_entries    = params.sq_entries;
+    uring->cq_head       = (unsigned *) ((char *) uring->cq_ring + params.cq_off.head);
+    uring->cq_tail       = (unsigned *) ((char *) uring->cq_ring + params.cq_off.tail);
+    uring->cqes          = (struct io_uring_cqe *) ((char *) uring->cq_ring + params.cq_off.cqes);
+    uring->cq_mask       = *(unsigned *) ((char *) uring->cq_ring + params.cq_off.ring_mask);
+    uring->num_to_submit = 0;
+
+    // Without provided buffers (Linux < 5.19), sockets are polled instead
+    // (see uring_recvmsg_multishot).
+    uring_create_buffers(uring);
+    return uring;
+
+ERR_MMAP_SQES:
+    if (uring->cq_ring != uring->sq_ring) munmap(uring->cq_ring, uring->cq_ring_size);
+ERR_MMAP_CQ_RING:
+    munmap(uring->sq_ring, uring->sq_ring_size);
+ERR_MMAP_SQ_RING:
+    close(uring->fd);
+ERR_IO_URING_SETUP:
+    free(uring);
+ERR_MALLOC:
+    return NULL;
+}
+
+void uring_free(uring_t * uring) {
+    if (uring) {
+        uring_drain(uring);
+        munmap(uring->sqes, uring->sqes_size);
+        if (uring->cq_ring != uring->sq_ring) munmap(uring->cq_ring, uring->cq_ring_size);
+        munmap(uring->sq_ring, uring->sq_ring_size);
+        close(uring->fd);
+        uring_free_buffers(uring);
+        free(uring);
+    }
+}
+
+bool uring_poll_add(uring_t * uring, int fd) {
+    return uring_poll_add_impl(uring, fd, POLLIN, false);
+}
+
+bool uring_poll_add_once(uring_t * uring, int fd, uint32_t events) {
+    return uring_poll_add_impl(uring, fd, events, true);
+}
+
+bool uring_recvmsg_multishot(uring_t * uring, int fd, uring_recv_callback_t callback, void * data) {
+#ifdef URING_USE_BUFFER_RING
+    uring_receiver_t * receiver;
+
+    if (!uring->buffers) {
+        errno = ENOSYS;
+        return false;
+    }
+
+    if (fd == -1) {
+        errno = EBADF;
+        return false;
+    }
+
+    if (uring->num_receivers == URING_MAX_RECEIVERS) {
+        errno = ENOSPC;
+        return false;
+    }
+
+    // Only the sizes of the source address and of the ancillary data
+    // matter: the kernel reserves this room at the beginning of each buffer.
+    receiver = &uring->receivers[uring->num_receivers];
+    memset(receiver, 0, sizeof(uring_receiver_t));
+    receiver->fd                 = fd;
+    receiver->msg.msg_namelen    = sizeof(struct sockaddr_storage);
+    receiver->msg.msg_controllen = URING_CONTROL_SIZE;
+    receiver->callback           = callback;
+    receiver->data               = data;
+
+    if (!uring_queue_recvmsg(uring, uring->num_receivers)) return false;
+    uring->num_receivers++;
+    return true;
+#else
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
+bool uring_sendto(
+    uring_t               * uring,
+    int                     fd,
+    const void            * bytes,
+    size_t                  num_bytes,
+    const struct sockaddr * dst_addr,
+    socklen_t               socklen
+) {
+    struct io_uring_sqe * sqe;
+    uring_send_t        * send;
+
+    if (socklen > sizeof(struct sockaddr_storage)) {
+        errno = EINVAL;
+        goto ERR_SOCKLEN;
+    }
+
+    // The datagram must remain valid until the request completes
+    if (!(send = malloc(sizeof(uring_send_t) + num_bytes))) goto ERR_MALLOC;
+    memcpy(send->bytes, bytes, num_bytes);
+    memcpy(&send->dst_addr, dst_addr, socklen);
+    memset(&send->msg, 0, sizeof(struct msghdr));
+    send->iov.iov_base    = send->bytes;
+    send->iov.iov_len     = num_bytes;
+    send->msg.msg_name    = &send->dst_addr;
+    send->msg.msg_namelen = socklen;
+    send->msg.msg_iov     = &send->iov;
+    send->msg.msg_iovlen  = 1;
+
+    if (!(sqe = uring_get_sqe(uring))) goto ERR_GET_SQE;
+    sqe->opcode    = IORING_OP_SENDMSG;
+    sqe->fd        = fd;
+    sqe->addr      = (uint64_t) (uintptr_t) &send->msg;
+    sqe->len       = 1;
+    sqe->user_data = (uint64_t) (uintptr_t) send | URING_SEND;
+    uring_queue_sqe(uring);
+    uring->num_sends_in_flight++;
+    return true;
+
+ERR_GET_SQE:
+    free(send);
+ERR_MALLOC:
+ERR_SOCKLEN:
+    return false;
+}
+
+bool uring_set_timer(uring_t * uring, int id, double delay) {
+    struct io_uring_sqe * sqe;
+    uring_timer_t       * timer;
+
+    if (!(timer = uring_get_timer(uring, id, true))) return false;
+
+    // Cancel the pending request. If it has already expired, its
+    // completion is ignored anyway since it refers to a former generation.
+    if (timer->is_armed) {
+        if (!(sqe = uring_get_sqe(uring))) return false;
+        sqe->opcode    = IORING_OP_TIMEOUT_REMOVE;
+        sqe->fd        = -1;
+        sqe->addr      = uring_timer_get_user_data(timer);
+        sqe->user_data = uring_make_user_data(URING_CANCEL, 0, 0);
+        uring_queue_sqe(uring);
+        timer->is_armed = false;
+    }
+    timer->generation = (timer->generation + 1) & URING_GENERATION_MASK;
+
+    if (delay <= 0) return true;
+
+    // The kernel reads the delay once the request is submitted
+    timer->delay.tv_sec  = (long long) delay;
+    timer->delay.tv_nsec = (long long) ((delay - timer->delay.tv_sec) * 1000000000);
+
+    // A timeout which does not wait for any completion is a pure timer
+    if (!(sqe = uring_get_sqe(uring))) return false;
+    sqe->opcode    = IORING_OP_TIMEOUT;
+    sqe->fd        = -1;
+    sqe->addr      = (uint64_t) (uintptr_t) &timer->delay;
+    sqe->len       = 1;
+    sqe->off       = 0;
+    sqe->user_data = uring_timer_get_user_data(timer);
+    uring_queue_sqe(uring);
+    timer->is_armed = true;
+    return true;
+}
+
+bool uring_submit(uring_t * uring) {
+    return uring->num_to_submit == 0 || uring_enter(uring, 0);
+}
+
+int uring_wait(uring_t * uring, struct epoll_event * events, int max_events) {
+    unsigned head, tail;
+    int      n = 0;
+
+    // Submit the queued requests, and wait only if no completion is available.
+    head = *uring->cq_head;
+    tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail || uring->num_to_submit > 0) {
+        if (!uring_enter(uring, head == tail ? 1 : 0)) return -1;
+        tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+    }
+
+    // Each completion reports at most one file descriptor
+    for (; head != tail && n < max_events; head++) {
+        if (uring_process_cqe(uring, &uring->cqes[head & uring->cq_mask], &events[n])) n++;
+    }
+
+    __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+void uring_dump_stats(const uring_t * uring) {
+    fprintf(stderr,
+        "uring: %zu io_uring_enter calls, %zu datagrams received, %zu packets sent\n",
+        uring->num_enters,
+        uring->num_received,
+        uring->num_sent
+    );
+}
+
+#else // HAVE_LINUX_IO_URING_H
+
+uring_t * uring_create(unsigned num_entries) {
+    errno = ENOSYS;
+    return NULL;
+}
+
+void uring_free(uring_t * uring) {
+}
+
+bool uring_poll_add(uring_t * uring, int fd) {
+    errno = ENOSYS;
+    return false;
+}
+
+bool uring_poll_add_once(uring_t * uring, int fd, uint32_t events) {
+    errno = ENOSYS;
+    return false;
+}
+
+bool uring_recvmsg_multishot(uring_t * uring, int fd, uring_recv_callback_t callback, void * data) {
+    errno = ENOSYS;
+    return false;
+}
+
+bool uring_sendto(
+    uring_t               * uring,
+    int                     fd,
+    const void            * bytes,
+    size_t                  num_bytes,
+    const struct sockaddr * dst_addr,
+    socklen_t               socklen
+) {
+    errno = ENOSYS;
+    return false;
+}
+
+bool uring_set_timer(uring_t * uring, int id, double delay) {
+    errno = ENOSYS;
+    return false;
+}
+
+bool uring_submit(uring_t * uring) {
+    errno = ENOSYS;
+    return false;
+}
+
+int uring_wait(uring_t * uring, struct epoll_event * events, int max_events) {
+    errno = ENOSYS;
+    return -1;
+}
+
+void uring_dump_stats(const uring_t * uring) {
+}
+
+#endif // HAVE_LINUX_IO_URING_H
@@ -0,0 +1,176 @@
+#ifndef LIBPT_URING_H
+#define LIBPT_URING_H
+
+/**
+ * \file uring.h
+ * \brief Minimal io_uring wrapper used by the io_uring backend of pt_loop.
+ *
+ * The uring_t reports the ready file descriptors the same way epoll_wait()
+ * does, so that pt_loop dispatches events identically whatever the backend.
+ * Besides, it moves the hot path of the network layer into the ring:
+ *
+ * - Sockets are read thanks to multishot IORING_OP_RECVMSG requests, which
+ *   write the received datagrams in a ring of buffers provided to the
+ *   kernel. Each datagram is passed to a callback (see uring_recvmsg_multishot).
+ * - Packets are sent thanks to IORING_OP_SENDMSG requests (see uring_sendto).
+ * - Timers are IORING_OP_TIMEOUT requests (see uring_set_timer).
+ * - Other file descriptors are polled (IORING_OP_POLL_ADD) in one-shot mode,
+ *   and automatically re-armed by uring_wait().
+ *
+ * Requests are queued and submitted along with the next wait (or by
+ * uring_submit), so a single io_uring_enter() system call both submits
+ * every pending request and harvests every completion, whatever the
+ * number of packets sent or received in the meantime.
+ *
+ * If the kernel headers do not provide io_uring, uring_create() fails
+ * with errno set to ENOSYS.
+ */
+
+#include <stdbool.h>        // bool
+#include <stddef.h>         // size_t
+#include <stdint.h>         // uint32_t
+#include <sys/socket.h>     // struct msghdr, struct sockaddr, socklen_t
+
+#include "os/sys/epoll.h"   // struct epoll_event
+
+#define URING_NUM_BUFFERS   128  /**< Number of buffers provided to the multishot receives (a power of 2) */
+#define URING_BUFFER_SIZE   8192 /**< Size of a provided buffer (header, source address, ancillary data and datagram) */
+#define URING_CONTROL_SIZE  1024 /**< Room reserved for the ancillary data of a received datagram */
+#define URING_MAX_RECEIVERS 4    /**< Maximum number of sockets read thanks to uring_recvmsg_multishot */
+#define URING_MAX_TIMERS    8    /**< Maximum number of timers managed thanks to uring_set_timer */
+
+typedef struct uring_s uring_t;
+
+/**
+ * \brief Function called for each datagram received by a multishot receive.
+ * \param fd The socket which has received the datagram.
+ * \param msg The datagram, as returned by recvmsg(): its source address,
+ *    its ancillary data, its flags and its bytes (msg->msg_iov[0]). It is
+ *    only valid until the callback returns.
+ * \param num_bytes The number of bytes of the datagram.
+ * \param data The data passed to uring_recvmsg_multishot.
+ */
+
+typedef void (* uring_recv_callback_t)(int fd, struct msghdr * msg, size_t num_bytes, void * data);
+
+/**
+ * \brief Create a uring_t instance.
+ * \param num_entries The size of the submission queue. It should be at
+ *    least equal to the number of watched file descriptors. A larger queue
+ *    allows to send more packets per io_uring_enter() call.
+ * \return The newly created uring_t instance, NULL otherwise.
+ */
+
+uring_t * uring_create(unsigned num_entries);
+
+/**
+ * \brief Release a uring_t instance from the memory. The packets queued
+ *    by uring_sendto are sent beforehand.
+ * \param uring A uring_t instance.
+ */
+
+void uring_free(uring_t * uring);
+
+/**
+ * \brief Watch a file descriptor (EPOLLIN) with a uring_t instance.
+ * \param uring A uring_t instance.
+ * \param fd The watched file descriptor.
+ * \return true iif successful.
+ */
+
+bool uring_poll_add(uring_t * uring, int fd);
+
+/**
+ * \brief Watch a file descriptor until it is ready once. Unlike
+ *    uring_poll_add(), the request is not re-armed by uring_wait().
+ * \param uring A uring_t instance.
+ * \param fd The watched file descriptor.
+ * \param events The awaited events (e.g. EPOLLOUT).
+ * \return true iif successful.
+ */
+
+bool uring_poll_add_once(uring_t * uring, int fd, uint32_t events);
+
+/**
+ * \brief Read every datagram received by a socket thanks to a multishot
+ *    receive. uring_wait() calls the callback for each datagram, and never
+ *    reports this socket as ready, unless the running kernel does not
+ *    support multishot receives: the socket is then polled (see
+ *    uring_poll_add) and must be read by the caller.
+ * \param uring A uring_t instance.
+ * \param fd The socket.
+ * \param callback The function called for each received datagram.
+ * \param data The data passed to callback.
+ * \return true iif successful. It fails with errno set to ENOSYS if the
+ *    kernel cannot provide buffers to the ring.
+ */
+
+bool uring_recvmsg_multishot(uring_t * uring, int fd, uring_recv_callback_t callback, void * data);
+
+/**
+ * \brief Queue a datagram to send (see sendto()). The bytes are copied,
+ *    and sent by the next io_uring_enter() call. A sending error is
+ *    reported on stderr once the request completes.
+ * \param uring A uring_t instance.
+ * \param fd The socket used to send the datagram.
+ * \param bytes The bytes of the datagram.
+ * \param num_bytes The number of bytes of the datagram.
+ * \param dst_addr The destination address.
+ * \param socklen The size of dst_addr.
+ * \return true iif successful.
+ */
+
+bool uring_sendto(
+    uring_t               * uring,
+    int                     fd,
+    const void            * bytes,
+    size_t                  num_bytes,
+    const struct sockaddr * dst_addr,
+    socklen_t               socklen
+);
+
+/**
+ * \brief Arm (or disarm) a timer. Once it has expired, uring_wait()
+ *    reports the timer as a ready file descriptor (EPOLLIN), so that
+ *    a timerfd can be replaced by a timer identified by this timerfd.
+ *    Re-arming a timer cancels its previous expiration.
+ * \param uring A uring_t instance.
+ * \param id The identifier of the timer (e.g. a timerfd never armed).
+ * \param delay The delay (in seconds) before the expiration of the
+ *    timer. Pass 0 to disarm the timer.
+ * \return true iif successful.
+ */
+
+bool uring_set_timer(uring_t * uring, int id, double delay);
+
+/**
+ * \brief Submit the pending requests (e.g. the packets queued by
+ *    uring_sendto) without waiting.
+ * \param uring A uring_t instance.
+ * \return true iif successful.
+ */
+
+bool uring_submit(uring_t * uring);
+
+/**
+ * \brief Submit the pending requests and wait until at least one request
+ *    completes. The received datagrams are passed to their callbacks.
+ * \param uring A uring_t instance.
+ * \param events The buffer in which ready file descriptors are written
+ *    (see epoll_wait()).
+ * \param max_events The size of events.
+ * \return The number of ready file descriptors (possibly 0 if only
+ *    datagrams have been received), -1 in case of failure (errno is set
+ *    accordingly).
+ */
+
+int uring_wait(uring_t * uring, struct epoll_event * events, int max_events);
+
+/**
+ * \brief Print the statistics of a uring_t (on stderr).
+ * \param uring A uring_t instance.
+ */
+
+void uring_dump_stats(const uring_t * uring);
+
+#endif // LIBPT_URING_H
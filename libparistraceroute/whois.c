@@ -6,35 +6,120 @@
 #include <errno.h>      // errno
 #include <stdio.h>      // fprintf
 #include <stdlib.h>     // realloc
-#include <string.h>     // memset, memcpy, strlen
+#include <string.h>     // memset, memcpy, strlen, strcmp
+#include <ctype.h>      // isspace
 #include <sys/types.h>  // socket, recv
 #include <sys/socket.h> // socket, recv
 #include <unistd.h>     // close
+#include <arpa/inet.h>  // inet_pton
 
-#ifdef USE_CACHE
-#    include "containers/map.h"
+#include "common.h"         // get_timestamp, MAX
+#include "network.h"        // update_timer_uring
+#include "hole.h"           // hole_t
+#include "asn_index.h"      // asn_index_t
+#include "os/sys/epoll.h"    // EPOLLIN, EPOLLOUT
+#include "os/sys/timerfd.h" // timerfd_create
+
+// A timer expiring in less than WHOIS_TIMER_PRECISION seconds is
+// considered as expired.
+#define WHOIS_TIMER_PRECISION 0.0001
 
-static map_t * cache_ip_asn = NULL;
+#ifdef USE_CACHE
+static address_cache_t * cache_ip_asn = NULL;
 
 static void __cache_ip_asn_create() __attribute__((constructor));
 static void __cache_ip_asn_free()   __attribute__((destructor));
 
-static void str_dump(const char * s) {
-    printf("%s (%p)", s, s);
+static uint32_t * uint32_dup(const uint32_t * x) {
+    uint32_t * y;
+
+    if ((y = malloc(sizeof(uint32_t)))) *y = *x;
+    return y;
+}
+
+static void uint32_fprintf(FILE * out, const uint32_t * x) {
+    fprintf(out, "%u", *x);
+}
+
+static uint32_t * uint32_from_string(const char * s) {
+    uint32_t x;
+
+    return sscanf(s, "%u", &x) == 1 ? uint32_dup(&x) : NULL;
 }
 
 static void __cache_ip_asn_create() {
-    cache_ip_asn = map_create(
-        address_dup, address_free, address_dump, address_compare,
-        strdup,      free,         str_dump
+    cache_ip_asn = address_cache_create(
+        "asn", ADDRESS_CACHE_DEFAULT_CAPACITY, ADDRESS_CACHE_DEFAULT_TTL,
+        uint32_dup, free, uint32_fprintf, uint32_from_string
     );
 }
 
 static void __cache_ip_asn_free() {
-    if (cache_ip_asn) map_free(cache_ip_asn);
+    address_cache_free(cache_ip_asn);
+}
+
+#endif
+
+address_cache_t * whois_get_asn_cache() {
+#ifdef USE_CACHE
+    return cache_ip_asn;
+#else
+    return NULL;
+#endif
+}
+
+// When an index is loaded, ASNs are retrieved offline (see whois_load_asn_index)
+static asn_index_t * s_asn_index = NULL;
+
+static void __asn_index_free() __attribute__((destructor));
+
+static void __asn_index_free() {
+    asn_index_close(s_asn_index);
+}
+
+bool whois_load_asn_index(const char * filename) {
+    asn_index_t * index;
+
+    if (!(index = asn_index_open(filename))) return false;
+    asn_index_close(s_asn_index);
+    s_asn_index = index;
+    return true;
+}
+
+bool whois_has_asn_index() {
+    return s_asn_index != NULL;
+}
+
+/**
+ * \brief Retrieve the ASN of an address from the cache.
+ * \param address The queried address.
+ * \param asn The address of an uint32_t, where the ASN will be written.
+ * \return true iif the ASN has been found.
+ */
+
+static bool whois_get_cached_asn(const address_t * address, uint32_t * asn) {
+#ifdef USE_CACHE
+    const uint32_t * cached_asn;
+
+    if (cache_ip_asn && (cached_asn = address_cache_find(cache_ip_asn, address))) {
+        *asn = *cached_asn;
+        return true;
+    }
+#endif
+    return false;
 }
 
+/**
+ * \brief Store the ASN of an address in the cache.
+ * \param address The queried address.
+ * \param asn The corresponding ASN.
+ */
+
+static void whois_set_cached_asn(const address_t * address, uint32_t asn) {
+#ifdef USE_CACHE
+    if (cache_ip_asn) address_cache_update(cache_ip_asn, address, &asn);
 #endif
+}
 
 bool whois_callback_print(void * pdata, const char * line) {
     FILE * out = (FILE *) pdata;
@@ -241,50 +326,630 @@ bool whois_get_asn(
     uint32_t        * asn,
     int               mask_cache
 ) {
-    bool ret = true;
+    bool ret = false;
 
-	// FIXME
-/*
+    // The index is authoritative: the network is never queried
+    if (s_asn_index) {
+        return asn_index_find(s_asn_index, queried_address, asn);
+    }
 
-	// valgrind error in map
+    if (mask_cache & CACHE_READ) {
+        ret = whois_get_cached_asn(queried_address, asn);
+    }
 
-	address_get_size: Invalid family==6139== Invalid read of size 1
-	==6139==    at 0x4E42696: address_compare (address.c:183)
-	==6139==    by 0x514414F: tfind (in /lib/x86_64-linux-gnu/libc-2.22.so)
-	==6139==    by 0x4E47D39: set_find (set.c:70)
-	==6139==    by 0x4E477A8: map_find_impl (map.c:145)
-	==6139==    by 0x4E521BB: whois_get_asn (whois.c:249)
-	==6139==    by 0x400917: main (traceroute.c:99)
-	==6139==  Address 0xffffffffffffffff is not stack'd, malloc'd or (recently) free'd
-*/
+    if (!ret) {
+        *asn = 0;
+        whois(queried_address, whois_callback_get_asn, asn);
+        ret = (*asn != 0);
+        if (ret && (mask_cache & CACHE_WRITE)) {
+            whois_set_cached_asn(queried_address, *asn);
+        }
+    }
 
-/*
-#ifdef USE_CACHE
-    if (cache_ip_asn && (mask_cache & CACHE_READ)) {
+    return ret;
+}
 
-        address_dump(queried_address);
-		printf("\n");
+//---------------------------------------------------------------------------
+// Lookups (internal usage)
+//---------------------------------------------------------------------------
+
+typedef struct {
+    whois_callback_t   callback;   /**< Function called once the ASN is known */
+    void             * data;       /**< Data passed to callback */
+} whois_waiter_t;
+
+typedef struct {
+    address_t          address;    /**< Queried address */
+    dynarray_t       * waiters;    /**< whois_waiter_t instances */
+} whois_lookup_t;
+
+typedef struct {
+    hole_t           * hole;       /**< Place of the ASN in the output */
+    whois_print_t      print;      /**< Function printing the address and its ASN */
+} whois_printer_t;
+
+static void whois_lookup_free(whois_lookup_t * lookup) {
+    if (lookup) {
+        dynarray_free(lookup->waiters, free);
+        free(lookup);
+    }
+}
 
-        ret = map_find(cache_ip_asn, queried_address, asn);
+static bool whois_lookup_add_waiter(whois_lookup_t * lookup, whois_callback_t callback, void * data) {
+    whois_waiter_t * waiter;
 
-		if (ret) printf("hit cache!");
-        address_dump(queried_address);
-		printf("\n");
+    if (!(waiter = malloc(sizeof(whois_waiter_t)))) return false;
+    waiter->callback = callback;
+    waiter->data     = data;
+    if (!dynarray_push_element(lookup->waiters, waiter)) {
+        free(waiter);
+        return false;
     }
+    return true;
+}
 
-    if (!ret) {
-#endif
-*/
-        whois(queried_address, whois_callback_get_asn, asn);
-		ret = (*asn != 0);
-/*
-#ifdef USE_CACHE
-        if (mask_cache & CACHE_WRITE) {
-            map_update(cache_ip_asn, queried_address, asn_dup);
+/**
+ * \brief Find the lookup related to an address in a dynarray.
+ * \param lookups A dynarray of whois_lookup_t instances.
+ * \param address The address.
+ * \param pi Points to a size_t where the index of the lookup is written
+ *    (if found). Pass NULL if not needed.
+ * \return The corresponding lookup if any, NULL otherwise.
+ */
+
+static whois_lookup_t * whois_find_lookup(const dynarray_t * lookups, const address_t * address, size_t * pi) {
+    whois_lookup_t * lookup;
+    size_t           i, num_lookups = dynarray_get_size(lookups);
+
+    for (i = 0; i < num_lookups; i++) {
+        lookup = dynarray_get_ith_element(lookups, i);
+        if (address_compare(&lookup->address, address) == 0) {
+            if (pi) *pi = i;
+            return lookup;
         }
     }
-#endif
-*/
-    return ret;
+    return NULL;
+}
+
+/**
+ * \brief Notify the waiters of a lookup and release it. The caller must
+ *    have removed it from the lookups of the whois_client_t.
+ * \param client A whois_client_t instance.
+ * \param lookup The lookup.
+ * \param asn The ASN, 0 if unknown.
+ */
+
+static void whois_lookup_complete(whois_client_t * client, whois_lookup_t * lookup, uint32_t asn) {
+    const whois_waiter_t * waiter;
+    size_t                 i, num_waiters = dynarray_get_size(lookup->waiters);
+
+    if (asn) {
+        whois_set_cached_asn(&lookup->address, asn);
+    } else {
+        client->num_failures++;
+    }
+
+    for (i = 0; i < num_waiters; i++) {
+        waiter = dynarray_get_ith_element(lookup->waiters, i);
+        waiter->callback(&lookup->address, asn, waiter->data);
+    }
+    whois_lookup_free(lookup);
+}
+
+/**
+ * \brief Complete every lookup of a dynarray as unknown.
+ * \param client A whois_client_t instance.
+ * \param lookups A dynarray of whois_lookup_t instances, emptied by this function.
+ */
+
+static void whois_lookups_fail(whois_client_t * client, dynarray_t * lookups) {
+    whois_lookup_t * lookup;
+
+    while (dynarray_get_size(lookups) > 0) {
+        lookup = dynarray_get_ith_element(lookups, 0);
+        dynarray_del_ith_element(lookups, 0, NULL);
+        whois_lookup_complete(client, lookup, 0);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Batches (internal usage)
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Arm the timer of a whois_client_t according to the expiration
+ *    of the current batch or to the start of the next one.
+ * \param client A whois_client_t instance.
+ */
+
+static void whois_client_update_timer(whois_client_t * client) {
+    double time = client->sockfd != -1 ? client->deadline : client->batch_time;
+
+    update_timer_uring(client->uring, client->timerfd, time ? MAX(time - get_timestamp(), WHOIS_TIMER_PRECISION) : 0);
+}
+
+/**
+ * \brief Schedule the next batch.
+ * \param client A whois_client_t instance.
+ * \param delay The delay (in seconds) before the next batch starts.
+ */
+
+static void whois_client_schedule_batch(whois_client_t * client, double delay) {
+    if (!client->batch_time) {
+        client->batch_time = get_timestamp() + delay;
+        whois_client_update_timer(client);
+    }
+}
+
+/**
+ * \brief Terminate the current batch. Its remaining lookups fail.
+ * \param client A whois_client_t instance.
+ */
+
+static void whois_client_end_batch(whois_client_t * client) {
+    if (client->sockfd != -1) {
+        // Wake up anything still waiting on this socket before closing it
+        shutdown(client->sockfd, SHUT_RDWR);
+        close(client->sockfd);
+        client->sockfd = -1;
+    }
+    free(client->request);
+    client->request = NULL;
+    client->request_size = 0;
+    client->request_offset = 0;
+    client->line_size = 0;
+    client->is_connecting = false;
+
+    whois_lookups_fail(client, client->lookups_in_flight);
+
+    if (dynarray_get_size(client->lookups_waiting) > 0) {
+        whois_client_schedule_batch(client, 0);
+    }
+    whois_client_update_timer(client);
+}
+
+/**
+ * \brief Prepare the address of the whois server.
+ * \param address The address of the whois server.
+ * \param ss The sockaddr_storage to fill.
+ * \param psa_len Points to the size of the sockaddr written in ss.
+ * \return true iif successful.
+ */
+
+static bool whois_sockaddr_from_address(const address_t * address, struct sockaddr_storage * ss, socklen_t * psa_len) {
+    struct sockaddr_in  * sin  = (struct sockaddr_in *)  ss;
+    struct sockaddr_in6 * sin6 = (struct sockaddr_in6 *) ss;
+
+    memset(ss, 0, sizeof(struct sockaddr_storage));
+    switch (address->family) {
+        case AF_INET:
+            sin->sin_family = AF_INET;
+            sin->sin_port   = htons(WHOIS_PORT);
+            memcpy(&sin->sin_addr, &address->ip.ipv4, sizeof(ipv4_t));
+            *psa_len = sizeof(struct sockaddr_in);
+            return true;
+        case AF_INET6:
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port   = htons(WHOIS_PORT);
+            memcpy(&sin6->sin6_addr, &address->ip.ipv6, sizeof(ipv6_t));
+            *psa_len = sizeof(struct sockaddr_in6);
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * \brief Send the waiting lookups to the whois server.
+ * \param client A whois_client_t instance.
+ */
+
+static void whois_client_start_batch(whois_client_t * client) {
+    struct sockaddr_storage   ss;
+    socklen_t                 sa_len;
+    whois_lookup_t          * lookup;
+    FILE                    * stream;
+    char                    * str_address;
+
+    client->batch_time = 0;
+    if (!(stream = open_memstream(&client->request, &client->request_size))) goto ERR_OPEN_MEMSTREAM;
+
+    // Bulk query: one address per line between "begin" and "end"
+    fprintf(stream, "begin\r\n");
+    while (dynarray_get_size(client->lookups_waiting) > 0
+    &&     dynarray_get_size(client->lookups_in_flight) < WHOIS_BULK_MAX_ADDRESSES
+    ) {
+        lookup = dynarray_get_ith_element(client->lookups_waiting, 0);
+        dynarray_del_ith_element(client->lookups_waiting, 0, NULL);
+        if (!dynarray_push_element(client->lookups_in_flight, lookup)) {
+            whois_lookup_complete(client, lookup, 0);
+            continue;
+        }
+
+        if (address_to_string(&lookup->address, &str_address) == 0) {
+            fprintf(stream, "%s\r\n", str_address);
+            free(str_address);
+        }
+        client->num_lookups++;
+    }
+    fprintf(stream, "end\r\n");
+    fclose(stream);
+
+    if (!whois_sockaddr_from_address(&client->server_address, &ss, &sa_len)) {
+        errno = EAFNOSUPPORT;
+        goto ERR_SOCKADDR;
+    }
+
+    if ((client->sockfd = socket(ss.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP)) == -1) goto ERR_SOCKET;
+    if (connect(client->sockfd, (struct sockaddr *) &ss, sa_len) == -1 && errno != EINPROGRESS) goto ERR_CONNECT;
+
+    client->num_batches++;
+    client->is_connecting = true;
+    client->deadline = get_timestamp() + WHOIS_BULK_TIMEOUT;
+    whois_client_update_timer(client);
+    return;
+
+ERR_CONNECT:
+ERR_SOCKET:
+ERR_SOCKADDR:
+ERR_OPEN_MEMSTREAM:
+    perror("whois");
+    whois_client_end_batch(client);
+}
+
+/**
+ * \brief Process a line of the reply of the whois server ("ASN | IP | ...").
+ * \param client A whois_client_t instance.
+ * \param line The line.
+ * \return The number of processed lookups (0 or 1).
+ */
+
+static size_t whois_client_process_line(whois_client_t * client, char * line) {
+    whois_lookup_t * lookup;
+    address_t        address;
+    char           * str_asn = line,
+                   * str_address,
+                   * end;
+    uint32_t         asn;
+    size_t           i;
+
+    // Other lines (e.g. the banner) are ignored
+    if (!(str_address = strchr(line, '|'))) return 0;
+    *str_address++ = '\0';
+    if ((end = strchr(str_address, '|'))) *end = '\0';
+
+    while (isspace((unsigned char) *str_address)) str_address++;
+    for (end = str_address + strlen(str_address); end > str_address && isspace((unsigned char) end[-1]); end--);
+    *end = '\0';
+
+    // Header: "AS | IP | AS Name"
+    if (strcmp(str_address, "IP") == 0) return 0;
+
+    // The server echoes numeric addresses: never resolve them
+    memset(&address, 0, sizeof(address_t));
+    address.family = strchr(str_address, ':') ? AF_INET6 : AF_INET;
+    if (inet_pton(address.family, str_address, &address.ip) != 1
+    || !(lookup = whois_find_lookup(client->lookups_in_flight, &address, &i))
+    ) {
+        return 0;
+    }
+
+    // "NA" stands for an unknown ASN
+    asn = strtoul(str_asn, NULL, 10);
+    dynarray_del_ith_element(client->lookups_in_flight, i, NULL);
+    whois_lookup_complete(client, lookup, asn);
+    return 1;
+}
+
+/**
+ * \brief Send the remaining bytes of the bulk query.
+ * \param client A whois_client_t instance.
+ * \return true iif successful (client->request_offset tells whether the
+ *    whole query has been sent).
+ */
+
+static bool whois_client_send_request(whois_client_t * client) {
+    ssize_t n;
+
+    while (client->request_offset < client->request_size) {
+        n = send(
+            client->sockfd,
+            client->request + client->request_offset,
+            client->request_size - client->request_offset,
+            MSG_NOSIGNAL
+        );
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        client->request_offset += n;
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// whois_client_t
+//---------------------------------------------------------------------------
+
+whois_client_t * whois_client_create(const address_t * server_address) {
+    whois_client_t * client;
+
+    if (!(client = malloc(sizeof(whois_client_t))))                             goto ERR_MALLOC;
+    if ((client->timerfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK)) == -1) goto ERR_TIMERFD_CREATE;
+    if (!(client->lookups_waiting = dynarray_create()))                         goto ERR_LOOKUPS_WAITING;
+    if (!(client->lookups_in_flight = dynarray_create()))                       goto ERR_LOOKUPS_IN_FLIGHT;
+
+    if (server_address) {
+        memcpy(&client->server_address, server_address, sizeof(address_t));
+    } else {
+        memset(&client->server_address, 0, sizeof(address_t));
+    }
+    client->uring          = NULL;
+    client->sockfd         = -1;
+    client->is_connecting  = false;
+    client->request        = NULL;
+    client->request_size   = 0;
+    client->request_offset = 0;
+    client->line_size      = 0;
+    client->batch_time     = 0;
+    client->deadline       = 0;
+    client->num_batches    = 0;
+    client->num_lookups    = 0;
+    client->num_failures   = 0;
+    client->num_cache_hits = 0;
+    client->num_index_lookups = 0;
+    return client;
+
+ERR_LOOKUPS_IN_FLIGHT:
+    dynarray_free(client->lookups_waiting, NULL);
+ERR_LOOKUPS_WAITING:
+    close(client->timerfd);
+ERR_TIMERFD_CREATE:
+    free(client);
+ERR_MALLOC:
+    return NULL;
+}
+
+void whois_client_free(whois_client_t * client) {
+    if (client) {
+        // The awaited ASNs are printed as unknown
+        whois_client_end_batch(client);
+        whois_lookups_fail(client, client->lookups_waiting);
+
+        dynarray_free(client->lookups_in_flight, NULL);
+        dynarray_free(client->lookups_waiting, NULL);
+        close(client->timerfd);
+        free(client);
+    }
+}
+
+int whois_client_get_sockfd(const whois_client_t * client) {
+    return client->sockfd;
+}
+
+uint32_t whois_client_get_events(const whois_client_t * client) {
+    if (client->sockfd == -1) return 0;
+    return client->is_connecting || client->request_offset < client->request_size ? EPOLLOUT : EPOLLIN;
+}
+
+int whois_client_get_timerfd(const whois_client_t * client) {
+    return client->timerfd;
+}
+
+void whois_client_set_uring(whois_client_t * client, struct uring_s * uring) {
+    client->uring = uring;
+}
+
+bool whois_client_get_asn(whois_client_t * client, const address_t * address, whois_callback_t callback, void * data) {
+    whois_lookup_t * lookup;
+    uint32_t         asn = 0;
+
+    if (s_asn_index) {
+        client->num_index_lookups++;
+        asn_index_find(s_asn_index, address, &asn);
+        callback(address, asn, data);
+        return true;
+    }
+
+    if (whois_get_cached_asn(address, &asn)) {
+        client->num_cache_hits++;
+        callback(address, asn, data);
+        return true;
+    }
+
+    // A single lookup is sent per address
+    if ((lookup = whois_find_lookup(client->lookups_in_flight, address, NULL))
+    ||  (lookup = whois_find_lookup(client->lookups_waiting, address, NULL))
+    ) {
+        return whois_lookup_add_waiter(lookup, callback, data);
+    }
+
+    if (!(lookup = malloc(sizeof(whois_lookup_t))))          goto ERR_MALLOC;
+    if (!(lookup->waiters = dynarray_create()))              goto ERR_DYNARRAY_CREATE;
+    if (!whois_lookup_add_waiter(lookup, callback, data))    goto ERR_ADD_WAITER;
+    memcpy(&lookup->address, address, sizeof(address_t));
+    if (!dynarray_push_element(client->lookups_waiting, lookup)) goto ERR_PUSH_ELEMENT;
+
+    // Gather the addresses discovered meanwhile in the same batch
+    if (client->sockfd == -1) {
+        if (dynarray_get_size(client->lookups_waiting) >= WHOIS_BULK_MAX_ADDRESSES) {
+            whois_client_start_batch(client);
+        } else {
+            whois_client_schedule_batch(client, WHOIS_BULK_DELAY);
+        }
+    }
+    return true;
+
+ERR_PUSH_ELEMENT:
+ERR_ADD_WAITER:
+    dynarray_free(lookup->waiters, free);
+ERR_DYNARRAY_CREATE:
+    free(lookup);
+ERR_MALLOC:
+    return false;
 }
 
+/**
+ * \brief Fill the hole related to an ASN (see whois_client_print_asn).
+ * \param address The queried address.
+ * \param asn The corresponding ASN, 0 if unknown.
+ * \param data The whois_printer_t instance, released by this function.
+ */
+
+static void whois_fill_hole(const address_t * address, uint32_t asn, void * data) {
+    whois_printer_t * printer = data;
+    FILE            * stream;
+    char            * text = NULL;
+    size_t            size;
+
+    if ((stream = open_memstream(&text, &size))) {
+        printer->print(stream, address, asn);
+        fclose(stream);
+    }
+    hole_fill(printer->hole, text);
+    free(text);
+    free(printer);
+}
+
+bool whois_client_print_asn(whois_client_t * client, hole_stream_t * hole_stream, const address_t * address, whois_print_t print) {
+    whois_printer_t * printer;
+    uint32_t          asn = 0;
+
+    // Known ASNs are printed immediately (possibly in a pending hole)
+    if (s_asn_index) {
+        client->num_index_lookups++;
+        asn_index_find(s_asn_index, address, &asn);
+        print(hole_stream_get_stream(hole_stream), address, asn);
+        return true;
+    }
+
+    if (whois_get_cached_asn(address, &asn)) {
+        client->num_cache_hits++;
+        print(hole_stream_get_stream(hole_stream), address, asn);
+        return true;
+    }
+
+    if (!(printer = malloc(sizeof(whois_printer_t)))) goto ERR_MALLOC;
+    if (!(printer->hole = hole_create(hole_stream)))  goto ERR_HOLE_CREATE;
+    printer->print = print;
+
+    if (!whois_client_get_asn(client, address, whois_fill_hole, printer)) {
+        whois_fill_hole(address, 0, printer);
+    }
+    return true;
+
+ERR_HOLE_CREATE:
+    free(printer);
+ERR_MALLOC:
+    print(hole_stream_get_stream(hole_stream), address, 0);
+    return false;
+}
+
+size_t whois_client_process_socket(whois_client_t * client) {
+    char      buffer[WHOIS_LINE_SIZE];
+    socklen_t len = sizeof(int);
+    size_t    num_lookups = 0;
+    ssize_t   n, i;
+    int       error;
+
+    if (client->sockfd == -1) return 0;
+
+    if (client->is_connecting) {
+        // The connection may still be in progress (spurious event)
+        if (getpeername(client->sockfd, (struct sockaddr *) buffer, &len) == -1) {
+            if (errno != ENOTCONN) goto ERR_CONNECT;
+            len = sizeof(int);
+            if (getsockopt(client->sockfd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) goto ERR_CONNECT;
+            if (!error) return 0;
+            errno = error;
+            goto ERR_CONNECT;
+        }
+        client->is_connecting = false;
+    }
+
+    if (!whois_client_send_request(client)) goto ERR_SEND;
+    if (client->request_offset < client->request_size) return 0;
+
+    for (;;) {
+        if ((n = recv(client->sockfd, buffer, sizeof(buffer), 0)) == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            goto ERR_RECV;
+        }
+
+        if (n == 0) {
+            // The server has answered every address it knows
+            if (client->line_size) {
+                client->line[client->line_size] = '\0';
+                num_lookups += whois_client_process_line(client, client->line);
+            }
+            num_lookups += dynarray_get_size(client->lookups_in_flight);
+            whois_client_end_batch(client);
+            break;
+        }
+
+        for (i = 0; i < n; i++) {
+            if (buffer[i] == '\n') {
+                client->line[client->line_size] = '\0';
+                num_lookups += whois_client_process_line(client, client->line);
+                client->line_size = 0;
+            } else if (client->line_size < WHOIS_LINE_SIZE - 1) {
+                // The end of longer lines (e.g. AS names) is ignored
+                client->line[client->line_size++] = buffer[i];
+            }
+        }
+    }
+    return num_lookups;
+
+ERR_RECV:
+ERR_SEND:
+ERR_CONNECT:
+    perror("whois");
+    num_lookups += dynarray_get_size(client->lookups_in_flight);
+    whois_client_end_batch(client);
+    return num_lookups;
+}
+
+size_t whois_client_process_timer(whois_client_t * client) {
+    uint64_t num_expirations;
+    double   now = get_timestamp();
+    size_t   num_lookups = 0;
+
+    // Acknowledge the timer (never armed with io_uring)
+    if (!client->uring && read(client->timerfd, &num_expirations, sizeof(num_expirations)) == -1) {
+        // The timer has been re-armed meanwhile, go on anyway.
+    }
+
+    if (client->sockfd != -1) {
+        if (client->deadline - WHOIS_TIMER_PRECISION <= now) {
+            fprintf(stderr, "whois: no reply from the server\n");
+            num_lookups = dynarray_get_size(client->lookups_in_flight);
+            whois_client_end_batch(client);
+        }
+    } else if (client->batch_time && client->batch_time - WHOIS_TIMER_PRECISION <= now) {
+        whois_client_start_batch(client);
+    }
+
+    whois_client_update_timer(client);
+    return num_lookups;
+}
+
+bool whois_client_is_pending(const whois_client_t * client) {
+    return dynarray_get_size(client->lookups_in_flight) > 0
+        || dynarray_get_size(client->lookups_waiting) > 0;
+}
+
+void whois_client_dump_stats(const whois_client_t * client) {
+    if (s_asn_index) {
+        fprintf(stderr, "whois: %zu addresses looked up in the ASN index\n", client->num_index_lookups);
+        return;
+    }
+
+    fprintf(stderr,
+        "whois: %zu addresses sent in %zu batches, %zu without ASN, %zu ASNs found in the cache\n",
+        client->num_lookups,
+        client->num_batches,
+        client->num_failures,
+        client->num_cache_hits
+    );
+}
@@ -3,8 +3,20 @@
 
 #include <stdint.h>		// uint32_t
 #include <stdbool.h>	// bool
+#include <stddef.h>		// size_t
+#include <stdio.h>		// FILE
 
 #include "address.h"	// address_t
+#include "address_cache.h"	// address_cache_t
+#include "dynarray.h"	// dynarray_t
+#include "hole.h"		// hole_stream_t
+
+#define WHOIS_PORT               43
+#define WHOIS_BULK_SERVER        "whois.cymru.com" /**< Default server supporting the bulk mode */
+#define WHOIS_BULK_DELAY         0.05  /**< Delay (in seconds) during which a batch gathers addresses */
+#define WHOIS_BULK_MAX_ADDRESSES 500   /**< Maximum number of addresses per batch */
+#define WHOIS_BULK_TIMEOUT       10.0  /**< Delay (in seconds) before a batch is dropped */
+#define WHOIS_LINE_SIZE          1024  /**< Maximum length of a line of a whois reply */
 
 /**
  * \brief Default callback for whois_* function.
@@ -75,8 +87,17 @@ bool whois(
 	void            * pdata
 );
 
+/**
+ * \brief Retrieve the cache used by whois_get_asn and whois_client_t
+ *    (see address_cache.h), e.g. to bound it or to save it.
+ * \return The corresponding address_cache_t instance, NULL if caches are disabled.
+ */
+
+address_cache_t * whois_get_asn_cache();
+
 /**
  * \brief Perform a whois query (whois_find_server + whois_query).
+ *    If an ASN index is loaded, it is used instead (see whois_load_asn_index).
  * \example
     uint32_t asn;
     address_t address;
@@ -96,4 +117,197 @@ bool whois_get_asn(
 	int               mask
 );
 
+//---------------------------------------------------------------------------
+// Offline ASN lookups
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Load an ASN index (see asn_index.h). From now on, ASNs are
+ *    retrieved from this index only, and the whois servers are never
+ *    queried: an address matching no prefix has no ASN.
+ * \param filename The path of an index file built by asn_index_build.
+ * \return true iif successful (errno is set otherwise).
+ */
+
+bool whois_load_asn_index(const char * filename);
+
+/**
+ * \brief Check whether an ASN index is loaded.
+ * \return true iif whois_load_asn_index has succeeded.
+ */
+
+bool whois_has_asn_index();
+
+//---------------------------------------------------------------------------
+// Asynchronous ASN lookups
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Function called once the ASN of an address is known.
+ * \param address The queried address.
+ * \param asn The corresponding ASN, 0 if unknown.
+ * \param data The data passed to whois_client_get_asn.
+ */
+
+typedef void (* whois_callback_t)(const address_t * address, uint32_t asn, void * data);
+
+/**
+ * \brief Function printing an address and its ASN.
+ * \param out The stream to write to.
+ * \param address The address.
+ * \param asn The corresponding ASN, 0 if unknown.
+ */
+
+typedef void (* whois_print_t)(FILE * out, const address_t * address, uint32_t asn);
+
+/**
+ * A whois_client_t retrieves ASNs without blocking the main loop (see
+ * pt_loop_get_whois_client). The queried addresses are gathered during
+ * WHOIS_BULK_DELAY seconds and sent in a single connection thanks to the
+ * bulk mode of the whois server:
+ *
+ *    begin
+ *    192.0.2.1
+ *    198.51.100.1
+ *    end
+ *
+ * The server answers one line per address ("ASN | IP | ...") and closes
+ * the connection. Addresses queried meanwhile are sent in the next batch.
+ * ASNs are stored in the cache of whois_get_asn.
+ */
+
+typedef struct {
+	address_t      server_address;    /**< Address of the whois server */
+	int            sockfd;            /**< Connection of the current batch (-1 if none) */
+	int            timerfd;           /**< Activated when the next batch starts or when the current one expires */
+	struct uring_s * uring;           /**< If set, the timer is armed through this io_uring instance (see whois_client_set_uring) */
+	bool           is_connecting;     /**< True iif sockfd is not yet connected */
+	char         * request;           /**< Bulk query of the current batch */
+	size_t         request_size;      /**< Size of request */
+	size_t         request_offset;    /**< Number of bytes of request already sent */
+	char           line[WHOIS_LINE_SIZE]; /**< Line being received */
+	size_t         line_size;         /**< Size of line */
+	double         batch_time;        /**< Start of the next batch (0 if none is scheduled) */
+	double         deadline;          /**< Expiration of the current batch */
+	dynarray_t   * lookups_waiting;   /**< Lookups gathered for the next batch */
+	dynarray_t   * lookups_in_flight; /**< Lookups of the current batch */
+
+	// Statistics
+	size_t         num_batches;       /**< Number of connections to the whois server */
+	size_t         num_lookups;       /**< Number of addresses sent to the whois server */
+	size_t         num_failures;      /**< Number of addresses without ASN */
+	size_t         num_cache_hits;    /**< Number of ASNs found in the cache */
+	size_t         num_index_lookups; /**< Number of addresses looked up in the ASN index */
+} whois_client_t;
+
+/**
+ * \brief Create a whois_client_t instance.
+ * \param server_address The address of a whois server supporting the bulk mode.
+ *    It may be NULL if an ASN index is loaded (see whois_load_asn_index).
+ * \return The newly allocated whois_client_t instance, NULL otherwise.
+ */
+
+whois_client_t * whois_client_create(const address_t * server_address);
+
+/**
+ * \brief Release a whois_client_t instance. The pending lookups fail,
+ *    and the awaited ASNs are printed as unknown.
+ * \param client A whois_client_t instance.
+ */
+
+void whois_client_free(whois_client_t * client);
+
+/**
+ * \brief Retrieve the socket of the current batch. It changes from
+ *    one batch to another.
+ * \param client A whois_client_t instance.
+ * \return The corresponding file descriptor, -1 if no batch is in progress.
+ */
+
+int whois_client_get_sockfd(const whois_client_t * client);
+
+/**
+ * \brief Retrieve the events awaited on the socket of the current batch.
+ * \param client A whois_client_t instance.
+ * \return EPOLLOUT while the query is being sent, EPOLLIN while the
+ *    reply is being received, 0 if no batch is in progress.
+ */
+
+uint32_t whois_client_get_events(const whois_client_t * client);
+
+/**
+ * \brief Retrieve the timer of a whois_client_t.
+ * \param client A whois_client_t instance.
+ * \return The corresponding file descriptor.
+ */
+
+int whois_client_get_timerfd(const whois_client_t * client);
+
+/**
+ * \brief Arm the timer of a whois_client_t through an io_uring instance.
+ *    The timerfd is then never armed: its expirations are reported by the
+ *    io_uring instance (see uring_set_timer).
+ * \param client A whois_client_t instance.
+ * \param uring An io_uring instance (NULL restores the timerfd).
+ */
+
+void whois_client_set_uring(whois_client_t * client, struct uring_s * uring);
+
+/**
+ * \brief Retrieve the ASN of an address. If it is cached, the callback
+ *    is called immediately.
+ * \param client A whois_client_t instance.
+ * \param address The queried address.
+ * \param callback The function called once the ASN is known.
+ * \param data The data passed to callback.
+ * \return true iif successful.
+ */
+
+bool whois_client_get_asn(whois_client_t * client, const address_t * address, whois_callback_t callback, void * data);
+
+/**
+ * \brief Print an address and its ASN in a hole_stream_t. If the ASN is
+ *    not cached, a hole is left until it is known (see hole.h).
+ * \param client A whois_client_t instance.
+ * \param hole_stream The hole_stream_t instance to print in
+ *    (see pt_loop_get_hole_stream).
+ * \param address The address to print.
+ * \param print The function printing the address and its ASN.
+ * \return true iif successful.
+ */
+
+bool whois_client_print_asn(whois_client_t * client, hole_stream_t * hole_stream, const address_t * address, whois_print_t print);
+
+/**
+ * \brief Process the socket of the current batch (connection, query
+ *    and reply).
+ * \param client A whois_client_t instance.
+ * \return The number of processed lookups.
+ */
+
+size_t whois_client_process_socket(whois_client_t * client);
+
+/**
+ * \brief Start the next batch or drop the current one if it has expired.
+ * \param client A whois_client_t instance.
+ * \return The number of processed lookups.
+ */
+
+size_t whois_client_process_timer(whois_client_t * client);
+
+/**
+ * \brief Check whether a whois_client_t has pending lookups.
+ * \param client A whois_client_t instance.
+ * \return true iif some lookups are in flight or waiting.
+ */
+
+bool whois_client_is_pending(const whois_client_t * client);
+
+/**
+ * \brief Print the statistics of a whois_client_t (on stderr).
+ * \param client A whois_client_t instance.
+ */
+
+void whois_client_dump_stats(const whois_client_t * client);
+
 #endif // LIBPT_WHOIS_H
@@ -0,0 +1,155 @@
+#include "config.h"
+
+#include <stdlib.h>                  // EXIT_SUCCESS, EXIT_FAILURE
+#include <stdio.h>                   // printf
+#include <stdbool.h>                 // bool
+#include <stdint.h>                  // uint64_t
+#include <string.h>                  // strdup
+#include <libgen.h>                  // basename
+#include <limits.h>                  // INT_MAX
+
+#include "common.h"                  // get_monotonic_timestamp
+#include "options.h"                 // options_*
+#include "algorithms/mda/bound.h"    // bound_*
+
+//---------------------------------------------------------------------------
+// Command line stuff
+//---------------------------------------------------------------------------
+
+// Default MDA options (see OPTIONS_MDA_BOUND_MAXBRANCH): 95% confidence,
+// 128 interfaces per hop at most, 5 branching points.
+#define BENCH_FAILURE        0.05
+#define BENCH_MAX_INTERFACES 128
+#define BENCH_MAX_BRANCH     5
+
+#define BENCH_HELP_n       "Number of MDA instances whose startup is timed (default: 100)."
+
+#define TEXT               "paris-bound-bench - time the startup cost of MDA instances: bound_create() versus bound_get_shared()."
+#define TEXT_OPTIONS       "Options:"
+
+static unsigned num_instances[3] = {100, 1, INT_MAX};
+
+struct opt_spec runnable_options[] = {
+    // action                 sf          lf                   metavar               help               data
+    {opt_text,                OPT_NO_SF,  OPT_NO_LF,           OPT_NO_METAVAR,       TEXT,              OPT_NO_DATA},
+    {opt_text,                OPT_NO_SF,  OPT_NO_LF,           OPT_NO_METAVAR,       TEXT_OPTIONS,      OPT_NO_DATA},
+    {opt_store_int_lim,       "n",        "--num-instances",   "NUM",                BENCH_HELP_n,      num_instances},
+    END_OPT_SPECS
+};
+
+/**
+ * \brief Prepare options supported by paris-bound-bench
+ * \return A pointer to the corresponding options_t instance if successfull, NULL otherwise
+ */
+
+static options_t * init_options(char * version) {
+    options_t * options;
+
+    // Building the command line options
+    if (!(options = options_create(NULL))) {
+        goto ERR_OPTIONS_CREATE;
+    }
+
+    options_add_optspecs(options, runnable_options);
+    options_add_common  (options, version);
+    return options;
+
+ERR_OPTIONS_CREATE:
+    return NULL;
+}
+
+//---------------------------------------------------------------------------
+// Benchmark
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Print the time spent to start some MDA instances.
+ * \param name The name of the measured function.
+ * \param num_instances The number of instances.
+ * \param start The monotonic timestamp (in ns) taken before the first instance.
+ */
+
+static void bench_dump(const char * name, size_t num_instances, uint64_t start) {
+    double elapsed = (get_monotonic_timestamp() - start) / 1e9;
+
+    printf("%-17s %zu instances in %.6lfs (%.3lfus per instance)\n",
+        name, num_instances, elapsed, elapsed * 1e6 / num_instances
+    );
+}
+
+/**
+ * \brief Start MDA instances which build their own stopping points.
+ * \param num_instances The number of instances.
+ * \return true iif successful.
+ */
+
+static bool bench_bound_create(size_t num_instances) {
+    bound_t  * bound;
+    uint64_t   start = get_monotonic_timestamp();
+    size_t     i;
+
+    for (i = 0; i < num_instances; i++) {
+        if (!(bound = bound_create(BENCH_FAILURE, BENCH_MAX_INTERFACES, BENCH_MAX_BRANCH))) {
+            return false;
+        }
+        bound_free(bound);
+    }
+    bench_dump("bound_create:", num_instances, start);
+    return true;
+}
+
+/**
+ * \brief Start MDA instances which share the stopping points of the process.
+ * \param num_instances The number of instances.
+ * \return true iif successful.
+ */
+
+static bool bench_bound_get_shared(size_t num_instances) {
+    uint64_t start = get_monotonic_timestamp();
+    size_t   i;
+
+    for (i = 0; i < num_instances; i++) {
+        if (!bound_get_shared(BENCH_FAILURE, BENCH_MAX_INTERFACES, BENCH_MAX_BRANCH)) {
+            return false;
+        }
+    }
+    bench_dump("bound_get_shared:", num_instances, start);
+    bound_free_shared();
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// Main program
+//---------------------------------------------------------------------------
+
+int main(int argc, char ** argv)
+{
+    int                       exit_code = EXIT_FAILURE;
+    char                    * version = strdup("version 1.0");
+    const char              * usage = "usage: %s [options]\n";
+    options_t               * options;
+
+    // Prepare the commande line options
+    if (!(options = init_options(version))) {
+        fprintf(stderr, "E: Can't initialize options\n");
+        goto ERR_INIT_OPTIONS;
+    }
+
+    if (options_parse(options, usage, argv) > 0) {
+        fprintf(stderr, "%s: too many arguments\n", basename(argv[0]));
+        goto ERR_OPT_PARSE;
+    }
+
+    if (!bench_bound_create(num_instances[0])
+    ||  !bench_bound_get_shared(num_instances[0])) {
+        fprintf(stderr, "%s: cannot compute the stopping points\n", basename(argv[0]));
+        goto ERR_BENCH;
+    }
+    exit_code = EXIT_SUCCESS;
+
+ERR_BENCH:
+ERR_OPT_PARSE:
+ERR_INIT_OPTIONS:
+    free(version);
+    exit(exit_code);
+}
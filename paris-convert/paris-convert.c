@@ -0,0 +1,266 @@
+#include "config.h"
+
+#include <stdlib.h>                  // EXIT_SUCCESS, EXIT_FAILURE
+#include <stdio.h>                   // printf, fopen
+#include <stdbool.h>                 // bool
+#include <string.h>                  // strcmp
+#include <libgen.h>                  // basename
+#include <sys/socket.h>              // AF_UNSPEC
+
+#include "address.h"                 // address_t
+#include "record.h"                  // record_*
+#include "asn_index.h"               // asn_index_build
+#include "options.h"                 // options_*
+
+//---------------------------------------------------------------------------
+// Command line stuff
+//---------------------------------------------------------------------------
+
+#define CONVERT_HELP_f     "Output format (default: 'text'). Valid values are 'text' and 'json'."
+#define CONVERT_HELP_asn_index "Read a prefix-to-AS dump ('PREFIX/LENGTH ASN' or 'ADDRESS LENGTH ASN' per line) instead, and write the corresponding ASN index (see paris-traceroute --asn-index) to OUTPUT."
+
+#define TEXT               "paris-convert - convert the binary output of paris-traceroute (--binary)."
+#define TEXT_OPTIONS       "Options:"
+
+const char * format_names[] = {
+    "text", // default value
+    "json",
+    NULL
+};
+
+static struct opt_str asn_index = {NULL, 0};
+
+struct opt_spec runnable_options[] = {
+    // action                 sf          lf                   metavar               help               data
+    {opt_text,                OPT_NO_SF,  OPT_NO_LF,           OPT_NO_METAVAR,       TEXT,              OPT_NO_DATA},
+    {opt_text,                OPT_NO_SF,  OPT_NO_LF,           OPT_NO_METAVAR,       TEXT_OPTIONS,      OPT_NO_DATA},
+    {opt_store_choice,        "f",        "--format",          "FORMAT",             CONVERT_HELP_f,    format_names},
+    {opt_store_str,           OPT_NO_SF,  "--asn-index",       "OUTPUT",             CONVERT_HELP_asn_index, &asn_index},
+    END_OPT_SPECS
+};
+
+/**
+ * \brief Prepare options supported by paris-convert
+ * \return A pointer to the corresponding options_t instance if successfull, NULL otherwise
+ */
+
+static options_t * init_options(char * version) {
+    options_t * options;
+
+    // Building the command line options
+    if (!(options = options_create(NULL))) {
+        goto ERR_OPTIONS_CREATE;
+    }
+
+    options_add_optspecs(options, runnable_options);
+    options_add_common  (options, version);
+    return options;
+
+ERR_OPTIONS_CREATE:
+    return NULL;
+}
+
+//---------------------------------------------------------------------------
+// Output
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Print an address of a record.
+ * \param address The address to print. AF_UNSPEC stands for a star.
+ * \param is_json Pass true to print a JSON value.
+ */
+
+static void address_print(const address_t * address, bool is_json)
+{
+    char * buffer;
+
+    if (address->family == AF_UNSPEC) {
+        printf("%s", is_json ? "null" : "*");
+    } else if (address_to_string(address, &buffer) == 0) {
+        printf(is_json ? "\"%s\"" : "%s", buffer);
+        free(buffer);
+    } else {
+        printf("%s", is_json ? "null" : "?");
+    }
+}
+
+/**
+ * \brief Print a record on a single line of text.
+ * \param record The record to print.
+ */
+
+static void record_print_text(const record_t * record)
+{
+    printf("%s %u", record_type_to_string(record->type), record->trace_id);
+
+    switch (record->type) {
+        case RECORD_TRACE_START:
+            printf(" %.6lf %s %s ",
+                record->trace_start.start_time,
+                record->trace_start.algorithm,
+                record->trace_start.protocol
+            );
+            address_print(&record->trace_start.dst_addr, false);
+            break;
+        case RECORD_PROBE:
+            printf(" %hhu %hu ", record->probe.ttl, record->probe.flow_id);
+            address_print(&record->probe.reply_addr, false);
+            if (record->probe.reply_addr.family != AF_UNSPEC) {
+                printf(" %.3lf", record->probe.rtt);
+            }
+            break;
+        case RECORD_HOP:
+            printf(" %hhu ", record->hop.ttl);
+            address_print(&record->hop.address, false);
+            if (record->hop.flags & RECORD_HOP_COMPLETED) {
+                printf(" completed %hu", record->hop.num_next);
+            }
+            break;
+        case RECORD_LINK:
+            printf(" %hhu ", record->link.ttl);
+            address_print(&record->link.source, false);
+            printf(" ");
+            if (record->link.has_target) {
+                address_print(&record->link.target, false);
+            } else {
+                printf("-");
+            }
+            break;
+        case RECORD_TRACE_END:
+            printf(" %s", record_status_to_string(record->status));
+            break;
+    }
+
+    printf("\n");
+}
+
+/**
+ * \brief Print a record as a JSON object on a single line.
+ * \param record The record to print.
+ */
+
+static void record_print_json(const record_t * record)
+{
+    printf("{\"type\": \"%s\", \"trace_id\": %u", record_type_to_string(record->type), record->trace_id);
+
+    switch (record->type) {
+        case RECORD_TRACE_START:
+            // Algorithm and protocol names never need to be escaped
+            printf(", \"start_time\": %.6lf, \"algorithm\": \"%s\", \"protocol\": \"%s\", \"dst_addr\": ",
+                record->trace_start.start_time,
+                record->trace_start.algorithm,
+                record->trace_start.protocol
+            );
+            address_print(&record->trace_start.dst_addr, true);
+            break;
+        case RECORD_PROBE:
+            printf(", \"ttl\": %hhu, \"flow_id\": %hu, \"reply_addr\": ", record->probe.ttl, record->probe.flow_id);
+            address_print(&record->probe.reply_addr, true);
+            if (record->probe.reply_addr.family != AF_UNSPEC) {
+                printf(", \"rtt\": %.3lf", record->probe.rtt);
+            } else {
+                printf(", \"rtt\": null");
+            }
+            break;
+        case RECORD_HOP:
+            printf(", \"ttl\": %hhu, \"address\": ", record->hop.ttl);
+            address_print(&record->hop.address, true);
+            if (record->hop.flags & RECORD_HOP_COMPLETED) {
+                printf(", \"completed\": true, \"num_next\": %hu", record->hop.num_next);
+            } else {
+                printf(", \"completed\": false");
+            }
+            break;
+        case RECORD_LINK:
+            printf(", \"ttl\": %hhu, \"source\": ", record->link.ttl);
+            address_print(&record->link.source, true);
+            printf(", \"target\": ");
+            if (record->link.has_target) {
+                address_print(&record->link.target, true);
+            } else {
+                printf("null");
+            }
+            break;
+        case RECORD_TRACE_END:
+            printf(", \"status\": \"%s\"", record_status_to_string(record->status));
+            break;
+    }
+
+    printf("}\n");
+}
+
+//---------------------------------------------------------------------------
+// Main program
+//---------------------------------------------------------------------------
+
+int main(int argc, char ** argv)
+{
+    int                       exit_code = EXIT_FAILURE;
+    char                    * version = strdup("version 1.0");
+    const char              * usage = "usage: %s [options] [FILE]\n";
+    options_t               * options;
+    int                       num_args;
+    FILE                    * file;
+    record_reader_t         * reader;
+    record_t                  record;
+    bool                      is_json;
+    size_t                    num_prefixes;
+
+    // Prepare the commande line options
+    if (!(options = init_options(version))) {
+        fprintf(stderr, "E: Can't initialize options\n");
+        goto ERR_INIT_OPTIONS;
+    }
+
+    // Retrieve values passed in the command-line. Read stdin by default.
+    if ((num_args = options_parse(options, usage, argv)) > 1) {
+        fprintf(stderr, "%s: too many files\n", basename(argv[0]));
+        goto ERR_OPT_PARSE;
+    }
+
+    is_json = strcmp(format_names[0], "json") == 0;
+
+    if (num_args == 0 || strcmp(argv[argc - 1], "-") == 0) {
+        file = stdin;
+    } else if (!(file = fopen(argv[argc - 1], asn_index.s ? "r" : "rb"))) {
+        perror(argv[argc - 1]);
+        goto ERR_FOPEN;
+    }
+
+    if (asn_index.s) {
+        if (asn_index_build(file, asn_index.s, &num_prefixes)) {
+            fprintf(stderr, "%s: %zu prefixes read, ASN index written to %s\n", basename(argv[0]), num_prefixes, asn_index.s);
+            exit_code = EXIT_SUCCESS;
+        }
+        goto ASN_INDEX_BUILT;
+    }
+
+    if (!(reader = record_reader_create(file))) {
+        fprintf(stderr, "%s: not a paris-traceroute binary stream (or unsupported version)\n", basename(argv[0]));
+        goto ERR_RECORD_READER_CREATE;
+    }
+
+    while (record_read(reader, &record)) {
+        if (is_json) {
+            record_print_json(&record);
+        } else {
+            record_print_text(&record);
+        }
+    }
+
+    if (reader->has_failed) {
+        fprintf(stderr, "%s: invalid stream after %zu records\n", basename(argv[0]), reader->num_records);
+    } else {
+        exit_code = EXIT_SUCCESS;
+    }
+
+    record_reader_free(reader);
+ASN_INDEX_BUILT:
+ERR_RECORD_READER_CREATE:
+    if (file != stdin) fclose(file);
+ERR_FOPEN:
+ERR_OPT_PARSE:
+ERR_INIT_OPTIONS:
+    free(version);
+    exit(exit_code);
+}
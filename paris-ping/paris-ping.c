@@ -1,7 +1,7 @@
 #include "config.h"
 
 #include <stdlib.h>                  // malloc...
-#include <stdio.h>                   // perror, printf
+#include <stdio.h>                   // perror, fprintf
 #include <stdbool.h>                 // bool
 #include <errno.h>                   // errno
 #include <libgen.h>                  // basename
@@ -11,6 +11,8 @@
 #include <sys/types.h>               // gai_strerror
 #include <sys/socket.h>              // gai_strerror, AF_INET, AF_INET6
 #include <netdb.h>                   // gai_strerror
+#include <unistd.h>                  // STDOUT_FILENO
+#include <fcntl.h>                   // fcntl, O_NONBLOCK
 
 #include "pt_loop.h"                 // pt_loop_t
 #include "probe.h"                   // probe_t
@@ -18,6 +20,7 @@
 #include "algorithms/ping.h"         // ping_options_t
 #include "address.h"                 // address_t
 #include "options.h"                 // options_*
+#include "output.h"                  // output_t
 
 //---------------------------------------------------------------------------
 // Command line stuff
@@ -248,7 +251,7 @@ void loop_handler(pt_loop_t * loop, event_t * event, void * user_data)
             ping_data = event->issuer->data;
 
             if (ping_data != NULL) { // to prevent to print statistics twice and to print an error-message
-                ping_dump_statistics(ping_data);
+                ping_dump_statistics(pt_loop_get_stream(loop), ping_data);
             }
 
             pt_stop_instance(loop, event->issuer);
@@ -304,6 +307,50 @@ const char * get_protocol_name(int family, bool use_icmp, bool use_tcp, bool use
     return NULL;
 }
 
+//---------------------------------------------------------------------------
+// Standard output (--output-buffer)
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Buffer the standard output in an output_t. STDOUT_FILENO is switched
+ *    to non-blocking mode, so that a slow consumer never delays the probes.
+ * \param capacity The size of the ring buffer.
+ * \param pflags Where the flags of STDOUT_FILENO are saved (see stdout_output_free).
+ * \return The newly allocated output_t instance, NULL otherwise.
+ */
+
+static output_t * stdout_output_create(size_t capacity, int * pflags)
+{
+    output_t * output;
+
+    fflush(stdout);
+    if ((*pflags = fcntl(STDOUT_FILENO, F_GETFL)) == -1)           goto ERR_FCNTL_GETFL;
+    if (!(output = output_create(STDOUT_FILENO, capacity)))       goto ERR_OUTPUT_CREATE;
+    if (fcntl(STDOUT_FILENO, F_SETFL, *pflags | O_NONBLOCK) == -1) goto ERR_FCNTL_SETFL;
+    return output;
+
+ERR_FCNTL_SETFL:
+    output_free(output);
+ERR_OUTPUT_CREATE:
+ERR_FCNTL_GETFL:
+    return NULL;
+}
+
+/**
+ * \brief Restore the flags of STDOUT_FILENO, write the pending bytes of
+ *    the standard output (this may block) and release its output_t.
+ * \param output The output_t returned by stdout_output_create (NULL if none).
+ * \param flags The flags saved by stdout_output_create.
+ */
+
+static void stdout_output_free(output_t * output, int flags)
+{
+    if (output) {
+        fcntl(STDOUT_FILENO, F_SETFL, flags);
+        output_free(output);
+    }
+}
+
 //---------------------------------------------------------------------------
 // Main program
 //---------------------------------------------------------------------------
@@ -325,6 +372,8 @@ int main(int argc, char ** argv)
     const char              * algorithm_name;
     const char              * protocol_name;
     bool                      use_icmp, use_udp, use_tcp;
+    output_t                * stdout_output = NULL;
+    int                       stdout_flags = 0;
 
     // Prepare the commande line options
     if (!(options = init_options(version))) {
@@ -470,8 +519,14 @@ int main(int argc, char ** argv)
     // Algorithm options (common options)
     options_ping_init(&ping_options, &dst_addr, send_time[0], max_ttl[0]);
 
+    // Write the standard output without delaying the probes
+    if (options_pt_loop_get_output_buffer()
+    && !(stdout_output = stdout_output_create(options_pt_loop_get_output_buffer(), &stdout_flags))) {
+        perror("Cannot buffer the standard output");
+    }
+
     // Create libparistraceroute loop
-    if (!(loop = pt_loop_create(loop_handler, NULL))) {
+    if (!(loop = pt_loop_create_backend(loop_handler, NULL, options_pt_loop_get_backend()))) {
         fprintf(stderr, "E: Cannot create libparistraceroute loop");
         goto ERR_LOOP_CREATE;
     }
@@ -479,10 +534,11 @@ int main(int argc, char ** argv)
     // Set network options (network and verbose)
     options_network_init(loop->network, false);
     options_pt_loop_init(loop);
+    if (stdout_output) pt_loop_set_output(loop, stdout_output);
 
-    printf("paris-ping to %s (", dst_ip);
-    address_dump(&dst_addr);
-    printf(")\n");
+    fprintf(pt_loop_get_stream(loop), "paris-ping to %s (", dst_ip);
+    address_fprintf(pt_loop_get_stream(loop), &dst_addr);
+    fprintf(pt_loop_get_stream(loop), ")\n");
 
     // Add an algorithm instance in the main loop
     if (!pt_add_instance(loop, algorithm_name, algorithm_options, probe)) {
@@ -506,12 +562,13 @@ ERR_INSTANCE:
     // Options and probe must be manually removed.
     pt_loop_free(loop);
 ERR_LOOP_CREATE:
+    stdout_output_free(stdout_output, stdout_flags);
     probe_free(probe);
 ERR_INVALID_PACKET_SIZE:
 ERR_PROBE_CREATE:
 ERR_ADDRESS_IP_FROM_STRING:
 ERR_ADDRESS_GUESS_FAMILY:
-    if (errno) perror(gai_strerror(errno));
+    if (exit_code != EXIT_SUCCESS && errno) perror(gai_strerror(errno));
 ERR_CHECK_OPTIONS:
 ERR_OPT_PARSE:
 ERR_INIT_OPTIONS:
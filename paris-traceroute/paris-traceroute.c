@@ -1,27 +1,35 @@
 #include "config.h"
 
 #include <stdlib.h>                  // malloc...
-#include <stdio.h>                   // perror, printf
+#include <stdio.h>                   // perror, fprintf
 #include <stdbool.h>                 // bool
 #include <errno.h>                   // errno
 #include <libgen.h>                  // basename
 #include <string.h>                  // strcmp
 #include <stdint.h>                  // UINT16_MAX
+#include <limits.h>                  // INT_MAX
 #include <float.h>                   // DBL_MAX
 #include <sys/types.h>               // gai_strerror
 #include <sys/socket.h>              // gai_strerror, AF_INET, AF_INET6
 #include <netdb.h>                   // gai_strerror
+#include <unistd.h>                  // access, close, STDOUT_FILENO
+#include <fcntl.h>                   // open, fcntl, O_NONBLOCK
 
-#include "common.h"                  // ELEMENT_DUMP
+#include "common.h"                  // ELEMENT_FPRINTF
 #include "optparse.h"                // opt_*()
 #include "pt_loop.h"                 // pt_loop_t
 #include "probe.h"                   // probe_t
 #include "lattice.h"                 // lattice_t
 #include "algorithm.h"               // algorithm_instance_t
 #include "algorithms/mda.h"          // mda_*_t
+#include "algorithms/mda/bound.h"    // bound_free_shared
 #include "algorithms/traceroute.h"   // traceroute_options_t
+#include "algorithms/yarrp.h"        // yarrp_options_t
 #include "address.h"                 // address_to_string
 #include "options.h"                 // options_*
+#include "output.h"                  // output_t
+#include "record.h"                  // record_*
+#include "topology_cache.h"          // topology_cache_*
 
 //---------------------------------------------------------------------------
 // Command line stuff
@@ -29,7 +37,7 @@
 
 #define TRACEROUTE_HELP_4  "Use IPv4."
 #define TRACEROUTE_HELP_6  "Use IPv6."
-#define TRACEROUTE_HELP_a  "Set the traceroute algorithm (default: 'paris-traceroute'). Valid values are 'paris-traceroute' and 'mda'."
+#define TRACEROUTE_HELP_a  "Set the traceroute algorithm (default: 'paris-traceroute'). Valid values are 'paris-traceroute', 'mda' and 'yarrp'."
 #define TRACEROUTE_HELP_d  "Print libparistraceroute debug information."
 #define TRACEROUTE_HELP_p  "Set PORT as destination port (default: 33457)."
 #define TRACEROUTE_HELP_s  "Set PORT as source port (default: 33456)."
@@ -37,6 +45,10 @@
 #define TRACEROUTE_HELP_P  "Use raw packet of protocol PROTOCOL for tracerouting (default: 'udp'). Valid values are 'udp' and 'icmp'."
 #define TRACEROUTE_HELP_T  "Use TCP for tracerouting."
 #define TRACEROUTE_HELP_U  "Use UDP for tracerouting. The destination port is set by default to 53."
+#define TRACEROUTE_HELP_TOPOLOGY_CACHE_FILE "Load the topology cache from FILE (if it exists) and save it to FILE once the trace is complete. Implies --topology-cache."
+#define TRACEROUTE_HELP_TARGETS "Read the targets from FILE ('-' for the standard input) instead of the command line, one per line: DST [ALGORITHM [PROTOCOL]]. Print one line per target once its measurement is complete."
+#define TRACEROUTE_HELP_MAX_INSTANCES "Set the maximum number of targets measured in parallel with --targets (default: 16)."
+#define TRACEROUTE_HELP_BINARY "Write the results to FILE ('-' for the standard output) using the binary record format instead of printing them. See paris-convert."
 #define TRACEROUTE_HELP_z  "Minimal time interval between probes (default 0).  If the value is more than 10, then it specifies a number in milliseconds, else it is a number of seconds (float point values allowed  too)"
 #define TEXT               "paris-traceroute - print the IP-level path toward a given IP host."
 #define TEXT_OPTIONS       "Options:"
@@ -54,6 +66,7 @@
 const char * algorithm_names[] = {
     "paris-traceroute", // default value
     "mda",
+    "yarrp",
     NULL
 };
 
@@ -76,6 +89,17 @@ const char * protocol_names[] = {
 static int    dst_port[4]    = {33457,  0,   UINT16_MAX, 0};
 static int    src_port[4]    = {33456,  0,   UINT16_MAX, 0};
 static double send_time[4]   = {1,      1,   DBL_MAX,    0};
+static int    max_instances[3] = {16,   1,   INT_MAX};
+
+static struct opt_str topology_cache_file = {NULL, 0};
+static struct opt_str targets_file        = {NULL, 0};
+static struct opt_str binary_file         = {NULL, 0};
+
+// Writes the results in binary_file (NULL if not set)
+static record_writer_t * record_writer = NULL;
+
+// Status of the measurement (single target mode)
+static record_status_t trace_status = RECORD_STATUS_UNKNOWN;
 
 struct opt_spec runnable_options[] = {
     // action                 sf          lf                   metavar             help                     data
@@ -92,6 +116,10 @@ struct opt_spec runnable_options[] = {
     {opt_store_choice,        "P",        "--protocol",        "PROTOCOL",         TRACEROUTE_HELP_P,       protocol_names},
     {opt_store_1,             "T",        "--tcp",             OPT_NO_METAVAR,     TRACEROUTE_HELP_T,       &is_tcp},
     {opt_store_1,             "U",        "--udp",             OPT_NO_METAVAR,     TRACEROUTE_HELP_U,       &is_udp},
+    {opt_store_str,           OPT_NO_SF,  "--topology-cache-file", "FILE",         TRACEROUTE_HELP_TOPOLOGY_CACHE_FILE, &topology_cache_file},
+    {opt_store_str,           OPT_NO_SF,  "--targets",         "FILE",             TRACEROUTE_HELP_TARGETS, &targets_file},
+    {opt_store_int_lim,       OPT_NO_SF,  "--max-instances",   "NUM",              TRACEROUTE_HELP_MAX_INSTANCES, max_instances},
+    {opt_store_str,           OPT_NO_SF,  "--binary",          "FILE",             TRACEROUTE_HELP_BINARY,  &binary_file},
     END_OPT_SPECS
 };
 
@@ -111,6 +139,7 @@ static options_t * init_options(char * version) {
     options_add_optspecs(options, runnable_options);
     options_add_optspecs(options, traceroute_get_options());
     options_add_optspecs(options, mda_get_options());
+    options_add_optspecs(options, yarrp_get_options());
     options_add_optspecs(options, network_get_options());
     options_add_optspecs(options, pt_loop_get_options());
     options_add_common  (options, version);
@@ -194,6 +223,151 @@ static bool check_options(
 // Command-line / libparistraceroute translation
 //---------------------------------------------------------------------------
 
+//---------------------------------------------------------------------------
+// Binary output (--binary)
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Retrieve the status of a measurement according to an event
+ *    raised by traceroute.
+ * \param type The type of the traceroute event.
+ * \return The corresponding status, RECORD_STATUS_UNKNOWN if this
+ *    event does not stop the forward probing.
+ */
+
+static record_status_t traceroute_event_get_status(traceroute_event_type_t type)
+{
+    switch (type) {
+        case TRACEROUTE_DESTINATION_REACHED: return RECORD_STATUS_REACHED;
+        case TRACEROUTE_MAX_TTL_REACHED:     return RECORD_STATUS_MAX_TTL;
+        case TRACEROUTE_TOO_MANY_STARS:      return RECORD_STATUS_TOO_MANY_STARS;
+        case TRACEROUTE_STOP_SET_REACHED:    return RECORD_STATUS_STOP_SET;
+        default:                             return RECORD_STATUS_UNKNOWN;
+    }
+}
+
+/**
+ * \brief Write a RECORD_TRACE_START record.
+ * \param trace_id The identifier of the measurement.
+ * \param algorithm_name The name of the algorithm.
+ * \param protocol_name The protocol of the probes.
+ * \param dst_addr The destination, NULL if unknown.
+ */
+
+static void record_trace_start(uint32_t trace_id, const char * algorithm_name, const char * protocol_name, const address_t * dst_addr)
+{
+    record_t record;
+
+    memset(&record, 0, sizeof(record_t));
+    record.type     = RECORD_TRACE_START;
+    record.trace_id = trace_id;
+    record.trace_start.start_time = get_timestamp();
+    strncpy(record.trace_start.algorithm, algorithm_name, RECORD_NAME_MAX - 1);
+    strncpy(record.trace_start.protocol,  protocol_name,  RECORD_NAME_MAX - 1);
+    if (dst_addr) record.trace_start.dst_addr = *dst_addr;
+    record_write(record_writer, &record);
+}
+
+/**
+ * \brief Write a RECORD_TRACE_END record.
+ * \param trace_id The identifier of the measurement.
+ * \param status Why the measurement has stopped.
+ */
+
+static void record_trace_end(uint32_t trace_id, record_status_t status)
+{
+    record_t record = {
+        .type     = RECORD_TRACE_END,
+        .trace_id = trace_id,
+        .status   = status
+    };
+
+    record_write(record_writer, &record);
+}
+
+/**
+ * \brief Copy the address of an IP hop discovered by mda.
+ * \param address The address to fill (AF_UNSPEC for a star).
+ * \param interface The IP hop, NULL if none.
+ */
+
+static inline void record_set_interface(address_t * address, const mda_interface_t * interface)
+{
+    if (interface && interface->address) {
+        *address = *interface->address;
+    } else memset(address, 0, sizeof(address_t));
+}
+
+/**
+ * \brief Fill the record corresponding to an event raised by an algorithm.
+ * \param record The record_t to fill.
+ * \param trace_id The identifier of the measurement.
+ * \param event The ALGORITHM_EVENT event.
+ * \return true iif this event corresponds to a record.
+ */
+
+static bool record_set_algorithm_event(record_t * record, uint32_t trace_id, const event_t * event)
+{
+    const char               * algorithm_name = event->issuer->algorithm->name;
+    const traceroute_event_t * traceroute_event;
+    const mda_event_t        * mda_event;
+    const probe_reply_t      * probe_reply;
+    const mda_interface_t   ** link;
+    const mda_hop_event_t    * hop_event;
+    const mda_link_event_t   * link_event;
+
+    memset(record, 0, sizeof(record_t));
+    record->trace_id = trace_id;
+
+    if (strcmp(algorithm_name, "traceroute") == 0) {
+        traceroute_event = event->data;
+        switch (traceroute_event->type) {
+            case TRACEROUTE_PROBE_REPLY:
+                probe_reply = traceroute_event->data;
+                if (!record_set_probe(record, trace_id, probe_reply->probe, probe_reply->reply)) return false;
+                break;
+            case TRACEROUTE_STAR:
+                if (!record_set_probe(record, trace_id, traceroute_event->data, NULL)) return false;
+                break;
+            default:
+                return false;
+        }
+    } else if (strcmp(algorithm_name, "mda") == 0) {
+        mda_event = event->data;
+        switch (mda_event->type) {
+            case MDA_NEW_LINK:
+                link = mda_event->data;
+                record->type            = RECORD_LINK;
+                record->link.ttl        = link[0]->num_ttls ? link[0]->ttl_set[0] : 0;
+                record->link.has_target = (link[1] != NULL);
+                record_set_interface(&record->link.source, link[0]);
+                record_set_interface(&record->link.target, link[1]);
+                break;
+            case MDA_NEW_HOP:
+            case MDA_HOP_COMPLETED:
+                hop_event = mda_event->data;
+                record->type         = RECORD_HOP;
+                record->hop.ttl      = hop_event->ttl;
+                record->hop.flags    = mda_event->type == MDA_HOP_COMPLETED ? RECORD_HOP_COMPLETED : 0;
+                record->hop.num_next = hop_event->num_next;
+                if (!hop_event->is_star) record->hop.address = hop_event->address;
+                break;
+            case MDA_LINK_PROBED:
+                link_event = mda_event->data;
+                record->type          = RECORD_PROBE;
+                record->probe.ttl     = link_event->ttl;
+                record->probe.flow_id = link_event->flow_id;
+                record->probe.rtt     = link_event->rtt;
+                if (!link_event->target.is_star) record->probe.reply_addr = link_event->target.address;
+                break;
+            default:
+                return false;
+        }
+    } else return false;
+
+    return true;
+}
+
 /**
  * \brief Handle events raised by libparistraceroute.
  * \param loop The main loop.
@@ -208,18 +382,38 @@ void loop_handler(pt_loop_t * loop, event_t * event, void * user_data)
     const traceroute_options_t * traceroute_options;
     const traceroute_data_t    * traceroute_data;
     mda_event_t                * mda_event;
+    yarrp_event_t              * yarrp_event;
     mda_data_t                 * mda_data;
     const char                 * algorithm_name;
+    record_t                     record;
 
     switch (event->type) {
         case ALGORITHM_HAS_TERMINATED:
             algorithm_name = event->issuer->algorithm->name;
+            if (record_writer) {
+                if (trace_status == RECORD_STATUS_UNKNOWN && loop->status != PT_LOOP_INTERRUPTED) {
+                    trace_status = RECORD_STATUS_COMPLETED;
+                }
+                record_trace_end(0, trace_status);
+            }
+
             if (strcmp(algorithm_name, "mda") == 0) {
                 mda_data = event->issuer->data;
-                printf("Lattice:\n");
-                lattice_dump(mda_data->lattice, (ELEMENT_DUMP) mda_lattice_elt_dump);
-                printf("\n");
+                if (!record_writer) {
+                    fprintf(pt_loop_get_stream(loop), "Lattice:\n");
+                    lattice_fprintf(pt_loop_get_stream(loop), mda_data->lattice, (ELEMENT_FPRINTF) mda_lattice_elt_dump);
+                    fprintf(pt_loop_get_stream(loop), "\n");
+                }
                 mda_data_free(mda_data);
+            } else if (strcmp(algorithm_name, "yarrp") == 0) {
+                yarrp_data_free(event->issuer->data);
+                event->issuer->data = NULL;
+            } else if (strcmp(algorithm_name, "traceroute") == 0) {
+                if (is_debug && event->issuer->data) {
+                    traceroute_data_dump_stats(event->issuer->data);
+                }
+                traceroute_data_free(event->issuer->data);
+                event->issuer->data = NULL;
             }
 
             // Tell to the algorithm it can free its data
@@ -233,16 +427,38 @@ void loop_handler(pt_loop_t * loop, event_t * event, void * user_data)
             break;
         case ALGORITHM_EVENT:
             algorithm_name = event->issuer->algorithm->name;
-            if (strcmp(algorithm_name, "mda") == 0) {
+            if (record_writer) {
+                // The results are written instead of being printed
+                if (record_set_algorithm_event(&record, 0, event)) {
+                    record_write(record_writer, &record);
+                }
+                if (strcmp(algorithm_name, "traceroute") == 0 && trace_status == RECORD_STATUS_UNKNOWN) {
+                    trace_status = traceroute_event_get_status(((traceroute_event_t *) event->data)->type);
+                }
+            } else if (strcmp(algorithm_name, "mda") == 0) {
                 mda_event = event->data;
                 traceroute_options = event->issuer->options; // mda_options inherits traceroute_options
                 switch (mda_event->type) {
                     case MDA_NEW_LINK:
-                        mda_link_dump(mda_event->data, traceroute_options->do_resolv);
+                        mda_link_dump(pt_loop_get_hole_stream(loop), mda_event->data, traceroute_options->do_resolv ? pt_loop_get_resolver(loop) : NULL);
+                        break;
+                    case MDA_NEW_HOP:
+                        mda_hop_event_dump(pt_loop_get_stream(loop), mda_event->data);
+                        break;
+                    case MDA_LINK_PROBED:
+                        mda_link_event_dump(pt_loop_get_stream(loop), mda_event->data);
+                        break;
+                    case MDA_HOP_COMPLETED:
+                        mda_hop_completed_event_dump(pt_loop_get_stream(loop), mda_event->data);
                         break;
                     default:
                         break;
                 }
+            } else if (strcmp(algorithm_name, "yarrp") == 0) {
+                yarrp_event = event->data;
+                if (yarrp_event->type == YARRP_REPLY) {
+                    yarrp_reply_dump(pt_loop_get_stream(loop), yarrp_event->data);
+                }
             } else if (strcmp(algorithm_name, "traceroute") == 0) {
                 traceroute_event   = event->data;
                 traceroute_options = event->issuer->options;
@@ -293,87 +509,34 @@ const char * get_protocol_name(int family, bool use_icmp, bool use_tcp, bool use
     return NULL;
 }
 
-//---------------------------------------------------------------------------
-// Main program
-//---------------------------------------------------------------------------
+/**
+ * \brief Prepare the probe skeleton of an algorithm instance.
+ * \param dst_addr The destination of the probes.
+ * \param use_icmp Pass true to send ICMP probes.
+ * \param use_tcp Pass true to send TCP probes.
+ * \param use_udp Pass true to send UDP probes.
+ * \return The newly allocated probe skeleton, NULL otherwise.
+ */
 
-int main(int argc, char ** argv)
+static probe_t * probe_skel_create(const address_t * dst_addr, bool use_icmp, bool use_tcp, bool use_udp)
 {
-    int                       exit_code = EXIT_FAILURE;
-    char                    * version = strdup("version 1.0");
-    const char              * usage = "usage: %s [options] host\n";
-    void                    * algorithm_options;
-    traceroute_options_t      traceroute_options;
-    traceroute_options_t    * ptraceroute_options;
-    mda_options_t             mda_options;
-    probe_t                 * probe;
-    pt_loop_t               * loop;
-    int                       family;
-    address_t                 dst_addr;
-    options_t               * options;
-    char                    * dst_ip;
-    const char              * algorithm_name;
-    const char              * protocol_name;
-    bool                      use_icmp, use_udp, use_tcp;
-
-    // Prepare the commande line options
-    if (!(options = init_options(version))) {
-        fprintf(stderr, "E: Can't initialize options\n");
-        goto ERR_INIT_OPTIONS;
-    }
-
-    // Retrieve values passed in the command-line
-    if (options_parse(options, usage, argv) != 1) {
-        fprintf(stderr, "%s: destination required\n", basename(argv[0]));
-        goto ERR_OPT_PARSE;
-    }
+    probe_t * probe;
 
-    // We assume that the target IP address is always the last argument
-    dst_ip         = argv[argc - 1];
-    algorithm_name = algorithm_names[0];
-    protocol_name  = protocol_names[0];
-
-    // Checking if there is any conflicts between options passed in the commandline
-    if (!check_options(is_icmp, is_tcp, is_udp, is_ipv4, is_ipv6, dst_port[3], src_port[3], protocol_name, algorithm_name)) {
-        goto ERR_CHECK_OPTIONS;
-    }
-
-    use_icmp = is_icmp || strcmp(protocol_name, "icmp") == 0;
-    use_tcp  = is_tcp  || strcmp(protocol_name, "tcp")  == 0;
-    use_udp  = is_udp  || strcmp(protocol_name, "udp")  == 0;
-
-    // If not any ip version is set, call address_guess_family.
-    // If only one is set to true, set family to AF_INET or AF_INET6
-    if (is_ipv4) {
-        family = AF_INET;
-    } else if (is_ipv6) {
-        family = AF_INET6;
-    } else {
-        // Get address family if not defined by the user
-        if (!address_guess_family(dst_ip, &family)) goto ERR_ADDRESS_GUESS_FAMILY;
-    }
-
-    // Translate the string IP / FQDN into an address_t * instance
-    if (address_from_string(family, dst_ip, &dst_addr) != 0) {
-        fprintf(stderr, "E: Invalid destination address %s\n", dst_ip);
-        goto ERR_ADDRESS_IP_FROM_STRING;
-    }
-
-    // Probe skeleton definition: IPv4/UDP probe targetting 'dst_ip'
+    // Probe skeleton definition: IPv4/UDP probe targetting 'dst_addr'
     if (!(probe = probe_create())) {
         fprintf(stderr,"E: Cannot create probe skeleton");
-        goto ERR_PROBE_CREATE;
+        return NULL;
     }
 
     // Prepare the probe skeleton
     probe_set_protocols(
         probe,
-        get_ip_protocol_name(family),                          // "ipv4"   | "ipv6"
-        get_protocol_name(family, use_icmp, use_tcp, use_udp), // "icmpv4" | "icmpv6" | "tcp" | "udp"
+        get_ip_protocol_name(dst_addr->family),                          // "ipv4"   | "ipv6"
+        get_protocol_name(dst_addr->family, use_icmp, use_tcp, use_udp), // "icmpv4" | "icmpv6" | "tcp" | "udp"
         NULL
     );
 
-    probe_set_field(probe, ADDRESS("dst_ip", &dst_addr));
+    probe_set_fields(probe, ADDRESS("dst_ip", dst_addr), NULL);
 
     if (send_time[3]) {
         if(send_time[0] <= 10) { // seconds
@@ -410,27 +573,611 @@ int main(int argc, char ** argv)
         probe_payload_resize(probe, 2);
     }
 
-    // Algorithm options (dedicated options)
-    if (strcmp(algorithm_name, "paris-traceroute") == 0) {
-        traceroute_options  = traceroute_get_default_options();
-        ptraceroute_options = &traceroute_options;
-        algorithm_options   = &traceroute_options;
-        algorithm_name      = "traceroute";
-    } else if ((strcmp(algorithm_name, "mda") == 0) || options_mda_get_is_set()) {
-        mda_options         = mda_get_default_options();
-        ptraceroute_options = &mda_options.traceroute_options;
-        algorithm_options   = &mda_options;
-        options_mda_init(&mda_options);
+    return probe;
+}
+
+//---------------------------------------------------------------------------
+// Standard output (--output-buffer)
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Buffer the standard output in an output_t. STDOUT_FILENO is switched
+ *    to non-blocking mode, so that a slow consumer never delays the probes.
+ * \param capacity The size of the ring buffer.
+ * \param pflags Where the flags of STDOUT_FILENO are saved (see stdout_output_free).
+ * \return The newly allocated output_t instance, NULL otherwise.
+ */
+
+static output_t * stdout_output_create(size_t capacity, int * pflags)
+{
+    output_t * output;
+
+    fflush(stdout);
+    if ((*pflags = fcntl(STDOUT_FILENO, F_GETFL)) == -1)           goto ERR_FCNTL_GETFL;
+    if (!(output = output_create(STDOUT_FILENO, capacity)))       goto ERR_OUTPUT_CREATE;
+    if (fcntl(STDOUT_FILENO, F_SETFL, *pflags | O_NONBLOCK) == -1) goto ERR_FCNTL_SETFL;
+    return output;
+
+ERR_FCNTL_SETFL:
+    output_free(output);
+ERR_OUTPUT_CREATE:
+ERR_FCNTL_GETFL:
+    return NULL;
+}
+
+/**
+ * \brief Restore the flags of STDOUT_FILENO, write the pending bytes of
+ *    the standard output (this may block) and release its output_t.
+ * \param output The output_t returned by stdout_output_create (NULL if none).
+ * \param flags The flags saved by stdout_output_create.
+ */
+
+static void stdout_output_free(output_t * output, int flags)
+{
+    if (output) {
+        fcntl(STDOUT_FILENO, F_SETFL, flags);
+        output_free(output);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Bulk mode (--targets)
+//---------------------------------------------------------------------------
+
+// In bulk mode, the targets are read from a file and measured by up to
+// max_instances algorithm instances running in the same loop. Each time
+// an instance terminates, its result is printed on a single line:
+//
+//   DST ALGORITHM PROTOCOL STATUS HOP...
+//
+// - paris-traceroute: each HOP is TTL:ADDRESS:RTT (RTT in ms) or TTL:* (star).
+// - mda: each HOP is a link TTL:ADDRESS>ADDRESS, where ADDRESS is * for a star.
+//   The last IP hops of the lattice may have no successor (TTL:ADDRESS).
+
+typedef struct {
+    union {
+        traceroute_options_t traceroute_options;
+        mda_options_t        mda_options;
+    } options;                    /**< Options of the instance. Must remain the first field (see bulk_target_from_instance) */
+    char        * dst_ip;         /**< The target, as read in the input */
+    address_t     dst_addr;       /**< The address of the target */
+    const char  * algorithm_name; /**< "paris-traceroute" or "mda" */
+    const char  * protocol_name;  /**< "udp", "icmp" or "tcp" */
+    probe_t     * probe;          /**< Probe skeleton of the instance */
+    uint32_t        trace_id;       /**< Identifies the target in the binary output */
+    record_status_t status;         /**< Why the measurement has stopped, RECORD_STATUS_UNKNOWN while running */
+    FILE        * hops;           /**< Stream filling hops_buffer, NULL once closed */
+    char        * hops_buffer;    /**< Hops discovered so far (see bulk_target_dump) */
+    size_t        hops_size;      /**< Size of hops_buffer */
+} bulk_target_t;
+
+typedef struct {
+    FILE        * input;          /**< The targets, one per line */
+    size_t        line_number;    /**< Number of lines read so far */
+    size_t        num_targets;    /**< Number of targets read so far */
+    size_t        num_instances;  /**< Number of running instances */
+    size_t        max_instances;  /**< Maximum number of running instances */
+} bulk_t;
+
+/**
+ * \brief Allocate a bulk_target_t instance.
+ * \param dst_ip The target.
+ * \param algorithm_name The algorithm used to measure this target.
+ * \param protocol_name The protocol of the probes.
+ * \return The newly allocated bulk_target_t instance, NULL otherwise.
+ */
+
+static bulk_target_t * bulk_target_create(const char * dst_ip, const char * algorithm_name, const char * protocol_name)
+{
+    bulk_target_t * target;
+
+    if (!(target = calloc(1, sizeof(bulk_target_t)))) goto ERR_CALLOC;
+    if (!(target->dst_ip = strdup(dst_ip)))           goto ERR_STRDUP;
+    if (!(target->hops = open_memstream(&target->hops_buffer, &target->hops_size))) {
+        goto ERR_OPEN_MEMSTREAM;
+    }
+    target->algorithm_name = algorithm_name;
+    target->protocol_name  = protocol_name;
+    return target;
+
+ERR_OPEN_MEMSTREAM:
+    free(target->dst_ip);
+ERR_STRDUP:
+    free(target);
+ERR_CALLOC:
+    return NULL;
+}
+
+/**
+ * \brief Release a bulk_target_t instance from the memory.
+ * \param target The bulk_target_t instance.
+ */
+
+static void bulk_target_free(bulk_target_t * target)
+{
+    if (target) {
+        if (target->hops) fclose(target->hops);
+        free(target->hops_buffer);
+        probe_free(target->probe);
+        free(target->dst_ip);
+        free(target);
+    }
+}
+
+/**
+ * \brief Retrieve the target measured by an algorithm instance.
+ * \param instance An instance added by bulk_start_target.
+ * \return The corresponding bulk_target_t instance.
+ */
+
+static inline bulk_target_t * bulk_target_from_instance(const algorithm_instance_t * instance) {
+    // instance->options points to the first field of the target
+    return (bulk_target_t *) instance->options;
+}
+
+/**
+ * \brief Print the result of a target on a single line
+ *    (or write its RECORD_TRACE_END record).
+ * \param loop The main loop.
+ * \param target The bulk_target_t instance.
+ */
+
+static void bulk_target_dump(pt_loop_t * loop, bulk_target_t * target)
+{
+    // The hops have already been written
+    if (record_writer) {
+        record_trace_end(target->trace_id, target->status);
+        return;
+    }
+
+    // Flush the hops in hops_buffer
+    fclose(target->hops);
+    target->hops = NULL;
+
+    fprintf(pt_loop_get_stream(loop), "%s %s %s %s%s\n",
+        target->dst_ip,
+        target->algorithm_name,
+        target->protocol_name,
+        record_status_to_string(target->status),
+        target->hops_buffer ? target->hops_buffer : ""
+    );
+
+    // Let the consumer process this record while the other targets are measured
+    hole_stream_flush(pt_loop_get_hole_stream(loop));
+}
+
+/**
+ * \brief Prepare the options and the probe skeleton of a target.
+ * \param target The bulk_target_t instance.
+ * \return true iif successful.
+ */
+
+static bool bulk_target_init(bulk_target_t * target)
+{
+    traceroute_options_t * traceroute_options;
+    int                    family;
+
+    // Translate the string IP / FQDN into an address_t * instance
+    if (is_ipv4) {
+        family = AF_INET;
+    } else if (is_ipv6) {
+        family = AF_INET6;
+    } else if (!address_guess_family(target->dst_ip, &family)) {
+        fprintf(stderr, "E: Cannot guess the address family of %s\n", target->dst_ip);
+        return false;
+    }
+
+    if (address_from_string(family, target->dst_ip, &target->dst_addr) != 0) {
+        fprintf(stderr, "E: Invalid destination address %s\n", target->dst_ip);
+        return false;
+    }
+
+    if (!(target->probe = probe_skel_create(
+        &target->dst_addr,
+        strcmp(target->protocol_name, "icmp") == 0,
+        strcmp(target->protocol_name, "tcp")  == 0,
+        strcmp(target->protocol_name, "udp")  == 0
+    ))) {
+        return false;
+    }
+
+    if (strcmp(target->algorithm_name, "paris-traceroute") == 0) {
+        target->options.traceroute_options = traceroute_get_default_options();
+        traceroute_options = &target->options.traceroute_options;
+    } else if (strcmp(target->algorithm_name, "mda") == 0) {
+        target->options.mda_options = mda_get_default_options();
+        options_mda_init(&target->options.mda_options);
+
+        // The links are retrieved from the MDA_NEW_LINK events
+        target->options.mda_options.stream = false;
+        traceroute_options = &target->options.mda_options.traceroute_options;
     } else {
-        fprintf(stderr, "E: Unknown algorithm");
-        goto ERR_UNKNOWN_ALGORITHM;
+        fprintf(stderr, "E: Algorithm %s cannot be used with --targets\n", target->algorithm_name);
+        return false;
+    }
+
+    options_traceroute_init(traceroute_options, &target->dst_addr);
+    traceroute_options->use_topology_cache |= (topology_cache_file.s != NULL);
+    return true;
+}
+
+/**
+ * \brief Search a string in a NULL-terminated array of strings.
+ * \param names The array of strings.
+ * \param name The searched string.
+ * \return The matching string of names, NULL if not found.
+ */
+
+static const char * bulk_find_name(const char ** names, const char * name)
+{
+    for (; *names; names++) {
+        if (strcmp(*names, name) == 0) return *names;
+    }
+    return NULL;
+}
+
+/**
+ * \brief Start the measurement of a target.
+ * \param loop The main loop.
+ * \param bulk The bulk_t instance.
+ * \param line A line of the input: DST [ALGORITHM [PROTOCOL]].
+ * \return true iif an instance has been started. Otherwise, the
+ *    line is either empty or its result has been printed.
+ */
+
+static bool bulk_start_target(pt_loop_t * loop, bulk_t * bulk, char * line)
+{
+    bulk_target_t * target;
+    const char    * dst_ip, * algorithm_name, * protocol_name;
+    char          * token, * saveptr;
+    bool            is_valid = true;
+
+    // Ignore comments and empty lines
+    if ((token = strchr(line, '#'))) *token = '\0';
+    if (!(dst_ip = strtok_r(line, " \t\r\n", &saveptr))) return false;
+
+    // Optional per-target algorithm and protocol (see opt_store_choice)
+    algorithm_name = algorithm_names[0];
+    protocol_name  = is_icmp ? "icmp" : is_tcp ? "tcp" : is_udp ? "udp" : protocol_names[0];
+    if ((token = strtok_r(NULL, " \t\r\n", &saveptr))) {
+        if (!(algorithm_name = bulk_find_name(algorithm_names, token))) {
+            fprintf(stderr, "E: line %zu: Unknown algorithm %s\n", bulk->line_number, token);
+            algorithm_name = "-";
+            is_valid = false;
+        } else if ((token = strtok_r(NULL, " \t\r\n", &saveptr)) && !(protocol_name = bulk_find_name(protocol_names, token))) {
+            fprintf(stderr, "E: line %zu: Unknown protocol %s\n", bulk->line_number, token);
+            protocol_name = "-";
+            is_valid = false;
+        }
+    }
+
+    if (!(target = bulk_target_create(dst_ip, algorithm_name, protocol_name))) {
+        perror("bulk_start_target");
+        return false;
+    }
+
+    target->trace_id = bulk->num_targets++;
+    if (!is_valid) goto ERR_INVALID_TARGET;
+    if (!bulk_target_init(target)) goto ERR_INVALID_TARGET;
+    if (record_writer) {
+        record_trace_start(target->trace_id, target->algorithm_name, target->protocol_name, &target->dst_addr);
     }
 
-    // Algorithm options (common options)
-    options_traceroute_init(ptraceroute_options, &dst_addr);
+    if (!pt_add_instance(loop, strcmp(algorithm_name, "mda") == 0 ? "mda" : "traceroute", &target->options, target->probe)) {
+        fprintf(stderr, "E: Cannot add the chosen algorithm\n");
+        goto ERR_INVALID_TARGET;
+    }
+
+    bulk->num_instances++;
+    return true;
+
+ERR_INVALID_TARGET:
+    if (record_writer) {
+        record_trace_start(target->trace_id, target->algorithm_name, target->protocol_name, NULL);
+    }
+    target->status = RECORD_STATUS_ERROR;
+    bulk_target_dump(loop, target);
+    bulk_target_free(target);
+    return false;
+}
+
+/**
+ * \brief Start the measurement of the next targets, as long as
+ *    bulk->max_instances is not reached. Stop the loop once every
+ *    target has been measured.
+ * \param loop The main loop.
+ * \param bulk The bulk_t instance.
+ */
+
+static void bulk_start_targets(pt_loop_t * loop, bulk_t * bulk)
+{
+    char  * line = NULL;
+    size_t  size = 0;
+
+    // After a ctrl-c, let the running instances terminate
+    while (bulk->input && loop->status != PT_LOOP_INTERRUPTED && bulk->num_instances < bulk->max_instances) {
+        if (getline(&line, &size, bulk->input) == -1) {
+            if (bulk->input != stdin) fclose(bulk->input);
+            bulk->input = NULL;
+            break;
+        }
+        bulk->line_number++;
+        bulk_start_target(loop, bulk, line);
+    }
+    free(line);
+
+    if (bulk->num_instances == 0) {
+        pt_loop_terminate(loop);
+    }
+}
+
+/**
+ * \brief Print in the result of a target the address of a record.
+ * \param target The bulk_target_t instance.
+ * \param address The address (AF_UNSPEC for a star).
+ */
+
+static inline void bulk_target_add_address(bulk_target_t * target, const address_t * address)
+{
+    if (address->family != AF_UNSPEC) {
+        address_fprintf(target->hops, address);
+    } else fprintf(target->hops, "*");
+}
+
+/**
+ * \brief Print in the result of a target a probe or a link.
+ * \param target The bulk_target_t instance.
+ * \param record The record (see record_set_algorithm_event).
+ */
+
+static void bulk_target_add_record(bulk_target_t * target, const record_t * record)
+{
+    switch (record->type) {
+        case RECORD_PROBE:
+            fprintf(target->hops, " %hhu:", record->probe.ttl);
+            bulk_target_add_address(target, &record->probe.reply_addr);
+            if (record->probe.reply_addr.family != AF_UNSPEC) {
+                fprintf(target->hops, ":%.3lf", record->probe.rtt);
+            }
+            break;
+        case RECORD_LINK:
+            fprintf(target->hops, " %hhu:", record->link.ttl);
+            bulk_target_add_address(target, &record->link.source);
+            if (record->link.has_target) {
+                fprintf(target->hops, ">");
+                bulk_target_add_address(target, &record->link.target);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * \brief Handle events raised by libparistraceroute in bulk mode.
+ * \param loop The main loop.
+ * \param event The event raised by libparistraceroute.
+ * \param user_data Points to the bulk_t instance.
+ */
+
+void bulk_handler(pt_loop_t * loop, event_t * event, void * user_data)
+{
+    bulk_t           * bulk = user_data;
+    bulk_target_t    * target = event->issuer ? bulk_target_from_instance(event->issuer) : NULL;
+    const char       * algorithm_name;
+    record_t           record;
+
+    switch (event->type) {
+        case ALGORITHM_EVENT:
+            algorithm_name = event->issuer->algorithm->name;
+            if (strcmp(algorithm_name, "traceroute") == 0 && target->status == RECORD_STATUS_UNKNOWN) {
+                // Doubletree: keep the reason why the forward probing has stopped
+                target->status = traceroute_event_get_status(((traceroute_event_t *) event->data)->type);
+            }
+            if (record_set_algorithm_event(&record, target->trace_id, event)) {
+                if (record_writer) {
+                    record_write(record_writer, &record);
+                } else bulk_target_add_record(target, &record);
+            }
+            break;
+        case ALGORITHM_ERROR:
+        case ALGORITHM_HAS_TERMINATED:
+            if (event->type == ALGORITHM_ERROR) {
+                target->status = RECORD_STATUS_ERROR;
+            } else if (target->status == RECORD_STATUS_UNKNOWN && loop->status != PT_LOOP_INTERRUPTED) {
+                target->status = RECORD_STATUS_COMPLETED;
+            }
+            bulk_target_dump(loop, target);
+
+            // The caller has to free the data allocated by the algorithm
+            algorithm_name = event->issuer->algorithm->name;
+            if (strcmp(algorithm_name, "mda") == 0) {
+                mda_data_free(event->issuer->data);
+            } else if (strcmp(algorithm_name, "traceroute") == 0) {
+                traceroute_data_free(event->issuer->data);
+            }
+            event->issuer->data = NULL;
+
+            // Tell to the algorithm it can free its data
+            pt_stop_instance(loop, event->issuer);
+
+            // Remove the application from the loop.
+            pt_del_instance(loop, event->issuer);
+            bulk_target_free(target);
+            bulk->num_instances--;
+
+            // Replace this instance by the next target (if any)
+            bulk_start_targets(loop, bulk);
+            break;
+        default:
+            break;
+    }
+    event_free(event);
+}
+
+//---------------------------------------------------------------------------
+// Main program
+//---------------------------------------------------------------------------
+
+int main(int argc, char ** argv)
+{
+    int                       exit_code = EXIT_FAILURE;
+    char                    * version = strdup("version 1.0");
+    const char              * usage = "usage: %s [options] (host | --targets FILE)\n";
+    void                    * algorithm_options = NULL;
+    traceroute_options_t      traceroute_options;
+    traceroute_options_t    * ptraceroute_options = NULL;
+    mda_options_t             mda_options;
+    yarrp_options_t           yarrp_options;
+    probe_t                 * probe = NULL;
+    pt_loop_t               * loop;
+    topology_cache_t        * topology_cache;
+    int                       family;
+    address_t                 dst_addr;
+    options_t               * options;
+    char                    * dst_ip = NULL;
+    const char              * algorithm_name;
+    const char              * protocol_name;
+    bool                      use_icmp = false, use_udp = false, use_tcp = false;
+    bulk_t                    bulk;
+    int                       binary_fd = -1;
+    output_t                * stdout_output = NULL;
+    output_t                * binary_output = NULL;
+    int                       stdout_flags = 0;
+
+    // Prepare the commande line options
+    if (!(options = init_options(version))) {
+        fprintf(stderr, "E: Can't initialize options\n");
+        goto ERR_INIT_OPTIONS;
+    }
+
+    // Retrieve values passed in the command-line. In bulk mode,
+    // the targets are read from targets_file instead.
+    if (options_parse(options, usage, argv) != (targets_file.s ? 0 : 1)) {
+        fprintf(stderr, "%s: %s\n", basename(argv[0]), targets_file.s ? "unexpected destination with --targets" : "destination required");
+        goto ERR_OPT_PARSE;
+    }
+
+    algorithm_name = algorithm_names[0];
+    protocol_name  = protocol_names[0];
+
+    // Checking if there is any conflicts between options passed in the commandline
+    if (!check_options(is_icmp, is_tcp, is_udp, is_ipv4, is_ipv6, dst_port[3], src_port[3], protocol_name, algorithm_name)) {
+        goto ERR_CHECK_OPTIONS;
+    }
+
+    if (!targets_file.s) {
+        // We assume that the target IP address is always the last argument
+        dst_ip   = argv[argc - 1];
+        use_icmp = is_icmp || strcmp(protocol_name, "icmp") == 0;
+        use_tcp  = is_tcp  || strcmp(protocol_name, "tcp")  == 0;
+        use_udp  = is_udp  || strcmp(protocol_name, "udp")  == 0;
+
+        // If not any ip version is set, call address_guess_family.
+        // If only one is set to true, set family to AF_INET or AF_INET6
+        if (is_ipv4) {
+            family = AF_INET;
+        } else if (is_ipv6) {
+            family = AF_INET6;
+        } else {
+            // Get address family if not defined by the user
+            if (!address_guess_family(dst_ip, &family)) goto ERR_ADDRESS_GUESS_FAMILY;
+        }
+
+        // Translate the string IP / FQDN into an address_t * instance
+        if (address_from_string(family, dst_ip, &dst_addr) != 0) {
+            fprintf(stderr, "E: Invalid destination address %s\n", dst_ip);
+            goto ERR_ADDRESS_IP_FROM_STRING;
+        }
+
+        if (!(probe = probe_skel_create(&dst_addr, use_icmp, use_tcp, use_udp))) {
+            goto ERR_PROBE_CREATE;
+        }
+
+        // Algorithm options (dedicated options)
+        if (strcmp(algorithm_name, "paris-traceroute") == 0) {
+            traceroute_options  = traceroute_get_default_options();
+            ptraceroute_options = &traceroute_options;
+            algorithm_options   = &traceroute_options;
+            algorithm_name      = "traceroute";
+        } else if ((strcmp(algorithm_name, "mda") == 0) || options_mda_get_is_set()) {
+            mda_options         = mda_get_default_options();
+            ptraceroute_options = &mda_options.traceroute_options;
+            algorithm_options   = &mda_options;
+            options_mda_init(&mda_options);
+        } else if (strcmp(algorithm_name, "yarrp") == 0) {
+            if (binary_file.s) {
+                fprintf(stderr, "E: --binary cannot be used with yarrp\n");
+                goto ERR_UNKNOWN_ALGORITHM;
+            }
+            yarrp_options       = yarrp_get_default_options();
+            ptraceroute_options = &yarrp_options.traceroute_options;
+            algorithm_options   = &yarrp_options;
+            options_yarrp_init(&yarrp_options);
+        } else {
+            fprintf(stderr, "E: Unknown algorithm");
+            goto ERR_UNKNOWN_ALGORITHM;
+        }
+
+        // Algorithm options (common options)
+        options_traceroute_init(ptraceroute_options, &dst_addr);
+        if (topology_cache_file.s) ptraceroute_options->use_topology_cache = true;
+    } else {
+        // Bulk mode: the targets are opened here and read by bulk_start_targets
+        memset(&bulk, 0, sizeof(bulk_t));
+        bulk.max_instances = max_instances[0];
+        if (!(bulk.input = strcmp(targets_file.s, "-") == 0 ? stdin : fopen(targets_file.s, "r"))) {
+            perror(targets_file.s);
+            goto ERR_TARGETS_OPEN;
+        }
+    }
+
+    // Write the standard output without delaying the probes
+    if (options_pt_loop_get_output_buffer()
+    && !(stdout_output = stdout_output_create(options_pt_loop_get_output_buffer(), &stdout_flags))) {
+        perror("Cannot buffer the standard output");
+    }
+
+    // Write the results in the binary record format
+    if (binary_file.s) {
+        binary_fd = strcmp(binary_file.s, "-") == 0 ? STDOUT_FILENO : open(binary_file.s, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (binary_fd == -1) {
+            perror(binary_file.s);
+            goto ERR_BINARY_OPEN;
+        }
+
+        // The records go through the buffered standard output, if any
+        if (binary_fd == STDOUT_FILENO && stdout_output) {
+            binary_output = stdout_output;
+        } else if (!(binary_output = output_create(binary_fd, RECORD_WRITER_DEFAULT_CAPACITY))) {
+            perror(binary_file.s);
+            goto ERR_BINARY_OUTPUT_CREATE;
+        }
+
+        if (!(record_writer = record_writer_create(binary_output))) {
+            fprintf(stderr, "E: Cannot create the record writer\n");
+            goto ERR_RECORD_WRITER_CREATE;
+        }
+    }
+
+    // Seed the topology cache shared by the algorithm instances
+    if (topology_cache_file.s) {
+        if (!(topology_cache = topology_cache_get_shared())) {
+            fprintf(stderr, "E: Cannot create the topology cache");
+            goto ERR_TOPOLOGY_CACHE_GET_SHARED;
+        }
+        if (access(topology_cache_file.s, F_OK) == 0
+        && !topology_cache_load(topology_cache, topology_cache_file.s)) {
+            goto ERR_TOPOLOGY_CACHE_LOAD;
+        }
+    }
 
     // Create libparistraceroute loop
-    if (!(loop = pt_loop_create(loop_handler, NULL))) {
+    if (!(loop = pt_loop_create_backend(
+        targets_file.s ? bulk_handler : loop_handler,
+        targets_file.s ? &bulk : NULL,
+        options_pt_loop_get_backend()
+    ))) {
         fprintf(stderr, "E: Cannot create libparistraceroute loop");
         goto ERR_LOOP_CREATE;
     }
@@ -438,44 +1185,78 @@ int main(int argc, char ** argv)
     // Set network options (network and verbose)
     options_network_init(loop->network, is_debug);
     options_pt_loop_init(loop);
+    if (stdout_output) pt_loop_set_output(loop, stdout_output);
 
-    printf("%s to %s (", algorithm_name, dst_ip);
-    address_dump(&dst_addr);
-    printf("), %u hops max, %u bytes packets\n",
-        ptraceroute_options->max_ttl,
-        (unsigned int)packet_get_size(probe->packet)
-    );
+    if (targets_file.s) {
+        // Start the first targets. The next ones are started by bulk_handler.
+        bulk_start_targets(loop, &bulk);
+    } else {
+        if (record_writer) {
+            // Same names as in the --targets file
+            record_trace_start(0, algorithm_names[0], use_icmp ? "icmp" : use_tcp ? "tcp" : "udp", &dst_addr);
+        } else {
+            fprintf(pt_loop_get_stream(loop), "%s to %s (", algorithm_name, dst_ip);
+            address_fprintf(pt_loop_get_stream(loop), &dst_addr);
+            fprintf(pt_loop_get_stream(loop), "), %u hops max, %u bytes packets\n",
+                ptraceroute_options->max_ttl,
+                (unsigned int)packet_get_size(probe->packet)
+            );
+        }
 
-    // Add an algorithm instance in the main loop
-    if (!pt_add_instance(loop, algorithm_name, algorithm_options, probe)) {
-        fprintf(stderr, "E: Cannot add the chosen algorithm");
-        goto ERR_INSTANCE;
+        // Add an algorithm instance in the main loop
+        if (!pt_add_instance(loop, algorithm_name, algorithm_options, probe)) {
+            fprintf(stderr, "E: Cannot add the chosen algorithm");
+            goto ERR_INSTANCE;
+        }
     }
 
     // Wait for events. They will be catched by handler_user()
-    if (pt_loop(loop) < 0) {
+    if ((!targets_file.s || bulk.num_instances > 0) && pt_loop(loop) < 0) {
         fprintf(stderr, "E: Main loop interrupted");
         goto ERR_PT_LOOP;
     }
+
+    // Save the hops discovered by this trace for the next ones
+    if (topology_cache_file.s && !topology_cache_save(topology_cache_get_shared(), topology_cache_file.s)) {
+        goto ERR_TOPOLOGY_CACHE_SAVE;
+    }
     exit_code = EXIT_SUCCESS;
 
     // Leave the program
+ERR_TOPOLOGY_CACHE_SAVE:
 ERR_PT_LOOP:
 ERR_INSTANCE:
     // pt_loop_free() automatically removes algorithms instances,
     // probe_replies and events from the memory.
     // Options and probe must be manually removed.
     pt_loop_free(loop);
+    bound_free_shared();
 ERR_LOOP_CREATE:
+ERR_TOPOLOGY_CACHE_LOAD:
+    topology_cache_free_shared();
+ERR_TOPOLOGY_CACHE_GET_SHARED:
+    record_writer_free(record_writer);
+ERR_RECORD_WRITER_CREATE:
+    // Write the records not yet written
+    if (binary_output != stdout_output) output_free(binary_output);
+ERR_BINARY_OUTPUT_CREATE:
+    if (binary_fd != -1 && binary_fd != STDOUT_FILENO) close(binary_fd);
+ERR_BINARY_OPEN:
+    stdout_output_free(stdout_output, stdout_flags);
+    if (targets_file.s && bulk.input && bulk.input != stdin) fclose(bulk.input);
 ERR_UNKNOWN_ALGORITHM:
     probe_free(probe);
 ERR_PROBE_CREATE:
 ERR_ADDRESS_IP_FROM_STRING:
 ERR_ADDRESS_GUESS_FAMILY:
-    if (errno) perror(gai_strerror(errno));
+    if (exit_code != EXIT_SUCCESS && errno) perror(gai_strerror(errno));
+ERR_TARGETS_OPEN:
 ERR_CHECK_OPTIONS:
 ERR_OPT_PARSE:
 ERR_INIT_OPTIONS:
+    if (topology_cache_file.s) free(topology_cache_file.s);
+    if (targets_file.s) free(targets_file.s);
+    if (binary_file.s) free(binary_file.s);
     free(version);
     exit(exit_code);
 }
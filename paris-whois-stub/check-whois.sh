@@ -0,0 +1,102 @@
+#!/bin/sh
+#
+# Run a whois_client_t (paris-whois-client) against a stand-in whois
+# server (paris-whois-stub):
+#   1) the hops of a whole trace are sent in a single batch,
+#   2) the connection is refused,
+#   3) the server never answers and the batch times out.
+#
+# The whois port (43) is privileged: unless it runs as root, this script
+# runs itself in a new user and network namespace (unshare -rn), and is
+# skipped if it cannot.
+
+STUB=${STUB:-./paris-whois-stub}
+CLIENT=${CLIENT:-./paris-whois-client}
+SERVER=127.0.0.43       # paris-whois-stub listens here
+NO_SERVER=127.0.0.44    # nothing listens here
+
+if [ "$(id -u)" != 0 ]; then
+    if [ -z "$CHECK_WHOIS_UNSHARED" ] && command -v unshare >/dev/null 2>&1; then
+        CHECK_WHOIS_UNSHARED=1 exec unshare -rn "$0" "$@"
+    fi
+    echo "check-whois: root privileges or unshare -rn are required, skipped"
+    exit 77
+fi
+if [ -n "$CHECK_WHOIS_UNSHARED" ]; then
+    ip link set lo up || exit 77
+fi
+
+TMPDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMPDIR"' EXIT
+num_failures=0
+
+# \brief Report a failed check.
+# \param $1 The name of the check.
+fail() {
+    echo "FAIL: $1"
+    sed 's/^/  stub: /' "$TMPDIR/stub.out"
+    sed 's/^/  client: /' "$TMPDIR/client.out" "$TMPDIR/client.err"
+    num_failures=$((num_failures + 1))
+}
+
+# \brief Start paris-whois-stub in background.
+# \param $@ The options of paris-whois-stub.
+start_stub() {
+    "$STUB" "$@" "$SERVER" > "$TMPDIR/stub.out" &
+    stub_pid=$!
+    sleep 1
+}
+
+# \brief Run paris-whois-client.
+# \param $1 The whois server.
+# \param $@ The queried addresses.
+run_client() {
+    server=$1
+    shift
+    "$CLIENT" "$server" "$@" > "$TMPDIR/client.out" 2> "$TMPDIR/client.err"
+}
+
+# 1) One batch for a whole trace
+start_stub
+if run_client "$SERVER" 10.0.0.1 10.1.0.2 10.2.0.3 10.3.0.0 \
+&& wait "$stub_pid" \
+&& grep -qx "batch 1: 4 addresses" "$TMPDIR/stub.out" \
+&& grep -qx "10.0.0.1 AS64513" "$TMPDIR/client.out" \
+&& grep -qx "10.1.0.2 AS64514" "$TMPDIR/client.out" \
+&& grep -qx "10.2.0.3 AS64515" "$TMPDIR/client.out" \
+&& grep -qx "10.3.0.0 NA" "$TMPDIR/client.out" \
+&& grep -q "4 addresses sent in 1 batches, 1 without ASN" "$TMPDIR/client.err"
+then
+    echo "PASS: one batch for a whole trace"
+else
+    fail "one batch for a whole trace"
+fi
+
+# 2) Refused connection
+: > "$TMPDIR/stub.out"
+if run_client "$NO_SERVER" 10.0.0.1 10.0.0.2 \
+&& grep -qx "10.0.0.1 NA" "$TMPDIR/client.out" \
+&& grep -qx "10.0.0.2 NA" "$TMPDIR/client.out" \
+&& grep -q "Connection refused" "$TMPDIR/client.err" \
+&& grep -q "2 addresses sent in 1 batches, 2 without ASN" "$TMPDIR/client.err"
+then
+    echo "PASS: refused connection"
+else
+    fail "refused connection"
+fi
+
+# 3) Server timeout (WHOIS_BULK_TIMEOUT)
+start_stub --silent
+if run_client "$SERVER" 10.0.0.1 10.0.0.2 \
+&& wait "$stub_pid" \
+&& grep -qx "batch 1: 2 addresses" "$TMPDIR/stub.out" \
+&& grep -qx "10.0.0.1 NA" "$TMPDIR/client.out" \
+&& grep -qx "10.0.0.2 NA" "$TMPDIR/client.out" \
+&& grep -q "2 addresses sent in 1 batches, 2 without ASN" "$TMPDIR/client.err"
+then
+    echo "PASS: server timeout"
+else
+    fail "server timeout"
+fi
+
+[ "$num_failures" = 0 ]
@@ -0,0 +1,178 @@
+#include "config.h"
+
+#include <stdlib.h>                  // EXIT_SUCCESS, EXIT_FAILURE
+#include <stdio.h>                   // printf
+#include <stdbool.h>                 // bool
+#include <stdint.h>                  // uint32_t
+#include <string.h>                  // strdup
+#include <libgen.h>                  // basename
+#include <errno.h>                   // errno, EINTR
+#include <poll.h>                    // poll
+
+#include "address.h"                 // address_t
+#include "options.h"                 // options_*
+#include "whois.h"                   // whois_client_*
+#include "os/sys/epoll.h"            // EPOLLIN, EPOLLOUT
+
+//---------------------------------------------------------------------------
+// Command line stuff
+//---------------------------------------------------------------------------
+
+#define TEXT               "paris-whois-client - retrieve the ASNs of some addresses through a whois_client_t connected to SERVER (e.g. paris-whois-stub), as paris-traceroute -A does. The ASNs are printed on the standard output, and the statistics of the client on stderr."
+#define TEXT_OPTIONS       "Options:"
+
+struct opt_spec runnable_options[] = {
+    // action                 sf          lf                   metavar               help               data
+    {opt_text,                OPT_NO_SF,  OPT_NO_LF,           OPT_NO_METAVAR,       TEXT,              OPT_NO_DATA},
+    {opt_text,                OPT_NO_SF,  OPT_NO_LF,           OPT_NO_METAVAR,       TEXT_OPTIONS,      OPT_NO_DATA},
+    END_OPT_SPECS
+};
+
+/**
+ * \brief Prepare options supported by paris-whois-client
+ * \return A pointer to the corresponding options_t instance if successfull, NULL otherwise
+ */
+
+static options_t * init_options(char * version) {
+    options_t * options;
+
+    // Building the command line options
+    if (!(options = options_create(NULL))) {
+        goto ERR_OPTIONS_CREATE;
+    }
+
+    options_add_optspecs(options, runnable_options);
+    options_add_common  (options, version);
+    return options;
+
+ERR_OPTIONS_CREATE:
+    return NULL;
+}
+
+//---------------------------------------------------------------------------
+// Lookups
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Print an address and its ASN (see whois_callback_t).
+ * \param address The queried address.
+ * \param asn The corresponding ASN, 0 if unknown.
+ * \param data Points to the number of lookups not yet completed.
+ */
+
+static void client_print_asn(const address_t * address, uint32_t asn, void * data) {
+    size_t * pnum_pending = data;
+
+    address_fprintf(stdout, address);
+    if (asn) {
+        printf(" AS%u\n", asn);
+    } else {
+        printf(" NA\n");
+    }
+    (*pnum_pending)--;
+}
+
+/**
+ * \brief Process the socket and the timer of a whois_client_t until
+ *    every lookup is completed, as pt_loop does.
+ * \param client A whois_client_t instance.
+ * \return true iif successful.
+ */
+
+static bool client_loop(whois_client_t * client) {
+    struct pollfd fds[2];
+    uint32_t      events;
+    nfds_t        num_fds;
+
+    while (whois_client_is_pending(client)) {
+        fds[0].fd      = whois_client_get_timerfd(client);
+        fds[0].events  = POLLIN;
+        fds[0].revents = 0;
+        num_fds = 1;
+
+        // The socket changes from one batch to another
+        if ((events = whois_client_get_events(client))) {
+            fds[1].fd      = whois_client_get_sockfd(client);
+            fds[1].events  = ((events & EPOLLIN) ? POLLIN : 0) | ((events & EPOLLOUT) ? POLLOUT : 0);
+            fds[1].revents = 0;
+            num_fds = 2;
+        }
+
+        if (poll(fds, num_fds, -1) == -1) {
+            if (errno == EINTR) continue;
+            perror("paris-whois-client: poll");
+            return false;
+        }
+
+        if (num_fds == 2 && fds[1].revents) whois_client_process_socket(client);
+        if (fds[0].revents) whois_client_process_timer(client);
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------
+// Main program
+//---------------------------------------------------------------------------
+
+int main(int argc, char ** argv)
+{
+    int                       exit_code = EXIT_FAILURE;
+    char                    * version = strdup("version 1.0");
+    const char              * usage = "usage: %s [options] SERVER ADDRESS...\n";
+    options_t               * options;
+    whois_client_t          * client;
+    address_t                 server_address,
+                              address;
+    int                       num_args, i, family;
+    size_t                    num_pending = 0;
+
+    // Prepare the commande line options
+    if (!(options = init_options(version))) {
+        fprintf(stderr, "E: Can't initialize options\n");
+        goto ERR_INIT_OPTIONS;
+    }
+
+    if ((num_args = options_parse(options, usage, argv)) < 2) {
+        fprintf(stderr, usage, basename(argv[0]));
+        goto ERR_OPT_PARSE;
+    }
+
+    if (!address_guess_family(argv[argc - num_args], &family)
+    ||  address_from_string(family, argv[argc - num_args], &server_address) != 0) {
+        fprintf(stderr, "%s: invalid server address\n", argv[argc - num_args]);
+        goto ERR_SERVER_ADDRESS;
+    }
+
+    if (!(client = whois_client_create(&server_address))) {
+        perror("paris-whois-client");
+        goto ERR_WHOIS_CLIENT_CREATE;
+    }
+
+    // Every address is queried at once, like the hops of a trace
+    for (i = argc - num_args + 1; i < argc; i++) {
+        if (!address_guess_family(argv[i], &family)
+        ||  address_from_string(family, argv[i], &address) != 0) {
+            fprintf(stderr, "%s: invalid address\n", argv[i]);
+            goto ERR_ADDRESS;
+        }
+        num_pending++;
+        if (!whois_client_get_asn(client, &address, client_print_asn, &num_pending)) {
+            goto ERR_WHOIS_CLIENT_GET_ASN;
+        }
+    }
+
+    if (client_loop(client) && num_pending == 0) {
+        exit_code = EXIT_SUCCESS;
+    }
+    whois_client_dump_stats(client);
+
+ERR_WHOIS_CLIENT_GET_ASN:
+ERR_ADDRESS:
+    whois_client_free(client);
+ERR_WHOIS_CLIENT_CREATE:
+ERR_SERVER_ADDRESS:
+ERR_OPT_PARSE:
+ERR_INIT_OPTIONS:
+    free(version);
+    exit(exit_code);
+}
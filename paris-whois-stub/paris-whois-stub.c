@@ -0,0 +1,233 @@
+#include "config.h"
+
+#include <stdlib.h>                  // EXIT_SUCCESS, EXIT_FAILURE
+#include <stdio.h>                   // fdopen, fgets, fprintf
+#include <stdbool.h>                 // bool
+#include <stdint.h>                  // uint8_t
+#include <string.h>                  // strdup, strcspn, strcmp
+#include <libgen.h>                  // basename
+#include <limits.h>                  // INT_MAX
+#include <unistd.h>                  // close, dup
+#include <arpa/inet.h>               // inet_pton, htons
+#include <sys/socket.h>              // socket, bind, listen, accept
+#include <netinet/in.h>              // sockaddr_in
+
+#include "options.h"                 // options_*
+#include "whois.h"                   // WHOIS_PORT, WHOIS_LINE_SIZE
+
+//---------------------------------------------------------------------------
+// Command line stuff
+//---------------------------------------------------------------------------
+
+#define STUB_HELP_n        "Exit after NUM batches (default: 1)."
+#define STUB_HELP_silent   "Never answer, so that the batches time out."
+
+#define TEXT               "paris-whois-stub - stand-in for a whois server supporting the Team Cymru bulk mode, listening on ADDRESS (IPv4, port 43). The ASN of an address is 64512 plus its last byte, and is unknown (NA) if its last byte is 0. Each batch is reported on the standard output."
+#define TEXT_OPTIONS       "Options:"
+
+static unsigned num_batches[3] = {1, 1, INT_MAX};
+static bool     is_silent      = false;
+
+struct opt_spec runnable_options[] = {
+    // action                 sf          lf                   metavar               help               data
+    {opt_text,                OPT_NO_SF,  OPT_NO_LF,           OPT_NO_METAVAR,       TEXT,              OPT_NO_DATA},
+    {opt_text,                OPT_NO_SF,  OPT_NO_LF,           OPT_NO_METAVAR,       TEXT_OPTIONS,      OPT_NO_DATA},
+    {opt_store_int_lim,       "n",        "--num-batches",     "NUM",                STUB_HELP_n,       num_batches},
+    {opt_store_1,             OPT_NO_SF,  "--silent",          OPT_NO_METAVAR,       STUB_HELP_silent,  &is_silent},
+    END_OPT_SPECS
+};
+
+/**
+ * \brief Prepare options supported by paris-whois-stub
+ * \return A pointer to the corresponding options_t instance if successfull, NULL otherwise
+ */
+
+static options_t * init_options(char * version) {
+    options_t * options;
+
+    // Building the command line options
+    if (!(options = options_create(NULL))) {
+        goto ERR_OPTIONS_CREATE;
+    }
+
+    options_add_optspecs(options, runnable_options);
+    options_add_common  (options, version);
+    return options;
+
+ERR_OPTIONS_CREATE:
+    return NULL;
+}
+
+//---------------------------------------------------------------------------
+// Bulk mode
+//---------------------------------------------------------------------------
+
+/**
+ * \brief Create a TCP socket listening on the whois port.
+ * \param str_address The IPv4 address to listen on.
+ * \return The corresponding file descriptor, -1 in case of failure.
+ */
+
+static int stub_socket_create(const char * str_address) {
+    struct sockaddr_in sin;
+    int                sockfd, on = 1;
+
+    memset(&sin, 0, sizeof(struct sockaddr_in));
+    sin.sin_family = AF_INET;
+    sin.sin_port   = htons(WHOIS_PORT);
+    if (inet_pton(AF_INET, str_address, &sin.sin_addr) != 1) {
+        fprintf(stderr, "%s: invalid IPv4 address\n", str_address);
+        goto ERR_INET_PTON;
+    }
+
+    if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) == -1) goto ERR_SOCKET;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(sockfd, (struct sockaddr *) &sin, sizeof(struct sockaddr_in)) == -1) goto ERR_BIND;
+    if (listen(sockfd, 16) == -1) goto ERR_LISTEN;
+    return sockfd;
+
+ERR_LISTEN:
+ERR_BIND:
+    close(sockfd);
+ERR_SOCKET:
+    perror("paris-whois-stub");
+ERR_INET_PTON:
+    return -1;
+}
+
+/**
+ * \brief Write the answer related to an address ("ASN | IP | AS Name").
+ * \param out The connection.
+ * \param line The queried address.
+ */
+
+static void stub_answer(FILE * out, const char * line) {
+    struct in_addr  ipv4;
+    struct in6_addr ipv6;
+    unsigned        last_byte;
+
+    if (inet_pton(AF_INET, line, &ipv4) == 1) {
+        last_byte = ((const uint8_t *) &ipv4)[3];
+    } else if (inet_pton(AF_INET6, line, &ipv6) == 1) {
+        last_byte = ipv6.s6_addr[15];
+    } else {
+        fprintf(out, "Error: no ASN or IP match on line: %s\n", line);
+        return;
+    }
+
+    if (last_byte) {
+        fprintf(out, "%-8u| %-16s | STUB-AS%u, ZZ\n", 64512 + last_byte, line, 64512 + last_byte);
+    } else {
+        fprintf(out, "%-8s| %-16s | NA\n", "NA", line);
+    }
+}
+
+/**
+ * \brief Serve a batch: read the query ("begin", one address per line,
+ *    "end"), answer it unless --silent is set, and close the connection.
+ * \param connfd The connection.
+ * \param batch The number of the batch.
+ * \return true iif successful.
+ */
+
+static bool stub_serve(int connfd, unsigned batch) {
+    FILE     * in, * out;
+    char       line[WHOIS_LINE_SIZE];
+    char    ** addresses = NULL, ** p;
+    size_t     i, num_addresses = 0;
+
+    if (!(in = fdopen(connfd, "r")))        goto ERR_FDOPEN_IN;
+    if (!(out = fdopen(dup(connfd), "w")))  goto ERR_FDOPEN_OUT;
+
+    while (fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strcmp(line, "begin") == 0) continue;
+        if (strcmp(line, "end") == 0) break;
+        if (!(p = realloc(addresses, (num_addresses + 1) * sizeof(char *)))) goto ERR_REALLOC;
+        addresses = p;
+        if (!(addresses[num_addresses] = strdup(line))) goto ERR_STRDUP;
+        num_addresses++;
+    }
+
+    printf("batch %u: %zu addresses\n", batch, num_addresses);
+    fflush(stdout);
+
+    if (is_silent) {
+        // Wait until the client gives up
+        while (fgets(line, sizeof(line), in));
+    } else {
+        fprintf(out, "Bulk mode; whois.cymru.com [stub]\n");
+        fprintf(out, "AS      | IP               | AS Name\n");
+        for (i = 0; i < num_addresses; i++) {
+            stub_answer(out, addresses[i]);
+        }
+    }
+
+    for (i = 0; i < num_addresses; i++) free(addresses[i]);
+    free(addresses);
+    fclose(out);
+    fclose(in);
+    return true;
+
+ERR_STRDUP:
+ERR_REALLOC:
+    for (i = 0; i < num_addresses; i++) free(addresses[i]);
+    free(addresses);
+    fclose(out);
+ERR_FDOPEN_OUT:
+    fclose(in);
+    return false;
+ERR_FDOPEN_IN:
+    close(connfd);
+    return false;
+}
+
+//---------------------------------------------------------------------------
+// Main program
+//---------------------------------------------------------------------------
+
+int main(int argc, char ** argv)
+{
+    int                       exit_code = EXIT_FAILURE;
+    char                    * version = strdup("version 1.0");
+    const char              * usage = "usage: %s [options] ADDRESS\n";
+    options_t               * options;
+    int                       sockfd, connfd;
+    unsigned                  batch;
+
+    // Prepare the commande line options
+    if (!(options = init_options(version))) {
+        fprintf(stderr, "E: Can't initialize options\n");
+        goto ERR_INIT_OPTIONS;
+    }
+
+    if (options_parse(options, usage, argv) != 1) {
+        fprintf(stderr, usage, basename(argv[0]));
+        goto ERR_OPT_PARSE;
+    }
+
+    if ((sockfd = stub_socket_create(argv[argc - 1])) == -1) {
+        goto ERR_SOCKET_CREATE;
+    }
+
+    for (batch = 1; batch <= num_batches[0]; batch++) {
+        if ((connfd = accept(sockfd, NULL, NULL)) == -1) {
+            perror("paris-whois-stub: accept");
+            goto ERR_ACCEPT;
+        }
+        if (!stub_serve(connfd, batch)) {
+            perror("paris-whois-stub");
+            goto ERR_SERVE;
+        }
+    }
+    exit_code = EXIT_SUCCESS;
+
+ERR_SERVE:
+ERR_ACCEPT:
+    close(sockfd);
+ERR_SOCKET_CREATE:
+ERR_OPT_PARSE:
+ERR_INIT_OPTIONS:
+    free(version);
+    exit(exit_code);
+}